@@ -7,6 +7,7 @@
 #include "zeek/Desc.h"
 #include "zeek/Expr.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/NetVar.h"
 #include "zeek/Val.h"
 #include "zeek/input/Manager.h"
 #include "zeek/threading/SerialTypes.h"
@@ -42,6 +43,8 @@ const char* attr_name(AttrTag t) {
 		"&is_assigned",
 		"&is_used",
 		"&ordered",
+		"&max_size",
+		"&eviction",
 	};
     // clang-format on
 
@@ -488,6 +491,9 @@ void Attributes::CheckAttr(Attr* a) {
             if ( Find(ATTR_BROKER_STORE) )
                 Error("&backend and &broker_store cannot be used simultaneously");
 
+            if ( Find(ATTR_MAX_SIZE) )
+                Error("&max_size cannot be used with &broker_store or &backend");
+
             break;
         }
 
@@ -519,6 +525,9 @@ void Attributes::CheckAttr(Attr* a) {
             if ( Find(ATTR_BACKEND) )
                 Error("&backend and &broker_store cannot be used simultaneously");
 
+            if ( Find(ATTR_MAX_SIZE) )
+                Error("&max_size cannot be used with &broker_store or &backend");
+
             break;
         }
 
@@ -576,6 +585,33 @@ void Attributes::CheckAttr(Attr* a) {
                 Error("&ordered only applicable to tables");
             break;
 
+        case ATTR_MAX_SIZE:
+            if ( type->Tag() != TYPE_TABLE ) {
+                Error("&max_size only applicable to sets/tables");
+                break;
+            }
+
+            if ( a->GetExpr()->GetType()->Tag() != TYPE_COUNT ) {
+                Error("&max_size must take a count argument");
+                break;
+            }
+
+            if ( Find(ATTR_BROKER_STORE) || Find(ATTR_BACKEND) )
+                Error("&max_size cannot be used with &broker_store or &backend");
+
+            break;
+
+        case ATTR_EVICTION:
+            if ( type->Tag() != TYPE_TABLE ) {
+                Error("&eviction only applicable to sets/tables");
+                break;
+            }
+
+            if ( ! same_type(a->GetExpr()->GetType(), BifType::Enum::TableEviction) )
+                Error("&eviction must take a TableEviction argument");
+
+            break;
+
         default: BadTag("Attributes::CheckAttr", attr_name(a->Tag()));
     }
 }
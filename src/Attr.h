@@ -50,6 +50,8 @@ enum AttrTag {
     ATTR_IS_ASSIGNED, // to suppress usage warnings
     ATTR_IS_USED,     // to suppress usage warnings
     ATTR_ORDERED,     // used to store tables in ordered mode
+    ATTR_MAX_SIZE,    // caps the number of table entries
+    ATTR_EVICTION,    // which entries to evict when over &max_size
     NUM_ATTRS         // this item should always be last
 };
 
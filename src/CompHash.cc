@@ -4,17 +4,22 @@
 
 #include "zeek/zeek-config.h"
 
+#include <chrono>
 #include <cstring>
 #include <map>
 #include <vector>
 
 #include "zeek/Func.h"
 #include "zeek/IPAddr.h"
+#include "zeek/NetVar.h"
 #include "zeek/RE.h"
 #include "zeek/Reporter.h"
+#include "zeek/RunState.h"
 #include "zeek/Val.h"
 #include "zeek/ZeekString.h"
 
+#include "zeek/3rdparty/doctest.h"
+
 namespace zeek::detail {
 
 // A comparison callable to assist with consistent iteration order over tables
@@ -78,6 +83,19 @@ std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_c
             v = lv->Idx(0).get();
         }
 
+        if ( UseCachedKey(v) ) {
+            auto rv = static_cast<const RecordVal*>(v);
+
+            if ( auto k = rv->index_key )
+                return std::make_unique<HashKey>(k->Key(), k->Size(), k->Hash());
+
+            if ( ! SingleValHash(*res, v, tl[0].get(), type_check, false, true) )
+                return nullptr;
+
+            rv->index_key = new HashKey(res->Key(), res->Size(), res->Hash());
+            return res;
+        }
+
         if ( SingleValHash(*res, v, tl[0].get(), type_check, false, true) )
             return res;
 
@@ -104,6 +122,52 @@ std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_c
     return res;
 }
 
+bool CompositeHash::UseCachedKey(const Val* v) const {
+    if ( ! cache_index_hash_keys )
+        return false;
+
+    const auto& t = type->GetTypes()[0];
+
+    if ( caches_keys < 0 ) {
+        if ( t->Tag() != TYPE_RECORD )
+            caches_keys = 0;
+
+        else if ( run_state::is_parsing )
+            // The record type might still get redef'd.
+            return false;
+
+        else {
+            // Only records whose fields can't change without going
+            // through the RecordVal qualify, as otherwise we wouldn't
+            // know when the cached key becomes stale.
+            auto rt = t->AsRecordType();
+            caches_keys = 1;
+
+            for ( auto i = 0; i < rt->NumFields(); ++i ) {
+                switch ( rt->GetFieldType(i)->Tag() ) {
+                    case TYPE_BOOL:
+                    case TYPE_INT:
+                    case TYPE_COUNT:
+                    case TYPE_DOUBLE:
+                    case TYPE_TIME:
+                    case TYPE_INTERVAL:
+                    case TYPE_PORT:
+                    case TYPE_ENUM:
+                    case TYPE_ADDR:
+                    case TYPE_SUBNET:
+                    case TYPE_STRING: break;
+
+                    default: caches_keys = 0; break;
+                }
+            }
+        }
+    }
+
+    // We can only reuse keys of values of the exact same type, as
+    // others might yield different keys when coerced.
+    return caches_keys && v->GetType() == t;
+}
+
 ListValPtr CompositeHash::RecoverVals(const HashKey& hk) const {
     auto l = make_intrusive<ListVal>(TYPE_ANY);
     const auto& tl = type->GetTypes();
@@ -790,3 +854,52 @@ bool CompositeHash::ReserveSingleTypeKeySize(HashKey& hk, Type* bt, const Val* v
 }
 
 } // namespace zeek::detail
+
+TEST_CASE("composite hash cached record keys benchmark" * doctest::skip(true)) {
+    // Run it with: zeek --test --test-case="composite hash cached record keys benchmark" --no-skip
+    //
+    // Looks up each of a set of conn_id's in a table[conn_id] many times, as
+    // the handlers of a connection's events do, with and without caching
+    // their hash keys.
+    using namespace zeek;
+
+    constexpr int num_ids = 10'000;
+    constexpr int num_rounds = 100;
+
+    auto tl = make_intrusive<TypeList>(id::conn_id);
+    tl->Append(id::conn_id);
+    auto tt = make_intrusive<TableType>(std::move(tl), base_type(TYPE_COUNT));
+
+    auto run = [&](bool cache) {
+        detail::cache_index_hash_keys = cache;
+
+        std::vector<RecordValPtr> ids;
+        auto tv = make_intrusive<TableVal>(tt);
+
+        for ( int i = 0; i < num_ids; ++i ) {
+            auto id = make_intrusive<RecordVal>(id::conn_id);
+            id->Assign(0, make_intrusive<AddrVal>(htonl(0x0a000000 + i)));
+            id->Assign(1, val_mgr->Port(1024 + i % 50000, TRANSPORT_TCP));
+            id->Assign(2, make_intrusive<AddrVal>(htonl(0xc0a80001)));
+            id->Assign(3, val_mgr->Port(443, TRANSPORT_TCP));
+            tv->Assign(id, val_mgr->Count(i));
+            ids.push_back(std::move(id));
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        zeek_uint_t sum = 0;
+
+        for ( int r = 0; r < num_rounds; ++r )
+            for ( const auto& id : ids )
+                sum += tv->FindOrDefault(id)->AsCount();
+
+        auto end = std::chrono::steady_clock::now();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+        MESSAGE((cache ? "cached:   " : "uncached: ") << ms << " ms (" << sum << ")");
+    };
+
+    auto orig = detail::cache_index_hash_keys;
+    run(false);
+    run(true);
+    detail::cache_index_hash_keys = orig;
+}
@@ -30,6 +30,10 @@ public:
     ListValPtr RecoverVals(const HashKey& k) const;
 
 protected:
+    // Returns true if the hash key of the given singleton index can come
+    // from the key that we cache with it.
+    bool UseCachedKey(const Val* v) const;
+
     bool SingleValHash(HashKey& hk, const Val* v, Type* bt, bool type_check, bool optional, bool singleton) const;
 
     // Recovers just one Val of possibly many; called from RecoverVals.
@@ -62,6 +66,10 @@ protected:
 
     TypeListPtr type;
     bool is_singleton = false; // if just one type in index
+
+    // Whether the index is a record type whose values have their hash
+    // keys cached, or -1 if not yet determined.
+    mutable int caches_keys = -1;
 };
 
 } // namespace zeek::detail
@@ -2,6 +2,10 @@
 
 #include "zeek/Dict.h"
 
+#include <chrono>
+#include <random>
+#include <string>
+
 #include "zeek/3rdparty/doctest.h"
 #include "zeek/Hash.h"
 
@@ -433,6 +437,104 @@ TEST_CASE("dict iterator invalidation") {
     delete key3;
 }
 
+TEST_CASE("dict lookups across growth and removal") {
+    PDict<uint32_t> dict;
+    constexpr uint32_t n = 50'000;
+
+    std::vector<std::string> keys;
+    std::vector<uint32_t> vals(n);
+
+    for ( uint32_t i = 0; i < n; ++i ) {
+        // Both keys stored in the entries and ones they point to.
+        keys.push_back(i % 2 ? "k" + std::to_string(i) : "a-longer-key-" + std::to_string(i));
+        vals[i] = i;
+    }
+
+    auto num_wrong = [&](uint32_t end) {
+        int wrong = 0;
+        for ( uint32_t i = 0; i < end; ++i ) {
+            auto v = dict.Lookup(keys[i].c_str());
+            if ( v != (i % 3 == 0 ? nullptr : &vals[i]) )
+                ++wrong;
+        }
+        return wrong;
+    };
+
+    for ( uint32_t i = 0; i < n / 2; ++i )
+        dict.Insert(keys[i].c_str(), &vals[i]);
+
+    for ( uint32_t i = 0; i < n / 2; i += 3 ) {
+        detail::HashKey h(keys[i].c_str());
+        dict.Remove(&h);
+    }
+
+    CHECK(num_wrong(n / 2) == 0);
+    CHECK(dict.Lookup("no-such-key") == nullptr);
+
+    // While a robust iterator is active, growing the dictionary doesn't
+    // remap its entries, so lookups need to consider the smaller sizes.
+    {
+        auto it = dict.begin_robust();
+
+        for ( uint32_t i = n / 2; i < n; ++i )
+            if ( i % 3 != 0 )
+                dict.Insert(keys[i].c_str(), &vals[i]);
+
+        CHECK(num_wrong(n) == 0);
+    }
+
+    CHECK(num_wrong(n) == 0);
+    CHECK(dict.Length() == n - (n + 2) / 3);
+}
+
+TEST_CASE("dict lookup benchmark" * doctest::skip(true)) {
+    // Run it with: zeek --test --test-case="dict lookup benchmark" --no-skip
+    //
+    // Build with -DDICT_NO_CTRL_PROBING to compare with looking up entries
+    // without their control bytes.
+    constexpr int num_lookups = 10'000'000;
+
+    for ( int size : {1'000, 100'000, 1'000'000} ) {
+        PDict<uint32_t> dict;
+        std::vector<std::unique_ptr<detail::HashKey>> keys;
+        std::vector<std::unique_ptr<detail::HashKey>> missing;
+        uint32_t val = 0;
+
+        for ( int i = 0; i < size; ++i ) {
+            detail::HashKey k(zeek_uint_t(2 * i));
+            dict.Insert(&k, &val);
+
+            keys.push_back(std::make_unique<detail::HashKey>(zeek_uint_t(2 * i)));
+            missing.push_back(std::make_unique<detail::HashKey>(zeek_uint_t(2 * i + 1)));
+
+            // Have the hashes computed up front.
+            keys.back()->Hash();
+            missing.back()->Hash();
+        }
+
+        auto run = [&](const auto& lookup_keys) {
+            std::mt19937 rng(42);
+            int found = 0;
+
+            auto begin = std::chrono::steady_clock::now();
+
+            for ( int i = 0; i < num_lookups; ++i )
+                if ( dict.Lookup(lookup_keys[rng() % size].get()) )
+                    ++found;
+
+            auto end = std::chrono::steady_clock::now();
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+            return std::make_pair(ms, found);
+        };
+
+        auto [hit_ms, hits] = run(keys);
+        auto [miss_ms, misses] = run(missing);
+
+        MESSAGE(size << " entries: hits " << hit_ms << " ms (" << hits << "), misses " << miss_ms << " ms ("
+                     << misses << ")");
+    }
+}
+
 // private
 void generic_delete_func(void* v) { free(v); }
 
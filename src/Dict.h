@@ -5,10 +5,23 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ZEEK_DICT_CTRL_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ZEEK_DICT_CTRL_NEON
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include "zeek/Hash.h"
 #include "zeek/Obj.h"
 #include "zeek/Reporter.h"
@@ -74,6 +87,65 @@ constexpr uint8_t DICT_THRESHOLD_BITS = 3;
 // bucket at which to start looking for the next value to return.
 constexpr uint16_t TOO_FAR_TO_REACH = 0xFFFF;
 
+// Alongside the entries of its table, a dictionary keeps one control byte
+// per position: CTRL_EMPTY if the position is empty, and otherwise a 7-bit
+// fingerprint of the entry's hash. Lookups compare a group of control bytes
+// at once against the fingerprint of the hash they're looking for, so that
+// they only need to examine the entries whose fingerprints match. The
+// control bytes are padded with a group's worth of empty ones, so that
+// groups can extend past the end of the table.
+constexpr uint8_t CTRL_EMPTY = 0x80;
+constexpr int CTRL_GROUP_SIZE = 16;
+
+inline uint8_t ctrl_fingerprint(hash_t h) { return static_cast<uint32_t>(h) >> 25; }
+
+// Compares the group of control bytes starting at p against fingerprint fp.
+// Returns masks of which bytes match it, and which are empty. Masks have
+// CTRL_MASK_STRIDE bits per control byte, of which at most the lowest is set.
+#ifdef ZEEK_DICT_CTRL_NEON
+constexpr int CTRL_MASK_STRIDE = 4;
+
+inline void ctrl_match(const uint8_t* p, uint8_t fp, uint64_t* match, uint64_t* empty) {
+    // There's no movemask on NEON, so we narrow each byte to a nibble.
+    auto to_mask = [](uint8x16_t v) {
+        auto nibbles = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+        return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x1111111111111111ULL;
+    };
+
+    uint8x16_t g = vld1q_u8(p);
+    *match = to_mask(vceqq_u8(g, vdupq_n_u8(fp)));
+    *empty = to_mask(vcgeq_u8(g, vdupq_n_u8(CTRL_EMPTY)));
+}
+#else
+constexpr int CTRL_MASK_STRIDE = 1;
+
+inline void ctrl_match(const uint8_t* p, uint8_t fp, uint64_t* match, uint64_t* empty) {
+#ifdef ZEEK_DICT_CTRL_SSE2
+    __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    *match = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(static_cast<char>(fp)))));
+    // Only empty positions have the high bit set.
+    *empty = static_cast<uint32_t>(_mm_movemask_epi8(g));
+#else
+    *match = *empty = 0;
+    for ( int i = 0; i < CTRL_GROUP_SIZE; ++i ) {
+        *match |= uint64_t(p[i] == fp) << i;
+        *empty |= uint64_t(p[i] == CTRL_EMPTY) << i;
+    }
+#endif
+}
+#endif
+
+// Returns the control byte that the lowest set bit of a mask refers to.
+inline int ctrl_lowest(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return static_cast<int>(idx) / CTRL_MASK_STRIDE;
+#else
+    return __builtin_ctzll(mask) / CTRL_MASK_STRIDE;
+#endif
+}
+
 /**
  * An entry stored in the dictionary.
  */
@@ -748,6 +820,27 @@ public:
         return NthEntry(n, (const void*&)key, key_len);
     }
 
+    // Returns the first entry at or after the given position in the table,
+    // wrapping around at its end. Positions beyond the table's capacity get
+    // reduced modulo it. Random positions thus sample the entries, though
+    // not quite uniformly since entries cluster. Returns nil if the
+    // dictionary is empty.
+    const detail::DictEntry<T>* EntryNear(uint64_t position) const {
+        if ( ! table || num_entries == 0 )
+            return nullptr;
+
+        int capacity = Capacity();
+        int start = static_cast<int>(position % capacity);
+
+        for ( int i = 0; i < capacity; i++ ) {
+            const auto& e = table[(start + i) % capacity];
+            if ( ! e.Empty() )
+                return &e;
+        }
+
+        return nullptr;
+    }
+
     void SetDeleteFunc(dict_delete_func f) { delete_func = f; }
 
     // Remove all entries.
@@ -807,6 +900,13 @@ public:
         ASSERT(valid);
         DUMPIF(! valid);
 
+        // control bytes must reflect the entries
+        for ( int i = 0; i < Capacity(); i++ ) {
+            valid = (Ctrl()[i] == (table[i].Empty() ? detail::CTRL_EMPTY : detail::ctrl_fingerprint(table[i].hash)));
+            ASSERT(valid);
+            DUMPIF(! valid);
+        }
+
         // entries must clustered together
         for ( int i = 1; i < Capacity(); i++ ) {
             if ( ! table || table[i].Empty() )
@@ -1115,11 +1215,26 @@ private:
         return position;
     }
 
+    // The size of the allocation for a table of the given capacity, which
+    // holds the entries followed by the control bytes.
+    static size_t TableSize(int capacity) {
+        return sizeof(detail::DictEntry<T>) * capacity + capacity + detail::CTRL_GROUP_SIZE;
+    }
+
+    uint8_t* Ctrl() const { return reinterpret_cast<uint8_t*>(table + bucket_capacity); }
+
+    // Updates the control byte for the given position after its entry changed.
+    void SetCtrl(int position) {
+        const auto& e = table[position];
+        Ctrl()[position] = e.Empty() ? detail::CTRL_EMPTY : detail::ctrl_fingerprint(e.hash);
+    }
+
     void Init() {
         ASSERT(! table);
-        table = (detail::DictEntry<T>*)malloc(sizeof(detail::DictEntry<T>) * ExpectedCapacity());
+        table = (detail::DictEntry<T>*)malloc(TableSize(ExpectedCapacity()));
         for ( int i = Capacity() - 1; i >= 0; i-- )
             table[i].SetEmpty();
+        memset(Ctrl(), detail::CTRL_EMPTY, Capacity() + detail::CTRL_GROUP_SIZE);
     }
 
     // Lookup
@@ -1184,6 +1299,12 @@ private:
     int LookupIndex(const void* key, int key_size, detail::hash_t hash, int begin, int end,
                     int* insert_position = nullptr, int* insert_distance = nullptr) {
         ASSERT(begin >= 0 && begin < Buckets());
+
+#ifndef DICT_NO_CTRL_PROBING
+        if ( ! insert_position && ! insert_distance )
+            return ProbeIndex(key, key_size, hash, begin, end);
+#endif
+
         int i = begin;
         for ( ; i < end && ! table[i].Empty() && BucketByPosition(i) <= begin; i++ )
             if ( BucketByPosition(i) == begin && table[i].Equal((char*)key, key_size, hash) )
@@ -1204,6 +1325,37 @@ private:
         return -1;
     }
 
+    // Same as the above when we don't need an insert position, but using the
+    // control bytes. Rather than stopping at the end of the begin bucket's
+    // part of the cluster, this goes on to the cluster's end, which the
+    // control bytes tell without looking at the entries.
+    int ProbeIndex(const void* key, int key_size, detail::hash_t hash, int begin, int end) const {
+        auto fp = detail::ctrl_fingerprint(hash);
+
+        for ( int i = begin; i < end; i += detail::CTRL_GROUP_SIZE ) {
+            uint64_t match, empty;
+            detail::ctrl_match(Ctrl() + i, fp, &match, &empty);
+
+            if ( empty )
+                // Only positions before the cluster's end count.
+                match &= (empty & (~empty + 1)) - 1;
+
+            for ( ; match; match &= match - 1 ) {
+                int j = i + detail::ctrl_lowest(match);
+                if ( j >= end )
+                    return -1;
+
+                if ( BucketByPosition(j) == begin && table[j].Equal((const char*)key, key_size, hash) )
+                    return j;
+            }
+
+            if ( empty )
+                return -1;
+        }
+
+        return -1;
+    }
+
     /// Insert entry, Adjust iterators when necessary.
     void InsertRelocateAndAdjust(detail::DictEntry<T>& entry, int insert_position) {
 /// e.distance is adjusted to be the one at insert_position.
@@ -1240,12 +1392,14 @@ private:
                 SizeUp(); // copied all the items to new table. as it's just copying without
                           // remapping, insert_position is now empty.
                 table[insert_position] = entry;
+                SetCtrl(insert_position);
                 if ( last_affected_position )
                     *last_affected_position = insert_position;
                 return;
             }
             if ( table[insert_position].Empty() ) { // the condition to end the loop.
                 table[insert_position] = entry;
+                SetCtrl(insert_position);
                 if ( last_affected_position )
                     *last_affected_position = insert_position;
                 return;
@@ -1258,6 +1412,7 @@ private:
 
             // swap
             table[insert_position] = entry;
+            SetCtrl(insert_position);
             entry = t;
             insert_position = next; // append to the end of the current cluster.
         }
@@ -1308,6 +1463,7 @@ private:
                 // no next cluster to fill, or next position is empty or next position is already in
                 // perfect bucket.
                 table[position].SetEmpty();
+                SetCtrl(position);
                 if ( last_affected_position )
                     *last_affected_position = position;
                 return entry;
@@ -1315,6 +1471,7 @@ private:
             int next = TailOfClusterByPosition(position + 1);
             table[position] = table[next];
             table[position].distance -= next - position; // distance improved for the item.
+            SetCtrl(position);
             position = next;
         }
 
@@ -1410,7 +1567,14 @@ private:
         SetLog2Buckets(log2_buckets + 1);
 
         int capacity = Capacity();
-        table = (detail::DictEntry<T>*)realloc(table, capacity * sizeof(detail::DictEntry<T>));
+        table = (detail::DictEntry<T>*)realloc(table, TableSize(capacity));
+
+        // Move the control bytes to past the new end of the entries before
+        // initializing the new entries overwrites them.
+        auto prev_ctrl = reinterpret_cast<uint8_t*>(table + prev_capacity);
+        memmove(Ctrl(), prev_ctrl, prev_capacity);
+        memset(Ctrl() + prev_capacity, detail::CTRL_EMPTY, capacity - prev_capacity + detail::CTRL_GROUP_SIZE);
+
         for ( int i = prev_capacity; i < capacity; i++ )
             table[i].SetEmpty();
 
@@ -29,7 +29,7 @@ void FragTimer::Dispatch(double t, bool /* is_expire */) {
 }
 
 FragReassembler::FragReassembler(session::Manager* arg_s, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt,
-                                 const FragReassemblerKey& k, double t)
+                                 const FragReassemblerKey& k, double t, const Packet* packet)
     : Reassembler(0, REASSEM_FRAG) {
     s = arg_s;
     key = k;
@@ -58,7 +58,7 @@ FragReassembler::FragReassembler(session::Manager* arg_s, const std::shared_ptr<
     else
         expire_timer = nullptr;
 
-    AddFragment(t, ip, pkt);
+    AddFragment(t, ip, pkt, packet);
 }
 
 FragReassembler::~FragReassembler() {
@@ -66,7 +66,8 @@ FragReassembler::~FragReassembler() {
     delete[] proto_hdr;
 }
 
-void FragReassembler::AddFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt) {
+void FragReassembler::AddFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt,
+                                  const Packet* packet) {
     const struct ip* ip4 = ip->IP4_Hdr();
 
     if ( ip4 ) {
@@ -138,7 +139,7 @@ void FragReassembler::AddFragment(double t, const std::shared_ptr<IP_Hdr>& ip, c
     pkt += hdr_len;
     len -= hdr_len;
 
-    NewBlock(run_state::network_time, offset, len, pkt);
+    NewBlock(run_state::network_time, offset, len, pkt, packet);
 }
 
 void FragReassembler::Weird(const char* name) const {
@@ -300,7 +301,8 @@ void FragReassembler::DeleteTimer() {
 
 FragmentManager::~FragmentManager() { Clear(); }
 
-FragReassembler* FragmentManager::NextFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt) {
+FragReassembler* FragmentManager::NextFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt,
+                                               const Packet* packet) {
     uint32_t frag_id = ip->ID();
     FragReassemblerKey key = std::make_tuple(ip->SrcAddr(), ip->DstAddr(), frag_id);
 
@@ -310,14 +312,14 @@ FragReassembler* FragmentManager::NextFragment(double t, const std::shared_ptr<I
         f = it->second;
 
     if ( ! f ) {
-        f = new FragReassembler(session_mgr, ip, pkt, key, t);
+        f = new FragReassembler(session_mgr, ip, pkt, key, t, packet);
         fragments[key] = f;
         if ( fragments.size() > max_fragments )
             max_fragments = fragments.size();
         return f;
     }
 
-    f->AddFragment(t, ip, pkt);
+    f->AddFragment(t, ip, pkt, packet);
     return f;
 }
 
@@ -13,6 +13,7 @@
 namespace zeek {
 
 class IP_Hdr;
+class Packet;
 
 namespace session {
 class Manager;
@@ -28,10 +29,12 @@ using FragReassemblerKey = std::tuple<IPAddr, IPAddr, zeek_uint_t>;
 class FragReassembler : public Reassembler {
 public:
     FragReassembler(session::Manager* s, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt,
-                    const FragReassemblerKey& k, double t);
+                    const FragReassemblerKey& k, double t, const Packet* packet = nullptr);
     ~FragReassembler() override;
 
-    void AddFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt);
+    // If given, packet is the packet containing the fragment. Its buffer
+    // is referenced instead of copying the fragment's data if possible.
+    void AddFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt, const Packet* packet = nullptr);
 
     void Expire(double t);
     void DeleteTimer();
@@ -75,7 +78,8 @@ public:
     FragmentManager() = default;
     ~FragmentManager();
 
-    FragReassembler* NextFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt);
+    FragReassembler* NextFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt,
+                                  const Packet* packet = nullptr);
     void Clear();
     void Remove(detail::FragReassembler* f);
 
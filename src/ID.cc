@@ -136,6 +136,9 @@ void ID::SetVal(ValPtr v) {
     UpdateValID();
 #endif
 
+    if ( IsGlobal() && val && val->GetType()->Tag() == TYPE_TABLE )
+        val->AsTableVal()->SetMetricsLabel(name);
+
     if ( type && val && type->Tag() == TYPE_FUNC && type->AsFuncType()->Flavor() == FUNC_FLAVOR_EVENT ) {
         EventHandler* handler = event_registry->Lookup(name);
         auto func = val.get()->As<FuncVal*>()->AsFuncPtr();
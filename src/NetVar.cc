@@ -110,6 +110,7 @@ namespace zeek::detail {
 int watchdog_interval;
 
 int max_timer_expires;
+int use_timer_wheel;
 
 int ignore_checksums;
 int partial_connection_ok;
@@ -160,6 +161,8 @@ int dns_max_queries;
 double table_expire_interval;
 double table_expire_delay;
 int table_incremental_step;
+int table_expire_index;
+int cache_index_hash_keys;
 
 double connection_status_update_interval;
 
@@ -227,6 +230,8 @@ void init_general_global_var() {
     table_expire_interval = id::find_val("table_expire_interval")->AsInterval();
     table_expire_delay = id::find_val("table_expire_delay")->AsInterval();
     table_incremental_step = id::find_val("table_incremental_step")->AsCount();
+    table_expire_index = id::find_val("table_expire_index")->AsBool();
+    cache_index_hash_keys = id::find_val("cache_index_hash_keys")->AsBool();
     packet_filter_default = id::find_val("packet_filter_default")->AsBool();
     sig_max_group_size = id::find_val("sig_max_group_size")->AsCount();
     check_for_unused_event_handlers = id::find_val("check_for_unused_event_handlers")->AsBool();
@@ -283,6 +288,7 @@ void init_net_var() {
     watchdog_interval = int(id::find_val("watchdog_interval")->AsInterval());
 
     max_timer_expires = id::find_val("max_timer_expires")->AsCount();
+    use_timer_wheel = id::find_val("use_timer_wheel")->AsBool();
 
     mime_segment_length = id::find_val("mime_segment_length")->AsCount();
     mime_segment_overlap_length = id::find_val("mime_segment_overlap_length")->AsCount();
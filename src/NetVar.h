@@ -11,6 +11,7 @@ namespace zeek::detail {
 extern int watchdog_interval;
 
 extern int max_timer_expires;
+extern int use_timer_wheel;
 
 extern int ignore_checksums;
 extern int partial_connection_ok;
@@ -62,6 +63,8 @@ extern int dns_max_queries;
 extern double table_expire_interval;
 extern double table_expire_delay;
 extern int table_incremental_step;
+extern int table_expire_index;
+extern int cache_index_hash_keys;
 
 extern int orig_addr_anonymization, resp_addr_anonymization;
 extern int other_addr_anonymization;
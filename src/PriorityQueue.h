@@ -21,12 +21,18 @@ public:
     int Offset() const { return offset; }
     void SetOffset(int off) { offset = off; }
 
+    // Where a TimingWheel keeps the element, with the offset giving the
+    // position there.
+    int Slot() const { return slot; }
+    void SetSlot(int s) { slot = s; }
+
     void MinimizeTime() { time = -HUGE_VAL; }
 
 protected:
     PQ_Element() = default;
     double time = 0.0;
     int offset = -1;
+    int slot = -1;
 };
 
 class PriorityQueue {
@@ -5,10 +5,14 @@
 #include "zeek/zeek-config.h"
 
 #include <algorithm>
+#include <chrono>
 #include <limits>
+#include <map>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Desc.h"
 #include "zeek/Reporter.h"
+#include "zeek/iosource/Packet.h"
 
 using std::min;
 
@@ -17,11 +21,175 @@ namespace zeek {
 uint64_t Reassembler::total_size = 0;
 uint64_t Reassembler::sizes[REASSEM_NUM];
 
+std::unordered_set<DataBlock*> DataBlock::shared_blocks;
+
 DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq) {
     seq = arg_seq;
     upper = seq + size;
-    block = new u_char[size];
-    memcpy(block, data, size);
+    block = CopyOf(data, size);
+}
+
+DataBlock::DataBlock(std::shared_ptr<const u_char> data, uint64_t size, uint64_t arg_seq) {
+    seq = arg_seq;
+    upper = seq + size;
+    block = data.get();
+    shared = std::move(data);
+    Track();
+}
+
+void DataBlock::Unshare(const u_char* begin, const u_char* end) {
+    std::vector<DataBlock*> blocks;
+
+    for ( auto* b : shared_blocks )
+        if ( b->block >= begin && b->block < end )
+            blocks.push_back(b);
+
+    for ( auto* b : blocks ) {
+        // Copy first, dropping the reference may release the buffer.
+        auto copy = CopyOf(b->block, b->Size());
+        shared_blocks.erase(b);
+        b->shared.reset();
+        b->block = copy;
+    }
+}
+
+// Referencing a packet's buffer keeps all of it alive, so we only do so
+// if the block makes up a decent part of the packet. Small segments are
+// cheaper to copy than to pin a full snaplen-sized buffer for.
+static std::shared_ptr<const u_char> share_block_data(const Packet* pkt, const u_char* data, uint64_t size) {
+    if ( ! pkt || size * 4 < pkt->cap_len )
+        return nullptr;
+
+    return pkt->ShareData(data, size);
+}
+
+size_t DataBlockMap::ChunkAfter(uint64_t seq) const {
+    auto n = chunks.size();
+
+    // Most activity happens at the end of a stream's data, so check the
+    // last chunk before searching.
+    if ( n == 0 || chunks[n - 1].items.back().first <= seq )
+        return n;
+
+    if ( n == 1 || chunks[n - 2].items.back().first <= seq )
+        return n - 1;
+
+    auto it = std::partition_point(chunks.begin(), chunks.end() - 1,
+                                   [seq](const Chunk& c) { return c.items.back().first <= seq; });
+    return it - chunks.begin();
+}
+
+DataBlockMap::const_iterator DataBlockMap::upper_bound(uint64_t seq) const {
+    auto c = ChunkAfter(seq);
+
+    if ( c == chunks.size() )
+        return end();
+
+    const auto& chunk = chunks[c];
+    auto it = std::upper_bound(chunk.items.begin() + chunk.head, chunk.items.end(), seq,
+                               [](uint64_t seq, const value_type& v) { return seq < v.first; });
+    return {this, c, static_cast<size_t>(it - chunk.items.begin()) - chunk.head};
+}
+
+DataBlockMap::const_iterator DataBlockMap::find(uint64_t seq) const {
+    auto it = upper_bound(seq);
+
+    if ( it == begin() )
+        return end();
+
+    --it;
+    return it->first == seq ? it : end();
+}
+
+DataBlockMap::const_iterator DataBlockMap::insert(value_type v) {
+    ++num_blocks;
+
+    // Fast path for appending in sequence order.
+    if ( chunks.empty() || v.first > back().first ) {
+        if ( chunks.empty() || chunks.back().Size() >= MAX_CHUNK_SIZE ) {
+            // Once a stream has filled a chunk, it's likely to fill the
+            // next one, too, so avoid growing the storage step by step.
+            bool bulk = ! chunks.empty();
+            chunks.emplace_back();
+            chunks.back().items = std::move(spare);
+
+            if ( bulk )
+                chunks.back().items.reserve(MAX_CHUNK_SIZE);
+        }
+
+        auto& chunk = chunks.back();
+
+        if ( chunk.head > 0 && chunk.items.size() == chunk.items.capacity() )
+            chunk.Compact();
+
+        chunk.items.push_back(std::move(v));
+        return {this, chunks.size() - 1, chunk.Size() - 1};
+    }
+
+    // Blocks arriving in reverse order get their own chunks, too.
+    if ( v.first < front().first && chunks.front().Size() >= MAX_CHUNK_SIZE ) {
+        chunks.emplace_front();
+        chunks.front().items.push_back(std::move(v));
+        return begin();
+    }
+
+    // There's a block starting after the new one, so this finds a chunk.
+    auto c = ChunkAfter(v.first);
+    chunks[c].Compact();
+
+    if ( chunks[c].Size() >= MAX_CHUNK_SIZE ) {
+        auto& full = chunks[c].items;
+        auto mid = full.begin() + full.size() / 2;
+        Chunk upper_half;
+        upper_half.items.assign(std::make_move_iterator(mid), std::make_move_iterator(full.end()));
+        full.erase(mid, full.end());
+
+        bool into_upper = v.first > full.back().first;
+        chunks.insert(chunks.begin() + c + 1, std::move(upper_half));
+
+        if ( into_upper )
+            ++c;
+    }
+
+    auto& items = chunks[c].items;
+    auto pos = std::lower_bound(items.begin(), items.end(), v.first,
+                                [](const value_type& e, uint64_t seq) { return e.first < seq; });
+    pos = items.insert(pos, std::move(v));
+    return {this, c, static_cast<size_t>(pos - items.begin())};
+}
+
+DataBlockMap::const_iterator DataBlockMap::erase(const_iterator it) {
+    auto& chunk = chunks[it.chunk];
+    --num_blocks;
+
+    if ( it.idx == 0 ) {
+        // Release the block, leaving its slot for later reclaiming.
+        chunk[0] = {0, DataBlock()};
+        ++chunk.head;
+    }
+    else
+        chunk.items.erase(chunk.items.begin() + chunk.head + it.idx);
+
+    if ( chunk.Size() == 0 ) {
+        // Keep the storage around for the next append. In the common
+        // case of a stream getting trimmed completely, that's the chunk
+        // we'd otherwise allocate anew right after.
+        spare = std::move(chunk.items);
+        spare.clear();
+        chunks.erase(chunks.begin() + it.chunk);
+        return {this, it.chunk, 0};
+    }
+
+    if ( it.idx == chunk.Size() )
+        return {this, it.chunk + 1, 0};
+
+    return it;
+}
+
+DataBlock DataBlockMap::extract(const_iterator it) {
+    auto b = std::move(chunks[it.chunk][it.idx].second);
+    erase(it);
+    return b;
 }
 
 void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* above) const {
@@ -53,12 +221,8 @@ void DataBlockList::Delete(DataBlockMap::const_iterator it) {
 }
 
 DataBlock DataBlockList::Remove(DataBlockMap::const_iterator it) {
-    auto b = std::move(it->second);
-    auto size = b.Size();
-
-    block_map.erase(it);
-    total_data_size -= size;
-
+    auto b = block_map.extract(it);
+    total_data_size -= b.Size();
     return b;
 }
 
@@ -74,7 +238,8 @@ void DataBlockList::Clear() {
 void DataBlockList::Append(DataBlock block, uint64_t limit) {
     total_data_size += block.Size();
 
-    block_map.emplace_hint(block_map.end(), block.seq, std::move(block));
+    auto seq = block.seq;
+    block_map.insert({seq, std::move(block)});
 
     while ( block_map.size() > limit )
         Delete(block_map.begin());
@@ -93,10 +258,14 @@ DataBlockMap::const_iterator DataBlockList::FirstBlockAtOrBefore(uint64_t seq) c
     return std::prev(it);
 }
 
-DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
-                                                   DataBlockMap::const_iterator hint) {
+DataBlockMap::const_iterator DataBlockList::InsertBlock(uint64_t seq, uint64_t upper, const u_char* data) {
     auto size = upper - seq;
-    auto rval = block_map.emplace_hint(hint, seq, DataBlock(data, size, seq));
+    DataBlockMap::const_iterator rval;
+
+    if ( auto shared = share_block_data(reassembler->lender, data, size) )
+        rval = block_map.insert({seq, DataBlock(std::move(shared), size, seq)});
+    else
+        rval = block_map.insert({seq, DataBlock(data, size, seq)});
 
     total_data_size += size;
     Reassembler::sizes[reassembler->rtype] += size + sizeof(DataBlock);
@@ -105,76 +274,84 @@ DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper,
     return rval;
 }
 
-DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
-                                                   DataBlockMap::const_iterator* hint) {
-    // Empty list.
-    if ( block_map.empty() )
-        return Insert(seq, upper, data, block_map.end());
-
-    const auto& last = block_map.rbegin()->second;
-
+DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data) {
     // Special check for the common case of appending to the end.
-    if ( seq == last.upper )
-        return Insert(seq, upper, data, block_map.end());
+    if ( block_map.empty() || seq >= block_map.back().second.upper )
+        return InsertBlock(seq, upper, data);
 
-    // Find the first block that doesn't come completely before the new data.
-    DataBlockMap::const_iterator it;
+    // Inserting invalidates iterators, so we remember the starting
+    // sequence number of the block to return, too. The iterator remains
+    // usable as long as it stems from the most recent insert.
+    bool have_rval = false;
+    uint64_t rval = 0;
+    DataBlockMap::const_iterator rval_it;
+    bool rval_it_valid = false;
 
-    if ( hint )
-        it = *hint;
-    else {
-        it = FirstBlockAtOrBefore(seq);
+    while ( seq < upper ) {
+        // Find the first block that doesn't come completely before the new data.
+        auto it = FirstBlockAtOrBefore(seq);
 
         if ( it == block_map.end() )
             it = block_map.begin();
-    }
+        else if ( it->second.upper <= seq )
+            ++it;
 
-    while ( std::next(it) != block_map.end() && it->second.upper <= seq )
-        ++it;
+        if ( it == block_map.end() || upper <= it->second.seq ) {
+            // The (remaining) new data doesn't overlap any block.
+            auto new_it = InsertBlock(seq, upper, data);
 
-    const auto& b = it->second;
+            if ( ! have_rval ) {
+                rval = seq;
+                rval_it = new_it;
+                rval_it_valid = true;
+            }
+            else
+                rval_it_valid = false;
 
-    if ( b.upper <= seq )
-        // b is the last block, and it comes completely before the new block.
-        return Insert(seq, upper, data, block_map.end());
+            have_rval = true;
+            break;
+        }
 
-    if ( upper <= b.seq )
-        // The new block comes completely before b.
-        return Insert(seq, upper, data, it);
+        const auto& b = it->second;
+        uint64_t b_seq = b.seq;
+        uint64_t b_upper = b.upper;
 
-    DataBlockMap::const_iterator rval;
+        // The blocks overlap.
+        if ( seq < b_seq ) {
+            // The new block has a prefix that comes before b.
+            uint64_t prefix_len = b_seq - seq;
 
-    // The blocks overlap.
-    if ( seq < b.seq ) {
-        // The new block has a prefix that comes before b.
-        uint64_t prefix_len = b.seq - seq;
+            auto new_it = InsertBlock(seq, b_seq, data);
 
-        rval = Insert(seq, seq + prefix_len, data, it);
+            if ( ! have_rval ) {
+                rval = seq;
+                rval_it = new_it;
+                rval_it_valid = true;
+            }
+            else
+                rval_it_valid = false;
 
-        data += prefix_len;
-        seq += prefix_len;
-    }
-    else
-        rval = it;
+            have_rval = true;
+            data += prefix_len;
+            seq += prefix_len;
+        }
 
-    uint64_t overlap_start = seq;
-    uint64_t overlap_offset = overlap_start - b.seq;
-    uint64_t new_b_len = upper - seq;
-    uint64_t b_len = b.upper - overlap_start;
-    uint64_t overlap_len = min(new_b_len, b_len);
+        // Skip the part overlapping b and go on with the remainder, if any.
+        uint64_t overlap_len = min(upper - seq, b_upper - seq);
 
-    if ( overlap_len < new_b_len ) {
-        // Recurse to resolve remainder of the new data.
-        data += overlap_len;
-        seq += overlap_len;
+        if ( seq + overlap_len == upper ) {
+            if ( ! have_rval )
+                rval = b_seq;
 
-        auto r = Insert(seq, upper, data, &it);
+            have_rval = true;
+            break;
+        }
 
-        if ( rval == it )
-            rval = r;
+        data += overlap_len;
+        seq += overlap_len;
     }
 
-    return rval;
+    return rval_it_valid ? rval_it : block_map.find(rval);
 }
 
 uint64_t DataBlockList::Trim(uint64_t seq, uint64_t max_old, DataBlockList* old_list) {
@@ -296,7 +473,7 @@ void Reassembler::CheckOverlap(const DataBlockList& list, uint64_t seq, uint64_t
     }
 }
 
-void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data) {
+void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data, const Packet* pkt) {
     // Check for overflows - this should be handled by the caller
     // and possibly reported as a weird or violation if applicable.
     if ( std::numeric_limits<uint64_t>::max() - seq < len ) {
@@ -327,8 +504,10 @@ void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* d
         len -= amount_old;
     }
 
+    lender = pkt;
     auto it = block_list.Insert(seq, upper_seq, data);
-    ;
+    lender = nullptr;
+
     BlockInserted(it);
 }
 
@@ -350,3 +529,212 @@ void Reassembler::Undelivered(uint64_t up_to_seq) {
 uint64_t Reassembler::MemoryAllocation(ReassemblerType rtype) { return Reassembler::sizes[rtype]; }
 
 } // namespace zeek
+
+TEST_CASE("reassembler shared packet data") {
+    class TestReassembler : public zeek::Reassembler {
+    public:
+        TestReassembler() : zeek::Reassembler(0, zeek::REASSEM_UNKNOWN) {}
+        const zeek::DataBlockList& Blocks() const { return block_list; }
+
+    protected:
+        void BlockInserted(zeek::DataBlockMap::const_iterator it) override {}
+        void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override {}
+    };
+
+    const u_char* payload = reinterpret_cast<const u_char*>("0123456789ABCDEF");
+    pkt_timeval ts = {0, 0};
+    auto pkt = std::make_unique<zeek::Packet>(DLT_RAW, &ts, 16, 16, payload, true);
+    auto r = std::make_unique<TestReassembler>();
+
+    SUBCASE("large block references packet data") {
+        r->NewBlock(0.0, 10, 8, pkt->data + 4, pkt.get());
+        const auto& b = r->Blocks().FirstBlock();
+        CHECK(b.IsShared());
+        CHECK_EQ(b.block, pkt->data + 4);
+
+        // The block's data stays valid after the packet is gone.
+        pkt.reset();
+        CHECK_EQ(memcmp(b.block, "456789AB", 8), 0);
+    }
+
+    SUBCASE("small block is copied") {
+        r->NewBlock(0.0, 10, 2, pkt->data, pkt.get());
+        CHECK_FALSE(r->Blocks().FirstBlock().IsShared());
+    }
+
+    SUBCASE("data outside of packet is copied") {
+        r->NewBlock(0.0, 10, 8, payload, pkt.get());
+        CHECK_FALSE(r->Blocks().FirstBlock().IsShared());
+    }
+
+    SUBCASE("overlapping insert splits shared block") {
+        r->NewBlock(0.0, 10, 4, pkt->data, pkt.get());
+        r->NewBlock(0.0, 8, 12, pkt->data + 4, pkt.get());
+        CHECK_EQ(r->Blocks().NumBlocks(), 3);
+        CHECK_EQ(r->TotalSize(), 12);
+    }
+
+    SUBCASE("unsharing copies data and releases the buffer") {
+        u_char buf[16];
+        memcpy(buf, payload, sizeof(buf));
+        bool released = false;
+
+        zeek::Packet lender(DLT_RAW, &ts, 16, 16, buf);
+        lender.SetDataOwner({buf, [&released](const u_char*) { released = true; }});
+        r->NewBlock(0.0, 10, 8, buf + 4, &lender);
+        lender.SetDataOwner(nullptr);
+
+        // Data elsewhere doesn't affect the block.
+        zeek::DataBlock::Unshare(buf + 12, buf + 16);
+        CHECK(r->Blocks().FirstBlock().IsShared());
+        CHECK_FALSE(released);
+
+        zeek::DataBlock::Unshare(buf, buf + 16);
+        CHECK(released);
+        memset(buf, 'x', sizeof(buf));
+
+        const auto& b = r->Blocks().FirstBlock();
+        CHECK_FALSE(b.IsShared());
+        CHECK_EQ(memcmp(b.block, "456789AB", 8), 0);
+    }
+}
+
+TEST_CASE("data block map") {
+    zeek::DataBlockMap m;
+    const u_char* data = reinterpret_cast<const u_char*>("x");
+
+    auto keys = [&m]() {
+        std::vector<uint64_t> rval;
+        for ( const auto& [k, b] : m )
+            rval.push_back(k);
+        return rval;
+    };
+
+    SUBCASE("in-order") {
+        for ( uint64_t i = 0; i < 100; ++i )
+            m.insert({i, zeek::DataBlock(data, 1, i)});
+
+        CHECK_EQ(m.size(), 100);
+        CHECK_EQ(m.front().first, 0);
+        CHECK_EQ(m.back().first, 99);
+        CHECK_EQ(m.upper_bound(41)->first, 42);
+        CHECK(m.upper_bound(99) == m.end());
+    }
+
+    SUBCASE("reordered") {
+        for ( uint64_t i = 0; i < 100; ++i )
+            m.insert({(i * 37) % 100, zeek::DataBlock(data, 1, (i * 37) % 100)});
+
+        auto k = keys();
+        CHECK_EQ(k.size(), 100);
+        CHECK(std::is_sorted(k.begin(), k.end()));
+        CHECK_EQ(m.find(63)->second.seq, 63);
+        CHECK(m.find(100) == m.end());
+    }
+
+    SUBCASE("erase") {
+        for ( uint64_t i = 0; i < 100; ++i )
+            m.insert({i, zeek::DataBlock(data, 1, i)});
+
+        // Remove from the front, as trimming does, and from the middle.
+        auto it = m.erase(m.begin());
+        CHECK_EQ(it->first, 1);
+        it = m.erase(m.find(50));
+        CHECK_EQ(it->first, 51);
+
+        auto b = m.extract(m.find(51));
+        CHECK_EQ(b.seq, 51);
+        CHECK_EQ(m.size(), 97);
+        CHECK_EQ(m.front().first, 1);
+
+        while ( ! m.empty() )
+            m.erase(m.begin());
+
+        CHECK(m.begin() == m.end());
+
+        m.insert({7, zeek::DataBlock(data, 1, 7)});
+        CHECK_EQ(keys(), std::vector<uint64_t>{7});
+    }
+}
+
+TEST_CASE("reassembler benchmark" * doctest::skip(true)) {
+    // Run it with: zeek --test --test-case="reassembler benchmark" --no-skip
+    //
+    // Feeds full-sized segments to a reassembler in order, reordered within
+    // small windows, and with each segment followed by a retransmission
+    // overlapping it. Trimming after each segment or window stands in for
+    // delivery. For comparison, the in-order workload also runs against a
+    // std::map of separately allocated buffers, as blocks used to be kept.
+    class BenchReassembler : public zeek::Reassembler {
+    public:
+        BenchReassembler() : zeek::Reassembler(0, zeek::REASSEM_UNKNOWN) {}
+
+    protected:
+        void BlockInserted(zeek::DataBlockMap::const_iterator it) override {}
+        void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override {}
+    };
+
+    constexpr uint64_t num_segments = 5'000'000;
+    constexpr uint64_t seg_len = 1460;
+    constexpr uint64_t window = 8;
+    std::vector<u_char> payload(2 * seg_len, 'x');
+
+    auto run = [&](auto feed) {
+        auto begin = std::chrono::steady_clock::now();
+        feed();
+        auto end = std::chrono::steady_clock::now();
+        auto secs = std::chrono::duration<double>(end - begin).count();
+        return static_cast<uint64_t>(num_segments / secs);
+    };
+
+    auto in_order = run([&]() {
+        BenchReassembler r;
+
+        for ( uint64_t i = 0; i < num_segments; ++i ) {
+            r.NewBlock(0.0, i * seg_len, seg_len, payload.data());
+            r.TrimToSeq((i + 1) * seg_len);
+        }
+    });
+
+    auto reordered = run([&]() {
+        BenchReassembler r;
+
+        for ( uint64_t w = 0; w < num_segments; w += window ) {
+            for ( uint64_t i = w + window; i > w; --i )
+                r.NewBlock(0.0, (i - 1) * seg_len, seg_len, payload.data());
+
+            r.TrimToSeq((w + window) * seg_len);
+        }
+    });
+
+    auto overlapping = run([&]() {
+        BenchReassembler r;
+
+        for ( uint64_t w = 0; w < num_segments; w += window ) {
+            for ( uint64_t i = w; i < w + window; i += 2 ) {
+                r.NewBlock(0.0, i * seg_len, seg_len, payload.data());
+                // Retransmits the second half of this segment with the
+                // next one, in place of sending the next one alone.
+                r.NewBlock(0.0, i * seg_len + seg_len / 2, seg_len + seg_len / 2, payload.data());
+            }
+
+            r.TrimToSeq((w + window) * seg_len);
+        }
+    });
+
+    auto map_in_order = run([&]() {
+        std::map<uint64_t, std::unique_ptr<u_char[]>> m;
+
+        for ( uint64_t i = 0; i < num_segments; ++i ) {
+            auto b = std::make_unique<u_char[]>(seg_len);
+            memcpy(b.get(), payload.data(), seg_len);
+            m.emplace(i * seg_len, std::move(b));
+            m.erase(m.begin());
+        }
+    });
+
+    MESSAGE("in-order: " << in_order << " segments/sec");
+    MESSAGE("reordered: " << reordered << " segments/sec");
+    MESSAGE("overlapping: " << overlapping << " segments/sec");
+    MESSAGE("std::map in-order: " << map_in_order << " segments/sec");
+}
@@ -6,12 +6,19 @@
 #include <cassert>
 #include <cstdint>
 #include <cstring>
-#include <map>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "zeek/Obj.h"
 
 namespace zeek {
 
+class Packet;
+
 // Whenever subclassing the Reassembler class
 // you should add to this for known subclasses.
 enum ReassemblerType {
@@ -36,31 +43,39 @@ public:
      */
     DataBlock(const u_char* data, uint64_t size, uint64_t seq);
 
+    /**
+     * Create a data block/segment that references, rather than copies,
+     * data kept alive by a shared buffer (e.g., a lent-out packet buffer).
+     */
+    DataBlock(std::shared_ptr<const u_char> data, uint64_t size, uint64_t seq);
+
     DataBlock(const DataBlock& other) {
         seq = other.seq;
         upper = other.upper;
-        auto size = other.Size();
-        block = new u_char[size];
-        memcpy(block, other.block, size);
+        shared = other.shared;
+        block = shared ? other.block : CopyOf(other.block, other.Size());
+        Track();
     }
 
     DataBlock(DataBlock&& other) {
         seq = other.seq;
         upper = other.upper;
         block = other.block;
+        shared = std::move(other.shared);
         other.block = nullptr;
+        Track(&other);
     }
 
     DataBlock& operator=(const DataBlock& other) {
         if ( this == &other )
             return *this;
 
+        Release();
         seq = other.seq;
         upper = other.upper;
-        auto size = other.Size();
-        delete[] block;
-        block = new u_char[size];
-        memcpy(block, other.block, size);
+        shared = other.shared;
+        block = shared ? other.block : CopyOf(other.block, other.Size());
+        Track();
         return *this;
     }
 
@@ -68,31 +83,249 @@ public:
         if ( this == &other )
             return *this;
 
+        Release();
         seq = other.seq;
         upper = other.upper;
-        delete[] block;
         block = other.block;
+        shared = std::move(other.shared);
         other.block = nullptr;
+        Track(&other);
         return *this;
     }
 
-    ~DataBlock() { delete[] block; }
+    ~DataBlock() { Release(); }
 
     /**
      * @return length of the data block
      */
     uint64_t Size() const { return upper - seq; }
 
+    /**
+     * @return true if the block references a shared buffer instead of
+     * owning a copy of its data.
+     */
+    bool IsShared() const { return shared != nullptr; }
+
+    /**
+     * Makes all blocks referencing shared data within [begin, end) copy
+     * it instead. Sources lending out their buffers use this to get back
+     * memory they need to reuse.
+     *
+     * @param begin Start of the memory range.
+     *
+     * @param end End of the memory range, exclusive.
+     */
+    static void Unshare(const u_char* begin, const u_char* end);
+
     uint64_t seq;
     uint64_t upper;
-    u_char* block;
+    const u_char* block;
+
+private:
+    friend class DataBlockMap;
+
+    // An empty block, for DataBlockMap to release blocks it removes.
+    DataBlock() : seq(0), upper(0), block(nullptr) {}
+
+    static const u_char* CopyOf(const u_char* data, uint64_t size) {
+        auto b = new u_char[size];
+        memcpy(b, data, size);
+        return b;
+    }
+
+    void Release() {
+        if ( ! shared )
+            delete[] block;
+        else
+            shared_blocks.erase(this);
+
+        shared.reset();
+    }
+
+    // Registers the block if it references shared data, in place of
+    // *moved_from* if given.
+    void Track(DataBlock* moved_from = nullptr) {
+        if ( ! shared )
+            return;
+
+        if ( moved_from )
+            shared_blocks.erase(moved_from);
+
+        shared_blocks.insert(this);
+    }
+
+    // Non-null if block points into a shared buffer.
+    std::shared_ptr<const u_char> shared;
+
+    // All blocks referencing shared buffers, for Unshare().
+    static std::unordered_set<DataBlock*> shared_blocks;
 };
 
-using DataBlockMap = std::map<uint64_t, DataBlock>;
+/**
+ * An ordered container of data blocks keyed by their starting sequence
+ * number. It mimics the parts of the std::map interface the reassembler
+ * needs, but keeps blocks in a deque of small sorted chunks instead of
+ * individually allocated tree nodes. Appending in sequence order (the
+ * common case for TCP and file reassembly) and removing from the front
+ * are cheap, while out-of-order inserts remain logarithmic in the number
+ * of chunks plus linear in the (bounded) chunk size.
+ *
+ * Any insertion or removal invalidates all iterators.
+ */
+class DataBlockMap {
+public:
+    using value_type = std::pair<uint64_t, DataBlock>;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = DataBlockMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+
+        reference operator*() const { return m->chunks[chunk][idx]; }
+        pointer operator->() const { return &m->chunks[chunk][idx]; }
+
+        const_iterator& operator++() {
+            if ( ++idx == m->chunks[chunk].Size() ) {
+                ++chunk;
+                idx = 0;
+            }
+
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto rval = *this;
+            ++*this;
+            return rval;
+        }
+
+        const_iterator& operator--() {
+            if ( idx == 0 ) {
+                --chunk;
+                idx = m->chunks[chunk].Size() - 1;
+            }
+            else
+                --idx;
+
+            return *this;
+        }
+
+        const_iterator operator--(int) {
+            auto rval = *this;
+            --*this;
+            return rval;
+        }
+
+        bool operator==(const const_iterator& other) const { return chunk == other.chunk && idx == other.idx; }
+        bool operator!=(const const_iterator& other) const { return ! (*this == other); }
+
+    private:
+        friend class DataBlockMap;
+
+        const_iterator(const DataBlockMap* m, size_t chunk, size_t idx) : m(m), chunk(chunk), idx(idx) {}
+
+        const DataBlockMap* m = nullptr;
+        size_t chunk = 0;
+        size_t idx = 0;
+    };
+
+    const_iterator begin() const { return {this, 0, 0}; }
+    const_iterator end() const { return {this, chunks.size(), 0}; }
+
+    bool empty() const { return chunks.empty(); }
+    size_t size() const { return num_blocks; }
+
+    /**
+     * @return the block with the lowest sequence number. Must not be
+     * called on an empty container.
+     */
+    const value_type& front() const { return chunks.front()[0]; }
+
+    /**
+     * @return the block with the highest sequence number. Must not be
+     * called on an empty container.
+     */
+    const value_type& back() const { return chunks.back().items.back(); }
+
+    /**
+     * @return an iterator to the first block starting after \a seq, or
+     * end() if there's none.
+     */
+    const_iterator upper_bound(uint64_t seq) const;
+
+    /**
+     * @return an iterator to the block starting at \a seq, or end() if
+     * there's none.
+     */
+    const_iterator find(uint64_t seq) const;
+
+    /**
+     * Inserts a block. There must not be a block with the same starting
+     * sequence number already.
+     * @return an iterator to the inserted block.
+     */
+    const_iterator insert(value_type v);
+
+    /**
+     * Removes a block.
+     * @return an iterator to the block following the removed one.
+     */
+    const_iterator erase(const_iterator it);
+
+    /**
+     * Moves a block out of the container and removes it.
+     */
+    DataBlock extract(const_iterator it);
+
+    void clear() {
+        chunks.clear();
+        spare = {};
+        num_blocks = 0;
+    }
+
+private:
+    // Maximum number of blocks per chunk. Full chunks are split in half
+    // for inserts, so moving blocks around stays cheap.
+    static constexpr size_t MAX_CHUNK_SIZE = 32;
+
+    // A sorted run of blocks. Removing the first block only releases it
+    // and advances head, so trimming a stream's delivered data doesn't
+    // shift the remaining blocks. The released slots get reclaimed once
+    // the chunk's storage runs full.
+    struct Chunk {
+        std::vector<value_type> items;
+        size_t head = 0;
+
+        size_t Size() const { return items.size() - head; }
+        value_type& operator[](size_t i) { return items[head + i]; }
+        const value_type& operator[](size_t i) const { return items[head + i]; }
+
+        void Compact() {
+            items.erase(items.begin(), items.begin() + head);
+            head = 0;
+        }
+    };
+
+    // Index of the first chunk whose last block starts after seq.
+    size_t ChunkAfter(uint64_t seq) const;
+
+    // Sorted, never contains empty chunks.
+    std::deque<Chunk> chunks;
+    size_t num_blocks = 0;
+
+    // Storage of the most recently emptied chunk, for reuse.
+    std::vector<value_type> spare;
+};
 
 /**
  * The data structure used for reassembling arbitrary sequences of data
- * blocks/segments.  It internally uses an ordered map (std::map).
+ * blocks/segments.  It internally uses an ordered container of blocks
+ * (DataBlockMap).
  */
 class DataBlockList {
 public:
@@ -118,7 +351,7 @@ public:
      */
     const DataBlock& FirstBlock() const {
         assert(block_map.size());
-        return block_map.begin()->second;
+        return block_map.front().second;
     }
 
     /**
@@ -127,7 +360,7 @@ public:
      */
     const DataBlock& LastBlock() const {
         assert(block_map.size());
-        return block_map.rbegin()->second;
+        return block_map.back().second;
     }
 
     /**
@@ -162,16 +395,15 @@ public:
     void Clear();
 
     /**
-     * Insert a new data block into the list.
+     * Insert a new data block into the list. Parts of the new data that
+     * overlap existing blocks are dropped.
      * @param seq  lower sequence number of the data block
      * @param upper  highest sequence number of the data block
      * @param data  points to the data block contents
-     * @param hint  a suggestion of the node from which to start searching
-     * for an insertion point or null to search from the beginning of the list
-     * @return an iterator to the element that was inserted
+     * @return an iterator to the first block that was inserted, or to the
+     * existing block covering the end of the new data if none was
      */
-    DataBlockMap::const_iterator Insert(uint64_t seq, uint64_t upper, const u_char* data,
-                                        DataBlockMap::const_iterator* hint = nullptr);
+    DataBlockMap::const_iterator Insert(uint64_t seq, uint64_t upper, const u_char* data);
 
     /**
      * Insert a new data block at the end of the list and remove blocks
@@ -203,16 +435,14 @@ public:
 
 private:
     /**
-     * Insert a new data block into the list.
+     * Insert a new data block into the list, which must not overlap any
+     * existing block.
      * @param seq  lower sequence number of the data block
      * @param upper  highest sequence number of the data block
      * @param data  points to the data block contents
-     * @param hint  a suggestion of the node from which to start searching
-     * for an insertion point
      * @return an iterator to the element that was inserted
      */
-    DataBlockMap::const_iterator Insert(uint64_t seq, uint64_t upper, const u_char* data,
-                                        DataBlockMap::const_iterator hint);
+    DataBlockMap::const_iterator InsertBlock(uint64_t seq, uint64_t upper, const u_char* data);
 
     /**
      * Removes a block from the list and updates other state which keeps
@@ -239,7 +469,10 @@ public:
     Reassembler(uint64_t init_seq, ReassemblerType reassem_type = REASSEM_UNKNOWN);
     ~Reassembler() override {}
 
-    void NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data);
+    // If pkt is given and its data is backed by a reference-counted
+    // buffer containing data, the new block references the buffer
+    // instead of copying the data.
+    void NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data, const Packet* pkt = nullptr);
 
     // Throws away all blocks up to seq.  Returns number of bytes
     // if not all in-sequence, 0 if they were.
@@ -288,6 +521,9 @@ protected:
     uint64_t trim_seq = 0; // how far we've trimmed
     uint32_t max_old_blocks = 0;
 
+    // Packet lending its data to the blocks of the current NewBlock() call.
+    const Packet* lender = nullptr;
+
     ReassemblerType rtype = REASSEM_UNKNOWN;
 
     static uint64_t total_size;
@@ -15,6 +15,7 @@
 #include "zeek/RunState.h"
 #include "zeek/Scope.h"
 #include "zeek/Trigger.h"
+#include "zeek/ValPool.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/input.h"
 #include "zeek/packet_analysis/protocol/tcp/TCP.h"
@@ -113,6 +114,14 @@ void ProfileLogger::Log() {
     file->Write(util::fmt("%.06f Memory: total=%" PRId64 "K total_adj=%" PRId64 "K malloced: %" PRId64 "K\n",
                           run_state::network_time, total / 1024, (total - first_total) / 1024, malloced / 1024));
 
+#ifdef POOL_VAL_ALLOCATIONS
+    const auto& vps = detail::ValPool::Local().Stats();
+    file->Write(util::fmt("%.06f Val pool: allocs=%" PRIu64 " reused=%" PRIu64 " unpooled=%" PRIu64
+                          " in_use=%" PRId64 " chunks=%" PRIu64 " (%" PRIu64 "K)\n",
+                          run_state::network_time, vps.pooled, vps.reused, vps.unpooled, vps.in_use, vps.chunks,
+                          vps.chunks * detail::ValPool::CHUNK_SIZE / 1024));
+#endif
+
     file->Write(util::fmt("%.06f Run-time: user+sys=%.1f user=%.1f sys=%.1f real=%.1f\n", run_state::network_time,
                           (utime + stime) - (first_utime + first_stime), utime - first_utime, stime - first_stime,
                           rtime - first_rtime));
@@ -195,10 +204,12 @@ void ProfileLogger::Log() {
         threading::MsgThread::Stats s = i->second;
         file->Write(util::fmt("%0.6f   %-25s in=%" PRIu64 " out=%" PRIu64 " pending=%" PRIu64 "/%" PRIu64
                               " (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
+                              " (#queue full/max: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
                               "\n",
                               run_state::network_time, i->first.c_str(), s.sent_in, s.sent_out, s.pending_in,
                               s.pending_out, s.queue_in_stats.num_reads, s.queue_in_stats.num_writes,
-                              s.queue_out_stats.num_reads, s.queue_out_stats.num_writes));
+                              s.queue_out_stats.num_reads, s.queue_out_stats.num_writes, s.queue_in_stats.num_full,
+                              s.queue_in_stats.max_size, s.queue_out_stats.num_full, s.queue_out_stats.max_size));
     }
 
     auto cs = broker_mgr->GetStatistics();
@@ -0,0 +1,183 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/TableExpireIndex.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/Attr.h"
+#include "zeek/Expr.h"
+#include "zeek/NetVar.h"
+#include "zeek/RunState.h"
+#include "zeek/Val.h"
+
+namespace zeek::detail {
+
+namespace {
+
+constexpr size_t RECORD_HEADER_SIZE = sizeof(hash_t) + sizeof(uint32_t);
+
+} // namespace
+
+void TableExpireIndex::Add(int access_time, const HashKey& key) {
+    // New entries almost always go into the latest bucket.
+    Bucket* b;
+    if ( ! buckets.empty() && buckets.rbegin()->first == access_time )
+        b = &buckets.rbegin()->second;
+    else
+        b = &buckets[access_time];
+
+    hash_t hash = key.Hash();
+    uint32_t size = key.Size();
+
+    auto offset = b->data.size();
+    b->data.resize(offset + RECORD_HEADER_SIZE + size);
+
+    char* p = b->data.data() + offset;
+    memcpy(p, &hash, sizeof(hash));
+    memcpy(p + sizeof(hash), &size, sizeof(size));
+    memcpy(p + RECORD_HEADER_SIZE, key.Key(), size);
+
+    ++num_keys;
+}
+
+std::unique_ptr<HashKey> TableExpireIndex::Pop() {
+    auto it = buckets.begin();
+    auto& b = it->second;
+
+    const char* p = b.data.data() + b.pos;
+    hash_t hash;
+    uint32_t size;
+    memcpy(&hash, p, sizeof(hash));
+    memcpy(&size, p + sizeof(hash), sizeof(size));
+
+    auto key = std::make_unique<HashKey>(p + RECORD_HEADER_SIZE, size, hash);
+
+    b.pos += RECORD_HEADER_SIZE + size;
+    if ( b.pos == b.data.size() )
+        buckets.erase(it);
+
+    --num_keys;
+    return key;
+}
+
+void TableExpireIndex::Clear() {
+    buckets.clear();
+    num_keys = 0;
+}
+
+} // namespace zeek::detail
+
+using zeek::detail::HashKey;
+using zeek::detail::TableExpireIndex;
+
+TEST_CASE("table expire index") {
+    TableExpireIndex idx;
+    CHECK(idx.Empty());
+
+    idx.Add(20, HashKey(zeek_int_t(1)));
+    idx.Add(10, HashKey(zeek_int_t(2)));
+    idx.Add(20, HashKey("three"));
+    idx.Add(10, HashKey(zeek_int_t(4)));
+
+    CHECK_EQ(idx.Size(), 4);
+    CHECK_EQ(idx.NextAccessTime(), 10);
+
+    SUBCASE("pop in order") {
+        auto k = idx.Pop();
+        CHECK(*k == HashKey(zeek_int_t(2)));
+        CHECK_EQ(k->Hash(), HashKey(zeek_int_t(2)).Hash());
+
+        k = idx.Pop();
+        CHECK(*k == HashKey(zeek_int_t(4)));
+        CHECK_EQ(idx.NextAccessTime(), 20);
+
+        k = idx.Pop();
+        CHECK(*k == HashKey(zeek_int_t(1)));
+
+        k = idx.Pop();
+        CHECK(*k == HashKey("three"));
+        CHECK(idx.Empty());
+        CHECK_EQ(idx.Size(), 0);
+    }
+
+    SUBCASE("refile while popping") {
+        // Keys added to the bucket being popped come after the others.
+        auto k = idx.Pop();
+        idx.Add(10, *k);
+        CHECK(*idx.Pop() == HashKey(zeek_int_t(4)));
+        CHECK(*idx.Pop() == HashKey(zeek_int_t(2)));
+        CHECK_EQ(idx.NextAccessTime(), 20);
+    }
+
+    SUBCASE("clear") {
+        idx.Clear();
+        CHECK(idx.Empty());
+        CHECK_EQ(idx.Size(), 0);
+    }
+}
+
+TEST_CASE("table expiration benchmark" * doctest::skip(true)) {
+    // Run it with: zeek --test --test-case="table expiration benchmark" --no-skip
+    using namespace zeek;
+
+    constexpr zeek_uint_t num_entries = 10'000'000;
+    constexpr int spread = 600;
+    constexpr int seconds = 60;
+    constexpr double timeout = 60;
+    constexpr double start = 1000;
+
+    auto saved_index = zeek::detail::table_expire_index;
+    auto saved_network_time = run_state::network_time;
+    auto saved_start = run_state::zeek_start_network_time;
+    run_state::zeek_start_network_time = start;
+
+    for ( int use_index : {0, 1} ) {
+        zeek::detail::table_expire_index = use_index;
+
+        auto index = make_intrusive<TypeList>(base_type(TYPE_COUNT));
+        index->Append(base_type(TYPE_COUNT));
+        auto tt = make_intrusive<TableType>(std::move(index), base_type(TYPE_COUNT));
+        auto expire = make_intrusive<zeek::detail::ConstExpr>(make_intrusive<IntervalVal>(timeout));
+        std::vector<zeek::detail::AttrPtr> attr_list{
+            make_intrusive<zeek::detail::Attr>(zeek::detail::ATTR_EXPIRE_CREATE, std::move(expire))};
+        auto attrs = make_intrusive<zeek::detail::Attributes>(std::move(attr_list), tt, false, false);
+        auto tbl = make_intrusive<TableVal>(std::move(tt), std::move(attrs));
+
+        // Entries get created evenly over the spread, so that a second's
+        // worth of them becomes due every second after the timeout.
+        for ( zeek_uint_t i = 0; i < num_entries; ++i ) {
+            run_state::network_time = start + i * spread / num_entries;
+            tbl->Assign(val_mgr->Count(i), val_mgr->Count(i));
+        }
+
+        // Advance time a second at a time and expire until the due entries
+        // are gone, like the table's timer would. Without the index, that
+        // takes a pass over the whole table every time.
+        auto begin = std::chrono::steady_clock::now();
+        size_t calls = 0;
+        zeek_uint_t expected = num_entries;
+
+        for ( int s = 0; s < seconds; ++s ) {
+            run_state::network_time = start + timeout + s + 0.5;
+            expected = num_entries - (s + 1) * num_entries / spread;
+
+            while ( static_cast<zeek_uint_t>(tbl->Size()) > expected ) {
+                tbl->DoExpire(run_state::network_time);
+                ++calls;
+            }
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+
+        MESSAGE((use_index ? "index" : "scan ") << ": " << ms << " ms, " << calls << " DoExpire() calls");
+        CHECK_LE(static_cast<zeek_uint_t>(tbl->Size()), expected);
+    }
+
+    zeek::detail::table_expire_index = saved_index;
+    run_state::network_time = saved_network_time;
+    run_state::zeek_start_network_time = saved_start;
+}
@@ -0,0 +1,77 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "zeek/Hash.h"
+
+namespace zeek::detail {
+
+/**
+ * Tracks the entries of a table with expiration by the time of their last
+ * expiration-relevant access, so that expiring them only needs to look at
+ * entries that have become due instead of scanning the whole table.
+ *
+ * The index keeps one bucket per second of access time, the resolution at
+ * which TableEntryVal records it, and stores the hash keys of the entries
+ * filed under a bucket back-to-back in a single buffer. It doesn't follow
+ * entries as they change: the table files an entry once and moves it along
+ * lazily, when its bucket comes due and the entry turns out to have been
+ * accessed since. Likewise, keys of entries removed from the table linger
+ * until their bucket comes due, and the table skips them then.
+ */
+class TableExpireIndex {
+public:
+    /**
+     * Files a key under an access time.
+     *
+     * @param access_time The access time, in the seconds since Zeek's
+     * start that TableEntryVal uses.
+     * @param key The entry's hash key. The index stores a copy.
+     */
+    void Add(int access_time, const HashKey& key);
+
+    /**
+     * Returns true if the index holds no keys.
+     */
+    bool Empty() const { return buckets.empty(); }
+
+    /**
+     * Returns the earliest access time any key is filed under. Must only
+     * be called if the index isn't empty.
+     */
+    int NextAccessTime() const { return buckets.begin()->first; }
+
+    /**
+     * Removes one of the keys filed under the earliest access time, in the
+     * order they were added. Must only be called if the index isn't empty.
+     */
+    std::unique_ptr<HashKey> Pop();
+
+    /**
+     * Removes all keys.
+     */
+    void Clear();
+
+    /**
+     * Returns the number of keys in the index.
+     */
+    size_t Size() const { return num_keys; }
+
+private:
+    struct Bucket {
+        // Sequence of (hash, size, key bytes) records.
+        std::vector<char> data;
+        // Offset of the next record to pop.
+        size_t pos = 0;
+    };
+
+    std::map<int, Bucket> buckets;
+    size_t num_keys = 0;
+};
+
+} // namespace zeek::detail
@@ -97,6 +97,20 @@ void TimerMgr::InitPostScript() {
         iosource_mgr->Register(this, true);
 
     dispatch_all_expired = zeek::detail::max_timer_expires == 0;
+
+    if ( zeek::detail::use_timer_wheel )
+        UseTimingWheel();
+}
+
+void TimerMgr::UseTimingWheel() {
+    if ( wheel )
+        return;
+
+    wheel = std::make_unique<TimingWheel>();
+
+    // Timers may have been added while parsing scripts already.
+    while ( auto* timer = q->Remove() )
+        wheel->Add(timer);
 }
 
 void TimerMgr::Add(Timer* timer) {
@@ -105,7 +119,7 @@ void TimerMgr::Add(Timer* timer) {
     // Add the timer even if it's already expired - that way, if
     // multiple already-added timers are added, they'll still
     // execute in sorted order.
-    if ( ! q->Add(timer) )
+    if ( ! (wheel ? wheel->Add(timer) : q->Add(timer)) )
         reporter->InternalError("out of memory");
 
     ++current_timers[timer->Type()];
@@ -144,7 +158,7 @@ int TimerMgr::DoAdvance(double new_t, int max_expire) {
 }
 
 void TimerMgr::Remove(Timer* timer) {
-    if ( ! q->Remove(timer) )
+    if ( ! (wheel ? wheel->Remove(timer) : q->Remove(timer)) )
         reporter->InternalError("asked to remove a missing timer");
 
     --current_timers[timer->Type()];
@@ -159,8 +173,8 @@ double TimerMgr::GetNextTimeout() {
     return -1;
 }
 
-Timer* TimerMgr::Remove() { return (Timer*)q->Remove(); }
+Timer* TimerMgr::Remove() { return (Timer*)(wheel ? wheel->Remove() : q->Remove()); }
 
-Timer* TimerMgr::Top() { return (Timer*)q->Top(); }
+Timer* TimerMgr::Top() { return (Timer*)(wheel ? wheel->Top() : q->Top()); }
 
 } // namespace zeek::detail
@@ -6,6 +6,7 @@
 #include <memory>
 
 #include "zeek/PriorityQueue.h"
+#include "zeek/TimingWheel.h"
 #include "zeek/iosource/IOSource.h"
 
 namespace zeek {
@@ -113,9 +114,9 @@ public:
 
     double Time() const { return t ? t : 1; } // 1 > 0
 
-    size_t Size() const { return q->Size(); }
-    size_t PeakSize() const { return q->PeakSize(); }
-    size_t CumulativeNum() const { return q->CumulativeNum(); }
+    size_t Size() const { return wheel ? wheel->Size() : q->Size(); }
+    size_t PeakSize() const { return wheel ? wheel->PeakSize() : q->PeakSize(); }
+    size_t CumulativeNum() const { return wheel ? wheel->CumulativeNum() : q->CumulativeNum(); }
 
     double LastTimestamp() const { return last_timestamp; }
 
@@ -137,6 +138,14 @@ public:
      */
     void InitPostScript();
 
+    /**
+     * Switches from the default binary heap to a hierarchical timing wheel
+     * for keeping the timers, moving over any existing ones. The global
+     * manager does this in InitPostScript() if :zeek:see:`use_timer_wheel`
+     * is set.
+     */
+    void UseTimingWheel();
+
 private:
     int DoAdvance(double t, int max_expire);
     void Remove(Timer* timer);
@@ -158,6 +167,7 @@ private:
 
     static unsigned int current_timers[NUM_TIMER_TYPES];
     std::unique_ptr<PriorityQueue> q;
+    std::unique_ptr<TimingWheel> wheel;
 };
 
 extern TimerMgr* timer_mgr;
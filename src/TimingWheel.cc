@@ -0,0 +1,368 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/TimingWheel.h"
+
+#include "zeek/zeek-config.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+namespace {
+
+int lowest_bit(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return static_cast<int>(idx);
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+} // namespace
+
+TimingWheel::TimingWheel(double resolution)
+    : ticks_per_second(1.0 / resolution), slots(NUM_LEVELS * SLOTS_PER_LEVEL) {}
+
+TimingWheel::~TimingWheel() {
+    for ( auto& slot : slots )
+        for ( auto* e : slot )
+            delete e;
+}
+
+uint64_t TimingWheel::Tick(double t) const {
+    double ticks = t * ticks_per_second;
+
+    // This also catches NaNs and the -HUGE_VAL of removed elements.
+    if ( ! (ticks > 0) )
+        return 0;
+
+    if ( ticks >= 0x1p63 )
+        return uint64_t(1) << 63;
+
+    return static_cast<uint64_t>(ticks);
+}
+
+void TimingWheel::Place(PQ_Element* e) {
+    uint64_t tick = Tick(e->Time());
+
+    if ( tick <= cursor ) {
+        e->SetSlot(READY_SLOT);
+        ready.Add(e);
+        return;
+    }
+
+    int level = 0;
+    for ( uint64_t diff = (tick ^ cursor) >> BITS_PER_LEVEL; diff; diff >>= BITS_PER_LEVEL )
+        ++level;
+
+    int idx = (tick >> (level * BITS_PER_LEVEL)) & (SLOTS_PER_LEVEL - 1);
+    occupied[level][idx / 64] |= uint64_t(1) << (idx % 64);
+
+    int slot = level * SLOTS_PER_LEVEL + idx;
+    auto& v = slots[slot];
+    e->SetSlot(slot);
+    e->SetOffset(static_cast<int>(v.size()));
+    v.push_back(e);
+    ++num_in_slots;
+}
+
+void TimingWheel::Refill() {
+    while ( ready.Size() == 0 && num_in_slots > 0 ) {
+        // The lowest non-empty slot of the lowest non-empty level holds the
+        // earliest elements. All other slots are for later ticks.
+        int level = 0;
+        int word = 0;
+
+        for ( ; level < NUM_LEVELS; ++level ) {
+            for ( word = 0; word < WORDS_PER_LEVEL; ++word )
+                if ( occupied[level][word] )
+                    break;
+
+            if ( word < WORDS_PER_LEVEL )
+                break;
+        }
+
+        int idx = word * 64 + lowest_bit(occupied[level][word]);
+        occupied[level][word] &= ~(uint64_t(1) << (idx % 64));
+
+        // Move the cursor to the beginning of the slot's range, so that
+        // its elements move to lower levels, or become ready.
+        int shift = level * BITS_PER_LEVEL;
+        uint64_t low_mask = (uint64_t(1) << shift) - 1;
+        uint64_t slot_mask = uint64_t(SLOTS_PER_LEVEL - 1) << shift;
+        cursor = (cursor & ~(low_mask | slot_mask)) | (uint64_t(idx) << shift);
+
+        cascade.swap(slots[level * SLOTS_PER_LEVEL + idx]);
+        num_in_slots -= static_cast<int>(cascade.size());
+
+        for ( auto* e : cascade )
+            Place(e);
+
+        cascade.clear();
+    }
+}
+
+PQ_Element* TimingWheel::Top() {
+    if ( ready.Size() == 0 )
+        Refill();
+
+    return ready.Top();
+}
+
+PQ_Element* TimingWheel::Remove() {
+    if ( ! Top() )
+        return nullptr;
+
+    auto* e = ready.Remove();
+    e->SetSlot(-1);
+    return e;
+}
+
+PQ_Element* TimingWheel::Remove(PQ_Element* e) {
+    int slot = e->Slot();
+
+    if ( slot == READY_SLOT ) {
+        if ( ! ready.Remove(e) )
+            return nullptr;
+
+        e->SetSlot(-1);
+        return e;
+    }
+
+    if ( slot < 0 || slot >= static_cast<int>(slots.size()) )
+        return nullptr;
+
+    auto& v = slots[slot];
+    int offset = e->Offset();
+
+    if ( offset < 0 || offset >= static_cast<int>(v.size()) || v[offset] != e )
+        return nullptr;
+
+    v[offset] = v.back();
+    v[offset]->SetOffset(offset);
+    v.pop_back();
+    --num_in_slots;
+
+    if ( v.empty() ) {
+        int level = slot / SLOTS_PER_LEVEL;
+        int idx = slot % SLOTS_PER_LEVEL;
+        occupied[level][idx / 64] &= ~(uint64_t(1) << (idx % 64));
+    }
+
+    e->SetSlot(-1);
+    e->SetOffset(-1);
+    return e;
+}
+
+bool TimingWheel::Add(PQ_Element* e) {
+    Place(e);
+
+    ++cumulative_num;
+    peak_size = std::max(peak_size, Size());
+
+    return true;
+}
+
+} // namespace zeek::detail
+
+using zeek::detail::PQ_Element;
+using zeek::detail::PriorityQueue;
+using zeek::detail::TimingWheel;
+
+namespace {
+
+class TestElement : public PQ_Element {
+public:
+    explicit TestElement(double t, int arg_id = 0) : PQ_Element(t), id(arg_id) {}
+
+    int id;
+};
+
+} // namespace
+
+TEST_CASE("timing wheel") {
+    TimingWheel w;
+
+    CHECK(w.Top() == nullptr);
+    CHECK(w.Remove() == nullptr);
+
+    SUBCASE("order") {
+        double times[] = {1700000000.5, 1.0, 1700000000.004, 1700000000.001, 1700003600.0, 1700000010.0, 0.0};
+
+        for ( double t : times )
+            w.Add(new TestElement(t));
+
+        CHECK_EQ(w.Size(), 7);
+
+        std::vector<double> popped;
+        while ( auto* e = w.Remove() ) {
+            popped.push_back(e->Time());
+            delete e;
+        }
+
+        std::vector<double> expected = {0.0, 1.0, 1700000000.001, 1700000000.004, 1700000000.5, 1700000010.0,
+                                        1700003600.0};
+        CHECK_EQ(popped, expected);
+        CHECK_EQ(w.Size(), 0);
+        CHECK_EQ(w.PeakSize(), 7);
+    }
+
+    SUBCASE("add before top") {
+        // Elements earlier than what the wheel has moved on to still come
+        // out first.
+        w.Add(new TestElement(100.0));
+        CHECK_EQ(w.Top()->Time(), 100.0);
+
+        w.Add(new TestElement(50.0));
+        w.Add(new TestElement(100.005));
+        CHECK_EQ(w.Top()->Time(), 50.0);
+
+        for ( double t : {50.0, 100.0, 100.005} ) {
+            auto* e = w.Remove();
+            CHECK_EQ(e->Time(), t);
+            delete e;
+        }
+    }
+
+    SUBCASE("remove") {
+        auto* a = new TestElement(10.0);
+        auto* b = new TestElement(20.0);
+        auto* c = new TestElement(30.0);
+        w.Add(a);
+        w.Add(b);
+        w.Add(c);
+
+        CHECK(w.Remove(b) == b);
+        CHECK(w.Remove(b) == nullptr);
+        delete b;
+
+        // a is in the ready queue after this.
+        CHECK(w.Top() == a);
+        CHECK(w.Remove(a) == a);
+        delete a;
+
+        CHECK(w.Top() == c);
+        CHECK_EQ(w.Size(), 1);
+    }
+
+    SUBCASE("same as priority queue") {
+        std::mt19937_64 rng(42);
+        std::uniform_real_distribution<double> delay(0.0, 600.0);
+        PriorityQueue q;
+        // Pairs of elements with the same time, at the index of their id.
+        std::vector<std::pair<TestElement*, TestElement*>> live;
+        double now = 1700000000.0;
+
+        auto forget = [&](int id) {
+            live[id] = live.back();
+            live[id].first->id = id;
+            live[id].second->id = id;
+            live.pop_back();
+        };
+
+        for ( int i = 0; i < 20000; ++i ) {
+            if ( rng() % 3 != 0 || live.empty() ) {
+                double t = now + delay(rng);
+                int id = static_cast<int>(live.size());
+                auto* we = new TestElement(t, id);
+                auto* qe = new TestElement(t, id);
+                w.Add(we);
+                q.Add(qe);
+                live.emplace_back(we, qe);
+            }
+            else {
+                auto [we, qe] = live[rng() % live.size()];
+                forget(we->id);
+                CHECK(w.Remove(we) == we);
+                CHECK(q.Remove(qe) == qe);
+                delete we;
+                delete qe;
+            }
+
+            // Advance time and expire, as the timer manager does.
+            now += 0.05;
+
+            while ( w.Top() && w.Top()->Time() <= now ) {
+                REQUIRE(q.Top());
+                CHECK_EQ(w.Top()->Time(), q.Top()->Time());
+
+                auto* we = static_cast<TestElement*>(w.Remove());
+                auto* qe = static_cast<TestElement*>(q.Remove());
+
+                // Random times don't collide, so both yield the same pair.
+                CHECK_EQ(we->id, qe->id);
+                forget(we->id);
+
+                delete we;
+                delete qe;
+            }
+
+            CHECK_EQ(w.Size(), q.Size());
+        }
+    }
+}
+
+TEST_CASE("timing wheel benchmark" * doctest::skip(true)) {
+    // Run it with: zeek --test --test-case="timing wheel benchmark" --no-skip
+    //
+    // Mimics connection timers: each packet cancels its connection's
+    // inactivity timer and adds a new one, and most connections go away
+    // before their timer fires.
+    constexpr int num_conns = 1'000'000;
+    constexpr int num_packets = 20'000'000;
+    constexpr double inactivity_timeout = 300.0;
+
+    auto run = [&](auto& queue, const char* name) {
+        std::mt19937_64 rng(42);
+        std::vector<TestElement*> timers(num_conns, nullptr);
+        double now = 1700000000.0;
+        int expired = 0;
+
+        auto begin = std::chrono::steady_clock::now();
+
+        for ( int i = 0; i < num_packets; ++i ) {
+            now += 0.0001;
+            int c = static_cast<int>(rng() % num_conns);
+
+            if ( timers[c] ) {
+                queue.Remove(timers[c]);
+                delete timers[c];
+            }
+
+            timers[c] = new TestElement(now + inactivity_timeout, c);
+            queue.Add(timers[c]);
+
+            while ( queue.Top() && queue.Top()->Time() <= now ) {
+                auto* e = static_cast<TestElement*>(queue.Remove());
+                timers[e->id] = nullptr;
+                delete e;
+                ++expired;
+            }
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+        MESSAGE(name << ": " << ms << " ms, " << expired << " expired, peak " << queue.PeakSize());
+    };
+
+    {
+        PriorityQueue q;
+        run(q, "heap ");
+    }
+
+    {
+        TimingWheel w;
+        run(w, "wheel");
+    }
+}
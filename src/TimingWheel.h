@@ -0,0 +1,89 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "zeek/PriorityQueue.h"
+
+namespace zeek::detail {
+
+/**
+ * A hierarchical timing wheel, offering the same interface as
+ * PriorityQueue for time-ordered elements.
+ *
+ * Times map to ticks of a fixed resolution. The wheel has one level per
+ * byte of the 64-bit tick, each with a slot per value of that byte. An
+ * element goes into the level of the most significant byte in which its
+ * tick differs from the wheel's cursor, so adding and removing elements
+ * are constant-time. Taking the top element moves the cursor to the
+ * earliest non-empty slot, re-distributing that slot's elements to lower
+ * levels until a slot's worth of elements is due. Those move into a small
+ * PriorityQueue in one batch, which also yields the exact order within the
+ * slot. Elements with ticks up to the cursor's go straight there.
+ */
+class TimingWheel {
+public:
+    static constexpr double DEFAULT_RESOLUTION = 0.01;
+
+    /**
+     * Constructor.
+     *
+     * @param resolution The duration of a tick, in seconds.
+     */
+    explicit TimingWheel(double resolution = DEFAULT_RESOLUTION);
+    ~TimingWheel();
+
+    // Returns the element with the earliest time, or nil if the wheel is
+    // empty.
+    PQ_Element* Top();
+
+    // Removes (and returns) the element with the earliest time. Returns
+    // nil if the wheel is empty.
+    PQ_Element* Remove();
+
+    // Removes element e. Returns e, or nullptr if e wasn't in the wheel.
+    PQ_Element* Remove(PQ_Element* e);
+
+    // Adds a new element. Always succeeds; the return value mirrors
+    // PriorityQueue::Add().
+    bool Add(PQ_Element* e);
+
+    int Size() const { return ready.Size() + num_in_slots; }
+    int PeakSize() const { return peak_size; }
+    uint64_t CumulativeNum() const { return cumulative_num; }
+
+private:
+    static constexpr int BITS_PER_LEVEL = 8;
+    static constexpr int SLOTS_PER_LEVEL = 1 << BITS_PER_LEVEL;
+    static constexpr int NUM_LEVELS = 64 / BITS_PER_LEVEL;
+    static constexpr int WORDS_PER_LEVEL = SLOTS_PER_LEVEL / 64;
+
+    // Slot() value of elements in the ready queue.
+    static constexpr int READY_SLOT = -2;
+
+    uint64_t Tick(double t) const;
+    void Place(PQ_Element* e);
+    void Refill();
+
+    double ticks_per_second;
+    uint64_t cursor = 0;
+
+    std::vector<std::vector<PQ_Element*>> slots;
+    // One bit per non-empty slot.
+    std::array<std::array<uint64_t, WORDS_PER_LEVEL>, NUM_LEVELS> occupied = {};
+    int num_in_slots = 0;
+
+    // Elements with ticks up to the cursor.
+    PriorityQueue ready;
+
+    // Scratch space for redistributing a slot.
+    std::vector<PQ_Element*> cascade;
+
+    int peak_size = 0;
+    uint64_t cumulative_num = 0;
+};
+
+} // namespace zeek::detail
@@ -95,6 +95,13 @@ public:
 
     BifEnum::Tunnel::Type Type() const { return type; }
 
+    /**
+     * Returns the key of the flow carrying the tunnel. For tunnels directly
+     * over IP, such as IP-in-IP and GRE, that's just the endpoints'
+     * addresses. For tunnels over UDP, it matches the UDP connection's key.
+     */
+    zeek::detail::ConnKey FlowKey() const { return {src_addr, dst_addr, src_port, dst_port, proto, false}; }
+
     /**
      * Returns record value of type "EncapsulatingConn" representing the tunnel.
      */
@@ -184,6 +191,11 @@ public:
      */
     size_t Depth() const { return conns ? conns->size() : 0; }
 
+    /**
+     * Returns the outermost tunnel. The stack must not be empty.
+     */
+    const EncapsulatingConn& Outermost() const { return conns->front(); }
+
     /**
      * Return the tunnel type of the inner-most tunnel.
      */
@@ -12,6 +12,7 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
@@ -36,10 +37,12 @@
 #include "zeek/Reporter.h"
 #include "zeek/RunState.h"
 #include "zeek/Scope.h"
+#include "zeek/TableExpireIndex.h"
 #include "zeek/ZeekString.h"
 #include "zeek/broker/Data.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/broker/Store.h"
+#include "zeek/telemetry/Manager.h"
 #include "zeek/threading/formatters/detail/json.h"
 
 using namespace std;
@@ -1348,6 +1351,8 @@ unsigned int ListVal::ComputeFootprint(std::unordered_set<const Val*>* analyzed_
 TableEntryVal* TableEntryVal::Clone(Val::CloneState* state) {
     auto rval = new TableEntryVal(val ? val->Clone(state) : nullptr);
     rval->expire_access_time = expire_access_time;
+    rval->eviction_rank = eviction_rank;
+    rval->footprint = footprint;
     return rval;
 }
 
@@ -1529,6 +1534,36 @@ void detail::TablePatternMatcher::Build() {
         reporter->FatalError("failed compile set for disjunctive matching");
 }
 
+// State of a table with &max_size.
+class detail::TableSizeCap {
+public:
+    // The &max_size expression, and its value when last evaluated. We
+    // evaluate it once the attribute is set, and again whenever the table
+    // grows past that value, so that a raised cap takes effect.
+    ExprPtr max_size;
+    std::optional<zeek_uint_t> max_size_val;
+
+    int policy = BifEnum::TableEviction::TABLE_EVICT_LRU;
+
+    // Ticks with every use of an entry, for LRU eviction.
+    uint32_t use_clock = 0;
+
+    // Sum of the footprints of the entries, each measured when assigned.
+    // Walking aggregate values on every change to them would be too
+    // expensive, and the eviction doesn't need it as it counts entries.
+    uint64_t footprint = 0;
+
+    // Whether we're evicting entries at the moment.
+    bool evicting = false;
+
+    // Only present once the table has a metrics label.
+    std::optional<telemetry::IntGauge> footprint_gauge;
+    std::optional<telemetry::IntCounter> evictions;
+};
+
+// How many entries to sample when picking one to evict.
+static constexpr int EVICTION_SAMPLES = 8;
+
 TableVal::TableVal(TableTypePtr t, detail::AttributesPtr a) : Val(t) {
     bool ordered = (a != nullptr && a->Find(detail::ATTR_ORDERED) != nullptr);
     Init(std::move(t), ordered);
@@ -1575,6 +1610,9 @@ TableVal::~TableVal() {
     if ( timer )
         detail::timer_mgr->Cancel(timer);
 
+    if ( size_cap && size_cap->footprint_gauge )
+        size_cap->footprint_gauge->Dec(size_cap->footprint);
+
     delete table_val;
     delete expire_iterator;
 }
@@ -1582,6 +1620,17 @@ TableVal::~TableVal() {
 void TableVal::RemoveAll() {
     delete expire_iterator;
     expire_iterator = nullptr;
+
+    if ( expire_index )
+        expire_index->Clear();
+
+    if ( size_cap ) {
+        if ( size_cap->footprint_gauge )
+            size_cap->footprint_gauge->Dec(size_cap->footprint);
+
+        size_cap->footprint = 0;
+    }
+
     // Here we take the brute force approach.
     delete table_val;
     table_val = new PDict<TableEntryVal>;
@@ -1640,6 +1689,28 @@ void TableVal::SetAttrs(detail::AttributesPtr a) {
         broker_store = c->AsStringVal()->AsString()->CheckString();
         broker_mgr->AddForwardedStore(broker_store, {NewRef{}, this});
     }
+
+    const auto& ms = attrs->Find(detail::ATTR_MAX_SIZE);
+
+    if ( ms && ! size_cap ) {
+        size_cap = std::make_unique<detail::TableSizeCap>();
+        size_cap->max_size = ms->GetExpr();
+        UpdateMaxSize();
+
+        if ( const auto& ev = attrs->Find(detail::ATTR_EVICTION) ) {
+            auto p = ev->GetExpr()->Eval(nullptr);
+
+            if ( p && same_type(p->GetType(), BifType::Enum::TableEviction) )
+                size_cap->policy = p->AsEnum();
+            else
+                ev->GetExpr()->Error("&eviction must take a TableEviction argument");
+        }
+
+        for ( const auto& tble : *table_val ) {
+            auto k = tble.GetHashKey();
+            AccountEntry(*k, nullptr, tble.value);
+        }
+    }
 }
 
 void TableVal::CheckExpireAttr(detail::AttrTag at) {
@@ -1708,6 +1779,26 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k, ValPtr n
     if ( old_entry_val && attrs && attrs->Find(detail::ATTR_EXPIRE_CREATE) )
         new_entry_val->SetExpireAccess(old_entry_val->ExpireAccessTime());
 
+    if ( size_cap ) {
+        if ( old_entry_val ) {
+            new_entry_val->eviction_rank = old_entry_val->eviction_rank;
+            UnaccountEntry(old_entry_val);
+        }
+
+        AccountEntry(k_copy, index.get(), new_entry_val);
+        NoteCappedUse(new_entry_val);
+    }
+
+    if ( expire_index ) {
+        // A replaced entry's spot in the index works for the new one as
+        // long as it isn't later than the new access time.
+        if ( old_entry_val && old_entry_val->indexed_access_time != TableEntryVal::NOT_INDEXED &&
+             old_entry_val->indexed_access_time <= new_entry_val->expire_access_time )
+            new_entry_val->indexed_access_time = old_entry_val->indexed_access_time;
+        else
+            IndexForExpiration(k_copy, new_entry_val);
+    }
+
     Modified();
 
     if ( change_func || (broker_forward && ! broker_store.empty()) ) {
@@ -1722,8 +1813,12 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k, ValPtr n
         }
     }
 
+    bool added = ! old_entry_val;
     delete old_entry_val;
 
+    if ( size_cap && added )
+        EnforceMaxSize(k_copy);
+
     return true;
 }
 
@@ -1952,6 +2047,8 @@ const ValPtr& TableVal::Find(const ValPtr& index) {
             if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
                 v->SetExpireAccess(run_state::network_time);
 
+            NoteUse(v);
+
             if ( v->GetVal() )
                 return v->GetVal();
 
@@ -1971,6 +2068,8 @@ const ValPtr& TableVal::Find(const ValPtr& index) {
                 if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
                     v->SetExpireAccess(run_state::network_time);
 
+                NoteUse(v);
+
                 if ( v->GetVal() )
                     return v->GetVal();
 
@@ -2238,8 +2337,10 @@ ValPtr TableVal::Remove(const Val& index, bool broker_forward, bool* iterators_i
     TableEntryVal* v = k ? table_val->RemoveEntry(k.get(), iterators_invalidated) : nullptr;
     ValPtr va;
 
-    if ( v )
+    if ( v ) {
         va = v->GetVal() ? v->GetVal() : IntrusivePtr{NewRef{}, this};
+        UnaccountEntry(v);
+    }
 
     if ( subnets && ! subnets->Remove(&index) )
         // VP: not clear to me this should be an internal warning,
@@ -2270,8 +2371,10 @@ ValPtr TableVal::Remove(const detail::HashKey& k, bool* iterators_invalidated) {
     TableEntryVal* v = table_val->RemoveEntry(k, iterators_invalidated);
     ValPtr va;
 
-    if ( v )
+    if ( v ) {
         va = v->GetVal() ? v->GetVal() : IntrusivePtr{NewRef{}, this};
+        UnaccountEntry(v);
+    }
 
     if ( subnets ) {
         auto index = GetTableHash()->RecoverVals(k);
@@ -2492,6 +2595,11 @@ void TableVal::DoExpire(double t) {
         // error, it has been reported already.
         return;
 
+    if ( zeek::detail::table_expire_index ) {
+        DoExpireIndexed(t, timeout);
+        return;
+    }
+
     if ( ! expire_iterator ) {
         auto it = table_val->begin_robust();
         expire_iterator = new RobustDictIterator(std::move(it));
@@ -2513,63 +2621,345 @@ void TableVal::DoExpire(double t) {
 
         else if ( v->ExpireAccessTime() + timeout < t ) {
             auto k = (*expire_iterator)->GetHashKey();
-            ListValPtr idx = nullptr;
+            ExpireEntry(*k, v, timeout, &modified);
 
-            if ( expire_func ) {
-                idx = RecreateIndex(*k);
-                double secs = CallExpireFunc(idx);
+            if ( ! expire_iterator )
+                // Entire table got dropped (e.g. clear_table() / RemoveAll())
+                break;
+        }
+    }
 
-                // It's possible that the user-provided
-                // function modified or deleted the table
-                // value, so look it up again.
-                v = table_val->Lookup(k.get());
+    if ( modified )
+        Modified();
 
-                if ( ! v ) { // user-provided function deleted it
-                    if ( ! expire_iterator )
-                        // Entire table got dropped (e.g. clear_table() / RemoveAll())
-                        break;
+    if ( ! expire_iterator || (*expire_iterator) == table_val->end_robust() ) {
+        delete expire_iterator;
+        expire_iterator = nullptr;
+        InitTimer(zeek::detail::table_expire_interval);
+    }
+    else
+        InitTimer(zeek::detail::table_expire_delay);
+}
 
-                    continue;
-                }
+void TableVal::DoExpireIndexed(double t, double timeout) {
+    if ( ! expire_index ) {
+        // Start out with what the table holds already. Entries added from
+        // now on get filed as they come in.
+        expire_index = std::make_unique<detail::TableExpireIndex>();
 
-                if ( secs > 0 ) {
-                    // User doesn't want us to expire
-                    // this now.
-                    v->SetExpireAccess(run_state::network_time - timeout + secs);
-                    continue;
-                }
-            }
+        for ( const auto& tble : *table_val ) {
+            auto k = tble.GetHashKey();
+            IndexForExpiration(*k, tble.value);
+        }
+    }
 
-            if ( subnets ) {
-                if ( ! idx )
-                    idx = RecreateIndex(*k);
-                if ( ! subnets->Remove(idx.get()) )
-                    reporter->InternalWarning("index not in prefix table");
-            }
+    bool modified = false;
 
-            table_val->RemoveEntry(k.get());
-            if ( change_func ) {
-                if ( ! idx )
-                    idx = RecreateIndex(*k);
+    for ( int i = 0; i < zeek::detail::table_incremental_step && ! expire_index->Empty(); ++i ) {
+        int access_time = expire_index->NextAccessTime();
+        double bucket_time = run_state::zeek_start_network_time + access_time;
 
-                CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
-            }
+        // A zero access time means network time wasn't initialized yet
+        // when the entries got inserted, as in DoExpire().
+        if ( bucket_time == 0 || bucket_time + timeout >= t )
+            break;
+
+        auto k = expire_index->Pop();
+        auto v = table_val->Lookup(k.get());
+
+        // Skip keys of entries that are gone, or have been filed again
+        // under a later access time.
+        if ( ! v || v->indexed_access_time != access_time )
+            continue;
 
-            delete v;
-            modified = true;
+        // Entries accessed after getting filed move to their new time.
+        if ( v->expire_access_time != access_time ) {
+            IndexForExpiration(*k, v);
+            continue;
         }
+
+        if ( (v = ExpireEntry(*k, v, timeout, &modified)) )
+            IndexForExpiration(*k, v);
     }
 
     if ( modified )
         Modified();
 
-    if ( ! expire_iterator || (*expire_iterator) == table_val->end_robust() ) {
-        delete expire_iterator;
-        expire_iterator = nullptr;
-        InitTimer(zeek::detail::table_expire_interval);
+    // Come back when the next entry is due, but check at least every
+    // table_expire_interval in case the expiration interval changes.
+    double delay = zeek::detail::table_expire_interval;
+
+    if ( ! expire_index->Empty() ) {
+        double due = run_state::zeek_start_network_time + expire_index->NextAccessTime() + timeout - t;
+        delay = std::clamp(due, zeek::detail::table_expire_delay, delay);
+    }
+
+    InitTimer(delay);
+}
+
+TableEntryVal* TableVal::ExpireEntry(const detail::HashKey& k, TableEntryVal* v, double timeout, bool* modified) {
+    ListValPtr idx = nullptr;
+
+    if ( expire_func ) {
+        idx = RecreateIndex(k);
+        double secs = CallExpireFunc(idx);
+
+        // It's possible that the user-provided
+        // function modified or deleted the table
+        // value, so look it up again.
+        v = table_val->Lookup(&k);
+
+        if ( ! v ) // user-provided function deleted it
+            return nullptr;
+
+        if ( secs > 0 ) {
+            // User doesn't want us to expire
+            // this now.
+            v->SetExpireAccess(run_state::network_time - timeout + secs);
+            return v;
+        }
+    }
+
+    if ( subnets ) {
+        if ( ! idx )
+            idx = RecreateIndex(k);
+        if ( ! subnets->Remove(idx.get()) )
+            reporter->InternalWarning("index not in prefix table");
+    }
+
+    table_val->RemoveEntry(k);
+    UnaccountEntry(v);
+
+    if ( change_func ) {
+        if ( ! idx )
+            idx = RecreateIndex(k);
+
+        CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
+    }
+
+    delete v;
+    *modified = true;
+    return nullptr;
+}
+
+void TableVal::IndexForExpiration(const detail::HashKey& k, TableEntryVal* v) {
+    v->indexed_access_time = v->expire_access_time;
+    expire_index->Add(v->expire_access_time, k);
+}
+
+void TableVal::SetMetricsLabel(const std::string& label) {
+    if ( ! size_cap || size_cap->footprint_gauge )
+        return;
+
+    static auto footprint_family =
+        telemetry_mgr->GaugeFamily("zeek", "table-footprint", {"table"},
+                                   "Footprint of tables with &max_size, in the units of val_footprint(), "
+                                   "with each entry measured when assigned");
+    static auto evictions_family =
+        telemetry_mgr->CounterFamily("zeek", "table-evictions", {"table"},
+                                     "Number of entries evicted from tables with &max_size", "1", true);
+
+    size_cap->footprint_gauge = footprint_family.GetOrAdd({{"table", label}});
+    size_cap->footprint_gauge->Inc(size_cap->footprint);
+    size_cap->evictions = evictions_family.GetOrAdd({{"table", label}});
+}
+
+uint64_t TableVal::AccountedFootprint() const { return size_cap ? size_cap->footprint : 0; }
+
+void TableVal::NoteCappedUse(TableEntryVal* v) {
+    if ( size_cap->policy == BifEnum::TableEviction::TABLE_EVICT_LFU ) {
+        if ( v->eviction_rank < std::numeric_limits<uint32_t>::max() )
+            ++v->eviction_rank;
     }
+
+    else if ( size_cap->policy == BifEnum::TableEviction::TABLE_EVICT_LRU )
+        v->eviction_rank = ++size_cap->use_clock;
+}
+
+void TableVal::AccountEntry(const detail::HashKey& k, const Val* index, TableEntryVal* v) {
+    if ( ! size_cap )
+        return;
+
+    // As in ComputeFootprint(), the entry itself counts once, plus its
+    // list of index values and its value.
+    unsigned int fp = 1;
+
+    if ( ! index )
+        fp += RecreateIndex(k)->Footprint();
+    else if ( index->GetType()->Tag() == TYPE_LIST )
+        fp += index->Footprint();
     else
-        InitTimer(zeek::detail::table_expire_delay);
+        fp += 1 + index->Footprint();
+
+    if ( v->GetVal() )
+        fp += v->GetVal()->Footprint();
+
+    v->footprint = fp;
+    size_cap->footprint += fp;
+
+    if ( size_cap->footprint_gauge )
+        size_cap->footprint_gauge->Inc(fp);
+}
+
+void TableVal::UnaccountEntry(const TableEntryVal* v) {
+    if ( ! size_cap )
+        return;
+
+    size_cap->footprint -= v->footprint;
+
+    if ( size_cap->footprint_gauge )
+        size_cap->footprint_gauge->Dec(v->footprint);
+}
+
+bool TableVal::UpdateMaxSize() {
+    ValPtr v;
+
+    try {
+        v = size_cap->max_size->Eval(nullptr);
+    } catch ( InterpreterException& e ) {
+    }
+
+    if ( ! v )
+        return false;
+
+    size_cap->max_size_val = v->AsCount();
+    return true;
+}
+
+void TableVal::EnforceMaxSize(const detail::HashKey& spare) {
+    // Evicting calls &expire_func and &on_change, which may add entries
+    // in turn. We leave those to the outermost call.
+    if ( size_cap->evicting )
+        return;
+
+    auto size = [this]() { return static_cast<zeek_uint_t>(table_val->Length()); };
+
+    // Below the cap as last evaluated, there's nothing to do.
+    if ( size_cap->max_size_val && size() <= *size_cap->max_size_val )
+        return;
+
+    if ( ! UpdateMaxSize() )
+        return;
+
+    zeek_uint_t max_size = *size_cap->max_size_val;
+
+    if ( size() <= max_size )
+        return;
+
+    size_cap->evicting = true;
+
+    // Handlers that keep adding entries could keep us here forever, so
+    // we evict no more entries than the table held in excess to begin
+    // with. Later additions take care of any remainder.
+    bool evicted = false;
+
+    for ( auto excess = size() - max_size; excess > 0 && size() > max_size; --excess ) {
+        auto k = PickEvictionVictim(spare);
+
+        if ( ! k )
+            break;
+
+        EvictEntry(*k);
+        evicted = true;
+    }
+
+    size_cap->evicting = false;
+
+    if ( evicted )
+        Modified();
+}
+
+std::unique_ptr<detail::HashKey> TableVal::PickEvictionVictim(const detail::HashKey& spare) {
+    bool random = size_cap->policy == BifEnum::TableEviction::TABLE_EVICT_RANDOM;
+    const detail::DictEntry<TableEntryVal>* victim = nullptr;
+    uint32_t victim_score = 0;
+
+    // Returns true once there's no point in looking further.
+    auto consider = [&](const detail::DictEntry<TableEntryVal>& e) {
+        if ( e.Equal(static_cast<const char*>(spare.Key()), spare.Size(), spare.Hash()) )
+            return false;
+
+        if ( random ) {
+            victim = &e;
+            return true;
+        }
+
+        // Higher scores make for better victims. For LRU, the score is
+        // the entry's age, which stays meaningful when the clock wraps.
+        uint32_t score;
+
+        if ( size_cap->policy == BifEnum::TableEviction::TABLE_EVICT_LFU )
+            score = std::numeric_limits<uint32_t>::max() - e.value->eviction_rank;
+        else
+            score = size_cap->use_clock - e.value->eviction_rank;
+
+        if ( ! victim || score > victim_score ) {
+            victim = &e;
+            victim_score = score;
+        }
+
+        return false;
+    };
+
+    // We scan small tables completely. For larger ones, rather than keeping
+    // the entries ordered by their rank, we sample a few and pick the best
+    // candidate among those. That approximates the policy well, and costs
+    // nothing as long as the table stays below its cap.
+    if ( ! random && table_val->Length() <= EVICTION_SAMPLES ) {
+        for ( const auto& e : *table_val )
+            consider(e);
+    }
+    else {
+        for ( int i = 0; i < EVICTION_SAMPLES; ++i ) {
+            auto e = table_val->EntryNear(util::detail::random_number());
+
+            if ( ! e || consider(*e) )
+                break;
+        }
+    }
+
+    return victim ? victim->GetHashKey() : nullptr;
+}
+
+void TableVal::EvictEntry(const detail::HashKey& k) {
+    ListValPtr idx = nullptr;
+
+    // Unlike for expiration, &expire_func's return value doesn't matter:
+    // the entry goes regardless.
+    if ( expire_func ) {
+        idx = RecreateIndex(k);
+        CallExpireFunc(idx);
+    }
+
+    // The function may have removed the entry already.
+    auto v = table_val->RemoveEntry(k);
+
+    if ( ! v )
+        return;
+
+    if ( subnets ) {
+        if ( ! idx )
+            idx = RecreateIndex(k);
+        if ( ! subnets->Remove(idx.get()) )
+            reporter->InternalWarning("index not in prefix table");
+    }
+
+    if ( pattern_matcher )
+        pattern_matcher->Clear();
+
+    UnaccountEntry(v);
+
+    if ( size_cap->evictions )
+        size_cap->evictions->Inc();
+
+    if ( change_func ) {
+        if ( ! idx )
+            idx = RecreateIndex(k);
+
+        CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
+    }
+
+    delete v;
 }
 
 double TableVal::GetExpireTime() {
@@ -2698,6 +3088,15 @@ ValPtr TableVal::DoClone(CloneState* state) {
     if ( expire_func )
         tv->expire_func = expire_func;
 
+    if ( size_cap ) {
+        tv->size_cap = std::make_unique<detail::TableSizeCap>();
+        tv->size_cap->max_size = size_cap->max_size;
+        tv->size_cap->max_size_val = size_cap->max_size_val;
+        tv->size_cap->policy = size_cap->policy;
+        tv->size_cap->use_clock = size_cap->use_clock;
+        tv->size_cap->footprint = size_cap->footprint;
+    }
+
     if ( def_val )
         tv->def_val = def_val->Clone();
 
@@ -2786,12 +3185,13 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(t), is_managed(t->
     if ( run_state::is_parsing )
         parse_time_records[rt.get()].emplace_back(NewRef{}, this);
 
-    if ( init_fields ) {
-        record_val.resize(n);
+    InitFields(n);
 
+    if ( init_fields ) {
         for ( auto& e : rt->CreationInits() ) {
             try {
                 record_val[e.first] = e.second->Generate();
+                SetPresent(e.first);
             } catch ( InterpreterException& e ) {
                 if ( run_state::is_parsing )
                     parse_time_records[rt.get()].pop_back();
@@ -2800,24 +3200,37 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(t), is_managed(t->
         }
     }
 
-    else
-        record_val.reserve(n);
+    else {
+        // Fields will be appended, so start out empty.
+        InitFields(0);
+        record_val.reserve(n + PresenceWords(n));
+    }
 }
 
-RecordVal::RecordVal(RecordTypePtr t, std::vector<std::optional<ZVal>> init_vals)
+RecordVal::RecordVal(RecordTypePtr t, const std::vector<std::optional<ZVal>>& init_vals)
     : Val(t), is_managed(t->ManagedFields()) {
     rt = std::move(t);
-    record_val = std::move(init_vals);
+
+    unsigned int n = init_vals.size();
+    InitFields(n);
+
+    for ( unsigned int i = 0; i < n; ++i )
+        if ( init_vals[i] ) {
+            record_val[i] = *init_vals[i];
+            SetPresent(i);
+        }
 }
 
 RecordVal::~RecordVal() {
-    auto n = record_val.size();
+    for ( unsigned int i = 0; i < num_fields; ++i )
+        DeleteFieldIfManaged(i);
 
-    for ( unsigned int i = 0; i < n; ++i ) {
-        auto f_i = record_val[i];
-        if ( f_i && IsManaged(i) )
-            ZVal::DeleteManagedType(*f_i);
-    }
+    delete index_key;
+}
+
+void RecordVal::DeleteIndexKey() {
+    delete index_key;
+    index_key = nullptr;
 }
 
 ValPtr RecordVal::SizeVal() const { return val_mgr->Count(GetType()->AsRecordType()->NumFields()); }
@@ -2828,24 +3241,35 @@ void RecordVal::Assign(int field, ValPtr new_val) {
 
         auto t = rt->GetFieldType(field);
         record_val[field] = ZVal(new_val, t);
-        Modified();
+        AddedField(field);
     }
     else
         Remove(field);
 }
 
 void RecordVal::Remove(int field) {
-    auto& f_i = record_val[field];
-    if ( f_i ) {
-        if ( IsManaged(field) )
-            ZVal::DeleteManagedType(*f_i);
-
-        f_i = std::nullopt;
-
+    if ( IsPresent(field) ) {
+        DeleteFieldIfManaged(field);
+        ClearPresent(field);
+        InvalidateIndexKey();
         Modified();
     }
 }
 
+void RecordVal::AppendField(ValPtr v, const TypePtr& t) {
+    auto field = num_fields++;
+
+    // The presence bitmap follows the fields, so make room for another
+    // word if needed, and then slide it over by one.
+    if ( field % 64 == 0 )
+        record_val.emplace_back(zeek_uint_t(0));
+
+    record_val.emplace(record_val.begin() + field, v ? ZVal(v, t) : ZVal());
+
+    if ( v )
+        SetPresent(field);
+}
+
 ValPtr RecordVal::GetFieldOrDefault(int field) const {
     auto val = GetField(field);
 
@@ -2955,7 +3379,7 @@ RecordValPtr RecordVal::CoerceTo(RecordTypePtr t, bool allow_orphaning) {
 TableValPtr RecordVal::GetRecordFieldsVal() const { return GetType()->AsRecordType()->GetRecordFieldsVal(this); }
 
 void RecordVal::Describe(ODesc* d) const {
-    auto n = record_val.size();
+    auto n = num_fields;
 
     if ( d->IsBinary() ) {
         rt->Describe(d);
@@ -2988,7 +3412,7 @@ void RecordVal::Describe(ODesc* d) const {
 }
 
 void RecordVal::DescribeReST(ODesc* d) const {
-    auto n = record_val.size();
+    auto n = num_fields;
     auto rt = GetType()->AsRecordType();
 
     d->Add("{");
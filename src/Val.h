@@ -4,6 +4,7 @@
 
 #include <sys/types.h> // for u_char
 #include <array>
+#include <limits>
 #include <list>
 #include <unordered_map>
 #include <variant>
@@ -14,6 +15,7 @@
 #include "zeek/Reporter.h"
 #include "zeek/Timer.h"
 #include "zeek/Type.h"
+#include "zeek/ValPool.h"
 #include "zeek/ZVal.h"
 #include "zeek/net_util.h"
 
@@ -50,7 +52,9 @@ class ScriptFunc;
 class Frame;
 class PrefixTable;
 class HashKey;
+class TableExpireIndex;
 class TablePatternMatcher;
+class TableSizeCap;
 
 struct DFA_State_Cache_Stats;
 
@@ -107,6 +111,12 @@ class Val : public Obj {
 public:
     static inline const ValPtr nil;
 
+#ifdef POOL_VAL_ALLOCATIONS
+    // Values come from a pool that recycles their memory, see ValPool.
+    static void* operator new(size_t size) { return detail::ValPool::Local().Allocate(size); }
+    static void operator delete(void* p, size_t size) { detail::ValPool::Local().Free(p, size); }
+#endif
+
     ~Val() override;
 
     Val* Ref() {
@@ -705,6 +715,19 @@ protected:
     // to save a few bytes, as we do not need a high resolution for these
     // anyway.
     int expire_access_time;
+
+    // The access time under which the entry is filed in the table's
+    // expiration index, if any.
+    static constexpr int NOT_INDEXED = std::numeric_limits<int>::min();
+    int indexed_access_time = NOT_INDEXED;
+
+    // For tables with &max_size: when the entry was last used, in ticks
+    // of the table's use clock (LRU), or how often it got used (LFU).
+    uint32_t eviction_rank = 0;
+
+    // For tables with &max_size: the footprint accounted for the entry,
+    // as of its assignment.
+    uint32_t footprint = 0;
 };
 
 class TableValTimer final : public detail::Timer {
@@ -988,6 +1011,24 @@ public:
      */
     void SetBrokerStore(const std::string& store) { broker_store = store; }
 
+    /**
+     * Sets the label of the telemetry metrics that a table with &max_size
+     * reports, usually the name of the global holding it. Tables without
+     * &max_size report no metrics, and labeling them does nothing.
+     * @param label  the value of the metrics' "table" label.
+     */
+    void SetMetricsLabel(const std::string& label);
+
+    /**
+     * For tables with &max_size, returns the sum of the footprints of the
+     * entries, each as of when it got assigned. This tracks the table's
+     * Footprint() without walking it, but doesn't reflect later changes
+     * to aggregate values held in the table, such as adding to a set
+     * stored in it, until their entry gets assigned again. Eviction counts
+     * entries and doesn't use this. Returns 0 for other tables.
+     */
+    uint64_t AccountedFootprint() const;
+
     /**
      * Disable change notification processing of &on_change until re-enabled.
      */
@@ -1028,6 +1069,17 @@ protected:
     // Calls &expire_func and returns its return interval;
     double CallExpireFunc(ListValPtr idx);
 
+    // Expires the given entry, unless &expire_func asks to keep it
+    // around. Returns the entry if it's still in the table afterwards.
+    TableEntryVal* ExpireEntry(const detail::HashKey& k, TableEntryVal* v, double timeout, bool* modified);
+
+    // Expires due entries by way of the expiration index rather than by
+    // scanning the table, when table_expire_index is set.
+    void DoExpireIndexed(double t, double timeout);
+
+    // Files an entry in the expiration index under its access time.
+    void IndexForExpiration(const detail::HashKey& k, TableEntryVal* v);
+
     // Enum for the different kinds of changes an &on_change handler can see
     enum OnChangeType { ELEMENT_NEW, ELEMENT_CHANGED, ELEMENT_REMOVED, ELEMENT_EXPIRED };
 
@@ -1037,6 +1089,36 @@ protected:
     // Sends data on to backing Broker Store
     void SendToStore(const Val* index, const TableEntryVal* new_entry_val, OnChangeType tpe);
 
+    // For tables with &max_size, updates the entry's eviction rank upon
+    // its use.
+    void NoteUse(TableEntryVal* v) {
+        if ( size_cap )
+            NoteCappedUse(v);
+    }
+    void NoteCappedUse(TableEntryVal* v);
+
+    // For tables with &max_size, adds a new entry's footprint to the
+    // table's, or removes a departing entry's.
+    void AccountEntry(const detail::HashKey& k, const Val* index, TableEntryVal* v);
+    void UnaccountEntry(const TableEntryVal* v);
+
+    // Evaluates the &max_size expression, caching its value. Returns
+    // false if it couldn't be evaluated.
+    bool UpdateMaxSize();
+
+    // Evicts entries while the table holds more than &max_size of them,
+    // sparing the given one, which just got added.
+    void EnforceMaxSize(const detail::HashKey& spare);
+
+    // Samples entries and returns the key of the one the eviction policy
+    // favors, other than the given one. Returns nil if there's no such
+    // entry.
+    std::unique_ptr<detail::HashKey> PickEvictionVictim(const detail::HashKey& spare);
+
+    // Removes an entry to enforce &max_size, letting &expire_func and
+    // &on_change know about it as for expiring entries.
+    void EvictEntry(const detail::HashKey& k);
+
     unsigned int ComputeFootprint(std::unordered_set<const Val*>* analyzed_vals) const override;
 
     ValPtr DoClone(CloneState* state) override;
@@ -1047,8 +1129,10 @@ protected:
     detail::ExprPtr expire_func;
     TableValTimer* timer;
     RobustDictIterator<TableEntryVal>* expire_iterator;
+    std::unique_ptr<detail::TableExpireIndex> expire_index;
     std::unique_ptr<detail::PrefixTable> subnets;
     std::unique_ptr<detail::TablePatternMatcher> pattern_matcher;
+    std::unique_ptr<detail::TableSizeCap> size_cap;
     ValPtr def_val;
     detail::ExprPtr change_func;
     std::string broker_store;
@@ -1152,8 +1236,8 @@ public:
 
     void Assign(int field, StringVal* new_val) {
         auto& fv = record_val[field];
-        if ( fv )
-            ZVal::DeleteManagedType(*fv);
+        if ( IsPresent(field) )
+            ZVal::DeleteManagedType(fv);
         fv = ZVal(new_val);
         AddedField(field);
     }
@@ -1177,7 +1261,7 @@ public:
      * Returns the number of fields in the record.
      * @return  The number of fields in the record.
      */
-    unsigned int NumFields() const { return record_val.size(); }
+    unsigned int NumFields() const { return num_fields; }
 
     /**
      * Returns true if the given field is in the record, false if
@@ -1186,7 +1270,7 @@ public:
      * @return  Whether there's a value for the given field index.
      */
     bool HasField(int field) const {
-        if ( record_val[field] )
+        if ( IsPresent(field) )
             return true;
 
         return rt->DeferredInits()[field] != nullptr;
@@ -1210,15 +1294,16 @@ public:
      */
     ValPtr GetField(int field) const {
         auto& fv = record_val[field];
-        if ( ! fv ) {
+        if ( ! IsPresent(field) ) {
             const auto& fi = rt->DeferredInits()[field];
             if ( ! fi )
                 return nullptr;
 
             fv = fi->Generate();
+            SetPresent(field);
         }
 
-        return fv->ToVal(rt->GetFieldType(field));
+        return fv.ToVal(rt->GetFieldType(field));
     }
 
     /**
@@ -1291,32 +1376,32 @@ public:
     template<typename T, typename std::enable_if_t<is_zeek_val_v<T>, bool> = true>
     auto GetFieldAs(int field) const -> std::invoke_result_t<decltype(&T::Get), T> {
         if constexpr ( std::is_same_v<T, BoolVal> || std::is_same_v<T, IntVal> || std::is_same_v<T, EnumVal> )
-            return record_val[field]->int_val;
+            return record_val[field].int_val;
         else if constexpr ( std::is_same_v<T, CountVal> )
-            return record_val[field]->uint_val;
+            return record_val[field].uint_val;
         else if constexpr ( std::is_same_v<T, DoubleVal> || std::is_same_v<T, TimeVal> ||
                             std::is_same_v<T, IntervalVal> )
-            return record_val[field]->double_val;
+            return record_val[field].double_val;
         else if constexpr ( std::is_same_v<T, PortVal> )
-            return val_mgr->Port(record_val[field]->uint_val);
+            return val_mgr->Port(record_val[field].uint_val);
         else if constexpr ( std::is_same_v<T, StringVal> )
-            return record_val[field]->string_val->Get();
+            return record_val[field].string_val->Get();
         else if constexpr ( std::is_same_v<T, AddrVal> )
-            return record_val[field]->addr_val->Get();
+            return record_val[field].addr_val->Get();
         else if constexpr ( std::is_same_v<T, SubNetVal> )
-            return record_val[field]->subnet_val->Get();
+            return record_val[field].subnet_val->Get();
         else if constexpr ( std::is_same_v<T, File> )
-            return *(record_val[field]->file_val);
+            return *(record_val[field].file_val);
         else if constexpr ( std::is_same_v<T, Func> )
-            return *(record_val[field]->func_val);
+            return *(record_val[field].func_val);
         else if constexpr ( std::is_same_v<T, PatternVal> )
-            return record_val[field]->re_val->Get();
+            return record_val[field].re_val->Get();
         else if constexpr ( std::is_same_v<T, RecordVal> )
-            return record_val[field]->record_val;
+            return record_val[field].record_val;
         else if constexpr ( std::is_same_v<T, VectorVal> )
-            return record_val[field]->vector_val;
+            return record_val[field].vector_val;
         else if constexpr ( std::is_same_v<T, TableVal> )
-            return record_val[field]->table_val->Get();
+            return record_val[field].table_val->Get();
         else {
             // It's an error to reach here, although because of
             // the type trait we really shouldn't ever wind up
@@ -1328,11 +1413,11 @@ public:
     template<typename T, typename std::enable_if_t<! is_zeek_val_v<T>, bool> = true>
     T GetFieldAs(int field) const {
         if constexpr ( std::is_integral_v<T> && std::is_signed_v<T> )
-            return record_val[field]->int_val;
+            return record_val[field].int_val;
         else if constexpr ( std::is_integral_v<T> && std::is_unsigned_v<T> )
-            return record_val[field]->uint_val;
+            return record_val[field].uint_val;
         else if constexpr ( std::is_floating_point_v<T> )
-            return record_val[field]->double_val;
+            return record_val[field].double_val;
 
         // Note: we could add other types here using type traits,
         // such as is_same_v<T, std::string>, etc.
@@ -1394,7 +1479,7 @@ protected:
 
     // Constructor for use by script optimization, directly initializing
     // record_vals from the second argument.
-    RecordVal(RecordTypePtr t, std::vector<std::optional<ZVal>> init_vals);
+    RecordVal(RecordTypePtr t, const std::vector<std::optional<ZVal>>& init_vals);
 
     RecordValPtr DoCoerceTo(RecordTypePtr other, bool allow_orphaning) const;
 
@@ -1407,38 +1492,52 @@ protected:
      * @param v  The value to append.
      * @param t  The type associated with the field.
      */
-    void AppendField(ValPtr v, const TypePtr& t) {
-        if ( v )
-            record_val.emplace_back(ZVal(v, t));
-        else
-            record_val.emplace_back(std::nullopt);
-    }
+    void AppendField(ValPtr v, const TypePtr& t);
 
     // For internal use by low-level ZAM instructions and event tracing.
     // Caller assumes responsibility for memory management.  The first
-    // version allows manipulation of whether the field is present at all.
-    // The second version ensures that the optional value is present.
-    std::optional<ZVal>& RawOptField(int field) {
-        auto& f = record_val[field];
-        if ( ! f ) {
+    // version returns nil if the field isn't present.  The second version
+    // ensures that the field is present.
+    ZVal* RawOptField(int field) {
+        if ( ! IsPresent(field) ) {
             const auto& fi = rt->DeferredInits()[field];
-            if ( fi )
-                f = fi->Generate();
+            if ( ! fi )
+                return nullptr;
+
+            record_val[field] = fi->Generate();
+            SetPresent(field);
         }
 
-        return f;
+        return &record_val[field];
     }
 
     ZVal& RawField(int field) {
-        auto& f = RawOptField(field);
-        if ( ! f )
-            f = ZVal();
-        return *f;
+        InvalidateIndexKey();
+
+        if ( ! RawOptField(field) ) {
+            record_val[field] = ZVal();
+            SetPresent(field);
+        }
+
+        return record_val[field];
     }
 
     ValPtr DoClone(CloneState* state) override;
 
-    void AddedField(int field) { Modified(); }
+    void AddedField(int field) {
+        SetPresent(field);
+        InvalidateIndexKey();
+        Modified();
+    }
+
+    // Discards the hash key that CompositeHash cached for the record
+    // being used as a table index, as it might no longer match.
+    void InvalidateIndexKey() {
+        if ( index_key )
+            DeleteIndexKey();
+    }
+
+    void DeleteIndexKey();
 
     Obj* origin = nullptr;
 
@@ -1447,13 +1546,29 @@ protected:
 
 private:
     void DeleteFieldIfManaged(unsigned int field) {
-        auto& f = record_val[field];
-        if ( f && IsManaged(field) )
-            ZVal::DeleteManagedType(*f);
+        if ( IsPresent(field) && IsManaged(field) )
+            ZVal::DeleteManagedType(record_val[field]);
     }
 
     bool IsManaged(unsigned int offset) const { return is_managed[offset]; }
 
+    // Number of ZVal-sized words needed for the presence bitmap of a
+    // record with n fields.
+    static unsigned int PresenceWords(unsigned int n) { return (n + 63) / 64; }
+
+    // Sizes the record for n fields, none of them present.
+    void InitFields(unsigned int n) {
+        num_fields = n;
+        record_val.assign(n + PresenceWords(n), ZVal(zeek_uint_t(0)));
+    }
+
+    zeek_uint_t& PresenceWord(unsigned int field) const { return record_val[num_fields + field / 64].uint_val; }
+    static zeek_uint_t PresenceBit(unsigned int field) { return zeek_uint_t(1) << (field % 64); }
+
+    bool IsPresent(unsigned int field) const { return PresenceWord(field) & PresenceBit(field); }
+    void SetPresent(unsigned int field) const { PresenceWord(field) |= PresenceBit(field); }
+    void ClearPresent(unsigned int field) { PresenceWord(field) &= ~PresenceBit(field); }
+
     // Just for template inferencing.
     RecordVal* Get() { return this; }
 
@@ -1462,10 +1577,20 @@ private:
     // Keep this handy for quick access during low-level operations.
     RecordTypePtr rt;
 
-    // Low-level values of each of the fields.
+    // Low-level values of each of the fields, followed by a bitmap
+    // of which fields are present, stored in ZVal-sized words.  Keeping
+    // both in one vector of unboxed values, rather than a vector of
+    // std::optional's, halves the size of a record's fields and keeps
+    // it to a single allocation.  Values of fields that aren't present
+    // are meaningless.
     //
     // Lazily modified during GetField(), so mutable.
-    mutable std::vector<std::optional<ZVal>> record_val;
+    mutable std::vector<ZVal> record_val;
+    unsigned int num_fields = 0;
+
+    // The hash key of the record when used as the sole index of a table,
+    // if cached (see CompositeHash::MakeHashKey()).
+    mutable detail::HashKey* index_key = nullptr;
 
     // Whether a given field requires explicit memory management.
     const std::vector<bool>& is_managed;
@@ -0,0 +1,125 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ValPool.h"
+
+#include "zeek/zeek-config.h"
+
+#include <chrono>
+#include <vector>
+
+#include "zeek/Event.h"
+#include "zeek/EventRegistry.h"
+#include "zeek/Val.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+thread_local ValPool ValPool::local_pool;
+
+void ValPool::NewChunk() {
+    // Whatever remains of the current chunk is too small for the object
+    // at hand. We give up on it rather than fragment the free lists.
+    chunk_next = static_cast<char*>(::operator new(CHUNK_SIZE));
+    chunk_left = CHUNK_SIZE;
+    ++stats.chunks;
+}
+
+} // namespace zeek::detail
+
+using zeek::detail::ValPool;
+
+TEST_CASE("val pool") {
+    ValPool pool;
+
+    auto a = pool.Allocate(40);
+    auto b = pool.Allocate(48);
+    auto c = pool.Allocate(200);
+
+    CHECK_EQ(pool.Stats().pooled, 3);
+    CHECK_EQ(pool.Stats().reused, 0);
+    CHECK_EQ(pool.Stats().chunks, 1);
+    CHECK_EQ(pool.Stats().in_use, 3);
+
+    // Objects of the same size class share the chunk without overlapping.
+    CHECK_EQ(static_cast<char*>(b) - static_cast<char*>(a), 48);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(c) % ValPool::GRANULARITY, 0);
+
+    SUBCASE("reuse") {
+        pool.Free(a, 40);
+        CHECK_EQ(pool.Stats().in_use, 2);
+
+        // A different size class doesn't get the freed object ...
+        auto d = pool.Allocate(16);
+        CHECK(d != a);
+
+        // ... but the same one does.
+        auto e = pool.Allocate(33);
+        CHECK(e == a);
+        CHECK_EQ(pool.Stats().reused, 1);
+
+        pool.Free(d, 16);
+        pool.Free(e, 33);
+    }
+
+    SUBCASE("unpooled") {
+        auto big = pool.Allocate(ValPool::MAX_SIZE + 1);
+        CHECK_EQ(pool.Stats().unpooled, 1);
+        CHECK_EQ(pool.Stats().in_use, 3);
+        pool.Free(big, ValPool::MAX_SIZE + 1);
+    }
+
+    SUBCASE("chunks") {
+        std::vector<void*> objs;
+        auto per_chunk = ValPool::CHUNK_SIZE / ValPool::MAX_SIZE;
+
+        for ( size_t i = 0; i < 2 * per_chunk; ++i )
+            objs.push_back(pool.Allocate(ValPool::MAX_SIZE));
+
+        CHECK_EQ(pool.Stats().chunks, 3);
+
+        for ( auto o : objs )
+            pool.Free(o, ValPool::MAX_SIZE);
+    }
+
+    pool.Free(b, 48);
+    pool.Free(c, 200);
+}
+
+TEST_CASE("val pool event dispatch benchmark" * doctest::skip(true)) {
+    // Run it with: zeek --test --test-case="val pool event dispatch benchmark" --no-skip
+    //
+    // Queues and drains batches of events carrying a conn_id and a string,
+    // as much of the event engine does. Compare the timing with that of a
+    // build configured without --enable-val-pool.
+    constexpr int num_batches = 20'000;
+    constexpr int batch_size = 100;
+
+    auto h = zeek::event_registry->Register("ValPool::benchmark_event");
+    h->SetGenerateAlways();
+
+    auto before = ValPool::Local().Stats();
+    auto begin = std::chrono::steady_clock::now();
+
+    for ( int i = 0; i < num_batches; ++i ) {
+        for ( int j = 0; j < batch_size; ++j ) {
+            auto id = zeek::make_intrusive<zeek::RecordVal>(zeek::id::conn_id);
+            id->Assign(0, zeek::make_intrusive<zeek::AddrVal>("10.0.0.1"));
+            id->Assign(1, zeek::val_mgr->Port(1024 + j, TRANSPORT_TCP));
+            id->Assign(2, zeek::make_intrusive<zeek::AddrVal>("192.168.1.1"));
+            id->Assign(3, zeek::val_mgr->Port(80, TRANSPORT_TCP));
+
+            zeek::event_mgr.Enqueue(h, std::move(id), zeek::make_intrusive<zeek::StringVal>("GET / HTTP/1.1"));
+        }
+
+        zeek::event_mgr.Drain();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+    auto after = ValPool::Local().Stats();
+
+    MESSAGE(num_batches * batch_size << " events: " << ms << " ms, " << after.pooled - before.pooled
+                                     << " pooled allocations, " << after.reused - before.reused << " reused, "
+                                     << after.chunks - before.chunks << " chunks");
+}
@@ -0,0 +1,114 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace zeek::detail {
+
+/**
+ * Statistics on the allocations of a ValPool.
+ */
+struct ValPoolStats {
+    uint64_t pooled = 0;   // allocations served by the pool
+    uint64_t reused = 0;   // ... of which recycled a freed object
+    uint64_t unpooled = 0; // allocations too large for the pool
+    uint64_t chunks = 0;   // chunks the pool obtained from malloc
+    int64_t in_use = 0;    // pooled objects allocated minus those freed
+};
+
+/**
+ * A pool for the memory of Val objects, which scripts create and destroy
+ * at high rates: most arguments of an event, and most temporaries of its
+ * handlers, die once the event has been dispatched. The pool carves objects
+ * out of large chunks and keeps freed objects on a free list per size
+ * class, so that the next event's values reuse their memory without going
+ * through malloc. Objects only return to the pool once their reference
+ * count drops to zero, so values that escape into globals, tables, or
+ * timers simply stay allocated. The pool never returns chunks to malloc.
+ *
+ * Each thread has its own pool, which also receives the objects that the
+ * thread frees, regardless of which pool they came from. A thread's in_use
+ * count can hence go negative if it frees values other threads allocated.
+ *
+ * As the pool's memory stays allocated, it's only used by builds
+ * configured with --enable-val-pool.
+ */
+class ValPool {
+public:
+    static constexpr size_t GRANULARITY = 16;
+    static constexpr size_t MAX_SIZE = 256;
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    /**
+     * @return The current thread's pool.
+     */
+    static ValPool& Local() { return local_pool; }
+
+    void* Allocate(size_t size) {
+        if ( size > MAX_SIZE ) {
+            ++stats.unpooled;
+            return ::operator new(size);
+        }
+
+        ++stats.pooled;
+        ++stats.in_use;
+
+        auto c = SizeClass(size);
+        if ( auto f = free_lists[c] ) {
+            free_lists[c] = f->next;
+            ++stats.reused;
+            return f;
+        }
+
+        size = (c + 1) * GRANULARITY;
+        if ( chunk_left < size )
+            NewChunk();
+
+        void* p = chunk_next;
+        chunk_next += size;
+        chunk_left -= size;
+        return p;
+    }
+
+    void Free(void* p, size_t size) {
+        if ( size > MAX_SIZE ) {
+            ::operator delete(p);
+            return;
+        }
+
+        --stats.in_use;
+
+        auto c = SizeClass(size);
+        auto f = static_cast<FreeObj*>(p);
+        f->next = free_lists[c];
+        free_lists[c] = f;
+    }
+
+    const ValPoolStats& Stats() const { return stats; }
+
+private:
+    struct FreeObj {
+        FreeObj* next;
+    };
+
+    static constexpr size_t NUM_CLASSES = MAX_SIZE / GRANULARITY;
+
+    static size_t SizeClass(size_t size) { return (size - 1) / GRANULARITY; }
+
+    void NewChunk();
+
+    FreeObj* free_lists[NUM_CLASSES] = {};
+
+    // Remainder of the chunk that new objects are carved from.
+    char* chunk_next = nullptr;
+    size_t chunk_left = 0;
+
+    ValPoolStats stats;
+
+    static thread_local ValPool local_pool;
+};
+
+} // namespace zeek::detail
@@ -5,6 +5,7 @@
 #include "zeek/File.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleMatcher.h"
+#include "zeek/RunState.h"
 #include "zeek/ZeekString.h"
 #include "zeek/analyzer/Analyzer.h"
 #include "zeek/analyzer/protocol/tcp/TCP.h"
@@ -439,7 +440,7 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len, const u_char* da
     }
 
     flags = arg_flags;
-    NewBlock(t, seq, len, data);
+    NewBlock(t, seq, len, data, run_state::current_pkt);
     flags = TCP_Flags();
 
     if ( Endpoint()->NoDataAcked() && zeek::detail::tcp_max_above_hole_without_any_acks &&
@@ -0,0 +1,795 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/BPF_Interpreter.h"
+
+#include "zeek/zeek-config.h"
+
+#include <cstring>
+
+extern "C" {
+#include <pcap.h>
+}
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/iosource/BPF_Program.h"
+#include "zeek/net_util.h"
+#include "zeek/util.h"
+
+// Older libpcap versions don't know these ALU operations yet.
+#ifndef BPF_MOD
+#define BPF_MOD 0x90
+#endif
+
+#ifndef BPF_XOR
+#define BPF_XOR 0xa0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ZEEK_BPF_THREADED_CODE
+#endif
+
+namespace zeek::iosource::detail {
+
+// The operations of the translated program. The "_K" and "_X" suffixes name
+// the operand source, a constant or the index register. The fused operations
+// combine a packet load with the conditional jump following it.
+#define ZEEK_BPF_OPS(X)                                                                                                \
+    X(RET_K)                                                                                                           \
+    X(RET_A)                                                                                                           \
+    X(LD_W_ABS)                                                                                                        \
+    X(LD_H_ABS)                                                                                                        \
+    X(LD_B_ABS)                                                                                                        \
+    X(LD_W_IND)                                                                                                        \
+    X(LD_H_IND)                                                                                                        \
+    X(LD_B_IND)                                                                                                        \
+    X(LD_LEN)                                                                                                          \
+    X(LD_IMM)                                                                                                          \
+    X(LD_MEM)                                                                                                          \
+    X(LDX_LEN)                                                                                                         \
+    X(LDX_IMM)                                                                                                         \
+    X(LDX_MEM)                                                                                                         \
+    X(LDX_MSH)                                                                                                         \
+    X(ST)                                                                                                              \
+    X(STX)                                                                                                             \
+    X(ADD_K)                                                                                                           \
+    X(SUB_K)                                                                                                           \
+    X(MUL_K)                                                                                                           \
+    X(DIV_K)                                                                                                           \
+    X(MOD_K)                                                                                                           \
+    X(AND_K)                                                                                                           \
+    X(OR_K)                                                                                                            \
+    X(XOR_K)                                                                                                           \
+    X(LSH_K)                                                                                                           \
+    X(RSH_K)                                                                                                           \
+    X(ADD_X)                                                                                                           \
+    X(SUB_X)                                                                                                           \
+    X(MUL_X)                                                                                                           \
+    X(DIV_X)                                                                                                           \
+    X(MOD_X)                                                                                                           \
+    X(AND_X)                                                                                                           \
+    X(OR_X)                                                                                                            \
+    X(XOR_X)                                                                                                           \
+    X(LSH_X)                                                                                                           \
+    X(RSH_X)                                                                                                           \
+    X(NEG)                                                                                                             \
+    X(JA)                                                                                                              \
+    X(JEQ_K)                                                                                                           \
+    X(JGT_K)                                                                                                           \
+    X(JGE_K)                                                                                                           \
+    X(JSET_K)                                                                                                          \
+    X(JEQ_X)                                                                                                           \
+    X(JGT_X)                                                                                                           \
+    X(JGE_X)                                                                                                           \
+    X(JSET_X)                                                                                                          \
+    X(TAX)                                                                                                             \
+    X(TXA)                                                                                                             \
+    X(LD_W_ABS_JEQ_K)                                                                                                  \
+    X(LD_H_ABS_JEQ_K)                                                                                                  \
+    X(LD_B_ABS_JEQ_K)                                                                                                  \
+    X(LD_H_IND_JEQ_K)                                                                                                  \
+    X(LD_B_IND_JEQ_K)                                                                                                  \
+    X(LD_H_ABS_JSET_K)                                                                                                 \
+    X(LD_B_ABS_JSET_K)
+
+enum class BPF_Op : uint8_t {
+#define ZEEK_BPF_OP_ENUM(op) op,
+    ZEEK_BPF_OPS(ZEEK_BPF_OP_ENUM)
+#undef ZEEK_BPF_OP_ENUM
+};
+
+struct BPF_Interpreter::Insn {
+    BPF_Op op;
+    uint32_t k;  // The instruction's constant, or the packet offset of a fused load.
+    uint32_t k2; // The comparison constant of a fused jump.
+    uint32_t jt; // Index of the jump target if true, or of JA's target.
+    uint32_t jf; // Index of the jump target if false.
+};
+
+// Maps a classic BPF opcode to the corresponding operation. Returns false for
+// opcodes we don't handle.
+static bool translate_opcode(uint16_t code, BPF_Op* op) {
+    switch ( code ) {
+        case BPF_RET | BPF_K: *op = BPF_Op::RET_K; return true;
+        case BPF_RET | BPF_A: *op = BPF_Op::RET_A; return true;
+
+        case BPF_LD | BPF_W | BPF_ABS: *op = BPF_Op::LD_W_ABS; return true;
+        case BPF_LD | BPF_H | BPF_ABS: *op = BPF_Op::LD_H_ABS; return true;
+        case BPF_LD | BPF_B | BPF_ABS: *op = BPF_Op::LD_B_ABS; return true;
+        case BPF_LD | BPF_W | BPF_IND: *op = BPF_Op::LD_W_IND; return true;
+        case BPF_LD | BPF_H | BPF_IND: *op = BPF_Op::LD_H_IND; return true;
+        case BPF_LD | BPF_B | BPF_IND: *op = BPF_Op::LD_B_IND; return true;
+        case BPF_LD | BPF_W | BPF_LEN: *op = BPF_Op::LD_LEN; return true;
+        case BPF_LD | BPF_IMM: *op = BPF_Op::LD_IMM; return true;
+        case BPF_LD | BPF_MEM: *op = BPF_Op::LD_MEM; return true;
+        case BPF_LDX | BPF_W | BPF_LEN: *op = BPF_Op::LDX_LEN; return true;
+        case BPF_LDX | BPF_W | BPF_IMM: *op = BPF_Op::LDX_IMM; return true;
+        case BPF_LDX | BPF_MEM: *op = BPF_Op::LDX_MEM; return true;
+        case BPF_LDX | BPF_B | BPF_MSH: *op = BPF_Op::LDX_MSH; return true;
+        case BPF_ST: *op = BPF_Op::ST; return true;
+        case BPF_STX: *op = BPF_Op::STX; return true;
+
+        case BPF_ALU | BPF_ADD | BPF_K: *op = BPF_Op::ADD_K; return true;
+        case BPF_ALU | BPF_SUB | BPF_K: *op = BPF_Op::SUB_K; return true;
+        case BPF_ALU | BPF_MUL | BPF_K: *op = BPF_Op::MUL_K; return true;
+        case BPF_ALU | BPF_DIV | BPF_K: *op = BPF_Op::DIV_K; return true;
+        case BPF_ALU | BPF_MOD | BPF_K: *op = BPF_Op::MOD_K; return true;
+        case BPF_ALU | BPF_AND | BPF_K: *op = BPF_Op::AND_K; return true;
+        case BPF_ALU | BPF_OR | BPF_K: *op = BPF_Op::OR_K; return true;
+        case BPF_ALU | BPF_XOR | BPF_K: *op = BPF_Op::XOR_K; return true;
+        case BPF_ALU | BPF_LSH | BPF_K: *op = BPF_Op::LSH_K; return true;
+        case BPF_ALU | BPF_RSH | BPF_K: *op = BPF_Op::RSH_K; return true;
+        case BPF_ALU | BPF_ADD | BPF_X: *op = BPF_Op::ADD_X; return true;
+        case BPF_ALU | BPF_SUB | BPF_X: *op = BPF_Op::SUB_X; return true;
+        case BPF_ALU | BPF_MUL | BPF_X: *op = BPF_Op::MUL_X; return true;
+        case BPF_ALU | BPF_DIV | BPF_X: *op = BPF_Op::DIV_X; return true;
+        case BPF_ALU | BPF_MOD | BPF_X: *op = BPF_Op::MOD_X; return true;
+        case BPF_ALU | BPF_AND | BPF_X: *op = BPF_Op::AND_X; return true;
+        case BPF_ALU | BPF_OR | BPF_X: *op = BPF_Op::OR_X; return true;
+        case BPF_ALU | BPF_XOR | BPF_X: *op = BPF_Op::XOR_X; return true;
+        case BPF_ALU | BPF_LSH | BPF_X: *op = BPF_Op::LSH_X; return true;
+        case BPF_ALU | BPF_RSH | BPF_X: *op = BPF_Op::RSH_X; return true;
+        case BPF_ALU | BPF_NEG: *op = BPF_Op::NEG; return true;
+
+        case BPF_JMP | BPF_JA: *op = BPF_Op::JA; return true;
+        case BPF_JMP | BPF_JEQ | BPF_K: *op = BPF_Op::JEQ_K; return true;
+        case BPF_JMP | BPF_JGT | BPF_K: *op = BPF_Op::JGT_K; return true;
+        case BPF_JMP | BPF_JGE | BPF_K: *op = BPF_Op::JGE_K; return true;
+        case BPF_JMP | BPF_JSET | BPF_K: *op = BPF_Op::JSET_K; return true;
+        case BPF_JMP | BPF_JEQ | BPF_X: *op = BPF_Op::JEQ_X; return true;
+        case BPF_JMP | BPF_JGT | BPF_X: *op = BPF_Op::JGT_X; return true;
+        case BPF_JMP | BPF_JGE | BPF_X: *op = BPF_Op::JGE_X; return true;
+        case BPF_JMP | BPF_JSET | BPF_X: *op = BPF_Op::JSET_X; return true;
+
+        case BPF_MISC | BPF_TAX: *op = BPF_Op::TAX; return true;
+        case BPF_MISC | BPF_TXA: *op = BPF_Op::TXA; return true;
+
+        default: return false;
+    }
+}
+
+static bool is_conditional_jump(BPF_Op op) {
+    switch ( op ) {
+        case BPF_Op::JEQ_K:
+        case BPF_Op::JGT_K:
+        case BPF_Op::JGE_K:
+        case BPF_Op::JSET_K:
+        case BPF_Op::JEQ_X:
+        case BPF_Op::JGT_X:
+        case BPF_Op::JGE_X:
+        case BPF_Op::JSET_X: return true;
+        default: return false;
+    }
+}
+
+// Returns the fused operation for a load followed by a conditional jump, if
+// there's one.
+static bool fuse(BPF_Op load, BPF_Op jump, BPF_Op* fused) {
+    if ( jump == BPF_Op::JEQ_K ) {
+        switch ( load ) {
+            case BPF_Op::LD_W_ABS: *fused = BPF_Op::LD_W_ABS_JEQ_K; return true;
+            case BPF_Op::LD_H_ABS: *fused = BPF_Op::LD_H_ABS_JEQ_K; return true;
+            case BPF_Op::LD_B_ABS: *fused = BPF_Op::LD_B_ABS_JEQ_K; return true;
+            case BPF_Op::LD_H_IND: *fused = BPF_Op::LD_H_IND_JEQ_K; return true;
+            case BPF_Op::LD_B_IND: *fused = BPF_Op::LD_B_IND_JEQ_K; return true;
+            default: return false;
+        }
+    }
+
+    if ( jump == BPF_Op::JSET_K ) {
+        switch ( load ) {
+            case BPF_Op::LD_H_ABS: *fused = BPF_Op::LD_H_ABS_JSET_K; return true;
+            case BPF_Op::LD_B_ABS: *fused = BPF_Op::LD_B_ABS_JSET_K; return true;
+            default: return false;
+        }
+    }
+
+    return false;
+}
+
+BPF_Interpreter::BPF_Interpreter() = default;
+
+BPF_Interpreter::~BPF_Interpreter() = default;
+
+size_t BPF_Interpreter::Size() const { return code.size(); }
+
+std::unique_ptr<BPF_Interpreter> BPF_Interpreter::Translate(const struct bpf_program* program) {
+    if ( ! program || ! program->bf_insns || program->bf_len == 0 )
+        return nullptr;
+
+    const auto* insns = program->bf_insns;
+    uint32_t len = program->bf_len;
+
+    std::vector<BPF_Op> ops(len);
+    std::vector<bool> is_target(len, false);
+
+    // Decode and validate the program, following the rules of libpcap's
+    // bpf_validate(). We reject anything that doesn't pass rather than
+    // trying to mimic libpcap's behavior for it.
+    for ( uint32_t i = 0; i < len; ++i ) {
+        const auto& insn = insns[i];
+
+        if ( ! translate_opcode(insn.code, &ops[i]) )
+            return nullptr;
+
+        if ( is_conditional_jump(ops[i]) ) {
+            if ( i + 1 + insn.jt >= len || i + 1 + insn.jf >= len )
+                return nullptr;
+
+            is_target[i + 1 + insn.jt] = true;
+            is_target[i + 1 + insn.jf] = true;
+            continue;
+        }
+
+        switch ( ops[i] ) {
+            case BPF_Op::LD_MEM:
+            case BPF_Op::LDX_MEM:
+            case BPF_Op::ST:
+            case BPF_Op::STX:
+                if ( insn.k >= BPF_MEMWORDS )
+                    return nullptr;
+                break;
+
+            case BPF_Op::DIV_K:
+            case BPF_Op::MOD_K:
+                if ( insn.k == 0 )
+                    return nullptr;
+                break;
+
+            case BPF_Op::LSH_K:
+            case BPF_Op::RSH_K:
+                if ( insn.k >= 32 )
+                    return nullptr;
+                break;
+
+            case BPF_Op::JA:
+                if ( insn.k >= len - i - 1 )
+                    return nullptr;
+
+                is_target[i + 1 + insn.k] = true;
+                break;
+
+            default: break;
+        }
+    }
+
+    if ( ops[len - 1] != BPF_Op::RET_K && ops[len - 1] != BPF_Op::RET_A )
+        return nullptr;
+
+    // Assign the new instruction indices, fusing pairs where the jump isn't
+    // the target of any other jump.
+    std::vector<uint32_t> new_index(len);
+    std::vector<bool> fused(len, false);
+    uint32_t n = 0;
+
+    for ( uint32_t i = 0; i < len; ++i ) {
+        BPF_Op f;
+        new_index[i] = n++;
+
+        if ( i + 1 < len && ! is_target[i + 1] && fuse(ops[i], ops[i + 1], &f) ) {
+            fused[i] = true;
+            new_index[i + 1] = new_index[i];
+            ++i;
+        }
+    }
+
+    std::unique_ptr<BPF_Interpreter> interp(new BPF_Interpreter());
+    interp->code.reserve(n);
+
+    for ( uint32_t i = 0; i < len; ++i ) {
+        const auto& insn = insns[i];
+        Insn t = {ops[i], insn.k, 0, 0, 0};
+
+        if ( ops[i] == BPF_Op::JA )
+            t.jt = new_index[i + 1 + insn.k];
+
+        else if ( fused[i] ) {
+            const auto& jump = insns[i + 1];
+            fuse(ops[i], ops[i + 1], &t.op);
+            t.k2 = jump.k;
+            t.jt = new_index[i + 2 + jump.jt];
+            t.jf = new_index[i + 2 + jump.jf];
+            ++i;
+        }
+
+        else if ( is_conditional_jump(ops[i]) ) {
+            t.jt = new_index[i + 1 + insn.jt];
+            t.jf = new_index[i + 1 + insn.jf];
+        }
+
+        interp->code.push_back(t);
+    }
+
+    return interp;
+}
+
+// Packet accessors, with the same bounds checks as libpcap's bpf_filter().
+// The offsets are widened so that the additions can't overflow.
+
+static inline bool load_word(const u_char* p, uint32_t buflen, uint64_t off, uint32_t* v) {
+    if ( off + sizeof(uint32_t) > buflen )
+        return false;
+
+    uint32_t w;
+    memcpy(&w, p + off, sizeof(w));
+    *v = ntohl(w);
+    return true;
+}
+
+static inline bool load_half(const u_char* p, uint32_t buflen, uint64_t off, uint32_t* v) {
+    if ( off + sizeof(uint16_t) > buflen )
+        return false;
+
+    uint16_t h;
+    memcpy(&h, p + off, sizeof(h));
+    *v = ntohs(h);
+    return true;
+}
+
+static inline bool load_byte(const u_char* p, uint32_t buflen, uint64_t off, uint32_t* v) {
+    if ( off >= buflen )
+        return false;
+
+    *v = p[off];
+    return true;
+}
+
+uint32_t BPF_Interpreter::Run(const u_char* p, uint32_t wirelen, uint32_t buflen) const {
+    uint32_t A = 0;
+    uint32_t X = 0;
+    uint32_t mem[BPF_MEMWORDS] = {0};
+
+    const Insn* base = code.data();
+    const Insn* pc = base;
+
+    // The evaluation loop below is written once for two dispatch techniques.
+    // With GCC and Clang, every operation ends in an indirect jump straight
+    // to the next operation's handler. Otherwise it's a regular switch.
+#ifdef ZEEK_BPF_THREADED_CODE
+#define ZEEK_BPF_OP_LABEL(op) &&L_##op,
+    static const void* const labels[] = {ZEEK_BPF_OPS(ZEEK_BPF_OP_LABEL)};
+#undef ZEEK_BPF_OP_LABEL
+
+#define OP(name) L_##name:
+#define DISPATCH() goto* labels[static_cast<uint8_t>(pc->op)]
+
+    DISPATCH();
+#else
+#define OP(name) case BPF_Op::name:
+#define DISPATCH() continue
+
+    for ( ;; ) {
+        switch ( pc->op ) {
+#endif
+
+#define NEXT()                                                                                                         \
+    {                                                                                                                  \
+        ++pc;                                                                                                          \
+        DISPATCH();                                                                                                    \
+    }
+
+#define BRANCH(cond)                                                                                                   \
+    {                                                                                                                  \
+        pc = base + ((cond) ? pc->jt : pc->jf);                                                                        \
+        DISPATCH();                                                                                                    \
+    }
+
+#define LOAD(fn, off)                                                                                                  \
+    if ( ! fn(p, buflen, (off), &A) )                                                                                  \
+    return 0
+
+    OP(RET_K) return pc->k;
+    OP(RET_A) return A;
+
+    OP(LD_W_ABS) {
+        LOAD(load_word, pc->k);
+        NEXT();
+    }
+    OP(LD_H_ABS) {
+        LOAD(load_half, pc->k);
+        NEXT();
+    }
+    OP(LD_B_ABS) {
+        LOAD(load_byte, pc->k);
+        NEXT();
+    }
+    OP(LD_W_IND) {
+        LOAD(load_word, uint64_t(X) + pc->k);
+        NEXT();
+    }
+    OP(LD_H_IND) {
+        LOAD(load_half, uint64_t(X) + pc->k);
+        NEXT();
+    }
+    OP(LD_B_IND) {
+        LOAD(load_byte, uint64_t(X) + pc->k);
+        NEXT();
+    }
+    OP(LD_LEN) {
+        A = wirelen;
+        NEXT();
+    }
+    OP(LD_IMM) {
+        A = pc->k;
+        NEXT();
+    }
+    OP(LD_MEM) {
+        A = mem[pc->k];
+        NEXT();
+    }
+
+    OP(LDX_LEN) {
+        X = wirelen;
+        NEXT();
+    }
+    OP(LDX_IMM) {
+        X = pc->k;
+        NEXT();
+    }
+    OP(LDX_MEM) {
+        X = mem[pc->k];
+        NEXT();
+    }
+    OP(LDX_MSH) {
+        if ( pc->k >= buflen )
+            return 0;
+
+        X = (p[pc->k] & 0xf) << 2;
+        NEXT();
+    }
+
+    OP(ST) {
+        mem[pc->k] = A;
+        NEXT();
+    }
+    OP(STX) {
+        mem[pc->k] = X;
+        NEXT();
+    }
+
+    OP(ADD_K) {
+        A += pc->k;
+        NEXT();
+    }
+    OP(SUB_K) {
+        A -= pc->k;
+        NEXT();
+    }
+    OP(MUL_K) {
+        A *= pc->k;
+        NEXT();
+    }
+    OP(DIV_K) {
+        A /= pc->k;
+        NEXT();
+    }
+    OP(MOD_K) {
+        A %= pc->k;
+        NEXT();
+    }
+    OP(AND_K) {
+        A &= pc->k;
+        NEXT();
+    }
+    OP(OR_K) {
+        A |= pc->k;
+        NEXT();
+    }
+    OP(XOR_K) {
+        A ^= pc->k;
+        NEXT();
+    }
+    OP(LSH_K) {
+        A <<= pc->k;
+        NEXT();
+    }
+    OP(RSH_K) {
+        A >>= pc->k;
+        NEXT();
+    }
+
+    OP(ADD_X) {
+        A += X;
+        NEXT();
+    }
+    OP(SUB_X) {
+        A -= X;
+        NEXT();
+    }
+    OP(MUL_X) {
+        A *= X;
+        NEXT();
+    }
+    OP(DIV_X) {
+        if ( X == 0 )
+            return 0;
+
+        A /= X;
+        NEXT();
+    }
+    OP(MOD_X) {
+        if ( X == 0 )
+            return 0;
+
+        A %= X;
+        NEXT();
+    }
+    OP(AND_X) {
+        A &= X;
+        NEXT();
+    }
+    OP(OR_X) {
+        A |= X;
+        NEXT();
+    }
+    OP(XOR_X) {
+        A ^= X;
+        NEXT();
+    }
+    OP(LSH_X) {
+        A = X < 32 ? A << X : 0;
+        NEXT();
+    }
+    OP(RSH_X) {
+        A = X < 32 ? A >> X : 0;
+        NEXT();
+    }
+    OP(NEG) {
+        A = -A;
+        NEXT();
+    }
+
+    OP(JA) {
+        pc = base + pc->jt;
+        DISPATCH();
+    }
+    OP(JEQ_K) BRANCH(A == pc->k);
+    OP(JGT_K) BRANCH(A > pc->k);
+    OP(JGE_K) BRANCH(A >= pc->k);
+    OP(JSET_K) BRANCH(A & pc->k);
+    OP(JEQ_X) BRANCH(A == X);
+    OP(JGT_X) BRANCH(A > X);
+    OP(JGE_X) BRANCH(A >= X);
+    OP(JSET_X) BRANCH(A & X);
+
+    OP(TAX) {
+        X = A;
+        NEXT();
+    }
+    OP(TXA) {
+        A = X;
+        NEXT();
+    }
+
+    OP(LD_W_ABS_JEQ_K) {
+        LOAD(load_word, pc->k);
+        BRANCH(A == pc->k2);
+    }
+    OP(LD_H_ABS_JEQ_K) {
+        LOAD(load_half, pc->k);
+        BRANCH(A == pc->k2);
+    }
+    OP(LD_B_ABS_JEQ_K) {
+        LOAD(load_byte, pc->k);
+        BRANCH(A == pc->k2);
+    }
+    OP(LD_H_IND_JEQ_K) {
+        LOAD(load_half, uint64_t(X) + pc->k);
+        BRANCH(A == pc->k2);
+    }
+    OP(LD_B_IND_JEQ_K) {
+        LOAD(load_byte, uint64_t(X) + pc->k);
+        BRANCH(A == pc->k2);
+    }
+    OP(LD_H_ABS_JSET_K) {
+        LOAD(load_half, pc->k);
+        BRANCH(A & pc->k2);
+    }
+    OP(LD_B_ABS_JSET_K) {
+        LOAD(load_byte, pc->k);
+        BRANCH(A & pc->k2);
+    }
+
+#ifndef ZEEK_BPF_THREADED_CODE
+        }
+    }
+#endif
+
+#undef LOAD
+#undef BRANCH
+#undef NEXT
+#undef DISPATCH
+#undef OP
+}
+
+} // namespace zeek::iosource::detail
+
+namespace {
+
+using zeek::iosource::detail::BPF_Interpreter;
+using zeek::iosource::detail::BPF_Program;
+
+// Builds Ethernet frames with a mix of encapsulations, protocols, and ports,
+// some of them fragmented or truncated.
+std::vector<std::vector<u_char>> make_test_packets(size_t n) {
+    std::vector<std::vector<u_char>> pkts;
+    pkts.reserve(n);
+
+    for ( size_t i = 0; i < n; ++i ) {
+        std::vector<u_char> p;
+        auto put16 = [&p](uint16_t v) {
+            p.push_back(v >> 8);
+            p.push_back(v & 0xff);
+        };
+
+        p.insert(p.end(), 12, 0x02); // MAC addresses
+
+        if ( i % 7 == 0 ) {
+            put16(0x8100); // VLAN
+            put16(i % 4096);
+        }
+
+        bool v6 = i % 5 == 0;
+        uint8_t proto = i % 3 == 0 ? 17 : 6;
+
+        if ( v6 ) {
+            put16(0x86dd);
+            p.insert(p.end(), {0x60, 0, 0, 0});
+            put16(20);
+            p.push_back(proto);
+            p.push_back(64);
+            for ( int j = 0; j < 32; ++j )
+                p.push_back(j == 15 || j == 31 ? i & 0xff : 0x20);
+        }
+        else {
+            put16(0x0800);
+            p.insert(p.end(), {0x45, 0});
+            put16(40);
+            put16(i);
+            put16(i % 11 == 0 ? 0x2000 | (i % 8) : 0); // fragments
+            p.insert(p.end(), {64, proto, 0, 0});
+            p.insert(p.end(), {10, 0, static_cast<u_char>(i >> 8), static_cast<u_char>(i)});
+            p.insert(p.end(), {192, 168, 1, static_cast<u_char>(i % 4)});
+        }
+
+        put16(1024 + i % 100);
+        put16(i % 4 == 0 ? 80 : (i % 4 == 1 ? 53 : 443));
+        p.insert(p.end(), 8, 0);
+        p.insert(p.end(), {0x50, static_cast<u_char>(i % 2 ? 0x02 : 0x10)}); // TCP offset, flags
+        p.insert(p.end(), 6, 0);
+
+        if ( i % 13 == 0 )
+            p.resize(p.size() / 2);
+
+        pkts.push_back(std::move(p));
+    }
+
+    return pkts;
+}
+
+const char* test_filters[] = {
+    "tcp port 80",
+    "udp and port 53",
+    "host 192.168.1.2 and not port 443",
+    "net 10.0.0.0/16 and tcp",
+    "ip6 and tcp",
+    "vlan and tcp",
+    "ip[6:2] & 0x1fff != 0",
+    "tcp[tcpflags] & tcp-syn != 0",
+    "greater 60",
+    "(tcp[2:2] > 1050 and tcp[2:2] < 1080) or udp[0:2] % 3 = 1",
+    "ip and ip[2:2] / 4 == 10",
+};
+
+} // namespace
+
+TEST_CASE("bpf interpreter") {
+    auto pkts = make_test_packets(2000);
+
+    for ( const auto* f : test_filters ) {
+        CAPTURE(f);
+
+        BPF_Program prog;
+        REQUIRE(prog.Compile(65535, DLT_EN10MB, f, 0xffffff00));
+
+        auto interp = BPF_Interpreter::Translate(prog.GetProgram());
+        REQUIRE(interp);
+
+        size_t matches = 0;
+
+        for ( const auto& p : pkts ) {
+            // Also try with the packets cut short by the capture.
+            for ( uint32_t caplen : {static_cast<uint32_t>(p.size()), static_cast<uint32_t>(p.size() * 2 / 3)} ) {
+                struct pcap_pkthdr hdr = {};
+                hdr.caplen = caplen;
+                hdr.len = p.size();
+
+                auto expected = pcap_offline_filter(prog.GetProgram(), &hdr, p.data());
+                CHECK_EQ(interp->Run(p.data(), hdr.len, hdr.caplen), expected);
+                CHECK_EQ(prog.Matches(&hdr, p.data()), expected != 0);
+                matches += expected != 0;
+            }
+        }
+
+        // Make sure the filters aren't trivial for the test packets.
+        CHECK_GT(matches, 0);
+        CHECK_LT(matches, 2 * pkts.size());
+    }
+
+    SUBCASE("invalid programs") {
+        struct bpf_insn out_of_range[] = {{BPF_JMP | BPF_JA, 0, 0, 5}, {BPF_RET | BPF_K, 0, 0, 0}};
+        struct bpf_insn no_return[] = {{BPF_LD | BPF_IMM, 0, 0, 1}};
+        struct bpf_insn bad_memory[] = {{BPF_ST, 0, 0, BPF_MEMWORDS}, {BPF_RET | BPF_K, 0, 0, 0}};
+        struct bpf_insn div_zero[] = {{BPF_ALU | BPF_DIV | BPF_K, 0, 0, 0}, {BPF_RET | BPF_A, 0, 0, 0}};
+
+        struct bpf_program p1 = {2, out_of_range};
+        struct bpf_program p2 = {1, no_return};
+        struct bpf_program p3 = {2, bad_memory};
+        struct bpf_program p4 = {2, div_zero};
+
+        CHECK_FALSE(BPF_Interpreter::Translate(&p1));
+        CHECK_FALSE(BPF_Interpreter::Translate(&p2));
+        CHECK_FALSE(BPF_Interpreter::Translate(&p3));
+        CHECK_FALSE(BPF_Interpreter::Translate(&p4));
+    }
+}
+
+// Compares the interpreter's speed with libpcap's. Run it with:
+//
+//     zeek --test --test-case="bpf interpreter benchmark" --no-skip
+TEST_CASE("bpf interpreter benchmark" * doctest::skip(true)) {
+    auto pkts = make_test_packets(4096);
+    constexpr int rounds = 2000;
+
+    for ( const auto* f : test_filters ) {
+        BPF_Program prog;
+        REQUIRE(prog.Compile(65535, DLT_EN10MB, f, 0xffffff00));
+
+        auto interp = BPF_Interpreter::Translate(prog.GetProgram());
+        REQUIRE(interp);
+
+        std::vector<struct pcap_pkthdr> hdrs(pkts.size());
+        for ( size_t i = 0; i < pkts.size(); ++i )
+            hdrs[i].caplen = hdrs[i].len = pkts[i].size();
+
+        size_t m1 = 0;
+        size_t m2 = 0;
+
+        auto t0 = zeek::util::current_time(true);
+        for ( int r = 0; r < rounds; ++r )
+            for ( size_t i = 0; i < pkts.size(); ++i )
+                m1 += pcap_offline_filter(prog.GetProgram(), &hdrs[i], pkts[i].data()) != 0;
+
+        auto t1 = zeek::util::current_time(true);
+        for ( int r = 0; r < rounds; ++r )
+            for ( size_t i = 0; i < pkts.size(); ++i )
+                m2 += interp->Run(pkts[i].data(), hdrs[i].len, hdrs[i].caplen) != 0;
+
+        auto t2 = zeek::util::current_time(true);
+
+        auto n = static_cast<double>(rounds) * pkts.size();
+        fprintf(stderr, "%-60s %3u -> %3zu insns  libpcap %5.1f ns/pkt  interpreter %5.1f ns/pkt\n", f,
+                prog.GetProgram()->bf_len, interp->Size(), (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n);
+
+        CHECK_EQ(m1, m2);
+    }
+}
@@ -0,0 +1,69 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct bpf_program;
+
+namespace zeek::iosource::detail {
+
+/**
+ * A fast evaluator for classic BPF programs, used where Zeek applies filters
+ * itself rather than letting the kernel do it, such as when reading traces.
+ *
+ * The program is translated once into a pre-decoded form: each instruction
+ * gets its own operation code that already fixes the addressing mode and
+ * operand source, jumps turn into absolute instruction indices, and the
+ * common "load a packet field, then compare it with a constant" pairs that
+ * pcap_compile() emits for protocol, address, and port checks get fused into
+ * single instructions. With GCC and Clang, the evaluation loop dispatches by
+ * threaded code through computed gotos.
+ *
+ * Results are identical to libpcap's bpf_filter(), including its bounds
+ * checks on packet accesses.
+ */
+class BPF_Interpreter {
+public:
+    /**
+     * Translates a compiled BPF program.
+     *
+     * @param program The program, as returned by pcap_compile().
+     *
+     * @return The translated program, or nullptr if the program uses
+     * instructions the interpreter doesn't support or fails validation. In
+     * that case the caller should fall back to pcap_offline_filter().
+     */
+    static std::unique_ptr<BPF_Interpreter> Translate(const struct bpf_program* program);
+
+    /**
+     * Runs the program on a packet.
+     *
+     * @param pkt The packet's captured data.
+     * @param wirelen The packet's original length on the wire.
+     * @param buflen The number of bytes captured, i.e. available at \a pkt.
+     *
+     * @return The program's return value, which is non-zero if the packet
+     * matches the filter.
+     */
+    uint32_t Run(const u_char* pkt, uint32_t wirelen, uint32_t buflen) const;
+
+    /**
+     * Returns the number of instructions after translation.
+     */
+    size_t Size() const;
+
+    ~BPF_Interpreter();
+
+private:
+    struct Insn;
+
+    BPF_Interpreter();
+
+    std::vector<Insn> code;
+};
+
+} // namespace zeek::iosource::detail
@@ -11,6 +11,7 @@
 // clang-format on
 #include <cstring>
 
+#include "zeek/iosource/BPF_Interpreter.h"
 #include "zeek/util.h"
 
 #ifdef DONT_HAVE_LIBPCAP_PCAP_FREECODE
@@ -87,6 +88,7 @@ bool BPF_Program::Compile(pcap_t* pcap, const char* filter, uint32_t netmask, bo
 
     m_compiled = true;
     m_matches_anything = filter_matches_anything(filter);
+    m_interpreter = BPF_Interpreter::Translate(&m_program);
 
     return true;
 }
@@ -119,6 +121,16 @@ bool BPF_Program::Compile(zeek_uint_t snaplen, int linktype, const char* filter,
 
 bpf_program* BPF_Program::GetProgram() { return m_compiled ? &m_program : nullptr; }
 
+bool BPF_Program::Matches(const struct pcap_pkthdr* hdr, const u_char* pkt) {
+    if ( ! m_compiled )
+        return false;
+
+    if ( m_interpreter )
+        return m_interpreter->Run(pkt, hdr->len, hdr->caplen) != 0;
+
+    return pcap_offline_filter(&m_program, hdr, pkt) != 0;
+}
+
 void BPF_Program::FreeCode() {
     if ( m_compiled ) {
 #ifdef DONT_HAVE_LIBPCAP_PCAP_FREECODE
@@ -127,6 +139,7 @@ void BPF_Program::FreeCode() {
         pcap_freecode(&m_program);
 #endif
         m_compiled = false;
+        m_interpreter.reset();
     }
 }
 
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <string>
 
 #include "zeek/util.h"
@@ -21,6 +22,8 @@ enum class FilterState : uint8_t {
 
 namespace detail {
 
+class BPF_Interpreter;
+
 // BPF_Programs are an abstraction around struct bpf_program,
 // to create a clean facility for creating, compiling, and
 // freeing such programs.
@@ -65,6 +68,17 @@ public:
      */
     bpf_program* GetProgram();
 
+    /**
+     * Runs the compiled program on a packet. This uses Zeek's own BPF
+     * interpreter where it supports the program, and libpcap's otherwise.
+     *
+     * @param hdr The header of the packet to filter.
+     * @param pkt The content of the packet to filter.
+     *
+     * @return true if the program is compiled and matches the packet.
+     */
+    bool Matches(const struct pcap_pkthdr* hdr, const u_char* pkt);
+
     /**
      * Returns the state of the compilation process.
      */
@@ -85,6 +99,7 @@ protected:
     bool m_compiled = false;
     bool m_matches_anything = false;
     struct bpf_program m_program;
+    std::unique_ptr<BPF_Interpreter> m_interpreter;
 
     FilterState state = FilterState::OK;
     std::string state_message;
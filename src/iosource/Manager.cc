@@ -7,11 +7,19 @@
 // stop working.
 // clang-format off
 #include <sys/types.h>
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#else
 #include <sys/event.h>
+#endif
 // clang-format on
 #include <sys/time.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/NetVar.h"
 #include "zeek/RunState.h"
 #include "zeek/broker/Manager.h"
@@ -47,9 +55,18 @@ void Manager::WakeupHandler::Ping(std::string_view where) {
 }
 
 Manager::Manager() {
+#ifdef USE_EPOLL
+    event_queue = epoll_create1(EPOLL_CLOEXEC);
+    if ( event_queue == -1 )
+        reporter->FatalError("Failed to initialize epoll: %s", strerror(errno));
+
+    // epoll_wait() requires room for at least one event.
+    events.resize(1);
+#else
     event_queue = kqueue();
     if ( event_queue == -1 )
         reporter->FatalError("Failed to initialize kqueue: %s", strerror(errno));
+#endif
 }
 
 Manager::~Manager() {
@@ -173,6 +190,63 @@ void Manager::FindReadySources(ReadySources* ready) {
         Poll(ready, timeout, timeout_src);
 }
 
+#ifdef USE_EPOLL
+void Manager::Poll(ReadySources* ready, double timeout, IOSource* timeout_src) {
+    struct timespec epoll_timeout;
+    ConvertTimeout(timeout, epoll_timeout);
+
+#ifdef HAVE_EPOLL_PWAIT2
+    int ret = epoll_pwait2(event_queue, events.data(), events.size(), &epoll_timeout, nullptr);
+#else
+    // Without epoll_pwait2() we only get millisecond resolution. Round up so
+    // that short, non-zero timeouts don't turn into busy polling.
+    int timeout_ms = static_cast<int>(epoll_timeout.tv_sec * 1000 + std::ceil(epoll_timeout.tv_nsec / 1e6));
+    int ret = epoll_wait(event_queue, events.data(), events.size(), timeout_ms);
+#endif
+
+    if ( ret == -1 ) {
+        // Ignore interrupts since we may catch one during shutdown and we don't want the
+        // error to get printed.
+        if ( errno != EINTR )
+            reporter->InternalWarning("Error calling epoll_wait: %s", strerror(errno));
+    }
+    else if ( ret == 0 ) {
+        // If a timeout_src was provided and nothing else was ready, we timed out
+        // according to the given source's timeout and can add it as ready.
+        if ( timeout_src )
+            ready->push_back({timeout_src, -1, 0});
+    }
+    else {
+        // Unlike kqueue, epoll reports a single event per file descriptor
+        // that may cover both directions. Hang-ups and errors count as
+        // readable, like kqueue's EV_EOF does, so that the source gets to
+        // notice them.
+        bool timeout_src_added = false;
+        for ( int i = 0; i < ret; i++ ) {
+            int fd = events[i].data.fd;
+            auto ev = events[i].events;
+
+            if ( (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 ) {
+                if ( auto it = fd_map.find(fd); it != fd_map.end() ) {
+                    ready->push_back({it->second, fd, IOSource::ProcessFlags::READ});
+                    timeout_src_added |= it->second == timeout_src;
+                }
+            }
+
+            if ( (ev & (EPOLLOUT | EPOLLERR)) != 0 ) {
+                if ( auto it = write_fd_map.find(fd); it != write_fd_map.end() ) {
+                    ready->push_back({it->second, fd, IOSource::ProcessFlags::WRITE});
+                    timeout_src_added |= it->second == timeout_src;
+                }
+            }
+        }
+
+        // A timeout_src with a zero timeout can be considered ready.
+        if ( timeout_src && timeout == 0.0 && ! timeout_src_added )
+            ready->push_back({timeout_src, -1, 0});
+    }
+}
+#else
 void Manager::Poll(ReadySources* ready, double timeout, IOSource* timeout_src) {
     struct timespec kqueue_timeout;
     ConvertTimeout(timeout, kqueue_timeout);
@@ -216,6 +290,7 @@ void Manager::Poll(ReadySources* ready, double timeout, IOSource* timeout_src) {
             ready->push_back({timeout_src, -1, 0});
     }
 }
+#endif
 
 void Manager::ConvertTimeout(double timeout, struct timespec& spec) {
     // If timeout ended up -1, set it to some nominal value just to keep the loop
@@ -231,6 +306,79 @@ void Manager::ConvertTimeout(double timeout, struct timespec& spec) {
     }
 }
 
+#ifdef USE_EPOLL
+static uint32_t epoll_flags(bool read, bool write) { return (read ? EPOLLIN : 0) | (write ? EPOLLOUT : 0); }
+
+bool Manager::RegisterFd(int fd, IOSource* src, int flags) {
+    bool had_read = fd_map.count(fd) != 0;
+    bool had_write = write_fd_map.count(fd) != 0;
+    bool add_read = (flags & IOSource::READ) != 0 && ! had_read;
+    bool add_write = (flags & IOSource::WRITE) != 0 && ! had_write;
+
+    if ( ! add_read && ! add_write )
+        return true;
+
+    struct epoll_event ev = {};
+    ev.events = epoll_flags(had_read || add_read, had_write || add_write);
+    ev.data.fd = fd;
+
+    bool known = had_read || had_write;
+    if ( epoll_ctl(event_queue, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) == -1 ) {
+        reporter->Error("Failed to register fd %d from %s: %s (flags %d)", fd, src->Tag(), strerror(errno), flags);
+        return false;
+    }
+
+    DBG_LOG(DBG_MAINLOOP, "Registered fd %d from %s", fd, src->Tag());
+
+    // epoll returns at most one event per file descriptor.
+    if ( ! known && fd_map.size() + write_fd_map.size() > 0 )
+        events.emplace_back();
+
+    if ( add_read )
+        fd_map[fd] = src;
+    if ( add_write )
+        write_fd_map[fd] = src;
+
+    Wakeup("RegisterFd");
+    return true;
+}
+
+bool Manager::UnregisterFd(int fd, IOSource* src, int flags) {
+    bool had_read = fd_map.count(fd) != 0;
+    bool had_write = write_fd_map.count(fd) != 0;
+    bool del_read = (flags & IOSource::READ) != 0 && had_read;
+    bool del_write = (flags & IOSource::WRITE) != 0 && had_write;
+
+    if ( ! del_read && ! del_write ) {
+        reporter->Error("Attempted to unregister an unknown file descriptor %d from %s", fd, src->Tag());
+        return false;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = epoll_flags(had_read && ! del_read, had_write && ! del_write);
+    ev.data.fd = fd;
+
+    bool remove = ev.events == 0;
+
+    // We don't care about failure here. If it failed, it's likely because
+    // the file descriptor was already closed, which removed it from the
+    // epoll set already.
+    epoll_ctl(event_queue, remove ? EPOLL_CTL_DEL : EPOLL_CTL_MOD, fd, &ev);
+
+    DBG_LOG(DBG_MAINLOOP, "Unregistered fd %d from %s", fd, src->Tag());
+
+    if ( remove && events.size() > 1 )
+        events.pop_back();
+
+    if ( del_read )
+        fd_map.erase(fd);
+    if ( del_write )
+        write_fd_map.erase(fd);
+
+    Wakeup("UnregisterFd");
+    return true;
+}
+#else
 bool Manager::RegisterFd(int fd, IOSource* src, int flags) {
     std::vector<struct kevent> new_events;
 
@@ -314,6 +462,7 @@ bool Manager::UnregisterFd(int fd, IOSource* src, int flags) {
 
     return true;
 }
+#endif
 
 void Manager::Register(IOSource* src, bool dont_count, bool manage_lifetime) {
     // First see if we already have registered that source. If so, just
@@ -440,3 +589,83 @@ PktDumper* Manager::OpenPktDumper(const std::string& path, bool append) {
 }
 
 } // namespace zeek::iosource
+
+namespace {
+
+// A source owning a set of flares, used to measure the main loop's overhead
+// when lots of file descriptors are registered but few of them are active.
+class FlareSource final : public zeek::iosource::IOSource {
+public:
+    FlareSource(size_t n) : IOSource(true), flares(n) {
+        for ( size_t i = 0; i < n; ++i ) {
+            zeek::iosource_mgr->RegisterFd(flares[i].FD(), this);
+            fd_to_flare[flares[i].FD()] = i;
+        }
+    }
+
+    ~FlareSource() override {
+        for ( const auto& f : flares )
+            zeek::iosource_mgr->UnregisterFd(f.FD(), this);
+    }
+
+    void Fire(size_t i) { flares[i % flares.size()].Fire(); }
+    void Close() { SetClosed(true); }
+
+    void Process() override {}
+    void ProcessFd(int fd, int flags) override {
+        flares[fd_to_flare[fd]].Extinguish();
+        ++processed;
+    }
+
+    double GetNextTimeout() override { return -1; }
+    const char* Tag() override { return "FlareSource"; }
+
+    size_t processed = 0;
+
+private:
+    std::vector<zeek::detail::Flare> flares;
+    std::unordered_map<int, size_t> fd_to_flare;
+};
+
+} // namespace
+
+// Measures main loop iterations per second with one ready file descriptor
+// among many registered ones. Each flare uses two descriptors, so the largest
+// size needs a corresponding file descriptor limit. Run it with:
+//
+//     zeek --test --test-case="iosource manager loop benchmark" --no-skip
+TEST_CASE("iosource manager loop benchmark" * doctest::skip(true)) {
+    constexpr size_t iterations = 200000;
+
+    for ( size_t n : {10, 100, 1000, 10000} ) {
+        FlareSource src(n);
+        zeek::iosource_mgr->Register(&src, false, false);
+
+        zeek::iosource::Manager::ReadySources ready;
+        auto t0 = zeek::util::current_time(true);
+
+        for ( size_t i = 0; i < iterations; ++i ) {
+            src.Fire(i * 7919);
+            zeek::iosource_mgr->FindReadySources(&ready);
+
+            for ( const auto& r : ready )
+                if ( r.src == &src )
+                    src.ProcessFd(r.fd, r.flags);
+        }
+
+        auto t1 = zeek::util::current_time(true);
+
+#ifdef USE_EPOLL
+        const char* backend = "epoll";
+#else
+        const char* backend = "kqueue";
+#endif
+
+        fprintf(stderr, "%6zu flares  %s  %.0f iterations/sec\n", n, backend, iterations / (t1 - t0));
+        CHECK_GT(src.processed, 0);
+
+        // Closing the source makes the manager drop it on the next round.
+        src.Close();
+        zeek::iosource_mgr->FindReadySources(&ready);
+    }
+}
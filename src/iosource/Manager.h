@@ -13,6 +13,7 @@
 
 struct timespec;
 struct kevent;
+struct epoll_event;
 
 namespace zeek {
 namespace iosource {
@@ -159,7 +160,7 @@ private:
 
     /**
      * Converts a double timeout value into a timespec struct used for calls
-     * to kevent().
+     * to kevent() or epoll_pwait2().
      */
     void ConvertTimeout(double timeout, struct timespec& spec);
 
@@ -216,9 +217,13 @@ private:
     std::map<int, IOSource*> fd_map;
     std::map<int, IOSource*> write_fd_map;
 
-    // This is only used for the output of the call to kqueue in FindReadySources().
-    // The actual events are stored as part of the queue.
+    // This is only used for the output of the call to kqueue or epoll in
+    // Poll(). The actual events are stored as part of the queue.
+#ifdef USE_EPOLL
+    std::vector<struct epoll_event> events;
+#else
     std::vector<struct kevent> events;
+#endif
 };
 
 } // namespace iosource
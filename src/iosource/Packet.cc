@@ -25,23 +25,22 @@ namespace zeek {
 
 void Packet::Init(int arg_link_type, pkt_timeval* arg_ts, uint32_t arg_caplen, uint32_t arg_len, const u_char* arg_data,
                   bool arg_copy, std::string arg_tag) {
-    if ( data && copy )
-        delete[] data;
-
     link_type = arg_link_type;
     ts = *arg_ts;
     cap_len = arg_caplen;
     len = arg_len;
     tag = std::move(arg_tag);
 
-    copy = arg_copy;
-
     if ( arg_data && arg_copy ) {
-        data = new u_char[arg_caplen];
-        memcpy(const_cast<u_char*>(data), arg_data, arg_caplen);
+        auto copied = new u_char[arg_caplen];
+        memcpy(copied, arg_data, arg_caplen);
+        data_owner = std::shared_ptr<const u_char>(copied, std::default_delete<const u_char[]>());
+        data = copied;
     }
-    else
+    else {
+        data_owner.reset();
         data = arg_data;
+    }
 
     dump_packet = false;
 
@@ -70,10 +69,7 @@ void Packet::Init(int arg_link_type, pkt_timeval* arg_ts, uint32_t arg_caplen, u
     processed = false;
 }
 
-Packet::~Packet() {
-    if ( copy )
-        delete[] data;
-}
+Packet::~Packet() = default;
 
 RecordValPtr Packet::ToRawPktHdrVal() const {
     static auto raw_pkt_hdr_type = id::find_type<RecordType>("raw_pkt_hdr");
@@ -4,6 +4,7 @@
 
 #include <sys/types.h> // for u_char
 #include <cstdint>
+#include <memory>
 #include <string>
 
 #if defined(__OpenBSD__)
@@ -115,6 +116,37 @@ public:
     void Init(int link_type, pkt_timeval* ts, uint32_t caplen, uint32_t len, const u_char* data, bool copy = false,
               std::string tag = "");
 
+    /**
+     * Associates the packet's data with a reference-counted buffer. Packet
+     * sources that can lend out their buffers call this after \a Init()
+     * to allow analyzers to hold on to packet data past the source's
+     * \a DoneWithPacket() without copying it. The source must not reuse
+     * the buffer's memory until the last reference has been released.
+     *
+     * @param owner A reference keeping the memory *data* points into
+     * alive.
+     */
+    void SetDataOwner(std::shared_ptr<const u_char> owner) { data_owner = std::move(owner); }
+
+    /**
+     * Returns a reference to a range of the packet's data that keeps it
+     * valid beyond the packet's own lifetime.
+     *
+     * @param p Start of the range, which must point into the packet's data.
+     *
+     * @param n Length of the range.
+     *
+     * @return A reference pointing to *p*, or null if the packet's data
+     * isn't backed by a reference-counted buffer or the range isn't
+     * contained in it. Callers need to copy the data in that case.
+     */
+    std::shared_ptr<const u_char> ShareData(const u_char* p, uint64_t n) const {
+        if ( ! data_owner || p < data || n > cap_len || p + n > data + cap_len )
+            return nullptr;
+
+        return {data_owner, p};
+    }
+
     /**
      * Returns a \c raw_pkt_hdr RecordVal, which includes layer 2 and
      * also everything in IP_Hdr (i.e., IP4/6 + TCP/UDP/ICMP).
@@ -279,9 +311,10 @@ private:
     // Renders an MAC address into its ASCII representation.
     ValPtr FmtEUI48(const u_char* mac) const;
 
-    // True if we need to delete associated packet memory upon
-    // destruction.
-    bool copy;
+    // Keeps the packet's data alive if it lives in a reference-counted
+    // buffer, either lent out by the packet source or, for copied data,
+    // owned by ourselves.
+    std::shared_ptr<const u_char> data_owner;
 };
 
 } // namespace zeek
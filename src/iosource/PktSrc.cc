@@ -26,7 +26,7 @@ PktSrc::Properties::Properties() {
 }
 
 PktSrc::PktSrc() {
-    have_packet = false;
+    batch.resize(1);
     // Small lie to make a new PktSrc look like the previous ExtractNextPacket() was successful.
     had_packet = true;
     errbuf = "";
@@ -75,6 +75,10 @@ void PktSrc::Opened(const Properties& arg_props) {
 void PktSrc::Closed() {
     SetClosed(true);
 
+    // Whatever is left of the current batch has become invalid with
+    // the source's buffers.
+    batch_len = batch_pos = 0;
+
     if ( props.selectable_fd != -1 )
         iosource_mgr->UnregisterFd(props.selectable_fd, this);
 
@@ -94,7 +98,10 @@ void PktSrc::Weird(const std::string& msg, const Packet* p) { session_mgr->Weird
 
 void PktSrc::InternalError(const std::string& msg) { reporter->InternalError("%s", msg.c_str()); }
 
-void PktSrc::InitSource() { Open(); }
+void PktSrc::InitSource() {
+    batch.resize(std::max(BifConst::Pcap::packet_batch_size, static_cast<zeek_uint_t>(1)));
+    Open();
+}
 
 void PktSrc::Done() {
     if ( IsOpen() )
@@ -102,7 +109,7 @@ void PktSrc::Done() {
 }
 
 bool PktSrc::HasBeenIdleFor(double interval) const {
-    if ( have_packet || had_packet )
+    if ( batch_pos < batch_len || had_packet )
         return false;
 
     // Take the hit of a current_time() call now.
@@ -114,43 +121,68 @@ void PktSrc::Process() {
     if ( ! IsOpen() )
         return;
 
-    if ( ! ExtractNextPacketInternal() )
-        return;
+    // Drain up to a batch worth of packets per wakeup to amortize the
+    // main loop's bookkeeping. In pseudo-realtime mode each packet has
+    // to wait for its own time, so we stick to one at a time there.
+    size_t budget = run_state::pseudo_realtime ? 1 : batch.size();
+
+    while ( budget-- > 0 && ExtractNextPacketInternal() ) {
+        Packet* pkt = &batch[batch_pos];
+
+        // Get the next packet's session entry on its way into the cache
+        // while this one is being processed.
+        if ( batch_pos + 1 < batch_len )
+            packet_mgr->PrefetchPacket(&batch[batch_pos + 1]);
 
-    run_state::detail::dispatch_packet(&current_packet, this);
+        if ( pkt->time < 0 )
+            Weird("negative_packet_timestamp", pkt);
+        else
+            run_state::detail::dispatch_packet(pkt, this);
 
-    have_packet = false;
-    DoneWithPacket();
+        // Processing the packet may have closed the source, which
+        // discards the remainder of the batch.
+        if ( ! IsOpen() )
+            return;
+
+        if ( ++batch_pos == batch_len )
+            FinishBatch();
+    }
 }
 
-const char* PktSrc::Tag() { return "PktSrc"; }
+void PktSrc::FinishBatch() {
+    // Don't let the batch's packets keep lent buffers from going back to
+    // the source until their slots get reused.
+    for ( size_t i = 0; i < batch_len; ++i )
+        batch[i].SetDataOwner(nullptr);
 
-bool PktSrc::ExtractNextPacketInternal() {
-    if ( have_packet )
-        return true;
+    batch_len = batch_pos = 0;
+    DoneWithBatch();
+}
 
-    have_packet = false;
+const char* PktSrc::Tag() { return "PktSrc"; }
 
+bool PktSrc::ExtractNextPacketInternal() {
     // Don't return any packets if processing is suspended (except for the
     // very first packet which we need to set up times).
     if ( run_state::is_processing_suspended() && run_state::detail::first_timestamp )
         return false;
 
+    if ( batch_pos < batch_len )
+        return true;
+
     if ( run_state::pseudo_realtime )
         run_state::detail::current_wallclock = util::current_time(true);
 
-    if ( ExtractNextPacket(&current_packet) ) {
-        had_packet = true;
+    size_t max = run_state::pseudo_realtime ? 1 : batch.size();
+    batch_pos = 0;
+    batch_len = ExtractNextBatch(batch.data(), max);
 
-        if ( current_packet.time < 0 ) {
-            Weird("negative_packet_timestamp", &current_packet);
-            return false;
-        }
+    if ( batch_len > 0 ) {
+        had_packet = true;
 
-        if ( ! run_state::detail::first_timestamp )
-            run_state::detail::first_timestamp = current_packet.time;
+        if ( ! run_state::detail::first_timestamp && batch[0].time >= 0 )
+            run_state::detail::first_timestamp = batch[0].time;
 
-        have_packet = true;
         return true;
     }
     else {
@@ -226,14 +258,14 @@ bool PktSrc::ApplyBPFFilter(int index, const struct pcap_pkthdr* hdr, const u_ch
     if ( code->MatchesAnything() )
         return true;
 
-    return pcap_offline_filter(code->GetProgram(), hdr, pkt);
+    return code->Matches(hdr, pkt);
 }
 
 bool PktSrc::GetCurrentPacket(const Packet** pkt) {
-    if ( ! have_packet )
+    if ( batch_pos >= batch_len )
         return false;
 
-    *pkt = &current_packet;
+    *pkt = &batch[batch_pos];
     return true;
 }
 
@@ -247,7 +279,7 @@ double PktSrc::GetNextTimeout() {
         ExtractNextPacketInternal();
 
         // This duplicates the calculation used in run_state::check_pseudo_time().
-        double pseudo_time = current_packet.time - run_state::detail::first_timestamp;
+        double pseudo_time = batch[batch_pos].time - run_state::detail::first_timestamp;
         double ct = (util::current_time(true) - run_state::detail::first_wallclock) * run_state::pseudo_realtime;
         return std::max(0.0, pseudo_time - ct);
     }
@@ -260,9 +292,9 @@ double PktSrc::GetNextTimeout() {
 
     // A heuristic to avoid short sleeps when a non-selectable packet source has more
     // packets queued is to return 0.0 if the source has yielded a packet on the
-    // last call to ExtractNextPacket().
+    // last call to ExtractNextBatch().
     if ( props.selectable_fd == -1 ) {
-        if ( have_packet || had_packet )
+        if ( batch_pos < batch_len || had_packet )
             return 0.0;
 
         return BifConst::Pcap::non_fd_timeout;
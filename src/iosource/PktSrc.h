@@ -50,6 +50,13 @@ public:
          * Packets filtered by the packet source.
          */
         std::optional<uint64_t> filtered;
+
+        /**
+         * Fraction of the source's capture buffer, between 0 and 1, that
+         * holds packets not yet processed. Optional, can be left unset if
+         * not available.
+         */
+        std::optional<double> buffer_fill;
     };
 
     /**
@@ -350,6 +357,37 @@ protected:
      */
     virtual void DoneWithPacket() = 0;
 
+    /**
+     * Provides up to \a max packets from the source at once.
+     *
+     * Sources that can lend out several packet buffers at the same time
+     * (e.g., ring-buffer based capture mechanisms handing over whole
+     * blocks) should override this method to amortize per-packet
+     * overhead. The default implementation extracts at most a single
+     * packet through \a ExtractNextPacket().
+     *
+     * @param pkts An array of at least \a max packet structures to fill
+     * in. The callee keeps ownership of the data but must guarantee that
+     * it stays available for all returned packets at least until \a
+     * DoneWithBatch() is called. It is guaranteed that no two calls to
+     * this method will happen without \a DoneWithBatch() in between.
+     *
+     * @param max The maximum number of packets to return. Always larger
+     * than zero.
+     *
+     * @return The number of packets filled into *pkts*. Zero if no packet
+     * is available or an error occurred (which must be flagged via
+     * Error()).
+     */
+    virtual size_t ExtractNextBatch(Packet* pkts, size_t max) { return ExtractNextPacket(&pkts[0]) ? 1 : 0; }
+
+    /**
+     * Signals that the data of all packets previously extracted via \a
+     * ExtractNextBatch() will no longer be needed. The default
+     * implementation calls \a DoneWithPacket().
+     */
+    virtual void DoneWithBatch() { DoneWithPacket(); }
+
     /**
      * Performs the actual filter compilation. This can be overridden to
      * provide a different implementation of the compilation called by
@@ -363,9 +401,13 @@ protected:
     virtual detail::BPF_Program* CompileFilter(const std::string& filter);
 
 private:
-    // Internal helper for ExtractNextPacket().
+    // Internal helper for ExtractNextBatch(). Returns true if there's a
+    // pending packet at batch[batch_pos].
     bool ExtractNextPacketInternal();
 
+    // Internal helper releasing a completely dispatched batch.
+    void FinishBatch();
+
     // IOSource interface implementation.
     void InitSource() override;
     void Done() override;
@@ -374,9 +416,13 @@ private:
 
     Properties props;
 
-    bool have_packet;
-    Packet current_packet;
-    // Did the previous call to ExtractNextPacket() yield a packet.
+    // Packets handed out by the most recent ExtractNextBatch() call. Entries
+    // in [batch_pos, batch_len) are still waiting to be dispatched.
+    std::vector<Packet> batch;
+    size_t batch_len = 0;
+    size_t batch_pos = 0;
+
+    // Did the previous call to ExtractNextBatch() yield a packet.
     bool had_packet;
 
     double idle_at_wallclock = 0.0;
@@ -209,7 +209,12 @@ bool PcapSource::ExtractNextPacket(Packet* pkt) {
     const u_char* data;
     pcap_pkthdr* header;
 
-    int res = pcap_next_ex(pd, &header, &data);
+    auto* filter = offline_filter >= 0 ? GetBPFFilter(offline_filter) : nullptr;
+
+    int res;
+    do {
+        res = pcap_next_ex(pd, &header, &data);
+    } while ( res == 1 && filter && data && ! filter->Matches(header, data) );
 
     switch ( res ) {
         case PCAP_ERROR_BREAK: // -2
@@ -301,6 +306,18 @@ bool PcapSource::SetFilter(int index) {
         // since the default scripts will always attempt to compile
         // and install a default filter
     }
+    else if ( ! props.is_live ) {
+        // When reading a file, we apply the filter ourselves instead of
+        // handing it to libpcap, because BPF_Program's interpreter is
+        // faster than libpcap's. Filters matching everything don't need
+        // to run at all.
+        if ( code->GetProgram() )
+            offline_filter = code->MatchesAnything() ? -1 : index;
+        else if ( code->GetState() != FilterState::OK )
+            return false;
+        else
+            offline_filter = -1;
+    }
     else if ( auto program = code->GetProgram() ) {
         if ( pcap_setfilter(pd, program) < 0 ) {
             PcapError();
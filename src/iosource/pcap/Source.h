@@ -43,6 +43,10 @@ private:
     pcap_t* pd;
     struct pcap_stat prev_pstat = {0};
 
+    // Index of the filter that ExtractNextPacket() applies when reading
+    // from a PCAP file, or -1 if there's none.
+    int offline_filter = -1;
+
     // Buffer provided to setvbuf() when reading from a PCAP file.
     std::vector<char> iobuf;
 };
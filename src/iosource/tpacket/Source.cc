@@ -0,0 +1,410 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/tpacket/Source.h"
+
+#include "zeek/zeek-config.h"
+
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <pcap.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "zeek/Reassem.h"
+#include "zeek/iosource/BPF_Program.h"
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/tpacket/tpacket.bif.h"
+
+namespace zeek::iosource::tpacket {
+
+TPacketSource::TPacketSource(const std::string& path, bool is_live) {
+    props.path = path;
+    props.is_live = is_live;
+}
+
+TPacketSource::~TPacketSource() { Close(); }
+
+void TPacketSource::Open() {
+    if ( ! props.is_live ) {
+        Error("tpacket sources only support live capture");
+        return;
+    }
+
+    fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+    if ( fd < 0 ) {
+        SysError("socket");
+        return;
+    }
+
+    int ifindex = if_nametoindex(props.path.c_str());
+
+    if ( ifindex == 0 ) {
+        SysError(util::fmt("unknown interface %s", props.path.c_str()));
+        return;
+    }
+
+    if ( ! LinkTypeOf(ifindex) )
+        return;
+
+    int version = TPACKET_V3;
+
+    if ( setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ) {
+        SysError("setsockopt(PACKET_VERSION)");
+        return;
+    }
+
+    if ( BifConst::TPacket::enable_hw_timestamping )
+        EnableHardwareTimestamps();
+
+    if ( ! SetupRing() )
+        return;
+
+    struct sockaddr_ll addr = {};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = ifindex;
+
+    if ( bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ) {
+        SysError("bind");
+        return;
+    }
+
+    struct packet_mreq mreq = {};
+    mreq.mr_ifindex = ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+
+    if ( setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 ) {
+        SysError("setsockopt(PACKET_ADD_MEMBERSHIP)");
+        return;
+    }
+
+    if ( auto fanout_id = BifConst::TPacket::fanout_id ) {
+        // Sockets joining the same group split the interface's traffic by
+        // flow hash, with IP fragments reassembled first so that they hash
+        // like the rest of their flow.
+        int fanout = (fanout_id & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+
+        if ( setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0 ) {
+            SysError("setsockopt(PACKET_FANOUT)");
+            return;
+        }
+    }
+
+    props.selectable_fd = fd;
+    props.netmask = NETMASK_UNKNOWN;
+    props.is_live = true;
+
+    Opened(props);
+}
+
+void TPacketSource::Close() {
+    if ( fd < 0 )
+        return;
+
+    // Blocks still lent out keep the ring mapped until they're returned.
+    block_owner.reset();
+    ring.reset();
+
+    close(fd);
+
+    fd = -1;
+    current_block = 0;
+    have_block = false;
+    next_pkt = nullptr;
+    pkts_left = 0;
+
+    Closed();
+}
+
+bool TPacketSource::LinkTypeOf(int ifindex) {
+    struct ifreq ifr = {};
+    strncpy(ifr.ifr_name, props.path.c_str(), sizeof(ifr.ifr_name) - 1);
+
+    if ( ioctl(fd, SIOCGIFHWADDR, &ifr) < 0 ) {
+        SysError("ioctl(SIOCGIFHWADDR)");
+        return false;
+    }
+
+    switch ( ifr.ifr_hwaddr.sa_family ) {
+        case ARPHRD_LOOPBACK:
+            // Packet sockets see loopback traffic twice, once leaving and
+            // once entering the interface. Like libpcap, we skip the former.
+            skip_outgoing = true;
+            props.link_type = DLT_EN10MB;
+            return true;
+
+        case ARPHRD_ETHER:
+            props.link_type = DLT_EN10MB;
+            return true;
+
+        default:
+            Error(util::fmt("unsupported link type %d on interface %s", ifr.ifr_hwaddr.sa_family,
+                            props.path.c_str()));
+            Close();
+            return false;
+    }
+}
+
+bool TPacketSource::SetupRing() {
+    auto block_size = BifConst::TPacket::block_size;
+    auto page_size = static_cast<zeek_uint_t>(getpagesize());
+
+    if ( block_size == 0 || block_size % page_size != 0 || (block_size & (block_size - 1)) != 0 ) {
+        Error(util::fmt("TPacket::block_size must be a power of two multiple of the page size (%" PRIu64 ")",
+                        page_size));
+        Close();
+        return false;
+    }
+
+    auto block_nr = BifConst::TPacket::buffer_size * 1024 * 1024 / block_size;
+
+    if ( block_nr < 2 )
+        block_nr = 2;
+
+    // Frames don't have a fixed size with TPACKET_V3, but the kernel still
+    // validates their geometry.
+    req.tp_block_size = block_size;
+    req.tp_block_nr = block_nr;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    req.tp_frame_nr = block_size / req.tp_frame_size * block_nr;
+    req.tp_retire_blk_tov = static_cast<unsigned int>(BifConst::TPacket::block_timeout * 1000);
+    req.tp_sizeof_priv = 0;
+    req.tp_feature_req_word = 0;
+
+    if ( req.tp_retire_blk_tov == 0 )
+        req.tp_retire_blk_tov = 1;
+
+    if ( setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 ) {
+        SysError("setsockopt(PACKET_RX_RING)");
+        return false;
+    }
+
+    auto ring_size = static_cast<size_t>(req.tp_block_size) * req.tp_block_nr;
+    void* mem = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+
+    if ( mem == MAP_FAILED ) {
+        SysError("mmap");
+        return false;
+    }
+
+    ring = std::make_shared<Ring>();
+    ring->mem = static_cast<uint8_t*>(mem);
+    ring->size = ring_size;
+    ring->block_size = req.tp_block_size;
+    ring->lent.resize(req.tp_block_nr);
+
+    // Leave the kernel at least half of the ring to fill.
+    max_lent = std::min(static_cast<size_t>(BifConst::TPacket::max_lent_blocks), static_cast<size_t>(block_nr / 2));
+    return true;
+}
+
+TPacketSource::Ring::~Ring() { munmap(mem, size); }
+
+void TPacketSource::EnableHardwareTimestamps() {
+    // Ask the NIC to timestamp all incoming packets. This needs
+    // CAP_NET_ADMIN and driver support; without either, we keep going with
+    // the kernel's software timestamps.
+    struct hwtstamp_config config = {};
+    config.tx_type = HWTSTAMP_TX_OFF;
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+    struct ifreq ifr = {};
+    strncpy(ifr.ifr_name, props.path.c_str(), sizeof(ifr.ifr_name) - 1);
+    ifr.ifr_data = reinterpret_cast<char*>(&config);
+
+    if ( ioctl(fd, SIOCSHWTSTAMP, &ifr) < 0 ) {
+        Info(util::fmt("hardware timestamping not available on %s: %s", props.path.c_str(), strerror(errno)));
+        return;
+    }
+
+    int req = SOF_TIMESTAMPING_RAW_HARDWARE;
+
+    if ( setsockopt(fd, SOL_PACKET, PACKET_TIMESTAMP, &req, sizeof(req)) < 0 )
+        Info(util::fmt("cannot use hardware timestamps on %s: %s", props.path.c_str(), strerror(errno)));
+}
+
+bool TPacketSource::ExtractNextPacket(Packet* pkt) { return ExtractNextBatch(pkt, 1) > 0; }
+
+void TPacketSource::DoneWithPacket() { DoneWithBatch(); }
+
+size_t TPacketSource::ExtractNextBatch(Packet* pkts, size_t max) {
+    if ( ! ring )
+        return 0;
+
+    if ( ! have_block ) {
+        // The kernel doesn't skip blocks we still hold, so whoever still
+        // references the block's data needs to let go of it now. Blocks
+        // may be held indefinitely, like by fragments that never complete.
+        if ( ring->lent[current_block] ) {
+            auto* mem = reinterpret_cast<const u_char*>(Block(current_block));
+            DataBlock::Unshare(mem, mem + req.tp_block_size);
+
+            if ( ring->lent[current_block] )
+                return 0;
+        }
+
+        auto* block = Block(current_block);
+
+        if ( (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0 )
+            return 0;
+
+        have_block = true;
+        pkts_left = block->hdr.bh1.num_pkts;
+        next_pkt = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(block) +
+                                                   block->hdr.bh1.offset_to_first_pkt);
+
+        if ( ring->num_lent < max_lent )
+            block_owner = LendBlock(current_block);
+    }
+
+    size_t n = 0;
+
+    while ( n < max && pkts_left > 0 ) {
+        auto* hdr = next_pkt;
+        next_pkt = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(hdr) + hdr->tp_next_offset);
+        --pkts_left;
+
+        if ( skip_outgoing ) {
+            auto* sll = reinterpret_cast<const sockaddr_ll*>(reinterpret_cast<uint8_t*>(hdr) +
+                                                             TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+            if ( sll->sll_pkttype == PACKET_OUTGOING )
+                continue;
+        }
+
+        auto* data = reinterpret_cast<const u_char*>(hdr) + hdr->tp_mac;
+        pkt_timeval ts = {static_cast<time_t>(hdr->tp_sec), static_cast<suseconds_t>(hdr->tp_nsec / 1000)};
+
+        auto& pkt = pkts[n];
+        pkt.Init(props.link_type, &ts, hdr->tp_snaplen, hdr->tp_len, data);
+
+        if ( block_owner )
+            pkt.SetDataOwner(block_owner);
+
+        // The kernel strips the outermost VLAN tag and reports it
+        // separately.
+        if ( hdr->tp_status & TP_STATUS_VLAN_VALID )
+            pkt.vlan = hdr->hv1.tp_vlan_tci & 0x0fff;
+
+        ++stats.received;
+        stats.bytes_received += hdr->tp_len;
+        ++n;
+    }
+
+    // Blocks may be empty when retired by timeout, or hold only packets we
+    // skip.
+    if ( n == 0 )
+        ReleaseBlock();
+
+    return n;
+}
+
+void TPacketSource::DoneWithBatch() {
+    if ( have_block && pkts_left == 0 )
+        ReleaseBlock();
+}
+
+std::shared_ptr<const u_char> TPacketSource::LendBlock(size_t idx) {
+    ring->lent[idx] = true;
+    ++ring->num_lent;
+
+    // The block goes back to the kernel with its last reference.
+    auto* block = reinterpret_cast<const u_char*>(Block(idx));
+    return {block, [r = ring, idx](const u_char*) {
+                r->lent[idx] = false;
+                --r->num_lent;
+                __atomic_store_n(&r->Block(idx)->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            }};
+}
+
+void TPacketSource::ReleaseBlock() {
+    if ( block_owner )
+        block_owner.reset();
+    else {
+        auto* block = Block(current_block);
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    }
+
+    current_block = (current_block + 1) % req.tp_block_nr;
+    have_block = false;
+    next_pkt = nullptr;
+    pkts_left = 0;
+}
+
+bool TPacketSource::SetFilter(int index) {
+    if ( fd < 0 )
+        return true; // Prevent error message
+
+    iosource::detail::BPF_Program* code = GetBPFFilter(index);
+
+    if ( ! code ) {
+        Error(util::fmt("No precompiled pcap filter for index %d", index));
+        return false;
+    }
+
+    auto* program = code->GetProgram();
+
+    if ( ! program )
+        return code->GetState() == FilterState::OK;
+
+    // The kernel's classic BPF instructions share libpcap's layout.
+    struct sock_fprog fprog = {};
+    fprog.len = program->bf_len;
+    fprog.filter = reinterpret_cast<struct sock_filter*>(program->bf_insns);
+
+    if ( setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 ) {
+        SysError("setsockopt(SO_ATTACH_FILTER)");
+        return false;
+    }
+
+    return true;
+}
+
+void TPacketSource::Statistics(Stats* s) {
+    if ( fd >= 0 ) {
+        struct tpacket_stats_v3 kstats = {};
+        socklen_t len = sizeof(kstats);
+
+        // The kernel resets its counters whenever we query them.
+        if ( getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) == 0 ) {
+            stats.link += kstats.tp_packets;
+            stats.dropped += kstats.tp_drops;
+        }
+    }
+
+    s->received = stats.received;
+    s->dropped = stats.dropped;
+    s->link = stats.link;
+    s->bytes_received = stats.bytes_received;
+
+    if ( ring ) {
+        size_t full = 0;
+
+        for ( size_t i = 0; i < req.tp_block_nr; ++i )
+            if ( __atomic_load_n(&Block(i)->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER )
+                ++full;
+
+        s->buffer_fill = static_cast<double>(full) / req.tp_block_nr;
+    }
+}
+
+void TPacketSource::SysError(const char* where) {
+    Error(util::fmt("%s: %s", where, strerror(errno)));
+    Close();
+}
+
+PktSrc* TPacketSource::Instantiate(const std::string& path, bool is_live) {
+    return new TPacketSource(path, is_live);
+}
+
+} // namespace zeek::iosource::tpacket
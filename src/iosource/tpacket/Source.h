@@ -0,0 +1,86 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <linux/if_packet.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "zeek/iosource/PktSrc.h"
+
+namespace zeek::iosource::tpacket {
+
+/**
+ * A Linux packet source reading directly from a TPACKET_V3 memory-mapped
+ * receive ring. The kernel fills the ring's blocks with packets and hands
+ * them over a whole block at a time, which the source passes on through
+ * the batch interface without copying. Up to TPacket::max_lent_blocks
+ * blocks can be lent out to analyzers holding on to their packets' data,
+ * in which case they return to the kernel once the last reference is gone,
+ * or when capture wraps around to them, with the holders copying the data.
+ */
+class TPacketSource : public PktSrc {
+public:
+    TPacketSource(const std::string& path, bool is_live);
+    ~TPacketSource() override;
+
+    static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+    // PktSrc interface.
+    void Open() override;
+    void Close() override;
+    bool ExtractNextPacket(Packet* pkt) override;
+    void DoneWithPacket() override;
+    size_t ExtractNextBatch(Packet* pkts, size_t max) override;
+    void DoneWithBatch() override;
+    bool SetFilter(int index) override;
+    void Statistics(Stats* stats) override;
+
+private:
+    // The mapped ring. Lent blocks keep it mapped until they've all been
+    // returned, even if the source has been closed in the meantime.
+    struct Ring {
+        uint8_t* mem = nullptr;
+        size_t size = 0;
+        size_t block_size = 0;
+        std::vector<bool> lent;
+        size_t num_lent = 0;
+
+        ~Ring();
+
+        tpacket_block_desc* Block(size_t idx) const {
+            return reinterpret_cast<tpacket_block_desc*>(mem + idx * block_size);
+        }
+    };
+
+    tpacket_block_desc* Block(size_t idx) const { return ring->Block(idx); }
+
+    bool LinkTypeOf(int ifindex);
+    bool SetupRing();
+    void EnableHardwareTimestamps();
+    std::shared_ptr<const u_char> LendBlock(size_t idx);
+    void ReleaseBlock();
+    void SysError(const char* where);
+
+    Properties props;
+    Stats stats;
+
+    int fd = -1;
+    tpacket_req3 req = {};
+    std::shared_ptr<Ring> ring;
+    size_t max_lent = 0;
+
+    // The block currently being handed out, and the position within it.
+    // If the block is lent out, its packets share block_owner.
+    size_t current_block = 0;
+    bool have_block = false;
+    std::shared_ptr<const u_char> block_owner;
+    tpacket3_hdr* next_pkt = nullptr;
+    uint32_t pkts_left = 0;
+
+    bool skip_outgoing = false;
+};
+
+} // namespace zeek::iosource::tpacket
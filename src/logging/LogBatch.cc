@@ -0,0 +1,172 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/LogBatch.h"
+
+#include <cstring>
+
+#include "zeek/IPAddr.h"
+
+using zeek::threading::Value;
+
+namespace zeek::logging {
+
+LogBatch::Column::Column(TypeTag arg_type, TypeTag arg_subtype, std::string* arg_arena)
+    : type(arg_type), subtype(arg_subtype), arena(arg_arena) {
+    if ( type == TYPE_TABLE || type == TYPE_VECTOR )
+        elements = std::make_unique<Column>(subtype, TYPE_VOID, arena);
+}
+
+LogBatch::Cell& LogBatch::Column::NewCell(bool null) {
+    auto i = cells.size();
+
+    if ( i % 64 == 0 )
+        nulls.push_back(0);
+
+    if ( null )
+        nulls[i / 64] |= uint64_t(1) << (i % 64);
+
+    return cells.emplace_back();
+}
+
+void LogBatch::Column::AddNull() {
+    auto& c = NewCell(true);
+
+    if ( elements )
+        // Keep the element ranges contiguous.
+        c.uint_val = elements->Size();
+    else
+        memset(&c, 0, sizeof(c));
+}
+
+void LogBatch::Column::AddPort(zeek_uint_t port, TransportProto proto) {
+    auto& c = NewCell();
+    c.port_val.port = port;
+    c.port_val.proto = proto;
+}
+
+void LogBatch::Column::AddAddr(const IPAddr& a) { a.ConvertToThreadingValue(&NewCell().addr_val); }
+
+void LogBatch::Column::AddSubNet(const IPPrefix& s) { s.ConvertToThreadingValue(&NewCell().subnet_val); }
+
+void LogBatch::Column::AddString(const char* data, size_t len) {
+    auto& c = NewCell();
+    c.string_val.offset = arena->size();
+    c.string_val.length = len;
+    arena->append(data, len);
+}
+
+void LogBatch::Column::Reserve(size_t n) {
+    cells.reserve(n);
+    nulls.reserve((n + 63) / 64);
+}
+
+LogBatch::LogBatch(int num_fields, const threading::Field* const* fields) {
+    columns.reserve(num_fields);
+
+    for ( int i = 0; i < num_fields; ++i )
+        columns.emplace_back(fields[i]->type, fields[i]->subtype, &arena);
+}
+
+void LogBatch::Reserve(int rows, size_t arena_size) {
+    for ( auto& c : columns )
+        c.Reserve(rows);
+
+    arena.reserve(arena_size);
+}
+
+// Fills in a value from a cell, pointing its string data into the arena.
+static void fill_value(Value* v, const LogBatch& batch, const LogBatch::Cell& c) {
+    switch ( v->type ) {
+        case TYPE_BOOL:
+        case TYPE_INT: v->val.int_val = c.int_val; break;
+
+        case TYPE_COUNT: v->val.uint_val = c.uint_val; break;
+
+        case TYPE_PORT: v->val.port_val = c.port_val; break;
+
+        case TYPE_ADDR: v->val.addr_val = c.addr_val; break;
+
+        case TYPE_SUBNET: v->val.subnet_val = c.subnet_val; break;
+
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: v->val.double_val = c.double_val; break;
+
+        case TYPE_ENUM:
+        case TYPE_STRING:
+        case TYPE_FILE:
+        case TYPE_FUNC: {
+            v->val.string_val.data = const_cast<char*>(batch.StringData(c));
+            v->val.string_val.length = static_cast<int>(c.string_val.length);
+            break;
+        }
+
+        default: break;
+    }
+}
+
+LogBatch::RowBuffer::~RowBuffer() {
+    // The values don't own their string data or element arrays, which
+    // their destructor skips for values not present.
+    for ( auto& s : slots ) {
+        for ( auto e : s.elements ) {
+            e->present = false;
+            delete e;
+        }
+
+        s.val->present = false;
+        delete s.val;
+    }
+}
+
+void LogBatch::RowBuffer::FillValue(Value* v, const LogBatch& batch, const Column& col, size_t i) {
+    v->type = col.Type();
+    v->subtype = col.SubType();
+    v->present = ! col.IsNull(i);
+
+    if ( v->present )
+        fill_value(v, batch, col.At(i));
+}
+
+threading::Value** LogBatch::RowBuffer::Fill(const LogBatch& batch, int row) {
+    auto n = batch.NumFields();
+
+    while ( static_cast<int>(slots.size()) < n ) {
+        slots.emplace_back();
+        slots.back().val = new Value;
+    }
+
+    vals.resize(n);
+
+    for ( int i = 0; i < n; ++i ) {
+        auto& col = batch.GetColumn(i);
+        auto& s = slots[i];
+        auto v = s.val;
+
+        FillValue(v, batch, col, row);
+        vals[i] = v;
+
+        if ( ! v->present || (col.Type() != TYPE_TABLE && col.Type() != TYPE_VECTOR) )
+            continue;
+
+        auto [b, e] = col.ElementRange(row);
+        auto num = e - b;
+
+        while ( s.elements.size() < num )
+            s.elements.push_back(new Value);
+
+        s.element_ptrs.resize(num);
+
+        for ( size_t j = 0; j < num; ++j ) {
+            FillValue(s.elements[j], batch, col.Elements(), b + j);
+            s.element_ptrs[j] = s.elements[j];
+        }
+
+        v->val.set_val.size = num;
+        v->val.set_val.vals = s.element_ptrs.data();
+    }
+
+    return vals.data();
+}
+
+} // namespace zeek::logging
@@ -0,0 +1,213 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Column-wise storage for a batch of log writes on their way from the
+// logging::Manager to a writer.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek {
+
+class IPAddr;
+class IPPrefix;
+
+namespace logging {
+
+/**
+ * A batch of log records written to one writer, stored by column rather
+ * than as one threading::Value array per record. Each column keeps its
+ * values in a single typed vector, plus a bitmap marking the unset ones.
+ * The string data of all columns goes into one arena shared by the batch,
+ * and the elements of set and vector columns into a nested column. The
+ * manager fills a batch on the main thread, with no allocations per value
+ * once the batch's storage has grown to its working size, and then passes
+ * it to the writer thread as a whole.
+ */
+class LogBatch {
+public:
+    /**
+     * The storage for one value of a column. Which member is valid
+     * depends on the column's type, as for threading::Value.
+     */
+    union Cell {
+        zeek_int_t int_val;     // bool, int
+        zeek_uint_t uint_val;   // count, and for sets and vectors the end of the elements
+        double double_val;      // double, time, interval
+        threading::Value::port_t port_val;
+        threading::Value::addr_t addr_val;
+        threading::Value::subnet_t subnet_val;
+
+        struct {
+            size_t offset;      // into the batch's arena
+            size_t length;
+        } string_val;           // enum, string, file, func
+    };
+
+    /**
+     * One column of a batch.
+     */
+    class Column {
+    public:
+        Column(TypeTag type, TypeTag subtype, std::string* arena);
+
+        TypeTag Type() const { return type; }
+        TypeTag SubType() const { return subtype; }
+
+        /**
+         * Returns the number of values in the column.
+         */
+        size_t Size() const { return cells.size(); }
+
+        /**
+         * Returns true if the i'th value is unset.
+         */
+        bool IsNull(size_t i) const { return (nulls[i / 64] >> (i % 64)) & 1; }
+
+        /**
+         * Returns the i'th value.
+         */
+        const Cell& At(size_t i) const { return cells[i]; }
+
+        /**
+         * For set and vector columns, returns the column holding the
+         * elements of all of the values.
+         */
+        const Column& Elements() const { return *elements; }
+        Column& Elements() { return *elements; }
+
+        /**
+         * For set and vector columns, returns the index into Elements()
+         * of the i'th value's first element, and one beyond its last.
+         */
+        std::pair<size_t, size_t> ElementRange(size_t i) const {
+            return {i > 0 ? cells[i - 1].uint_val : 0, cells[i].uint_val};
+        }
+
+        // Methods for adding a value to the end of the column. They
+        // must match the column's type.
+        void AddNull();
+        void AddInt(zeek_int_t i) { NewCell().int_val = i; }
+        void AddUInt(zeek_uint_t u) { NewCell().uint_val = u; }
+        void AddDouble(double d) { NewCell().double_val = d; }
+        void AddPort(zeek_uint_t port, TransportProto proto);
+        void AddAddr(const IPAddr& a);
+        void AddSubNet(const IPPrefix& s);
+        void AddString(const char* data, size_t len);
+
+        /**
+         * Adds a set or vector value, consisting of the elements added to
+         * Elements() since the previous value.
+         */
+        void AddContainer() { NewCell().uint_val = elements->Size(); }
+
+        /**
+         * Preallocates storage for the given number of values.
+         */
+        void Reserve(size_t n);
+
+    private:
+        Cell& NewCell(bool null = false);
+
+        TypeTag type;
+        TypeTag subtype;
+        std::vector<Cell> cells;
+        std::vector<uint64_t> nulls;
+        std::unique_ptr<Column> elements;
+        std::string* arena;
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param num_fields The number of log fields.
+     *
+     * @param fields The log fields, which determine the types of the
+     * columns. The batch does not take ownership.
+     */
+    LogBatch(int num_fields, const threading::Field* const* fields);
+
+    LogBatch(const LogBatch&) = delete;
+    LogBatch& operator=(const LogBatch&) = delete;
+
+    int NumFields() const { return static_cast<int>(columns.size()); }
+
+    /**
+     * Returns the number of complete records in the batch.
+     */
+    int NumRows() const { return num_rows; }
+
+    const Column& GetColumn(int i) const { return columns[i]; }
+    Column& GetColumn(int i) { return columns[i]; }
+
+    /**
+     * Returns the start of the string data of a cell.
+     */
+    const char* StringData(const Cell& c) const { return arena.data() + c.string_val.offset; }
+
+    /**
+     * Completes a record once a value has been added to each column.
+     */
+    void AddRow() { ++num_rows; }
+
+    /**
+     * Returns the number of bytes of string data in the batch.
+     */
+    size_t ArenaSize() const { return arena.size(); }
+
+    /**
+     * Preallocates storage for the given number of records and bytes of
+     * string data, such as those of the preceding batch.
+     */
+    void Reserve(int rows, size_t arena_size);
+
+    /**
+     * Presents the records of batches as threading::Value arrays, for
+     * writers that work on individual records. The Value objects are
+     * allocated once and reused for every record, with their string data
+     * pointing into the batch. They thus remain valid only until the next
+     * call to Fill() and as long as the batch exists, and must not be
+     * deleted or modified by the caller.
+     */
+    class RowBuffer {
+    public:
+        RowBuffer() = default;
+        ~RowBuffer();
+
+        RowBuffer(const RowBuffer&) = delete;
+        RowBuffer& operator=(const RowBuffer&) = delete;
+
+        /**
+         * Returns the values of the given record of the batch.
+         */
+        threading::Value** Fill(const LogBatch& batch, int row);
+
+    private:
+        struct Slot {
+            threading::Value* val = nullptr;
+
+            // For sets and vectors, the reused element values, and the
+            // array of pointers to them that the value refers to.
+            std::vector<threading::Value*> elements;
+            std::vector<threading::Value*> element_ptrs;
+        };
+
+        void FillValue(threading::Value* v, const LogBatch& batch, const Column& col, size_t i);
+
+        std::vector<Slot> slots;
+        std::vector<threading::Value*> vals;
+    };
+
+private:
+    std::vector<Column> columns;
+    std::string arena;
+    int num_rows = 0;
+};
+
+} // namespace logging
+} // namespace zeek
@@ -668,7 +668,7 @@ bool Manager::DisableStream(EnumVal* id) {
 
 // Helper for recursive record field unrolling.
 bool Manager::TraverseRecord(Stream* stream, Filter* filter, RecordType* rt, TableVal* include, TableVal* exclude,
-                             const string& path, const list<int>& indices) {
+                             const string& path, const list<int>& indices, bool optional) {
     // Only include extensions for the outer record.
     int num_ext_fields = (indices.size() == 0) ? filter->num_ext_fields : 0;
 
@@ -706,10 +706,17 @@ bool Manager::TraverseRecord(Stream* stream, Filter* filter, RecordType* rt, Tab
         if ( j < num_ext_fields )
             new_path = filter->ext_prefix + new_path;
 
+        // A field may be missing if it's optional itself, or if it's in an
+        // optional record. Extension fields are missing when the ext_func
+        // fails.
+        bool field_optional = optional || j < num_ext_fields ||
+                              rtype->FieldDecl(i)->GetAttr(zeek::detail::ATTR_OPTIONAL);
+
         if ( t->InternalType() == TYPE_INTERNAL_OTHER ) {
             if ( t->Tag() == TYPE_RECORD ) {
                 // Recurse.
-                if ( ! TraverseRecord(stream, filter, t->AsRecordType(), include, exclude, new_path, new_indices) )
+                if ( ! TraverseRecord(stream, filter, t->AsRecordType(), include, exclude, new_path, new_indices,
+                                      field_optional) )
                     return false;
 
                 continue;
@@ -778,10 +785,8 @@ bool Manager::TraverseRecord(Stream* stream, Filter* filter, RecordType* rt, Tab
         else if ( t->Tag() == TYPE_VECTOR )
             st = t->AsVectorType()->Yield()->Tag();
 
-        bool optional = (bool)rtype->FieldDecl(i)->GetAttr(zeek::detail::ATTR_OPTIONAL);
-
         filter->fields[filter->num_fields - 1] =
-            new threading::Field(new_path.c_str(), nullptr, t->Tag(), st, optional);
+            new threading::Field(new_path.c_str(), nullptr, t->Tag(), st, field_optional);
     }
 
     return true;
@@ -1156,6 +1161,22 @@ bool Manager::WriteToFilters(const Manager::Stream* stream, zeek::RecordValPtr c
 
         // Alright, can do the write now.
 
+        assert(writer);
+        assert(w != stream->writers.end());
+
+        if ( writer->AcceptsBatches() && writer->NumFields() == filter->num_fields &&
+             ! plugin_mgr->HavePluginForHook(plugin::HOOK_LOG_WRITE) ) {
+            // Nobody needs the record as individual values, so add it to
+            // the writer's current batch directly. The filter's ext_func
+            // needs to run first, as it may write to the stream itself,
+            // which can send the current batch off to the writer thread.
+            auto ext_rec = ExtensionRecord(filter);
+            RecordToBatch(filter, columns.get(), ext_rec.get(), writer->Batch());
+            writer->FinishBatchRow();
+            w->second->total_writes.Inc();
+            continue;
+        }
+
         threading::Value** vals = RecordToFilterVals(stream, filter, columns.get());
 
         if ( ! PLUGIN_HOOK_WITH_RESULT(HOOK_LOG_WRITE,
@@ -1172,11 +1193,9 @@ bool Manager::WriteToFilters(const Manager::Stream* stream, zeek::RecordValPtr c
             return true;
         }
 
-        assert(w != stream->writers.end());
         w->second->total_writes.Inc();
 
         // Write takes ownership of vals.
-        assert(writer);
         writer->Write(filter->num_fields, vals);
 
 #ifdef DEBUG
@@ -1519,7 +1538,117 @@ threading::Value* Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
     return lval;
 }
 
-threading::Value** Manager::RecordToFilterVals(const Stream* stream, Filter* filter, RecordVal* columns) {
+void Manager::ValToBatch(LogBatch::Column* col, std::optional<ZVal>& val, Type* ty) {
+    // This mirrors ValToLogVal().
+    if ( ! val ) {
+        col->AddNull();
+        return;
+    }
+
+    switch ( ty->Tag() ) {
+        case TYPE_BOOL:
+        case TYPE_INT: col->AddInt(val->AsInt()); break;
+
+        case TYPE_ENUM: {
+            const char* s = ty->AsEnumType()->Lookup(val->AsInt());
+
+            if ( s )
+                col->AddString(s, strlen(s));
+
+            else {
+                auto err_msg = "enum type does not contain value:" + std::to_string(val->AsInt());
+                ty->Error(err_msg.c_str());
+                col->AddString("", 0);
+            }
+            break;
+        }
+
+        case TYPE_COUNT: col->AddUInt(val->AsCount()); break;
+
+        case TYPE_PORT: {
+            auto p = val->AsCount();
+
+            auto pt = TRANSPORT_UNKNOWN;
+            auto pm = p & PORT_SPACE_MASK;
+            if ( pm == TCP_PORT_MASK )
+                pt = TRANSPORT_TCP;
+            else if ( pm == UDP_PORT_MASK )
+                pt = TRANSPORT_UDP;
+            else if ( pm == ICMP_PORT_MASK )
+                pt = TRANSPORT_ICMP;
+
+            col->AddPort(p & ~PORT_SPACE_MASK, pt);
+            break;
+        }
+
+        case TYPE_SUBNET: col->AddSubNet(val->AsSubNet()->Get()); break;
+
+        case TYPE_ADDR: col->AddAddr(val->AsAddr()->Get()); break;
+
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: col->AddDouble(val->AsDouble()); break;
+
+        case TYPE_STRING: {
+            const String* s = val->AsString()->AsString();
+            col->AddString(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+            break;
+        }
+
+        case TYPE_FILE: {
+            const char* s = val->AsFile()->Name();
+            col->AddString(s, strlen(s));
+            break;
+        }
+
+        case TYPE_FUNC: {
+            ODesc d;
+            val->AsFunc()->Describe(&d);
+            col->AddString(d.Description(), strlen(d.Description()));
+            break;
+        }
+
+        case TYPE_TABLE: {
+            auto tbl = val->AsTable();
+            auto set = tbl->ToPureListVal();
+
+            if ( ! set )
+                // ToPureListVal has reported an internal warning
+                // already. Just keep going by making something up.
+                set = make_intrusive<ListVal>(TYPE_INT);
+
+            auto tbl_t = cast_intrusive<TableType>(tbl->GetType());
+            auto& set_t = tbl_t->GetIndexTypes()[0];
+            bool is_managed = ZVal::IsManagedType(set_t);
+
+            for ( int i = 0; i < set->Length(); i++ ) {
+                std::optional<ZVal> s_i = ZVal(set->Idx(i), set_t);
+                ValToBatch(&col->Elements(), s_i, set_t.get());
+                if ( is_managed )
+                    ZVal::DeleteManagedType(*s_i);
+            }
+
+            col->AddContainer();
+            break;
+        }
+
+        case TYPE_VECTOR: {
+            VectorVal* vec = val->AsVector();
+            auto& vv = vec->RawVec();
+            auto& vt = vec->GetType()->Yield();
+
+            for ( unsigned int i = 0; i < vec->Size(); i++ )
+                ValToBatch(&col->Elements(), vv[i], vt.get());
+
+            col->AddContainer();
+            break;
+        }
+
+        default: reporter->InternalError("unsupported type %s for log_write", type_name(ty->Tag()));
+    }
+}
+
+RecordValPtr Manager::ExtensionRecord(Filter* filter) {
     RecordValPtr ext_rec;
 
     if ( filter->num_ext_fields > 0 ) {
@@ -1529,6 +1658,12 @@ threading::Value** Manager::RecordToFilterVals(const Stream* stream, Filter* fil
             ext_rec = {AdoptRef{}, res.release()->AsRecordVal()};
     }
 
+    return ext_rec;
+}
+
+threading::Value** Manager::RecordToFilterVals(const Stream* stream, Filter* filter, RecordVal* columns) {
+    auto ext_rec = ExtensionRecord(filter);
+
     threading::Value** vals = new threading::Value*[filter->num_fields];
 
     for ( int i = 0; i < filter->num_fields; ++i ) {
@@ -1555,14 +1690,17 @@ threading::Value** Manager::RecordToFilterVals(const Stream* stream, Filter* fil
 
         for ( list<int>::iterator j = indices.begin(); j != indices.end(); ++j ) {
             auto vr = val->AsRecord();
-            val = vr->RawOptField(*j);
+            auto f = vr->RawOptField(*j);
 
-            if ( ! val ) {
+            if ( ! f ) {
                 // Value, or any of its parents, is not set.
                 vals[i] = new threading::Value(filter->fields[i]->type, false);
+                val = std::nullopt;
                 break;
             }
 
+            val = *f;
+
             vt = cast_intrusive<RecordType>(vr->GetType())->GetFieldType(*j).get();
         }
 
@@ -1573,6 +1711,45 @@ threading::Value** Manager::RecordToFilterVals(const Stream* stream, Filter* fil
     return vals;
 }
 
+void Manager::RecordToBatch(Filter* filter, RecordVal* columns, RecordVal* ext_rec, LogBatch* batch) {
+    // This mirrors RecordToFilterVals().
+    for ( int i = 0; i < filter->num_fields; ++i ) {
+        auto col = &batch->GetColumn(i);
+        std::optional<ZVal> val;
+        Type* vt;
+
+        if ( i < filter->num_ext_fields ) {
+            if ( ! ext_rec ) {
+                col->AddNull();
+                continue;
+            }
+
+            val = ZVal(ext_rec);
+            vt = ext_rec->GetType().get();
+        }
+        else {
+            val = ZVal(columns);
+            vt = columns->GetType().get();
+        }
+
+        for ( auto j : filter->indices[i] ) {
+            auto vr = val->AsRecord();
+            auto f = vr->RawOptField(j);
+
+            if ( ! f ) {
+                val = std::nullopt;
+                break;
+            }
+
+            val = *f;
+
+            vt = cast_intrusive<RecordType>(vr->GetType())->GetFieldType(j).get();
+        }
+
+        ValToBatch(col, val, vt);
+    }
+}
+
 bool Manager::CreateWriterForRemoteLog(EnumVal* id, EnumVal* writer, WriterBackend::WriterInfo* info, int num_fields,
                                        const threading::Field* const* fields) {
     return CreateWriter(id, writer, info, num_fields, fields, true, false, true);
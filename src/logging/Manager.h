@@ -373,12 +373,25 @@ private:
     struct Stream;
     struct WriterInfo;
 
+    // Adds the record's fields to the filter's. The optional flag tells
+    // whether the record itself may be missing from a log entry.
     bool TraverseRecord(Stream* stream, Filter* filter, RecordType* rt, TableVal* include, TableVal* exclude,
-                        const std::string& path, const std::list<int>& indices);
+                        const std::string& path, const std::list<int>& indices, bool optional = false);
+
+    // Returns the record of extension fields the filter's ext_func yields,
+    // if it has one.
+    RecordValPtr ExtensionRecord(Filter* filter);
 
     threading::Value** RecordToFilterVals(const Stream* stream, Filter* filter, RecordVal* columns);
 
     threading::Value* ValToLogVal(std::optional<ZVal>& val, Type* ty);
+
+    // Like RecordToFilterVals() and ValToLogVal(), but adding the values
+    // to a writer's batch instead. The caller provides the ExtensionRecord(),
+    // as computing it runs script code that may flush the batch.
+    void RecordToBatch(Filter* filter, RecordVal* columns, RecordVal* ext_rec, LogBatch* batch);
+    void ValToBatch(LogBatch::Column* col, std::optional<ZVal>& val, Type* ty);
+
     Stream* FindStream(EnumVal* id);
     void RemoveDisabledWriters(Stream* stream);
     void InstallRotationTimer(WriterInfo* winfo);
@@ -231,6 +231,40 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals) {
     return success;
 }
 
+bool WriterBackend::WriteBatch(LogBatch* batch) {
+    std::unique_ptr<LogBatch> b(batch);
+
+    if ( num_fields != batch->NumFields() ) {
+#ifdef DEBUG
+        const char* msg = Fmt("Number of fields don't match in WriterBackend::WriteBatch() (%d vs. %d)",
+                              batch->NumFields(), num_fields);
+        Debug(DBG_LOGGING, msg);
+#endif
+
+        DisableFrontend();
+        return false;
+    }
+
+    if ( Failed() )
+        return true;
+
+    if ( ! DoWriteBatch(*batch) ) {
+        DisableFrontend();
+        return false;
+    }
+
+    return true;
+}
+
+bool WriterBackend::DoWriteBatch(const LogBatch& batch) {
+    for ( int j = 0; j < batch.NumRows(); j++ ) {
+        if ( ! DoWrite(num_fields, fields, BatchRow(batch, j)) )
+            return false;
+    }
+
+    return true;
+}
+
 bool WriterBackend::SetBuf(bool enabled) {
     if ( enabled == buffering )
         // No change.
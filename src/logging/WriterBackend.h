@@ -5,6 +5,7 @@
 #pragma once
 
 #include "zeek/logging/Component.h"
+#include "zeek/logging/LogBatch.h"
 #include "zeek/threading/MsgThread.h"
 
 namespace broker {
@@ -153,6 +154,16 @@ public:
      */
     bool Write(int num_fields, int num_writes, threading::Value*** vals);
 
+    /**
+     * Writes a batch of log entries.
+     *
+     * @param batch The entries, with columns matching the fields passed
+     * to Init(). The method takes ownership.
+     *
+     * @return False if an error occurred.
+     */
+    bool WriteBatch(LogBatch* batch);
+
     /**
      * Sets the buffering status for the writer, assuming the writer
      * supports that. (If not, it will be ignored).
@@ -281,6 +292,23 @@ protected:
      */
     virtual bool DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) = 0;
 
+    /**
+     * Writer-specific output method implementing recording of a batch
+     * of log entries.
+     *
+     * A writer implementation may override this method to process the
+     * batch's columns directly. The default implementation passes each
+     * entry to DoWrite(), using values that are only valid for the
+     * duration of that call. Return values are as for DoWrite().
+     */
+    virtual bool DoWriteBatch(const LogBatch& batch);
+
+    /**
+     * Returns the values of an entry of a batch, as they would be passed
+     * to DoWrite(). They remain valid until the next call.
+     */
+    threading::Value** BatchRow(const LogBatch& batch, int row) { return row_buffer.Fill(batch, row); }
+
     /**
      * Writer-specific method implementing a change of the buffering
      * state.  If buffering is disabled, the writer should attempt to
@@ -385,6 +413,8 @@ private:
     bool buffering;                        // True if buffering is enabled.
 
     int rotation_counter; // Tracks FinishedRotation() calls.
+
+    LogBatch::RowBuffer row_buffer; // Presents batched entries to DoWrite().
 };
 
 } // namespace zeek::logging
@@ -64,6 +64,17 @@ private:
     Value*** vals;
 };
 
+class WriteBatchMessage final : public threading::InputMessage<WriterBackend> {
+public:
+    WriteBatchMessage(WriterBackend* backend, LogBatch* batch)
+        : threading::InputMessage<WriterBackend>("WriteBatch", backend), batch(batch) {}
+
+    bool Process() override { return Object()->WriteBatch(batch); }
+
+private:
+    LogBatch* batch;
+};
+
 class SetBufMessage final : public threading::InputMessage<WriterBackend> {
 public:
     SetBufMessage(WriterBackend* backend, const bool enabled)
@@ -190,6 +201,10 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals) {
         return;
     }
 
+    if ( batch )
+        // Keep the order of records buffered in the other form.
+        FlushWriteBuffer();
+
     if ( ! write_buffer ) {
         // Need new buffer.
         write_buffer = new Value**[WRITER_BUFFER_SIZE];
@@ -203,7 +218,38 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals) {
         FlushWriteBuffer();
 }
 
+LogBatch* WriterFrontend::Batch() {
+    if ( write_buffer_pos )
+        // Keep the order of records buffered in the other form.
+        FlushWriteBuffer();
+
+    if ( ! batch ) {
+        batch = std::make_unique<LogBatch>(num_fields, fields);
+        batch->Reserve(last_batch_rows, last_batch_arena);
+    }
+
+    return batch.get();
+}
+
+void WriterFrontend::FinishBatchRow() {
+    batch->AddRow();
+
+    if ( batch->NumRows() >= WRITER_BUFFER_SIZE || ! buf || run_state::terminating )
+        // Buffer full (or no buffering desired or terminating).
+        FlushWriteBuffer();
+}
+
 void WriterFrontend::FlushWriteBuffer() {
+    if ( batch ) {
+        last_batch_rows = batch->NumRows();
+        last_batch_arena = batch->ArenaSize();
+
+        if ( backend && last_batch_rows > 0 )
+            backend->SendIn(new WriteBatchMessage(backend, batch.release()));
+
+        batch.reset();
+    }
+
     if ( ! write_buffer_pos )
         // Nothing to do.
         return;
@@ -92,6 +92,32 @@ public:
      */
     void Write(int num_fields, threading::Value** vals);
 
+    /**
+     * Returns true if records may be added through Batch() instead of
+     * Write(), which is the case when they only go to a local backend.
+     *
+     * This method must only be called from the main thread.
+     */
+    bool AcceptsBatches() const { return backend && ! remote && ! disabled; }
+
+    /**
+     * Returns the batch to add the values of the next record to. Once
+     * done, the caller must call FinishBatchRow(). Like Write(), this
+     * may buffer several records before sending them over to the
+     * backend, but as columns rather than as individual values.
+     *
+     * This method must only be called from the main thread, and only if
+     * AcceptsBatches() returns true.
+     */
+    LogBatch* Batch();
+
+    /**
+     * Completes the record added to Batch().
+     *
+     * This method must only be called from the main thread.
+     */
+    void FinishBatchRow();
+
     /**
      * Sets the buffering state.
      *
@@ -206,6 +232,12 @@ protected:
     static const int WRITER_BUFFER_SIZE = 1000;
     int write_buffer_pos;             // Position of next write in buffer.
     threading::Value*** write_buffer; // Buffer of size WRITER_BUFFER_SIZE.
+
+    // Buffer for bulk writes added through Batch(). Only one of this and
+    // write_buffer holds records at any time.
+    std::unique_ptr<LogBatch> batch;
+    int last_batch_rows = 0;        // Size of the batch sent last, for
+    size_t last_batch_arena = 0;    // preallocating the next one.
 };
 
 } // namespace zeek::logging
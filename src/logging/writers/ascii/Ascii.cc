@@ -2,11 +2,14 @@
 
 #include "zeek/logging/writers/ascii/Ascii.h"
 
+#include "zeek/zeek-config.h"
+
 #include <dirent.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <ctime>
@@ -15,6 +18,14 @@
 #include <string>
 #include <vector>
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
 #include "zeek/3rdparty/doctest.h"
 #include "zeek/Func.h"
 #include "zeek/RunState.h"
@@ -196,6 +207,149 @@ static std::optional<LeftoverLog> parse_shadow_log(const std::string& fname) {
     return rval;
 }
 
+/**
+ * Compresses a log file's data as a stream into its file descriptor, for
+ * the codecs that zlib's gzFile doesn't cover.
+ */
+class StreamCompressor {
+public:
+    virtual ~StreamCompressor() = default;
+
+    /**
+     * Starts the compressed stream. Returns false on error, with Error()
+     * describing it, as for the other methods.
+     */
+    virtual bool Begin(int fd) = 0;
+
+    virtual bool Write(const char* data, size_t len) = 0;
+
+    /**
+     * Completes the compressed stream. The caller closes the file.
+     */
+    virtual bool End() = 0;
+
+    const std::string& Error() const { return error; }
+
+protected:
+    bool Fail(std::string msg) {
+        error = std::move(msg);
+        return false;
+    }
+
+    bool Output(const char* data, size_t len) { return len == 0 || util::safe_write(fd, data, len); }
+
+    int fd = -1;
+    std::vector<char> buffer;
+
+private:
+    std::string error;
+};
+
+#ifdef HAVE_ZSTD
+class ZstdCompressor final : public StreamCompressor {
+public:
+    ZstdCompressor(int level, int threads) : level(level), threads(threads) {}
+    ~ZstdCompressor() override { ZSTD_freeCCtx(cctx); }
+
+    bool Begin(int arg_fd) override {
+        fd = arg_fd;
+        cctx = ZSTD_createCCtx();
+
+        if ( ! cctx )
+            return Fail("cannot create zstd context");
+
+        if ( ! Check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level)) )
+            return false;
+
+        // This fails if libzstd was built without multithreading support.
+        if ( threads > 0 && ! Check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads)) )
+            return false;
+
+        buffer.resize(ZSTD_CStreamOutSize());
+        return true;
+    }
+
+    bool Write(const char* data, size_t len) override { return Compress(data, len, ZSTD_e_continue); }
+    bool End() override { return Compress(nullptr, 0, ZSTD_e_end); }
+
+private:
+    bool Check(size_t rc) { return ! ZSTD_isError(rc) || Fail(ZSTD_getErrorName(rc)); }
+
+    bool Compress(const char* data, size_t len, ZSTD_EndDirective mode) {
+        ZSTD_inBuffer in = {data, len, 0};
+
+        for ( ;; ) {
+            ZSTD_outBuffer out = {buffer.data(), buffer.size(), 0};
+            size_t remaining = ZSTD_compressStream2(cctx, &out, &in, mode);
+
+            if ( ! Check(remaining) || ! Output(buffer.data(), out.pos) )
+                return false;
+
+            if ( mode == ZSTD_e_end ? remaining == 0 : in.pos == in.size )
+                return true;
+        }
+    }
+
+    int level;
+    int threads;
+    ZSTD_CCtx* cctx = nullptr;
+};
+#endif
+
+#ifdef HAVE_LZ4
+class LZ4Compressor final : public StreamCompressor {
+public:
+    explicit LZ4Compressor(int level) : level(level) {}
+    ~LZ4Compressor() override { LZ4F_freeCompressionContext(cctx); }
+
+    bool Begin(int arg_fd) override {
+        fd = arg_fd;
+
+        if ( ! Check(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION)) )
+            return false;
+
+        prefs = {};
+        prefs.compressionLevel = level;
+
+        // Large enough for any chunk's output, including the frame's
+        // header and footer.
+        buffer.resize(LZ4F_compressBound(CHUNK_SIZE, &prefs));
+
+        size_t n = LZ4F_compressBegin(cctx, buffer.data(), buffer.size(), &prefs);
+        return Check(n) && Output(buffer.data(), n);
+    }
+
+    bool Write(const char* data, size_t len) override {
+        while ( len > 0 ) {
+            auto chunk = std::min(len, CHUNK_SIZE);
+            size_t n = LZ4F_compressUpdate(cctx, buffer.data(), buffer.size(), data, chunk, nullptr);
+
+            if ( ! Check(n) || ! Output(buffer.data(), n) )
+                return false;
+
+            data += chunk;
+            len -= chunk;
+        }
+
+        return true;
+    }
+
+    bool End() override {
+        size_t n = LZ4F_compressEnd(cctx, buffer.data(), buffer.size(), nullptr);
+        return Check(n) && Output(buffer.data(), n);
+    }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    bool Check(size_t rc) { return ! LZ4F_isError(rc) || Fail(LZ4F_getErrorName(rc)); }
+
+    int level;
+    LZ4F_cctx* cctx = nullptr;
+    LZ4F_preferences_t prefs;
+};
+#endif
+
 Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend) {
     fd = 0;
     ascii_done = false;
@@ -208,6 +362,10 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend) {
     formatter = nullptr;
     gzip_level = 0;
     gzfile = nullptr;
+    codec = Codec::None;
+    zstd_level = 3;
+    zstd_threads = 0;
+    lz4_level = 0;
 
     InitConfigOptions();
     init_options = InitFilterOptions();
@@ -240,6 +398,11 @@ void Ascii::InitConfigOptions() {
     gzip_file_extension.assign((const char*)BifConst::LogAscii::gzip_file_extension->Bytes(),
                                BifConst::LogAscii::gzip_file_extension->Len());
 
+    compression = BifConst::LogAscii::compression->ToStdString();
+    zstd_level = BifConst::LogAscii::zstd_level;
+    zstd_threads = BifConst::LogAscii::zstd_threads;
+    lz4_level = BifConst::LogAscii::lz4_level;
+
     logdir = zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString();
 }
 
@@ -335,6 +498,62 @@ bool Ascii::InitFilterOptions() {
 
         else if ( strcmp(i->first, "gzip_file_extension") == 0 )
             gzip_file_extension.assign(i->second);
+
+        else if ( strcmp(i->first, "compression") == 0 )
+            compression.assign(i->second);
+
+        else if ( strcmp(i->first, "zstd_level") == 0 )
+            zstd_level = atoi(i->second);
+
+        else if ( strcmp(i->first, "zstd_threads") == 0 )
+            zstd_threads = atoi(i->second);
+
+        else if ( strcmp(i->first, "lz4_level") == 0 )
+            lz4_level = atoi(i->second);
+    }
+
+    if ( compression.empty() )
+        codec = gzip_level > 0 ? Codec::Gzip : Codec::None;
+    else if ( compression == "none" )
+        codec = Codec::None;
+    else if ( compression == "gzip" )
+        codec = Codec::Gzip;
+    else if ( compression == "zstd" )
+        codec = Codec::Zstd;
+    else if ( compression == "lz4" )
+        codec = Codec::LZ4;
+    else {
+        Error("invalid value for 'compression', must be one of \"gzip\", \"zstd\", \"lz4\", or \"none\"");
+        return false;
+    }
+
+#ifndef HAVE_ZSTD
+    if ( codec == Codec::Zstd ) {
+        Error("zstd compression is not available, Zeek was built without libzstd");
+        return false;
+    }
+#endif
+
+#ifndef HAVE_LZ4
+    if ( codec == Codec::LZ4 ) {
+        Error("lz4 compression is not available, Zeek was built without liblz4");
+        return false;
+    }
+#endif
+
+    if ( codec == Codec::Zstd && (zstd_level < 1 || zstd_level > 22) ) {
+        Error("invalid value for 'zstd_level', must be a number between 1 and 22.");
+        return false;
+    }
+
+    if ( codec == Codec::Zstd && zstd_threads < 0 ) {
+        Error("invalid value for 'zstd_threads', must not be negative.");
+        return false;
+    }
+
+    if ( codec == Codec::LZ4 && (lz4_level < 0 || lz4_level > 12) ) {
+        Error("invalid value for 'lz4_level', must be a number between 0 and 12.");
+        return false;
     }
 
     if ( ! InitFormatter() )
@@ -408,12 +627,24 @@ void Ascii::CloseFile(double t) {
     gzfile = nullptr;
 }
 
+std::string Ascii::CompressionExt() const {
+    switch ( codec ) {
+        case Codec::Gzip: return "." + (gzip_file_extension.empty() ? std::string("gz") : gzip_file_extension);
+        case Codec::Zstd: return ".zst";
+        case Codec::LZ4: return ".lz4";
+        default: return "";
+    }
+}
+
 bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Field* const* fields) {
     assert(! fd);
 
     if ( ! init_options )
         return false;
 
+    if ( use_json )
+        static_cast<threading::formatter::JSON*>(formatter)->InitFields(num_fields, fields);
+
     string path = info.path;
 
     if ( output_to_stdout )
@@ -422,12 +653,7 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
     fname = path;
 
     if ( ! IsSpecial(fname) ) {
-        std::string ext = "." + LogExt();
-
-        if ( gzip_level > 0 ) {
-            ext += ".";
-            ext += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-        }
+        std::string ext = "." + LogExt() + CompressionExt();
 
         if ( fname.front() != '/' && ! logdir.empty() )
             fname = (zeek::filesystem::path(logdir) / fname).string();
@@ -476,14 +702,19 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
         return false;
     }
 
-    if ( gzip_level > 0 ) {
+    if ( codec == Codec::Gzip ) {
         if ( gzip_level < 0 || gzip_level > 9 ) {
             Error("invalid value for 'gzip_level', must be a number between 0 and 9.");
             return false;
         }
 
         char mode[4];
-        snprintf(mode, sizeof(mode), "wb%d", gzip_level);
+
+        // Level 0 means zlib's default when gzip was chosen explicitly.
+        if ( gzip_level > 0 )
+            snprintf(mode, sizeof(mode), "wb%d", gzip_level);
+        else
+            snprintf(mode, sizeof(mode), "wb");
         errno = 0; // errno will only be set under certain circumstances by gzdopen.
         gzfile = gzdopen(fd, mode);
 
@@ -494,6 +725,21 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
     }
     else {
         gzfile = nullptr;
+
+#ifdef HAVE_ZSTD
+        if ( codec == Codec::Zstd )
+            compressor = std::make_unique<ZstdCompressor>(zstd_level, zstd_threads);
+#endif
+
+#ifdef HAVE_LZ4
+        if ( codec == Codec::LZ4 )
+            compressor = std::make_unique<LZ4Compressor>(lz4_level);
+#endif
+
+        if ( compressor && ! compressor->Begin(fd) ) {
+            Error(Fmt("cannot compress %s: %s", fname.c_str(), compressor->Error().c_str()));
+            return false;
+        }
     }
 
     if ( ! WriteHeader(path) ) {
@@ -568,10 +814,7 @@ bool Ascii::DoFinish(double network_time) {
     return true;
 }
 
-bool Ascii::DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) {
-    if ( ! fd )
-        DoInit(Info(), NumFields(), Fields());
-
+bool Ascii::FormatLine(int num_fields, const threading::Field* const* fields, threading::Value** vals) {
     desc.Clear();
 
     if ( ! formatter->Describe(&desc, num_fields, fields, vals) )
@@ -586,25 +829,67 @@ bool Ascii::DoWrite(int num_fields, const threading::Field* const* fields, threa
         // It would so escape the first character.
         char hex[4] = {'\\', 'x', '0', '0'};
         util::bytetohex(bytes[0], hex + 2);
-
-        if ( ! InternalWrite(fd, hex, 4) )
-            goto write_error;
+        write_buffer.append(hex, 4);
 
         ++bytes;
         --len;
     }
 
-    if ( ! InternalWrite(fd, bytes, len) )
-        goto write_error;
+    write_buffer.append(bytes, len);
+    return true;
+}
+
+bool Ascii::FlushLines() {
+    if ( write_buffer.empty() )
+        return true;
+
+    bool ok = InternalWrite(fd, write_buffer.data(), write_buffer.size());
+    write_buffer.clear();
+
+    if ( ! ok ) {
+        Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+        return false;
+    }
+
+    return true;
+}
+
+bool Ascii::DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) {
+    if ( ! fd )
+        DoInit(Info(), NumFields(), Fields());
+
+    if ( ! FormatLine(num_fields, fields, vals) || ! FlushLines() )
+        return false;
 
     if ( ! IsBuf() )
         fsync(fd);
 
     return true;
+}
 
-write_error:
-    Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
-    return false;
+bool Ascii::DoWriteBatch(const LogBatch& batch) {
+    if ( ! fd )
+        DoInit(Info(), NumFields(), Fields());
+
+    // Collect the lines of the batch, so that we write them out with few
+    // calls rather than one per line.
+    for ( int i = 0; i < batch.NumRows(); ++i ) {
+        if ( ! FormatLine(NumFields(), Fields(), BatchRow(batch, i)) ) {
+            FlushLines();
+            return false;
+        }
+
+        if ( write_buffer.size() >= WRITE_BUFFER_FLUSH_SIZE && ! FlushLines() )
+            return false;
+    }
+
+    if ( ! FlushLines() )
+        return false;
+
+    if ( ! IsBuf() )
+        fsync(fd);
+
+    return true;
 }
 
 bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool terminating) {
@@ -616,12 +901,7 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 
     CloseFile(close);
 
-    string nname = string(rotated_path) + "." + LogExt();
-
-    if ( gzip_level > 0 ) {
-        nname += ".";
-        nname += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-    }
+    string nname = string(rotated_path) + "." + LogExt() + CompressionExt();
 
     if ( rename(fname.c_str(), nname.c_str()) != 0 ) {
         char buf[256];
@@ -813,6 +1093,14 @@ string Ascii::Timestamp(double t) {
 }
 
 bool Ascii::InternalWrite(int fd, const char* data, int len) {
+    if ( compressor ) {
+        if ( compressor->Write(data, len) )
+            return true;
+
+        Error(Fmt("Ascii::InternalWrite error: %s\n", compressor->Error().c_str()));
+        return false;
+    }
+
     if ( ! gzfile )
         return util::safe_write(fd, data, len);
 
@@ -833,6 +1121,17 @@ bool Ascii::InternalWrite(int fd, const char* data, int len) {
 }
 
 bool Ascii::InternalClose(int fd) {
+    if ( compressor ) {
+        bool ok = compressor->End();
+
+        if ( ! ok )
+            Error(Fmt("Ascii::InternalClose error: %s\n", compressor->Error().c_str()));
+
+        compressor.reset();
+        util::safe_close(fd);
+        return ok;
+    }
+
     if ( ! gzfile ) {
         util::safe_close(fd);
         return true;
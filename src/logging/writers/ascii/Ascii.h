@@ -5,6 +5,7 @@
 #pragma once
 
 #include <zlib.h>
+#include <memory>
 
 #include "zeek/Desc.h"
 #include "zeek/logging/WriterBackend.h"
@@ -17,6 +18,8 @@ class Plugin;
 
 namespace zeek::logging::writer::detail {
 
+class StreamCompressor;
+
 class Ascii : public WriterBackend {
 public:
     explicit Ascii(WriterFrontend* frontend);
@@ -29,6 +32,7 @@ public:
 protected:
     bool DoInit(const WriterInfo& info, int num_fields, const threading::Field* const* fields) override;
     bool DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) override;
+    bool DoWriteBatch(const LogBatch& batch) override;
     bool DoSetBuf(bool enabled) override;
     bool DoRotate(const char* rotated_path, double open, double close, bool terminating) override;
     bool DoFlush(double network_time) override;
@@ -49,12 +53,27 @@ private:
     bool InitFilterOptions();
     bool InitFormatter();
     bool InternalWrite(int fd, const char* data, int len);
+
+    // Appends a formatted log line to write_buffer.
+    bool FormatLine(int num_fields, const threading::Field* const* fields, threading::Value** vals);
+
+    // Writes out and clears write_buffer.
+    bool FlushLines();
     bool InternalClose(int fd);
 
+    // Returns the file name extension for the compression codec, including
+    // the leading dot, or an empty string for uncompressed output.
+    std::string CompressionExt() const;
+
     int fd;
     gzFile gzfile;
+    std::unique_ptr<StreamCompressor> compressor; // For codecs other than gzip.
     std::string fname;
     ODesc desc;
+    std::string write_buffer; // Formatted lines not yet written out.
+
+    // Size at which a batch's formatted lines are written out early.
+    static constexpr size_t WRITE_BUFFER_FLUSH_SIZE = 64 * 1024;
     bool ascii_done;
 
     // Options set from the script-level.
@@ -68,8 +87,15 @@ private:
     std::string unset_field;
     std::string meta_prefix;
 
-    int gzip_level; // level > 0 enables gzip compression
+    enum class Codec { None, Gzip, Zstd, LZ4 };
+
+    int gzip_level; // level > 0 enables gzip compression if no codec is set
     std::string gzip_file_extension;
+    std::string compression;
+    Codec codec;
+    int zstd_level;
+    int zstd_threads;
+    int lz4_level;
     bool use_json;
     bool enable_utf_8;
     std::string json_timestamps;
@@ -0,0 +1,566 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/parquet/Parquet.h"
+
+#include <arrow/util/compression.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "zeek/ID.h"
+#include "zeek/Type.h"
+#include "zeek/Val.h"
+#include "zeek/logging/writers/parquet/parquet.bif.h"
+#include "zeek/threading/Formatter.h"
+#include "zeek/threading/SerialTypes.h"
+#include "zeek/util.h"
+
+using namespace std;
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::logging::writer::detail {
+
+// Returns the Arrow type that a log field's values map to, or null if the
+// type cannot be logged.
+static shared_ptr<arrow::DataType> arrow_type(TypeTag type, TypeTag subtype) {
+    switch ( type ) {
+        case TYPE_BOOL: return arrow::boolean();
+        case TYPE_INT: return arrow::int64();
+        case TYPE_COUNT: return arrow::uint64();
+        case TYPE_PORT: return arrow::uint16();
+        case TYPE_DOUBLE:
+        case TYPE_INTERVAL: return arrow::float64();
+        case TYPE_TIME: return arrow::timestamp(arrow::TimeUnit::MICRO, "UTC");
+
+        case TYPE_ADDR:
+        case TYPE_SUBNET:
+        case TYPE_ENUM:
+        case TYPE_STRING:
+        case TYPE_FILE:
+        case TYPE_FUNC: return arrow::utf8();
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR: {
+            auto elem = arrow_type(subtype, TYPE_VOID);
+            return elem ? arrow::list(elem) : nullptr;
+        }
+
+        default: return nullptr;
+    }
+}
+
+static int64_t to_micros(double t) { return llround(t * 1e6); }
+
+// Appends string data to a utf8 column. Zeek strings are arbitrary bytes,
+// so anything that isn't valid UTF-8 gets escaped as for JSON logs.
+static arrow::Status append_string(arrow::ArrayBuilder* b, const char* data, size_t len) {
+    auto sb = static_cast<arrow::StringBuilder*>(b);
+
+    for ( size_t i = 0; i < len; ++i ) {
+        auto c = static_cast<unsigned char>(data[i]);
+
+        if ( c < 32 || c >= 127 ) {
+            auto escaped = util::json_escape_utf8(data, len);
+            return sb->Append(escaped.data(), static_cast<int32_t>(escaped.size()));
+        }
+    }
+
+    return sb->Append(data, static_cast<int32_t>(len));
+}
+
+static arrow::Status append_string(arrow::ArrayBuilder* b, const string& s) {
+    return append_string(b, s.data(), s.size());
+}
+
+// Appends a single value to its field's builder.
+static arrow::Status append_value(arrow::ArrayBuilder* b, const Value* v) {
+    if ( ! v->present )
+        return b->AppendNull();
+
+    switch ( v->type ) {
+        case TYPE_BOOL: return static_cast<arrow::BooleanBuilder*>(b)->Append(v->val.int_val != 0);
+        case TYPE_INT: return static_cast<arrow::Int64Builder*>(b)->Append(v->val.int_val);
+        case TYPE_COUNT: return static_cast<arrow::UInt64Builder*>(b)->Append(v->val.uint_val);
+        case TYPE_PORT: return static_cast<arrow::UInt16Builder*>(b)->Append(v->val.port_val.port);
+
+        case TYPE_DOUBLE:
+        case TYPE_INTERVAL: return static_cast<arrow::DoubleBuilder*>(b)->Append(v->val.double_val);
+
+        case TYPE_TIME: return static_cast<arrow::TimestampBuilder*>(b)->Append(to_micros(v->val.double_val));
+
+        case TYPE_ADDR: return append_string(b, threading::Formatter::Render(v->val.addr_val));
+        case TYPE_SUBNET: return append_string(b, threading::Formatter::Render(v->val.subnet_val));
+
+        case TYPE_ENUM:
+        case TYPE_STRING:
+        case TYPE_FILE:
+        case TYPE_FUNC: return append_string(b, v->val.string_val.data, v->val.string_val.length);
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR: {
+            auto lb = static_cast<arrow::ListBuilder*>(b);
+            ARROW_RETURN_NOT_OK(lb->Append());
+
+            auto size = v->type == TYPE_TABLE ? v->val.set_val.size : v->val.vector_val.size;
+            auto vals = v->type == TYPE_TABLE ? v->val.set_val.vals : v->val.vector_val.vals;
+
+            for ( zeek_int_t i = 0; i < size; ++i )
+                ARROW_RETURN_NOT_OK(append_value(lb->value_builder(), vals[i]));
+
+            return arrow::Status::OK();
+        }
+
+        default: return arrow::Status::TypeError("unsupported log value type ", type_name(v->type));
+    }
+}
+
+// Appends a range of a column's values that can be stored directly.
+template<typename Builder, typename Get>
+static arrow::Status append_cells(arrow::ArrayBuilder* b, const LogBatch::Column& col, size_t begin, size_t end,
+                                  Get get) {
+    auto builder = static_cast<Builder*>(b);
+    ARROW_RETURN_NOT_OK(builder->Reserve(end - begin));
+
+    for ( auto i = begin; i < end; ++i ) {
+        if ( col.IsNull(i) )
+            builder->UnsafeAppendNull();
+        else
+            builder->UnsafeAppend(get(col.At(i)));
+    }
+
+    return arrow::Status::OK();
+}
+
+// Appends a range of a column's values to its builder.
+static arrow::Status append_column(arrow::ArrayBuilder* b, const LogBatch& batch, const LogBatch::Column& col,
+                                   size_t begin, size_t end) {
+    if ( begin == end )
+        return arrow::Status::OK();
+
+    using Cell = LogBatch::Cell;
+
+    switch ( col.Type() ) {
+        case TYPE_BOOL:
+            return append_cells<arrow::BooleanBuilder>(b, col, begin, end,
+                                                       [](const Cell& c) { return c.int_val != 0; });
+
+        case TYPE_INT:
+            return append_cells<arrow::Int64Builder>(b, col, begin, end, [](const Cell& c) { return c.int_val; });
+
+        case TYPE_COUNT:
+            return append_cells<arrow::UInt64Builder>(b, col, begin, end, [](const Cell& c) { return c.uint_val; });
+
+        case TYPE_PORT:
+            return append_cells<arrow::UInt16Builder>(b, col, begin, end,
+                                                      [](const Cell& c) { return c.port_val.port; });
+
+        case TYPE_DOUBLE:
+        case TYPE_INTERVAL:
+            return append_cells<arrow::DoubleBuilder>(b, col, begin, end,
+                                                      [](const Cell& c) { return c.double_val; });
+
+        case TYPE_TIME:
+            return append_cells<arrow::TimestampBuilder>(b, col, begin, end,
+                                                         [](const Cell& c) { return to_micros(c.double_val); });
+
+        case TYPE_ADDR:
+        case TYPE_SUBNET:
+        case TYPE_ENUM:
+        case TYPE_STRING:
+        case TYPE_FILE:
+        case TYPE_FUNC: {
+            auto sb = static_cast<arrow::StringBuilder*>(b);
+            ARROW_RETURN_NOT_OK(sb->Reserve(end - begin));
+
+            if ( col.Type() != TYPE_ADDR && col.Type() != TYPE_SUBNET ) {
+                size_t data_size = 0;
+
+                for ( auto i = begin; i < end; ++i )
+                    data_size += col.At(i).string_val.length;
+
+                ARROW_RETURN_NOT_OK(sb->ReserveData(data_size));
+            }
+
+            for ( auto i = begin; i < end; ++i ) {
+                if ( col.IsNull(i) ) {
+                    ARROW_RETURN_NOT_OK(sb->AppendNull());
+                    continue;
+                }
+
+                const auto& c = col.At(i);
+
+                if ( col.Type() == TYPE_ADDR )
+                    ARROW_RETURN_NOT_OK(append_string(b, threading::Formatter::Render(c.addr_val)));
+                else if ( col.Type() == TYPE_SUBNET )
+                    ARROW_RETURN_NOT_OK(append_string(b, threading::Formatter::Render(c.subnet_val)));
+                else
+                    ARROW_RETURN_NOT_OK(append_string(b, batch.StringData(c), c.string_val.length));
+            }
+
+            return arrow::Status::OK();
+        }
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR: {
+            // The lists' offsets go in one go, followed by all of their
+            // elements as one range of the element column.
+            auto lb = static_cast<arrow::ListBuilder*>(b);
+            auto elem_begin = col.ElementRange(begin).first;
+            auto elem_end = col.ElementRange(end - 1).second;
+            auto base = lb->value_builder()->length();
+
+            vector<int32_t> offsets;
+            vector<uint8_t> valid;
+            offsets.reserve(end - begin);
+            valid.reserve(end - begin);
+
+            for ( auto i = begin; i < end; ++i ) {
+                offsets.push_back(static_cast<int32_t>(base + col.ElementRange(i).first - elem_begin));
+                valid.push_back(! col.IsNull(i));
+            }
+
+            ARROW_RETURN_NOT_OK(lb->AppendValues(offsets.data(), end - begin, valid.data()));
+            return append_column(lb->value_builder(), batch, col.Elements(), elem_begin, elem_end);
+        }
+
+        default: return arrow::Status::TypeError("unsupported log column type ", type_name(col.Type()));
+    }
+}
+
+Parquet::Parquet(WriterFrontend* frontend) : WriterBackend(frontend) {
+    format = Format::Parquet;
+    row_group_size = 0;
+    row_group_interval = 0;
+
+    InitConfigOptions();
+    init_options = InitFilterOptions();
+}
+
+Parquet::~Parquet() {
+    // Files still open here belong to a writer that failed; finish them
+    // anyway so that the row groups already written remain readable.
+    if ( parquet_writer )
+        ARROW_UNUSED(parquet_writer->Close());
+
+    if ( ipc_writer )
+        ARROW_UNUSED(ipc_writer->Close());
+
+    if ( outfile )
+        ARROW_UNUSED(outfile->Close());
+}
+
+void Parquet::InitConfigOptions() {
+    format = BifConst::LogParquet::format->ToStdString() == "arrow" ? Format::IPC : Format::Parquet;
+    compression = BifConst::LogParquet::compression->ToStdString();
+    row_group_size = BifConst::LogParquet::row_group_size;
+    row_group_interval = BifConst::LogParquet::row_group_interval;
+    logdir = zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString();
+}
+
+bool Parquet::InitFilterOptions() {
+    const WriterInfo& info = Info();
+
+    // Set per-filter configuration options.
+    for ( WriterInfo::config_map::const_iterator i = info.config.begin(); i != info.config.end(); ++i ) {
+        if ( strcmp(i->first, "format") == 0 ) {
+            if ( strcmp(i->second, "parquet") == 0 )
+                format = Format::Parquet;
+            else if ( strcmp(i->second, "arrow") == 0 )
+                format = Format::IPC;
+            else {
+                Error("invalid value for 'format', must be either \"parquet\" or \"arrow\"");
+                return false;
+            }
+        }
+
+        else if ( strcmp(i->first, "compression") == 0 )
+            compression = i->second;
+
+        else if ( strcmp(i->first, "row_group_size") == 0 ) {
+            char* end;
+            row_group_size = strtoull(i->second, &end, 10);
+
+            if ( *end || ! *i->second ) {
+                Error("invalid value for 'row_group_size', must be a number");
+                return false;
+            }
+        }
+
+        else if ( strcmp(i->first, "row_group_interval") == 0 ) {
+            char* end;
+            row_group_interval = strtod(i->second, &end);
+
+            if ( *end || ! *i->second || row_group_interval < 0 ) {
+                Error("invalid value for 'row_group_interval', must be a number of seconds");
+                return false;
+            }
+        }
+    }
+
+    if ( row_group_size == 0 ) {
+        Error("'row_group_size' must be larger than zero");
+        return false;
+    }
+
+    if ( compression == "none" )
+        compression = "uncompressed";
+
+    if ( ! arrow::util::Codec::GetCompressionType(compression).ok() ) {
+        Error(Fmt("unknown compression '%s'", compression.c_str()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Parquet::InitSchema(int num_fields, const Field* const* fields) {
+    arrow::FieldVector schema_fields;
+
+    for ( int i = 0; i < num_fields; ++i ) {
+        auto type = arrow_type(fields[i]->type, fields[i]->subtype);
+
+        if ( ! type ) {
+            Error(Fmt("field '%s' has a type that cannot be logged", fields[i]->name));
+            return false;
+        }
+
+        schema_fields.push_back(arrow::field(fields[i]->name, type, fields[i]->optional));
+
+        auto builder = arrow::MakeBuilder(type);
+
+        if ( ! Check(builder.status(), "creating column builder") )
+            return false;
+
+        builders.push_back(std::move(*builder));
+    }
+
+    schema = arrow::schema(std::move(schema_fields));
+    return true;
+}
+
+bool Parquet::Check(const arrow::Status& status, const char* what) {
+    if ( status.ok() )
+        return true;
+
+    Error(Fmt("%s %s: %s", what, fname.c_str(), status.ToString().c_str()));
+    return false;
+}
+
+bool Parquet::DoInit(const WriterInfo& info, int num_fields, const Field* const* fields) {
+    if ( ! init_options )
+        return false;
+
+    fname = info.path;
+
+    if ( fname.front() != '/' && ! logdir.empty() )
+        fname = (zeek::filesystem::path(logdir) / fname).string();
+
+    fname += "." + FileExt();
+
+    if ( ! InitSchema(num_fields, fields) )
+        return false;
+
+    return OpenFile();
+}
+
+bool Parquet::OpenFile() {
+    assert(! outfile);
+
+    auto file = arrow::io::FileOutputStream::Open(fname);
+
+    if ( ! Check(file.status(), "cannot open") )
+        return false;
+
+    outfile = *file;
+
+    auto codec = *arrow::util::Codec::GetCompressionType(compression);
+
+    if ( format == Format::Parquet ) {
+        auto props = parquet::WriterProperties::Builder().compression(codec)->build();
+
+        // Storing the Arrow schema keeps the timestamps' time zone.
+        auto arrow_props = parquet::ArrowWriterProperties::Builder().store_schema()->build();
+
+        auto writer = parquet::arrow::FileWriter::Open(*schema, arrow::default_memory_pool(), outfile, props,
+                                                       arrow_props);
+
+        if ( ! Check(writer.status(), "cannot write") )
+            return false;
+
+        parquet_writer = std::move(*writer);
+    }
+
+    else {
+        auto options = arrow::ipc::IpcWriteOptions::Defaults();
+
+        if ( codec != arrow::Compression::UNCOMPRESSED ) {
+            auto c = arrow::util::Codec::Create(codec);
+
+            if ( ! Check(c.status(), "cannot compress") )
+                return false;
+
+            options.codec = std::move(*c);
+        }
+
+        auto writer = arrow::ipc::MakeFileWriter(outfile, schema, options);
+
+        if ( ! Check(writer.status(), "cannot write") )
+            return false;
+
+        ipc_writer = std::move(*writer);
+    }
+
+    return true;
+}
+
+bool Parquet::CloseFile() {
+    bool ok = FlushRowGroup();
+
+    if ( parquet_writer )
+        ok = Check(parquet_writer->Close(), "cannot finish") && ok;
+
+    if ( ipc_writer )
+        ok = Check(ipc_writer->Close(), "cannot finish") && ok;
+
+    if ( outfile && ! outfile->closed() )
+        ok = Check(outfile->Close(), "cannot close") && ok;
+
+    parquet_writer.reset();
+    ipc_writer.reset();
+    outfile.reset();
+
+    return ok;
+}
+
+bool Parquet::AddedRows(int64_t n) {
+    if ( group_rows == 0 )
+        group_start = util::current_time();
+
+    group_rows += n;
+
+    if ( static_cast<zeek_uint_t>(group_rows) >= row_group_size )
+        return FlushRowGroup();
+
+    return true;
+}
+
+bool Parquet::FlushRowGroup() {
+    if ( group_rows == 0 )
+        return true;
+
+    vector<shared_ptr<arrow::Array>> arrays;
+    arrays.reserve(builders.size());
+
+    for ( auto& b : builders ) {
+        auto array = b->Finish();
+
+        if ( ! Check(array.status(), "cannot finish row group for") )
+            return false;
+
+        arrays.push_back(std::move(*array));
+    }
+
+    auto rows = group_rows;
+    group_rows = 0;
+
+    if ( parquet_writer ) {
+        auto table = arrow::Table::Make(schema, std::move(arrays), rows);
+        return Check(parquet_writer->WriteTable(*table, rows), "cannot write row group to");
+    }
+
+    auto record_batch = arrow::RecordBatch::Make(schema, rows, std::move(arrays));
+    return Check(ipc_writer->WriteRecordBatch(*record_batch), "cannot write record batch to");
+}
+
+bool Parquet::DoWrite(int num_fields, const Field* const* fields, Value** vals) {
+    if ( ! outfile && ! OpenFile() )
+        return false;
+
+    for ( int i = 0; i < num_fields; ++i ) {
+        if ( ! Check(append_value(builders[i].get(), vals[i]), "cannot add value for") )
+            return false;
+    }
+
+    return AddedRows(1);
+}
+
+bool Parquet::DoWriteBatch(const LogBatch& batch) {
+    if ( ! outfile && ! OpenFile() )
+        return false;
+
+    size_t rows = batch.NumRows();
+    size_t begin = 0;
+
+    // Fill the current row group column by column, as far as the batch
+    // goes or the group has room.
+    while ( begin < rows ) {
+        auto room = row_group_size - static_cast<zeek_uint_t>(group_rows);
+        auto end = std::min(rows, begin + static_cast<size_t>(room));
+
+        for ( int i = 0; i < batch.NumFields(); ++i ) {
+            if ( ! Check(append_column(builders[i].get(), batch, batch.GetColumn(i), begin, end),
+                         "cannot add values for") )
+                return false;
+        }
+
+        if ( ! AddedRows(end - begin) )
+            return false;
+
+        begin = end;
+    }
+
+    return true;
+}
+
+bool Parquet::DoSetBuf(bool enabled) {
+    // Nothing to do, as row groups always get written as a whole.
+    return true;
+}
+
+bool Parquet::DoRotate(const char* rotated_path, double open, double close, bool terminating) {
+    // Don't rotate if there's not a file currently open.
+    if ( ! outfile ) {
+        FinishedRotation();
+        return true;
+    }
+
+    if ( ! CloseFile() ) {
+        FinishedRotation();
+        return false;
+    }
+
+    string nname = string(rotated_path) + "." + FileExt();
+
+    if ( rename(fname.c_str(), nname.c_str()) != 0 ) {
+        char buf[256];
+        util::zeek_strerror_r(errno, buf, sizeof(buf));
+        Error(Fmt("failed to rename %s to %s: %s", fname.c_str(), nname.c_str(), buf));
+        FinishedRotation();
+        return false;
+    }
+
+    if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) ) {
+        Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+        return false;
+    }
+
+    // The next write opens a new file.
+    return true;
+}
+
+bool Parquet::DoFlush(double network_time) { return FlushRowGroup(); }
+
+bool Parquet::DoFinish(double network_time) { return outfile ? CloseFile() : true; }
+
+bool Parquet::DoHeartbeat(double network_time, double current_time) {
+    if ( group_rows > 0 && row_group_interval > 0 && current_time - group_start >= row_group_interval )
+        return FlushRowGroup();
+
+    return true;
+}
+
+} // namespace zeek::logging::writer::detail
@@ -0,0 +1,87 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for Parquet and Arrow IPC files.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include <parquet/arrow/writer.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/logging/WriterBackend.h"
+
+namespace zeek::logging::writer::detail {
+
+/**
+ * A writer producing columnar files through Apache Arrow: Parquet files by
+ * default, or Arrow IPC files. Records are collected in one Arrow builder
+ * per field and written out as a row group once there are enough of them,
+ * or once the group has been open for long enough. Batches of writes are
+ * encoded column by column.
+ */
+class Parquet : public WriterBackend {
+public:
+    explicit Parquet(WriterFrontend* frontend);
+    ~Parquet() override;
+
+    static WriterBackend* Instantiate(WriterFrontend* frontend) { return new Parquet(frontend); }
+
+protected:
+    bool DoInit(const WriterInfo& info, int num_fields, const threading::Field* const* fields) override;
+    bool DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) override;
+    bool DoWriteBatch(const LogBatch& batch) override;
+    bool DoSetBuf(bool enabled) override;
+    bool DoRotate(const char* rotated_path, double open, double close, bool terminating) override;
+    bool DoFlush(double network_time) override;
+    bool DoFinish(double network_time) override;
+    bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+    enum class Format { Parquet, IPC };
+
+    void InitConfigOptions();
+    bool InitFilterOptions();
+    bool InitSchema(int num_fields, const threading::Field* const* fields);
+
+    // Returns the file extension for the output format.
+    std::string FileExt() const { return format == Format::Parquet ? "parquet" : "arrow"; }
+
+    bool OpenFile();
+    bool CloseFile();
+
+    // Counts records appended to the builders, starting a new row group
+    // timer for the first one and writing out the group once full.
+    bool AddedRows(int64_t n);
+
+    // Writes the records collected in the builders as one row group.
+    bool FlushRowGroup();
+
+    // Reports a failed Arrow operation, returning false if it failed.
+    bool Check(const arrow::Status& status, const char* what);
+
+    // Options set from the script-level.
+    Format format;
+    std::string compression;
+    zeek_uint_t row_group_size;
+    double row_group_interval;
+    std::string logdir;
+
+    bool init_options;
+    std::string fname;
+
+    std::shared_ptr<arrow::Schema> schema;
+    std::vector<std::unique_ptr<arrow::ArrayBuilder>> builders;
+
+    int64_t group_rows = 0;  // Records in the current row group.
+    double group_start = 0;  // When the first of them was added.
+
+    std::shared_ptr<arrow::io::FileOutputStream> outfile;
+    std::unique_ptr<parquet::arrow::FileWriter> parquet_writer;
+    std::shared_ptr<arrow::ipc::RecordBatchWriter> ipc_writer;
+};
+
+} // namespace zeek::logging::writer::detail
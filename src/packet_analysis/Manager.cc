@@ -2,6 +2,7 @@
 
 #include "zeek/packet_analysis/Manager.h"
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/RunState.h"
 #include "zeek/Stats.h"
 #include "zeek/iosource/Manager.h"
@@ -9,10 +10,58 @@
 #include "zeek/packet_analysis/Analyzer.h"
 #include "zeek/packet_analysis/Dispatcher.h"
 #include "zeek/plugin/Manager.h"
+#include "zeek/session/Manager.h"
 #include "zeek/zeek-bif.h"
 
 using namespace zeek::packet_analysis;
 
+namespace {
+
+constexpr uint32_t ETHERTYPE_IPV4 = 0x0800;
+constexpr uint32_t ETHERTYPE_IPV6 = 0x86dd;
+constexpr uint32_t ETHERTYPE_VLAN = 0x8100;
+
+// Only prefetch once the session table is large enough that lookups
+// actually miss the caches. Below that, parsing ahead is just overhead.
+constexpr unsigned int PREFETCH_MIN_SESSIONS = 16384;
+
+// The layer 2 framing of an Ethernet II frame that carries IP.
+struct L2Frame {
+    size_t hdr_len = 14;
+    uint32_t eth_type = 0;
+    bool tagged = false;
+    uint32_t vlan = 0;
+};
+
+// Parses an Ethernet frame with at most one VLAN tag, returning false for
+// anything that isn't plain IPv4 or IPv6 on top of that. The length checks
+// mirror those of the Ethernet and VLAN analyzers, so that frames they'd
+// flag as truncated never qualify.
+bool parse_l2(const uint8_t* data, size_t len, bool allow_vlan, L2Frame* frame) {
+    if ( len <= 16 )
+        return false;
+
+    uint32_t protocol = (data[12] << 8u) + data[13];
+
+    if ( protocol == ETHERTYPE_VLAN ) {
+        if ( ! allow_vlan || len - 14 <= 4 )
+            return false;
+
+        frame->hdr_len = 18;
+        frame->tagged = true;
+        frame->vlan = ((data[14] << 8u) + data[15]) & 0xfff;
+        protocol = (data[16] << 8u) + data[17];
+    }
+
+    if ( protocol != ETHERTYPE_IPV4 && protocol != ETHERTYPE_IPV6 )
+        return false;
+
+    frame->eth_type = protocol;
+    return true;
+}
+
+} // namespace
+
 Manager::Manager() : plugin::ComponentManager<packet_analysis::Component>("PacketAnalyzer", "Tag", "AllAnalyzers") {}
 
 Manager::~Manager() {
@@ -106,6 +155,12 @@ void Manager::ProcessPacket(Packet* packet) {
 
     ++num_packets_processed;
 
+    session_mgr->CheckLoad(packet->time);
+
+    // Dispatch tables can change until zeek_init() has finished.
+    if ( ! fast_path.initialized && run_state::detail::zeek_init_done )
+        SetupFastPath();
+
     bool dumped_packet = false;
     if ( packet->dump_packet || zeek::detail::record_all_packets ) {
         DumpPacket(packet, packet->dump_size);
@@ -113,7 +168,8 @@ void Manager::ProcessPacket(Packet* packet) {
     }
 
     // Start packet analysis
-    root_analyzer->ForwardPacket(packet->cap_len, packet->data, packet, packet->link_type);
+    if ( ! fast_path.ip || ! ForwardFastPath(packet) )
+        root_analyzer->ForwardPacket(packet->cap_len, packet->data, packet, packet->link_type);
 
     if ( ! packet->processed ) {
         if ( packet_not_processed )
@@ -139,6 +195,118 @@ bool Manager::ProcessInnerPacket(Packet* packet) {
     return root_analyzer->ForwardPacket(packet->cap_len, packet->data, packet, packet->link_type);
 }
 
+void Manager::PrefetchPacket(const Packet* packet) {
+    if ( packet->link_type != DLT_EN10MB || session_mgr->CurrentSessions() < PREFETCH_MIN_SESSIONS )
+        return;
+
+    L2Frame frame;
+    if ( ! parse_l2(packet->data, packet->cap_len, true, &frame) )
+        return;
+
+    const uint8_t* data = packet->data + frame.hdr_len;
+    size_t len = packet->cap_len - frame.hdr_len;
+
+    IPAddr src;
+    IPAddr dst;
+    size_t ip_hdr_len;
+    int proto;
+
+    if ( frame.eth_type == ETHERTYPE_IPV4 ) {
+        if ( len < sizeof(struct ip) )
+            return;
+
+        auto ip4 = reinterpret_cast<const struct ip*>(data);
+
+        // Fragments go through reassembly first, and only the first one
+        // carries the ports anyway.
+        if ( ip4->ip_v != 4 || (ntohs(ip4->ip_off) & 0x3fff) != 0 )
+            return;
+
+        ip_hdr_len = ip4->ip_hl * 4;
+        proto = ip4->ip_p;
+        src = IPAddr(ip4->ip_src);
+        dst = IPAddr(ip4->ip_dst);
+    }
+    else {
+        if ( len < sizeof(struct ip6_hdr) )
+            return;
+
+        // Extension headers would need walking the chain; skip those.
+        auto ip6 = reinterpret_cast<const struct ip6_hdr*>(data);
+        ip_hdr_len = sizeof(struct ip6_hdr);
+        proto = ip6->ip6_nxt;
+        src = IPAddr(ip6->ip6_src);
+        dst = IPAddr(ip6->ip6_dst);
+    }
+
+    if ( (proto != IPPROTO_TCP && proto != IPPROTO_UDP) || len < ip_hdr_len + 4 )
+        return;
+
+    // TCP and UDP headers both start with the ports, which connection keys
+    // keep in network byte order.
+    uint16_t src_port;
+    uint16_t dst_port;
+    memcpy(&src_port, data + ip_hdr_len, sizeof(src_port));
+    memcpy(&dst_port, data + ip_hdr_len + 2, sizeof(dst_port));
+
+    zeek::detail::ConnKey key(src, dst, src_port, dst_port, proto == IPPROTO_TCP ? TRANSPORT_TCP : TRANSPORT_UDP,
+                              false);
+    session_mgr->PrefetchConnection(key);
+}
+
+void Manager::SetupFastPath() {
+    fast_path = {};
+    fast_path.initialized = true;
+
+    // The fast path replicates what the built-in Ethernet and VLAN analyzers
+    // do, so it applies only if those are in place and all forward IP to
+    // the same analyzer. Scripts or plugins changing that fall back to the
+    // generic dispatch.
+    const auto& ethernet = root_analyzer->Lookup(DLT_EN10MB);
+    if ( ! ethernet || ! ethernet->IsAnalyzer("Ethernet") )
+        return;
+
+    const auto& ip = ethernet->Lookup(ETHERTYPE_IPV4);
+    if ( ! ip || ip != ethernet->Lookup(ETHERTYPE_IPV6) )
+        return;
+
+    fast_path.ethernet = ethernet.get();
+    fast_path.ip = ip.get();
+
+    const auto& vlan = ethernet->Lookup(ETHERTYPE_VLAN);
+    if ( vlan && vlan->IsAnalyzer("VLAN") && vlan->Lookup(ETHERTYPE_IPV4) == ip &&
+         vlan->Lookup(ETHERTYPE_IPV6) == ip )
+        fast_path.vlan = vlan.get();
+
+    DBG_LOG(DBG_PACKET_ANALYSIS, "Fast path enabled for %s via %s", fast_path.vlan ? "Ethernet/VLAN" : "Ethernet",
+            fast_path.ip->GetAnalyzerName());
+}
+
+bool Manager::ForwardFastPath(Packet* packet) {
+    // Disabling an analyzer takes effect at any time, and the generic
+    // dispatch takes care of that.
+    if ( packet->link_type != DLT_EN10MB || ! fast_path.ethernet->IsEnabled() || ! fast_path.ip->IsEnabled() )
+        return false;
+
+    L2Frame frame;
+    bool allow_vlan = fast_path.vlan && fast_path.vlan->IsEnabled();
+
+    if ( ! parse_l2(packet->data, packet->cap_len, allow_vlan, &frame) )
+        return false;
+
+    packet->eth_type = frame.eth_type;
+    packet->l2_dst = packet->data;
+    packet->l2_src = packet->data + 6;
+
+    if ( frame.tagged ) {
+        auto& vlan_ref = packet->vlan != 0 ? packet->inner_vlan : packet->vlan;
+        vlan_ref = frame.vlan;
+    }
+
+    fast_path.ip->AnalyzePacket(packet->cap_len - frame.hdr_len, packet->data + frame.hdr_len, packet);
+    return true;
+}
+
 AnalyzerPtr Manager::InstantiateAnalyzer(const Tag& tag) {
     Component* c = Lookup(tag);
 
@@ -237,3 +405,52 @@ void Manager::ReportUnknownProtocol(const std::string& analyzer, uint32_t protoc
         }
     }
 }
+
+TEST_CASE("packet analysis fast path framing") {
+    uint8_t frame[64] = {0};
+    L2Frame l2;
+
+    SUBCASE("ipv4") {
+        frame[12] = 0x08;
+        frame[13] = 0x00;
+        CHECK(parse_l2(frame, sizeof(frame), false, &l2));
+        CHECK_EQ(l2.hdr_len, 14);
+        CHECK_EQ(l2.eth_type, ETHERTYPE_IPV4);
+        CHECK_FALSE(l2.tagged);
+
+        // Anything the Ethernet analyzer considers truncated goes the generic way.
+        CHECK_FALSE(parse_l2(frame, 16, false, &l2));
+    }
+
+    SUBCASE("vlan") {
+        frame[12] = 0x81;
+        frame[13] = 0x00;
+        frame[14] = 0x20;
+        frame[15] = 0x2a;
+        frame[16] = 0x86;
+        frame[17] = 0xdd;
+        CHECK_FALSE(parse_l2(frame, sizeof(frame), false, &l2));
+        CHECK(parse_l2(frame, sizeof(frame), true, &l2));
+        CHECK_EQ(l2.hdr_len, 18);
+        CHECK_EQ(l2.eth_type, ETHERTYPE_IPV6);
+        CHECK(l2.tagged);
+        CHECK_EQ(l2.vlan, 42);
+    }
+
+    SUBCASE("other") {
+        // Stacked VLAN tags, ARP, and 802.3 frames aren't handled.
+        frame[12] = 0x81;
+        frame[13] = 0x00;
+        frame[16] = 0x81;
+        frame[17] = 0x00;
+        CHECK_FALSE(parse_l2(frame, sizeof(frame), true, &l2));
+
+        frame[12] = 0x08;
+        frame[13] = 0x06;
+        CHECK_FALSE(parse_l2(frame, sizeof(frame), true, &l2));
+
+        frame[12] = 0x00;
+        frame[13] = 0x2e;
+        CHECK_FALSE(parse_l2(frame, sizeof(frame), true, &l2));
+    }
+}
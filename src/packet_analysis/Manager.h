@@ -134,6 +134,18 @@ public:
      */
     bool ProcessInnerPacket(Packet* packet);
 
+    /**
+     * Parses ahead into a packet that's about to be processed to find its
+     * connection, and prefetches the session table entry that processing it
+     * will look up. Packet sources call this for the next packet of a batch
+     * while the current one is being processed. This handles only plain
+     * TCP and UDP over IPv4 and IPv6 in Ethernet frames, and does nothing
+     * for anything else.
+     *
+     * @param packet The upcoming packet.
+     */
+    void PrefetchPacket(const Packet* packet);
+
     uint64_t PacketsProcessed() const { return num_packets_processed; }
 
     /**
@@ -199,9 +211,39 @@ private:
 
     bool PermitUnknownProtocol(const std::string& analyzer, uint32_t protocol);
 
+    /**
+     * Resolves the analyzers of the fast path from the dispatch tables. Needs
+     * to run once all script-level analyzer registrations are in place.
+     */
+    void SetupFastPath();
+
+    /**
+     * Processes the Ethernet and VLAN layers of a common packet directly and
+     * passes it on to the IP analyzer, bypassing the generic dispatch through
+     * the root, Ethernet, and VLAN analyzers. The result is the same as going
+     * through the dispatch chain.
+     *
+     * @param packet The packet to process.
+     *
+     * @return False if the packet isn't a plain Ethernet frame carrying IP,
+     * with at most one VLAN tag. The packet remains unmodified in that case
+     * and needs to go through the generic dispatch.
+     */
+    bool ForwardFastPath(Packet* packet);
+
     std::map<std::string, AnalyzerPtr> analyzers;
     AnalyzerPtr root_analyzer = nullptr;
 
+    // The analyzers the fast path skips ahead through. The VLAN analyzer is
+    // null if tagged frames can't take the fast path, and the IP analyzer
+    // is null if the fast path is unavailable altogether.
+    struct FastPath {
+        bool initialized = false;
+        Analyzer* ethernet = nullptr;
+        Analyzer* vlan = nullptr;
+        Analyzer* ip = nullptr;
+    } fast_path;
+
     uint64_t num_packets_processed = 0;
     detail::PacketProfiler* pkt_profiler = nullptr;
     detail::PacketFilter* pkt_filter = nullptr;
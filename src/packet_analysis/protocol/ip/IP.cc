@@ -157,7 +157,7 @@ bool IPAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* packet)
         }
         else {
             f = detail::fragment_mgr->NextFragment(run_state::processing_start_time, packet->ip_hdr,
-                                                   packet->data + hdr_size);
+                                                   packet->data + hdr_size, packet);
             std::shared_ptr<IP_Hdr> ih = f->ReassembledPkt();
 
             if ( ! ih )
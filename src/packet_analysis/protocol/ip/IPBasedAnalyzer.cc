@@ -29,9 +29,25 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
     const std::shared_ptr<IP_Hdr>& ip_hdr = pkt->ip_hdr;
     detail::ConnKey key(tuple);
 
+    // With flow sharding, only analyze the flows assigned to this process.
+    // Tunneled flows go with the shard of the outermost flow carrying them.
+    bool outermost = ! pkt->encap || pkt->encap->Depth() == 0;
+    bool local = outermost ? session_mgr->IsLocalFlow(key) : session_mgr->IsLocalTunnel(*pkt->encap);
+
+    if ( ! local ) {
+        pkt->processed = true;
+        return true;
+    }
+
     Connection* conn = session_mgr->FindConnection(key);
 
     if ( ! conn ) {
+        // Under overload, don't start analyzing flows selected for shedding.
+        if ( outermost && session_mgr->ShedFlow(key) ) {
+            pkt->processed = true;
+            return true;
+        }
+
         conn = NewConn(&tuple, key, pkt);
         if ( conn )
             session_mgr->Insert(conn, false);
@@ -53,6 +69,13 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
     if ( ! conn )
         return false;
 
+    // Under overload, don't spend anything on connections whose analysis
+    // we're skipping anyway.
+    if ( session_mgr->IsShedding() && conn->GetSessionAdapter()->Skipping() ) {
+        pkt->processed = true;
+        return true;
+    }
+
     // If we successfully made a connection for this packet that means it'll eventually
     // get logged, which means we can mark this packet as having been processed.
     pkt->processed = true;
@@ -110,6 +110,9 @@ bool IPTunnelAnalyzer::ProcessEncapsulatedPacket(double t, const Packet* pkt, co
     p.Init(DLT_RAW, &ts, caplen, len, data, false, "");
     p.encap = outer;
 
+    if ( pkt )
+        p.SetDataOwner(pkt->ShareData(data, caplen));
+
     // Forward the packet back to the IP analyzer.
     bool return_val = ForwardPacket(len, data, &p);
 
@@ -141,6 +144,9 @@ bool IPTunnelAnalyzer::ProcessEncapsulatedPacket(double t, const Packet* pkt, ui
     p.Init(link_type, &ts, caplen, len, data, false, "");
     p.encap = outer;
 
+    if ( pkt )
+        p.SetDataOwner(pkt->ShareData(data, caplen));
+
     // Process the packet as if it was a brand new packet by passing it back
     // to the packet manager.
     bool return_val = packet_mgr->ProcessInnerPacket(&p);
@@ -165,6 +171,7 @@ std::unique_ptr<Packet> build_inner_packet(Packet* outer_pkt, int* encap_index,
     uint32_t inner_wire_len = outer_pkt->len - consumed_len;
 
     auto inner_pkt = std::make_unique<Packet>(link_type, &outer_pkt->ts, inner_cap_len, inner_wire_len, data);
+    inner_pkt->SetDataOwner(outer_pkt->ShareData(data, inner_cap_len));
 
     *encap_index = 0;
     if ( outer_pkt->session ) {
@@ -31,6 +31,7 @@
 %token TOK_ATTR_PRIORITY TOK_ATTR_LOG TOK_ATTR_ERROR_HANDLER TOK_ATTR_GROUP
 %token TOK_ATTR_TYPE_COLUMN TOK_ATTR_DEPRECATED
 %token TOK_ATTR_IS_ASSIGNED TOK_ATTR_IS_USED TOK_ATTR_ORDERED
+%token TOK_ATTR_MAX_SIZE TOK_ATTR_EVICTION
 
 %token TOK_DEBUG
 
@@ -1815,6 +1816,10 @@ attr:
 			}
 	|	TOK_ATTR_ORDERED
 			{ $$ = new Attr(ATTR_ORDERED); }
+	|	TOK_ATTR_MAX_SIZE '=' expr
+			{ $$ = new Attr(ATTR_MAX_SIZE, {AdoptRef{}, $3}); }
+	|	TOK_ATTR_EVICTION '=' expr
+			{ $$ = new Attr(ATTR_EVICTION, {AdoptRef{}, $3}); }
 	;
 
 stmt:
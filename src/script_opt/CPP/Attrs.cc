@@ -109,6 +109,8 @@ const char* CPPCompile::AttrName(AttrTag t) {
         case ATTR_DEPRECATED: return "ATTR_DEPRECATED";
         case ATTR_IS_ASSIGNED: return "ATTR_IS_ASSIGNED";
         case ATTR_IS_USED: return "ATTR_IS_USED";
+        case ATTR_MAX_SIZE: return "ATTR_MAX_SIZE";
+        case ATTR_EVICTION: return "ATTR_EVICTION";
 
         default: return "<busted>";
     }
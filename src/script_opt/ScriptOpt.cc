@@ -2,11 +2,20 @@
 
 #include "zeek/script_opt/ScriptOpt.h"
 
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
 #include "zeek/Desc.h"
 #include "zeek/EventHandler.h"
 #include "zeek/EventRegistry.h"
 #include "zeek/Options.h"
 #include "zeek/Reporter.h"
+#include "zeek/ScannedFile.h"
+#include "zeek/input.h"
 #include "zeek/module_util.h"
 #include "zeek/script_opt/CPP/Compile.h"
 #include "zeek/script_opt/CPP/Func.h"
@@ -16,8 +25,12 @@
 #include "zeek/script_opt/Reduce.h"
 #include "zeek/script_opt/UsageAnalyzer.h"
 #include "zeek/script_opt/UseDefs.h"
+#include "zeek/script_opt/ZAM/Cache.h"
 #include "zeek/script_opt/ZAM/Compile.h"
 #include "zeek/script_opt/ZAM/Profile.h"
+#include "zeek/supervisor/Supervisor.h"
+
+extern char** environ;
 
 namespace zeek::detail {
 
@@ -329,6 +342,29 @@ static void init_options() {
         estimate_ZAM_profiling_overhead();
     }
 
+    auto zcache = getenv("ZEEK_ZAM_CACHE");
+    if ( zcache )
+        analysis_options.ZAM_cache_dir = zcache;
+
+    auto zjobs = getenv("ZEEK_ZAM_JOBS");
+    if ( zjobs ) {
+        analysis_options.ZAM_jobs = atoi(zjobs);
+        if ( analysis_options.ZAM_jobs <= 0 )
+            reporter->FatalError("bad ZAM job count from $ZEEK_ZAM_JOBS: %s", zjobs);
+    }
+
+    auto zworker = getenv("ZEEK_ZAM_WORKER");
+    if ( zworker ) {
+        auto& ao = analysis_options;
+        if ( sscanf(zworker, "%d,%d,%d", &ao.ZAM_worker, &ao.ZAM_jobs, &ao.ZAM_worker_fd) != 3 || ao.ZAM_worker < 0 ||
+             ao.ZAM_worker >= ao.ZAM_jobs || ao.ZAM_worker_fd < 0 )
+            reporter->FatalError("bad ZAM worker specification from $ZEEK_ZAM_WORKER: %s", zworker);
+    }
+
+    auto zguide = getenv("ZEEK_ZAM_PROF_GUIDE");
+    if ( zguide && ! load_ZOP_pair_profile(zguide) )
+        reporter->FatalError("cannot read ZAM profile from $ZEEK_ZAM_PROF_GUIDE: %s", zguide);
+
     if ( analysis_options.gen_ZAM ) {
         analysis_options.gen_ZAM_code = true;
         analysis_options.inliner = true;
@@ -446,6 +482,134 @@ static void generate_CPP() {
     CPPCompile cpp(funcs, pfs, gen_name, standalone, report);
 }
 
+// Compiles the given bodies in worker processes, each taking every
+// ZAM_jobs'th body that the cache doesn't already know about, and adds
+// what they compiled to the cache. We use processes rather than threads
+// because the optimizer isn't thread-safe: it works on shared,
+// non-atomically reference-counted ASTs and keeps global state such as
+// the scope stack. The workers are fresh Zeek processes started with our
+// command line rather than forks of this one, as by now we're running
+// threads (Broker's, for example) whose locks a fork could inherit in a
+// held state. Each parses the scripts itself and then turns into a worker
+// (see compile_ZAM_worker()). Bodies that a worker fails to deliver remain
+// for the caller to compile itself.
+static void compile_ZAM_in_parallel(const std::vector<FuncInfo*>& to_compile, ZAMCache& cache) {
+    if ( supervisor_mgr || Supervisor::ThisNode() ) {
+        reporter->Warning("not compiling ZAM in parallel under the supervisor");
+        return;
+    }
+
+    for ( auto& sf : files_scanned )
+        if ( sf.canonical_path == ScannedFile::canonical_stdin_path ) {
+            reporter->Warning("not compiling ZAM in parallel for scripts read from stdin");
+            return;
+        }
+
+    auto jobs = analysis_options.ZAM_jobs;
+
+    auto exe = util::detail::get_exe_path(zeek_argv[0]);
+    std::vector<char*> args{exe.data()};
+    for ( auto i = 1; i < zeek_argc; ++i )
+        args.push_back(zeek_argv[i]);
+    args.push_back(nullptr);
+
+    // The workers' output goes nowhere: they'd only repeat our own
+    // messages, and we compile (and report on) what they fail to.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+    // The read end of the pipe from each worker.
+    std::vector<std::pair<pid_t, int>> workers;
+
+    for ( auto w = 0; w < jobs; ++w ) {
+        int fds[2];
+        if ( pipe(fds) < 0 ) {
+            reporter->Warning("cannot create pipe for parallel ZAM compilation: %s", strerror(errno));
+            break;
+        }
+
+        // Only the write end goes to the worker.
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+        std::string worker_env = util::fmt("ZEEK_ZAM_WORKER=%d,%d,%d", w, jobs, fds[1]);
+        std::vector<char*> env;
+        for ( auto e = environ; *e; ++e )
+            if ( strncmp(*e, "ZEEK_ZAM_WORKER=", 16) != 0 )
+                env.push_back(*e);
+        env.push_back(worker_env.data());
+        env.push_back(nullptr);
+
+        pid_t pid;
+        auto rc = posix_spawn(&pid, exe.c_str(), &actions, nullptr, args.data(), env.data());
+        close(fds[1]);
+
+        if ( rc != 0 ) {
+            reporter->Warning("cannot start process for parallel ZAM compilation: %s", strerror(rc));
+            close(fds[0]);
+            break;
+        }
+
+        workers.emplace_back(pid, fds[0]);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+
+    for ( auto& [pid, fd] : workers ) {
+        std::string data;
+        char buf[65536];
+
+        for ( ;; ) {
+            auto n = read(fd, buf, sizeof(buf));
+            if ( n > 0 )
+                data.append(buf, n);
+            else if ( n == 0 || errno != EINTR )
+                break;
+        }
+
+        close(fd);
+
+        int status = 0;
+        while ( waitpid(pid, &status, 0) < 0 && errno == EINTR )
+            ;
+
+        if ( WIFEXITED(status) && WEXITSTATUS(status) == 0 )
+            cache.Import(data);
+    }
+}
+
+// Runs a worker started by compile_ZAM_in_parallel(): compiles its share of
+// the bodies, sends the outcome to the starting process, and exits.
+[[noreturn]] static void compile_ZAM_worker(const std::vector<FuncInfo*>& to_compile, std::shared_ptr<ProfileFuncs> pfs,
+                                           ZAMCache& cache) {
+    auto w = analysis_options.ZAM_worker;
+    auto jobs = analysis_options.ZAM_jobs;
+
+    int n = 0;
+    for ( auto f : to_compile ) {
+        auto func = f->FuncPtr().get();
+
+        // Everyone needs to ask the cache, to keep its numbering of
+        // bodies in sync.
+        if ( cache.Knows(func, f->Body()) || n++ % jobs != w )
+            continue;
+
+        auto new_body = f->Body();
+        optimize_func(f->FuncPtr(), f->ProfilePtr(), pfs, f->Scope(), new_body);
+
+        if ( reporter->Errors() > 0 )
+            // Leave it to the starting process to compile (and report) this.
+            _exit(1);
+
+        cache.Record(func, f->Body(), new_body);
+    }
+
+    auto data = cache.Export();
+    _exit(util::safe_write(analysis_options.ZAM_worker_fd, data.data(), data.size()) ? 0 : 1);
+}
+
 static void analyze_scripts_for_ZAM() {
     if ( analysis_options.usage_issues > 0 && analysis_options.optimize_AST ) {
         fprintf(stderr,
@@ -499,18 +663,17 @@ static void analyze_scripts_for_ZAM() {
         }
     }
 
-    bool did_one = false;
+    // The bodies to compile, in the order we compile them.
+    std::vector<FuncInfo*> to_compile;
 
     for ( auto& f : funcs ) {
         if ( ! f.ShouldAnalyze() )
             continue;
 
-        auto& func = f.FuncPtr();
-        auto l = lambdas.find(func.get());
-        bool is_lambda = l != lambdas.end();
+        auto func = f.FuncPtr().get();
 
-        if ( ! analysis_options.compile_all && ! is_lambda && inl && inl->WasFullyInlined(func.get()) &&
-             func_used_indirectly.count(func.get()) == 0 ) {
+        if ( ! analysis_options.compile_all && ! is_lambda(func) && inl && inl->WasFullyInlined(func) &&
+             func_used_indirectly.count(func) == 0 ) {
             // No need to compile as it won't be called directly.
             // We'd like to zero out the body to recover the
             // memory, but a *few* such functions do get called,
@@ -520,20 +683,61 @@ static void analyze_scripts_for_ZAM() {
             continue;
         }
 
-        auto new_body = f.Body();
-        optimize_func(func, f.ProfilePtr(), pfs, f.Scope(), new_body);
-        f.SetBody(new_body);
+        to_compile.push_back(&f);
+    }
 
-        if ( is_lambda )
-            l->second->ReplaceBody(new_body);
+    bool did_one = ! to_compile.empty();
+
+    std::unique_ptr<ZAMCache> cache;
+    if ( ! analysis_options.ZAM_cache_dir.empty() ) {
+        cache = std::make_unique<ZAMCache>(analysis_options.ZAM_cache_dir);
+        if ( ! cache->IsActive() )
+            cache.reset();
+    }
 
-        did_one = true;
+    if ( analysis_options.ZAM_worker >= 0 ) {
+        if ( ! cache )
+            cache = std::make_unique<ZAMCache>();
+
+        compile_ZAM_worker(to_compile, pfs, *cache);
+    }
+
+    if ( analysis_options.ZAM_jobs > 1 && analysis_options.gen_ZAM_code && did_one ) {
+        if ( auto conflict = ZAMCache::Conflict() )
+            reporter->Warning("not compiling ZAM in parallel due to %s", conflict);
+        else {
+            if ( ! cache )
+                cache = std::make_unique<ZAMCache>();
+
+            compile_ZAM_in_parallel(to_compile, *cache);
+        }
+    }
+
+    for ( auto f : to_compile ) {
+        auto& func = f->FuncPtr();
+        auto new_body = f->Body();
+
+        if ( ! cache || ! cache->Lookup(func.get(), new_body) ) {
+            optimize_func(func, f->ProfilePtr(), pfs, f->Scope(), new_body);
+
+            if ( cache )
+                cache->Record(func.get(), f->Body(), new_body);
+        }
+
+        f->SetBody(new_body);
+
+        auto l = lambdas.find(func.get());
+        if ( l != lambdas.end() )
+            l->second->ReplaceBody(new_body);
     }
 
     if ( ! did_one )
         reporter->FatalError("no matching functions/files for -O ZAM");
 
     finalize_functions(funcs);
+
+    if ( cache )
+        cache->Save();
 }
 
 void clear_script_analysis() {
@@ -81,6 +81,27 @@ struct AnalyOpt {
     // An associated file to which to write the profile.
     FILE* profile_file = nullptr;
 
+    // If non-empty, a directory in which to cache compiled ZAM bodies
+    // across runs. Set via ZEEK_ZAM_CACHE.
+    std::string ZAM_cache_dir;
+
+    // If greater than one, the number of worker processes across which
+    // to spread compiling function bodies to ZAM. Set via ZEEK_ZAM_JOBS.
+    int ZAM_jobs = 0;
+
+    // In such a worker process, its index among the ZAM_jobs workers and
+    // the file descriptor to send what it compiled to. Set via
+    // ZEEK_ZAM_WORKER by the process starting the workers.
+    int ZAM_worker = -1;
+    int ZAM_worker_fd = -1;
+
+    // Script code given on the command line via -e, which the ZAM
+    // cache needs to take into account.
+    std::string command_line_code;
+
+    // Likewise, script options set on the command line ("name=value").
+    std::vector<std::string> command_line_options;
+
     // If true, dump out transformed code: the results of reducing
     // interpreted scripts, and, if optimize is set, of then optimizing
     // them.
@@ -10,6 +10,7 @@
 #include "zeek/script_opt/Reduce.h"
 #include "zeek/script_opt/ScriptOpt.h"
 #include "zeek/script_opt/ZAM/Compile.h"
+#include "zeek/script_opt/ZAM/Profile.h"
 
 namespace zeek::detail {
 
@@ -118,6 +119,15 @@ void ZAMCompiler::OptimizeInsts() {
                 DumpInsts1(nullptr);
             }
         }
+
+        if ( FuseHotInsts() ) {
+            something_changed = true;
+
+            if ( dump_intermediaries ) {
+                printf("Did some fusing:\n");
+                DumpInsts1(nullptr);
+            }
+        }
     } while ( something_changed );
 
     ReMapFrame();
@@ -317,6 +327,58 @@ bool ZAMCompiler::PruneUnused() {
     return did_prune;
 }
 
+bool ZAMCompiler::FuseHotInsts() {
+    bool did_fuse = false;
+
+    for ( auto i0 : insts1 ) {
+        if ( ! i0->live )
+            continue;
+
+        auto i1 = NextLiveInst(i0);
+
+        // The second instruction goes away, so nothing can branch to it.
+        if ( ! i1 || i1->num_labels > 0 || ! is_hot_ZOP_pair(i0->op, i1->op) )
+            continue;
+
+        if ( i0->op == OP_HAS_FIELD_COND_VVV && i1->op == OP_HAS_FIELD_COND_VVV ) {
+            if ( i1->v1 != i0->v1 || i1->target != i0->target )
+                continue;
+
+            i0->op = OP_HAS_FIELDS_COND_VVVV;
+            i0->op_type = OP_VVVV_I2_I3_I4;
+            i0->v3 = i1->v2;
+            i0->target_slot = 4;
+        }
+
+        else if ( i0->op == OP_VAL_IS_IN_TABLE_COND_VVV ) {
+            // Look for a lookup of the same index in the same table.
+            if ( i1->v2 != i0->v2 || i1->v3 != i0->v1 )
+                continue;
+
+            auto& lhs_t = frame_denizens[i1->v1]->GetType();
+            if ( i1->op != AssignmentFlavor(OP_TABLE_INDEX1_VVV, lhs_t->Tag(), false) )
+                continue;
+
+            i0->op = OP_VAL_IS_IN_TABLE_COND_INDEX1_VVVV;
+            i0->op_type = OP_VVVV_I4;
+            i0->v3 = i0->v1;
+            i0->v1 = i1->v1;
+            i0->target_slot = 4;
+            i0->t2 = lhs_t;
+            i0->is_managed = ZVal::IsManagedType(lhs_t);
+            i0->aux = i1->aux;
+        }
+
+        else
+            continue;
+
+        KillInst(i1);
+        did_fuse = true;
+    }
+
+    return did_fuse;
+}
+
 void ZAMCompiler::ComputeFrameLifetimes() {
     // Start analysis from scratch, since we might do this repeatedly.
     inst_beginnings.clear();
@@ -0,0 +1,1131 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/script_opt/ZAM/Cache.h"
+
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+#include "zeek/Desc.h"
+#include "zeek/EventHandler.h"
+#include "zeek/EventRegistry.h"
+#include "zeek/IPAddr.h"
+#include "zeek/Reporter.h"
+#include "zeek/ScannedFile.h"
+#include "zeek/digest.h"
+#include "zeek/script_opt/ScriptOpt.h"
+#include "zeek/script_opt/ZAM/Compile.h"
+
+extern "C" const char zeek_build_info[];
+
+namespace zeek {
+extern const char* zeek_version();
+}
+
+namespace zeek::detail {
+
+// Changing the layout of cache files requires changing this, too.
+static const char* CACHE_MAGIC = "ZAM cache 2";
+
+// Leading markers for saved types.
+enum SavedTypeKind {
+    ST_NIL,
+    ST_BASE,
+    ST_NAMED,
+    ST_LIST,
+    ST_TABLE,
+    ST_SET,
+    ST_VECTOR,
+    ST_FILE,
+    ST_TYPE,
+    ST_OPAQUE,
+    ST_FUNC,
+};
+
+// Leading markers for saved values.
+enum SavedValKind {
+    SV_NIL,
+    SV_PLAIN,
+    SV_TYPE,
+    SV_FUNC,
+};
+
+// Leading markers for saved auxiliary elements.
+enum SavedAuxElemKind {
+    SA_INT,
+    SA_SLOT,
+    SA_CONST,
+};
+
+static bool read_file(const std::string& path, std::string& contents) {
+    std::ifstream f(path, std::ios::binary);
+    if ( ! f )
+        return false;
+
+    std::ostringstream ss;
+    ss << f.rdbuf();
+    contents = ss.str();
+
+    return ! f.bad();
+}
+
+// True if the given tag is that of a type that we represent by
+// the corresponding base_type().
+static bool is_plain_base_tag(TypeTag tag) {
+    switch ( tag ) {
+        case TYPE_VOID:
+        case TYPE_BOOL:
+        case TYPE_INT:
+        case TYPE_COUNT:
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL:
+        case TYPE_STRING:
+        case TYPE_PATTERN:
+        case TYPE_PORT:
+        case TYPE_ADDR:
+        case TYPE_SUBNET:
+        case TYPE_ANY: return true;
+
+        default: return false;
+    }
+}
+
+// Returns the global with the given name if it holds a function, or
+// nil if there's no such global.
+static IDPtr find_func_ID(const std::string& name) {
+    auto& id = id::find(name);
+    if ( ! id || ! id->GetVal() || id->GetType()->Tag() != TYPE_FUNC )
+        return nullptr;
+
+    return id;
+}
+
+// True if we can find the given function by its name.
+static bool is_findable_func(const Func* f) {
+    auto id = find_func_ID(f->Name());
+    return id && id->GetVal()->AsFunc() == f;
+}
+
+void ZAMSaver::Int(int64_t i) { UInt((static_cast<uint64_t>(i) << 1) ^ static_cast<uint64_t>(i >> 63)); }
+
+void ZAMSaver::UInt(uint64_t u) {
+    while ( u >= 0x80 ) {
+        data.push_back(static_cast<char>((u & 0x7f) | 0x80));
+        u >>= 7;
+    }
+
+    data.push_back(static_cast<char>(u));
+}
+
+void ZAMSaver::Double(double d) {
+    char b[sizeof(d)];
+    memcpy(b, &d, sizeof(d));
+    data.append(b, sizeof(d));
+}
+
+void ZAMSaver::Str(const std::string& s) {
+    UInt(s.size());
+    data.append(s);
+}
+
+void ZAMSaver::Type(const TypePtr& t) {
+    if ( ! t ) {
+        UInt(ST_NIL);
+        return;
+    }
+
+    auto tag = t->Tag();
+
+    if ( is_plain_base_tag(tag) && t == base_type(tag) ) {
+        UInt(ST_BASE);
+        UInt(tag);
+        return;
+    }
+
+    auto& name = t->GetName();
+    if ( ! name.empty() ) {
+        auto& id = id::find(name);
+        if ( id && id->IsType() && id->GetType() == t ) {
+            UInt(ST_NAMED);
+            Str(name);
+            return;
+        }
+    }
+
+    switch ( tag ) {
+        case TYPE_LIST: {
+            auto tl = t->AsTypeList();
+            auto& types = tl->GetTypes();
+            UInt(ST_LIST);
+            Type(tl->GetPureType());
+            UInt(types.size());
+            for ( auto& lt : types )
+                Type(lt);
+            break;
+        }
+
+        case TYPE_TABLE: {
+            auto tt = t->AsTableType();
+            if ( tt->IsSet() ) {
+                UInt(ST_SET);
+                Type(tt->GetIndices());
+            }
+            else {
+                UInt(ST_TABLE);
+                Type(tt->GetIndices());
+                Type(tt->Yield());
+            }
+            break;
+        }
+
+        case TYPE_VECTOR: {
+            auto vt = t->AsVectorType();
+            UInt(ST_VECTOR);
+            Type(vt->IsUnspecifiedVector() ? base_type(TYPE_VOID) : vt->Yield());
+            break;
+        }
+
+        case TYPE_FILE:
+            UInt(ST_FILE);
+            Type(t->Yield());
+            break;
+
+        case TYPE_TYPE:
+            UInt(ST_TYPE);
+            Type(t->AsTypeType()->GetType());
+            break;
+
+        case TYPE_OPAQUE:
+            UInt(ST_OPAQUE);
+            Str(t->AsOpaqueType()->Name());
+            break;
+
+        case TYPE_FUNC: {
+            auto ft = t->AsFuncType();
+            auto& params = ft->Params();
+
+            if ( ft->GetCaptures() )
+                Fail();
+
+            UInt(ST_FUNC);
+            UInt(ft->Flavor());
+            Type(ft->Yield());
+            UInt(params->NumFields());
+
+            for ( auto i = 0; i < params->NumFields(); ++i ) {
+                if ( params->FieldDecl(i)->attrs )
+                    Fail();
+                Str(params->FieldName(i));
+                Type(params->GetFieldType(i));
+            }
+            break;
+        }
+
+        default:
+            // Anonymous records and enums, in particular, would need to
+            // be the same types as in the scripts, not just equivalent.
+            Fail();
+            UInt(ST_NIL);
+            break;
+    }
+}
+
+void ZAMSaver::Value(const ValPtr& v) {
+    if ( ! v ) {
+        UInt(SV_NIL);
+        return;
+    }
+
+    auto& t = v->GetType();
+    auto tag = t->Tag();
+
+    if ( tag == TYPE_TYPE ) {
+        UInt(SV_TYPE);
+        Type({NewRef{}, v->AsType()});
+        return;
+    }
+
+    if ( tag == TYPE_FUNC ) {
+        auto f = v->AsFunc();
+        if ( ! is_findable_func(f) )
+            Fail();
+
+        UInt(SV_FUNC);
+        Str(f->Name());
+        return;
+    }
+
+    UInt(SV_PLAIN);
+    Type(t);
+
+    switch ( tag ) {
+        case TYPE_BOOL: Int(v->AsBool()); break;
+        case TYPE_INT: Int(v->AsInt()); break;
+        case TYPE_ENUM: Int(v->AsEnum()); break;
+
+        case TYPE_COUNT: UInt(v->AsCount()); break;
+
+        case TYPE_PORT:
+            UInt(v->AsPortVal()->Port());
+            UInt(v->AsPortVal()->PortType());
+            break;
+
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: Double(v->AsDouble()); break;
+
+        case TYPE_STRING: {
+            auto s = v->AsStringVal();
+            Str(std::string(reinterpret_cast<const char*>(s->Bytes()), s->Len()));
+            break;
+        }
+
+        case TYPE_ADDR: Str(v->AsAddr().AsString()); break;
+
+        case TYPE_SUBNET:
+            Str(v->AsSubNet().Prefix().AsString());
+            UInt(v->AsSubNet().Length());
+            break;
+
+        default:
+            // Patterns and aggregates.
+            Fail();
+            break;
+    }
+}
+
+void ZAMSaver::Global(const ID* id) {
+    if ( ! id->IsGlobal() || id::find(id->Name()).get() != id )
+        Fail();
+
+    Str(id->Name());
+}
+
+void ZAMSaver::Inst(const ZInst& z) {
+    // Calls in "when" conditions need the original call expression,
+    // which we don't save.
+    if ( z.op == OP_WHENCALLN_V || z.op == OP_WHENINDCALLN_VV )
+        Fail();
+
+    Loc(z.loc);
+
+    UInt(z.op);
+    UInt(z.op_type);
+    Int(z.v1);
+    Int(z.v2);
+    Int(z.v3);
+    Int(z.v4);
+    Int(z.is_managed);
+
+    Type(z.t);
+    Type(z.t2);
+
+    auto c = z.ConstVal();
+    if ( ! c && z.c.ManagedVal() )
+        // Something's using the constant for other purposes.
+        Fail();
+
+    Value(c);
+    Aux(z.aux);
+}
+
+void ZAMSaver::Aux(const ZInstAux* aux) {
+    if ( ! aux ) {
+        Int(-1);
+        return;
+    }
+
+    // Lambdas, "when" statements, cat() replacements, and constructors
+    // with attributes or field initializers all refer to state that we
+    // don't save.
+    if ( aux->primary_func || aux->wi || aux->cat_args || aux->attrs || aux->field_inits )
+        Fail();
+
+    Int(aux->n);
+
+    for ( auto i = 0; i < aux->n; ++i ) {
+        auto& e = aux->elems[i];
+
+        if ( e.Constant() ) {
+            UInt(SA_CONST);
+            Value(e.Constant());
+        }
+        else if ( e.GetType() ) {
+            UInt(SA_SLOT);
+            Int(e.Slot());
+            Type(e.GetType());
+        }
+        else {
+            UInt(SA_INT);
+            Int(e.IntVal());
+        }
+    }
+
+    Int(aux->elems_has_slots);
+
+    Int(aux->id_val != nullptr);
+    if ( aux->id_val )
+        Global(aux->id_val.get());
+
+    Int(aux->func != nullptr);
+    if ( aux->func ) {
+        if ( ! is_findable_func(aux->func) )
+            Fail();
+        Str(aux->func->Name());
+    }
+
+    Int(aux->is_BiF_call);
+
+    auto h = aux->event_handler;
+    Int(h != nullptr);
+    if ( h ) {
+        if ( event_registry->Lookup(h->Name()) != h )
+            Fail();
+        Str(h->Name());
+    }
+
+    Int(aux->can_change_non_locals);
+
+    UInt(aux->map.size());
+    for ( auto m : aux->map )
+        Int(m);
+
+    UInt(aux->loop_vars.size());
+    for ( auto lv : aux->loop_vars )
+        Int(lv);
+
+    UInt(aux->loop_var_types.size());
+    for ( auto& lvt : aux->loop_var_types )
+        Type(lvt);
+
+    UInt(aux->lvt_is_managed.size());
+    for ( auto m : aux->lvt_is_managed )
+        Int(m);
+
+    Type(aux->value_var_type);
+
+    UInt(aux->zvec.size());
+}
+
+void ZAMSaver::Loc(const std::shared_ptr<ZAMLocInfo>& loc) {
+    if ( ! loc || ! loc->Loc() ) {
+        Fail();
+        return;
+    }
+
+    auto li = loc_indices.find(loc.get());
+    if ( li != loc_indices.end() ) {
+        Int(li->second);
+        return;
+    }
+
+    // A new index tells the loader that the location's definition
+    // follows.
+    int index = loc_indices.size();
+    loc_indices[loc.get()] = index;
+    Int(index);
+
+    auto l = loc->Loc();
+    Str(loc->FuncName());
+    Str(l->filename ? l->filename : "");
+    Int(l->first_line);
+    Int(l->last_line);
+    Int(l->first_column);
+    Int(l->last_column);
+
+    auto parent = loc->Parent();
+    if ( parent )
+        Loc(parent);
+    else
+        Int(-1);
+}
+
+int64_t ZAMLoader::Int() {
+    auto u = UInt();
+    return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+}
+
+uint64_t ZAMLoader::UInt() {
+    uint64_t u = 0;
+
+    for ( int shift = 0; shift < 64; shift += 7 ) {
+        if ( p == end ) {
+            Fail();
+            return 0;
+        }
+
+        auto b = static_cast<unsigned char>(*p++);
+        u |= static_cast<uint64_t>(b & 0x7f) << shift;
+
+        if ( ! (b & 0x80) )
+            return u;
+    }
+
+    Fail();
+    return 0;
+}
+
+double ZAMLoader::Double() {
+    double d = 0.0;
+
+    if ( end - p < static_cast<ptrdiff_t>(sizeof(d)) )
+        Fail();
+    else {
+        memcpy(&d, p, sizeof(d));
+        p += sizeof(d);
+    }
+
+    return d;
+}
+
+std::string ZAMLoader::Str() {
+    auto len = UInt();
+
+    if ( ! ok || len > static_cast<uint64_t>(end - p) ) {
+        Fail();
+        return "";
+    }
+
+    std::string s(p, len);
+    p += len;
+
+    return s;
+}
+
+TypePtr ZAMLoader::Type() {
+    switch ( UInt() ) {
+        case ST_NIL: return nullptr;
+
+        case ST_BASE: {
+            auto tag = UInt();
+            if ( tag >= NUM_TYPES || ! is_plain_base_tag(static_cast<TypeTag>(tag)) )
+                break;
+            return base_type(static_cast<TypeTag>(tag));
+        }
+
+        case ST_NAMED: {
+            auto& id = id::find(Str());
+            if ( ! id || ! id->IsType() )
+                break;
+            return id->GetType();
+        }
+
+        case ST_LIST: {
+            auto tl = make_intrusive<TypeList>(Type());
+            auto n = UInt();
+            for ( auto i = 0U; ok && i < n; ++i )
+                tl->Append(Type());
+            return tl;
+        }
+
+        case ST_TABLE: {
+            auto ind = Type();
+            auto yield = Type();
+            if ( ! ind || ind->Tag() != TYPE_LIST )
+                break;
+            return make_intrusive<TableType>(cast_intrusive<TypeList>(ind), std::move(yield));
+        }
+
+        case ST_SET: {
+            auto ind = Type();
+            if ( ! ind || ind->Tag() != TYPE_LIST )
+                break;
+            return make_intrusive<SetType>(cast_intrusive<TypeList>(ind), nullptr);
+        }
+
+        case ST_VECTOR: {
+            auto yield = Type();
+            if ( ! yield )
+                break;
+            return make_intrusive<VectorType>(std::move(yield));
+        }
+
+        case ST_FILE: {
+            auto yield = Type();
+            if ( ! yield )
+                break;
+            return make_intrusive<FileType>(std::move(yield));
+        }
+
+        case ST_TYPE: {
+            auto t = Type();
+            if ( ! t )
+                break;
+            return make_intrusive<TypeType>(std::move(t));
+        }
+
+        case ST_OPAQUE: return make_intrusive<OpaqueType>(Str());
+
+        case ST_FUNC: {
+            auto flavor = UInt();
+            auto yield = Type();
+            auto n = UInt();
+
+            if ( flavor > FUNC_FLAVOR_HOOK )
+                break;
+
+            auto params = new type_decl_list();
+            for ( auto i = 0U; ok && i < n; ++i ) {
+                auto name = Str();
+                params->push_back(new TypeDecl(util::copy_string(name.c_str()), Type()));
+            }
+
+            auto args = make_intrusive<RecordType>(params);
+            return make_intrusive<FuncType>(std::move(args), std::move(yield), static_cast<FunctionFlavor>(flavor));
+        }
+
+        default: break;
+    }
+
+    Fail();
+    return nullptr;
+}
+
+ValPtr ZAMLoader::Value() {
+    switch ( UInt() ) {
+        case SV_NIL: return nullptr;
+
+        case SV_TYPE: {
+            auto t = Type();
+            if ( ! t )
+                break;
+            return make_intrusive<TypeVal>(std::move(t), true);
+        }
+
+        case SV_FUNC: {
+            auto id = find_func_ID(Str());
+            if ( ! id )
+                break;
+            return id->GetVal();
+        }
+
+        case SV_PLAIN: {
+            auto t = Type();
+            if ( ! t )
+                break;
+
+            switch ( t->Tag() ) {
+                case TYPE_BOOL: return val_mgr->Bool(Int());
+                case TYPE_INT: return val_mgr->Int(Int());
+                case TYPE_ENUM: return t->AsEnumType()->GetEnumVal(Int());
+                case TYPE_COUNT: return val_mgr->Count(UInt());
+
+                case TYPE_PORT: {
+                    auto port = UInt();
+                    auto proto = UInt();
+                    if ( proto > TRANSPORT_ICMP )
+                        break;
+                    return val_mgr->Port(port, static_cast<TransportProto>(proto));
+                }
+
+                case TYPE_DOUBLE: return make_intrusive<DoubleVal>(Double());
+                case TYPE_TIME: return make_intrusive<TimeVal>(Double());
+                case TYPE_INTERVAL: return make_intrusive<IntervalVal>(Double());
+
+                case TYPE_STRING: return make_intrusive<StringVal>(Str());
+                case TYPE_ADDR: return make_intrusive<AddrVal>(Str());
+
+                case TYPE_SUBNET: {
+                    IPAddr prefix(Str());
+                    auto width = UInt();
+                    return make_intrusive<SubNetVal>(prefix, static_cast<int>(width));
+                }
+
+                default: break;
+            }
+            break;
+        }
+
+        default: break;
+    }
+
+    Fail();
+    return nullptr;
+}
+
+IDPtr ZAMLoader::Global() {
+    auto& id = id::find(Str());
+    if ( ! id )
+        Fail();
+
+    return id;
+}
+
+const char* ZAMLoader::Intern(const std::string& s) {
+    static std::unordered_set<std::string> interned;
+    return interned.insert(s).first->c_str();
+}
+
+ZInst* ZAMLoader::Inst() {
+    auto loc = Loc();
+    auto op = UInt();
+    auto op_type = UInt();
+
+    if ( ! ok || ! loc || op > OP_NOP || op_type > OP_VVVV_I2_I3_I4 ) {
+        Fail();
+        return nullptr;
+    }
+
+    ZAM::curr_loc = std::move(loc);
+    auto z = new ZInst(static_cast<ZOp>(op), static_cast<ZAMOpType>(op_type));
+
+    z->v1 = Int();
+    z->v2 = Int();
+    z->v3 = Int();
+    z->v4 = Int();
+    z->is_managed = Int();
+
+    z->t = Type();
+    z->t2 = Type();
+
+    auto c = Value();
+    if ( c ) {
+        if ( z->t )
+            z->c = ZVal(c, z->t);
+        else
+            Fail();
+    }
+
+    z->aux = Aux();
+
+    return z;
+}
+
+ZInstAux* ZAMLoader::Aux() {
+    auto n = Int();
+    if ( n < 0 )
+        return nullptr;
+
+    // Each element takes at least two bytes.
+    if ( ! ok || n > (end - p) / 2 ) {
+        Fail();
+        return nullptr;
+    }
+
+    auto aux = new ZInstAux(n);
+
+    for ( auto i = 0; ok && i < n; ++i ) {
+        switch ( UInt() ) {
+            case SA_INT: aux->Add(i, static_cast<int>(Int())); break;
+
+            case SA_SLOT: {
+                int slot = Int();
+                aux->Add(i, slot, Type());
+                break;
+            }
+
+            case SA_CONST: aux->Add(i, Value()); break;
+
+            default: Fail(); break;
+        }
+    }
+
+    aux->elems_has_slots = Int();
+
+    if ( Int() )
+        aux->id_val = Global();
+
+    if ( Int() ) {
+        auto id = find_func_ID(Str());
+        if ( id )
+            aux->func = id->GetVal()->AsFunc();
+        else
+            Fail();
+    }
+
+    aux->is_BiF_call = Int();
+
+    if ( Int() ) {
+        aux->event_handler = event_registry->Lookup(Str());
+        if ( ! aux->event_handler )
+            Fail();
+    }
+
+    aux->can_change_non_locals = Int();
+
+    auto nm = UInt();
+    for ( auto i = 0U; ok && i < nm; ++i )
+        aux->map.push_back(Int());
+
+    auto nlv = UInt();
+    for ( auto i = 0U; ok && i < nlv; ++i )
+        aux->loop_vars.push_back(Int());
+
+    auto nlvt = UInt();
+    for ( auto i = 0U; ok && i < nlvt; ++i )
+        aux->loop_var_types.push_back(Type());
+
+    auto nlvm = UInt();
+    for ( auto i = 0U; ok && i < nlvm; ++i )
+        aux->lvt_is_managed.push_back(Int());
+
+    aux->value_var_type = Type();
+
+    aux->zvec.resize(UInt());
+
+    return aux;
+}
+
+std::shared_ptr<ZAMLocInfo> ZAMLoader::Loc() {
+    auto index = Int();
+
+    if ( ! ok || index < 0 )
+        return nullptr;
+
+    if ( static_cast<size_t>(index) < locs.size() ) {
+        if ( ! locs[index] )
+            // Can't be its own ancestor.
+            Fail();
+        return locs[index];
+    }
+
+    if ( static_cast<size_t>(index) != locs.size() ) {
+        Fail();
+        return nullptr;
+    }
+
+    locs.emplace_back(nullptr);
+
+    auto func_name = Str();
+    auto filename = Str();
+    int first_line = Int();
+    int last_line = Int();
+    int first_column = Int();
+    int last_column = Int();
+    auto parent = Loc();
+
+    if ( ! ok )
+        return nullptr;
+
+    auto l = std::make_shared<Location>(Intern(filename), first_line, last_line, first_column, last_column);
+    auto loc = std::make_shared<ZAMLocInfo>(std::move(func_name), std::move(l), std::move(parent));
+    locs[index] = loc;
+
+    return loc;
+}
+
+ZAMCache::ZAMCache(std::string _dir) : dir(std::move(_dir)) {
+    if ( ! analysis_options.gen_ZAM_code )
+        return;
+
+    if ( auto conflict = Conflict() ) {
+        reporter->Warning("not using the ZAM cache due to %s", conflict);
+        return;
+    }
+
+    if ( dir.empty() ) {
+        active = true;
+        return;
+    }
+
+    if ( ! ComputeKey() )
+        return;
+
+    file_name = dir + "/" + key + ".zam";
+    active = true;
+
+    Read();
+}
+
+const char* ZAMCache::Conflict() {
+    auto& ao = analysis_options;
+
+    if ( ao.profile_ZAM )
+        return "ZAM profiling";
+
+    if ( ao.dump_xform || ao.dump_uds || ao.dump_ZAM )
+        return "dumping of optimized code";
+
+    if ( ao.report_uncompilable )
+        return "reporting uncompilable functions";
+
+    if ( ! ao.only_funcs.empty() || ! ao.only_files.empty() )
+        return "optimizing only some functions";
+
+    return nullptr;
+}
+
+bool ZAMCache::ComputeKey() {
+    auto h = hash_init(Hash_SHA256);
+
+    auto add = [h](std::string_view s) {
+        uint64_t len = s.size();
+        hash_update(h, &len, sizeof(len));
+        hash_update(h, s.data(), s.size());
+    };
+
+    add(CACHE_MAGIC);
+    add(zeek_version());
+    add(zeek_build_info);
+
+    for ( int i = 1; i <= OP_NOP; ++i )
+        add(ZOP_name(static_cast<ZOp>(i)));
+
+    auto& ao = analysis_options;
+    add(util::fmt("%d %d %d %d %d", ao.inliner, ao.optimize_AST, ao.no_ZAM_opt, ao.compile_all, ao.usage_issues));
+
+    bool ok = true;
+
+    for ( auto& sf : files_scanned ) {
+        add(sf.canonical_path);
+        add(sf.skipped ? "skipped" : "loaded");
+
+        if ( sf.skipped )
+            continue;
+
+        if ( sf.canonical_path == ScannedFile::canonical_stdin_path ) {
+            reporter->Warning("not using the ZAM cache for scripts read from stdin");
+            ok = false;
+            break;
+        }
+
+        auto path = sf.canonical_path;
+        if ( util::is_dir(path) )
+            path += "/__load__.zeek";
+
+        std::string contents;
+        if ( ! read_file(path, contents) ) {
+            reporter->Warning("not using the ZAM cache as %s can't be read", path.c_str());
+            ok = false;
+            break;
+        }
+
+        add(contents);
+    }
+
+    add(ao.command_line_code);
+
+    // Script options set on the command line.
+    for ( auto& o : ao.command_line_options )
+        add(o);
+
+    // A profile guiding ZAM's instruction fusion.
+    auto zguide = getenv("ZEEK_ZAM_PROF_GUIDE");
+    if ( zguide ) {
+        std::string contents;
+        read_file(zguide, contents);
+        add(contents);
+    }
+
+    u_char digest[ZEEK_SHA256_DIGEST_LENGTH];
+    hash_final(h, digest);
+    key = sha256_digest_print(digest);
+
+    return ok;
+}
+
+void ZAMCache::Read() {
+    std::string contents;
+    if ( ! read_file(file_name, contents) )
+        // Nothing cached yet.
+        return;
+
+    ZAMLoader l(contents.data(), contents.size());
+
+    if ( l.Str() != CACHE_MAGIC || l.Str() != key )
+        return;
+
+    std::map<std::string, Entry> new_entries;
+
+    if ( ReadEntries(l, new_entries) )
+        entries = std::move(new_entries);
+    else
+        reporter->Warning("ignoring corrupt ZAM cache file %s", file_name.c_str());
+}
+
+void ZAMCache::WriteEntry(ZAMSaver& s, const std::string& id, const Entry& e) const {
+    s.Str(id);
+    s.UInt(e.kind);
+    s.Int(e.frame_size);
+    s.Int(e.remapped_frame_size);
+    s.Str(e.fingerprint);
+    s.Str(e.body);
+}
+
+bool ZAMCache::ReadEntries(ZAMLoader& l, std::map<std::string, Entry>& new_entries) const {
+    auto n = l.UInt();
+    for ( auto i = 0U; l.OK() && i < n; ++i ) {
+        auto id = l.Str();
+
+        Entry e;
+        auto kind = l.UInt();
+        e.frame_size = l.Int();
+        e.remapped_frame_size = l.Int();
+        e.fingerprint = l.Str();
+        e.body = l.Str();
+
+        if ( kind > ENTRY_UNSAVED )
+            l.Fail();
+        else
+            e.kind = static_cast<EntryKind>(kind);
+
+        new_entries[id] = std::move(e);
+    }
+
+    return l.OK();
+}
+
+std::string ZAMCache::NextID(ScriptFunc* f) {
+    std::string name = f->Name();
+    return name + "#" + std::to_string(num_bodies[name]++);
+}
+
+std::string ZAMCache::Fingerprint(const StmtPtr& body) {
+    ODesc d;
+    body->Describe(&d);
+
+    auto loc = body->GetLocationInfo();
+    d.Add(util::fmt("\n%s:%d-%d", loc->filename ? loc->filename : "", loc->first_line, loc->last_line));
+
+    auto h = hash_init(Hash_SHA256);
+    hash_update(h, d.Bytes(), d.Len());
+
+    u_char digest[ZEEK_SHA256_DIGEST_LENGTH];
+    hash_final(h, digest);
+    return sha256_digest_print(digest);
+}
+
+ZAMCache::Entry* ZAMCache::Find(ScriptFunc* f, const StmtPtr& body) {
+    last_id = NextID(f);
+
+    auto e = entries.find(last_id);
+    if ( e == entries.end() || e->second.kind == ENTRY_UNSAVED )
+        return nullptr;
+
+    // Runtime-dependent @if's can make the same scripts yield different
+    // sets of bodies, and so the same name refer to another body.
+    if ( e->second.fingerprint != Fingerprint(body) )
+        return nullptr;
+
+    return &e->second;
+}
+
+bool ZAMCache::Lookup(ScriptFunc* f, StmtPtr& body) {
+    auto found = Find(f, body);
+    if ( ! found )
+        return false;
+
+    auto& entry = *found;
+
+    if ( entry.kind == ENTRY_ZAM ) {
+        ZAMLoader l(entry.body.data(), entry.body.size());
+        auto zb = ZBody::Load(l);
+
+        if ( ! zb ) {
+            entries.erase(last_id);
+            return false;
+        }
+
+        f->ReplaceBody(body, zb);
+        body = std::move(zb);
+    }
+
+    if ( entry.frame_size > f->FrameSize() )
+        f->SetFrameSize(entry.frame_size);
+
+    if ( entry.remapped_frame_size >= 0 ) {
+        auto r = remapped_intrp_frame_sizes.find(f);
+        if ( r == remapped_intrp_frame_sizes.end() || r->second < entry.remapped_frame_size )
+            remapped_intrp_frame_sizes[f] = entry.remapped_frame_size;
+    }
+
+    return true;
+}
+
+bool ZAMCache::Knows(ScriptFunc* f, const StmtPtr& body) { return Find(f, body) != nullptr; }
+
+void ZAMCache::Record(ScriptFunc* f, const StmtPtr& orig_body, const StmtPtr& new_body) {
+    Entry e;
+    e.kind = ENTRY_UNSAVED;
+    e.frame_size = f->FrameSize();
+    e.fingerprint = Fingerprint(orig_body);
+
+    auto r = remapped_intrp_frame_sizes.find(f);
+    e.remapped_frame_size = r == remapped_intrp_frame_sizes.end() ? -1 : r->second;
+
+    if ( new_body == orig_body )
+        e.kind = ENTRY_UNCHANGED;
+
+    else if ( new_body->Tag() == STMT_ZAM ) {
+        ZAMSaver s;
+        if ( cast_intrusive<ZBody>(new_body)->Save(s) ) {
+            e.kind = ENTRY_ZAM;
+            e.body = s.Data();
+        }
+    }
+
+    auto& old_e = entries[last_id];
+    if ( old_e.kind == ENTRY_UNSAVED && e.kind == ENTRY_UNSAVED && old_e.fingerprint == e.fingerprint )
+        // Already known, no need to rewrite the cache.
+        return;
+
+    old_e = std::move(e);
+    recorded.insert(last_id);
+    dirty = true;
+}
+
+void ZAMCache::Save() {
+    if ( ! active || ! dirty || file_name.empty() )
+        return;
+
+    if ( ! util::detail::ensure_intermediate_dirs(dir.c_str()) )
+        return;
+
+    ZAMSaver s;
+    s.Str(CACHE_MAGIC);
+    s.Str(key);
+    s.UInt(entries.size());
+
+    for ( auto& [id, e] : entries )
+        WriteEntry(s, id, e);
+
+    // Write to a temporary file first, so concurrently starting Zeek
+    // processes never see a partial cache file.
+    auto tmp_name = file_name + "." + std::to_string(getpid()) + ".tmp";
+    auto f = fopen(tmp_name.c_str(), "wb");
+
+    if ( ! f ) {
+        reporter->Warning("cannot write ZAM cache file %s: %s", tmp_name.c_str(), strerror(errno));
+        return;
+    }
+
+    auto& data = s.Data();
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = fclose(f) == 0 && ok;
+
+    if ( ! ok || rename(tmp_name.c_str(), file_name.c_str()) != 0 ) {
+        reporter->Warning("cannot write ZAM cache file %s: %s", file_name.c_str(), strerror(errno));
+        unlink(tmp_name.c_str());
+    }
+}
+
+std::string ZAMCache::Export() const {
+    ZAMSaver s;
+    s.UInt(recorded.size());
+
+    for ( auto& id : recorded )
+        WriteEntry(s, id, entries.at(id));
+
+    return s.Data();
+}
+
+bool ZAMCache::Import(const std::string& data) {
+    ZAMLoader l(data.data(), data.size());
+    std::map<std::string, Entry> new_entries;
+
+    if ( ! ReadEntries(l, new_entries) )
+        return false;
+
+    for ( auto& [id, e] : new_entries ) {
+        entries[id] = std::move(e);
+        recorded.insert(id);
+        dirty = true;
+    }
+
+    return true;
+}
+
+} // namespace zeek::detail
@@ -0,0 +1,233 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Classes for caching compiled ZAM function bodies on disk, so that runs
+// with unchanged scripts can skip compiling them.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "zeek/script_opt/ZAM/ZBody.h"
+#include "zeek/script_opt/ZAM/ZInst.h"
+
+namespace zeek::detail {
+
+// Writes out the elements of a compiled body in a compact binary form.
+// Elements that can't be faithfully reconstructed in a later run, such
+// as anonymous record types or pattern constants, render the body as a
+// whole unsaveable, which OK() reports.
+class ZAMSaver {
+public:
+    void Int(int64_t i);
+    void UInt(uint64_t u);
+    void Double(double d);
+    void Str(const std::string& s);
+
+    void Type(const TypePtr& t);
+    void Value(const ValPtr& v);
+    void Global(const ID* id);
+    void Inst(const ZInst& z);
+
+    template<typename T>
+    void Cases(const CaseMaps<T>& cases) {
+        UInt(cases.size());
+        for ( auto& cm : cases ) {
+            UInt(cm.size());
+            for ( auto& [k, v] : cm ) {
+                if constexpr ( std::is_same_v<T, zeek_int_t> )
+                    Int(k);
+                else if constexpr ( std::is_same_v<T, zeek_uint_t> )
+                    UInt(k);
+                else if constexpr ( std::is_same_v<T, double> )
+                    Double(k);
+                else
+                    Str(k);
+                Int(v);
+            }
+        }
+    }
+
+    void Fail() { ok = false; }
+    bool OK() const { return ok; }
+
+    const std::string& Data() const { return data; }
+
+private:
+    void Aux(const ZInstAux* aux);
+    void Loc(const std::shared_ptr<ZAMLocInfo>& loc);
+
+    std::string data;
+    bool ok = true;
+
+    // Locations are shared across instructions, so we write each out
+    // just once, and refer to it subsequently by its index.
+    std::unordered_map<const ZAMLocInfo*, int> loc_indices;
+};
+
+// The counterpart to ZAMSaver.  Malformed input, or a reference to a
+// global that no longer exists, leaves OK() false.
+class ZAMLoader {
+public:
+    ZAMLoader(const char* data, size_t len) : p(data), end(data + len) {}
+
+    int64_t Int();
+    uint64_t UInt();
+    double Double();
+    std::string Str();
+
+    TypePtr Type();
+    ValPtr Value();
+    IDPtr Global();
+
+    // The caller owns the returned instruction, but not its auxiliary
+    // information, which like that of compiled instructions lives on.
+    ZInst* Inst();
+
+    template<typename T>
+    CaseMaps<T> Cases() {
+        CaseMaps<T> cases;
+        auto n = UInt();
+        for ( auto i = 0U; ok && i < n; ++i ) {
+            CaseMap<T> cm;
+            auto m = UInt();
+            for ( auto j = 0U; ok && j < m; ++j ) {
+                T k;
+                if constexpr ( std::is_same_v<T, zeek_int_t> )
+                    k = Int();
+                else if constexpr ( std::is_same_v<T, zeek_uint_t> )
+                    k = UInt();
+                else if constexpr ( std::is_same_v<T, double> )
+                    k = Double();
+                else
+                    k = Str();
+                cm[k] = Int();
+            }
+            cases.emplace_back(std::move(cm));
+        }
+        return cases;
+    }
+
+    // Returns a copy of the given string that lives for the rest of
+    // the run, for uses that expect a plain C string.
+    static const char* Intern(const std::string& s);
+
+    void Fail() { ok = false; }
+    bool OK() const { return ok; }
+
+private:
+    ZInstAux* Aux();
+    std::shared_ptr<ZAMLocInfo> Loc();
+
+    const char* p;
+    const char* end;
+    bool ok = true;
+
+    std::vector<std::shared_ptr<ZAMLocInfo>> locs;
+};
+
+// Manages the cache of compiled bodies for the current run. The cache
+// lives in a single file per combination of loaded scripts (by content),
+// command-line script code, script optimization options, and Zeek build,
+// and maps each function body to its compiled form. Bodies are identified
+// by their function's name and their position among the bodies of that
+// function that we compile. As the scripts' @if's can depend on the
+// environment, entries also carry a fingerprint of the original body, and
+// only apply to bodies matching it.
+//
+// A cache without a directory lives only in memory. Parallel compilation
+// uses one to gather the bodies its worker processes compiled.
+class ZAMCache {
+public:
+    // Sets up a cache in the given directory, reading in whatever an
+    // earlier run with the same key left there.
+    ZAMCache(std::string dir = "");
+
+    // Returns why the present options rule out caching compiled bodies,
+    // or nil if they don't.
+    static const char* Conflict();
+
+    // False if the cache can't be used with the present options or
+    // scripts, in which case there's no point in using it further.
+    bool IsActive() const { return active; }
+
+    // Looks up what to do with the next body of the given function. If
+    // the cache knows, returns true with "body" updated to (and installed
+    // as) what compiling it would yield. Otherwise, returns false, and
+    // the caller should compile the body and pass the result to Record().
+    bool Lookup(ScriptFunc* f, StmtPtr& body);
+
+    // Like Lookup(), but only reports whether the cache knows what to do
+    // with the body, without loading it.
+    bool Knows(ScriptFunc* f, const StmtPtr& body);
+
+    // Records the outcome of compiling the body most recently looked up
+    // for the given function, from its original body to "new_body".
+    void Record(ScriptFunc* f, const StmtPtr& orig_body, const StmtPtr& new_body);
+
+    // Writes out the cache file if anything new was recorded.
+    void Save();
+
+    // Returns the entries recorded by this process in serialized form,
+    // for passing to Import() in another process with the same scripts.
+    std::string Export() const;
+
+    // Adds the entries from an Export(). Returns false, adding none, if
+    // the data is malformed.
+    bool Import(const std::string& data);
+
+private:
+    enum EntryKind {
+        ENTRY_UNCHANGED, // compilation leaves the body alone
+        ENTRY_ZAM,       // the body compiles to the included ZBody
+        ENTRY_UNSAVED,   // the compiled body can't be saved
+    };
+
+    struct Entry {
+        EntryKind kind = ENTRY_UNCHANGED;
+        int frame_size = 0;
+        int remapped_frame_size = -1;
+        std::string fingerprint; // of the original body
+        std::string body;
+    };
+
+    // Computes the key for the present run. Returns false if the
+    // scripts can't be identified by their content.
+    bool ComputeKey();
+
+    void Read();
+
+    // Returns the identifier of the next body of the given function.
+    std::string NextID(ScriptFunc* f);
+
+    // Returns a digest of a body's code and location.
+    static std::string Fingerprint(const StmtPtr& body);
+
+    // Returns the usable entry for the next body of the given function,
+    // if any.
+    Entry* Find(ScriptFunc* f, const StmtPtr& body);
+
+    void WriteEntry(ZAMSaver& s, const std::string& id, const Entry& e) const;
+    bool ReadEntries(ZAMLoader& l, std::map<std::string, Entry>& new_entries) const;
+
+    std::string dir;
+    std::string key;
+    std::string file_name;
+
+    bool active = false;
+    bool dirty = false;
+
+    std::map<std::string, Entry> entries;
+
+    // The entries recorded (rather than read) in this process.
+    std::unordered_set<std::string> recorded;
+
+    // How many bodies of each function we've looked up so far.
+    std::unordered_map<std::string, int> num_bodies;
+    std::string last_id;
+};
+
+} // namespace zeek::detail
@@ -408,6 +408,10 @@ private:
     // pruned.
     bool PruneUnused();
 
+    // Fuse adjacent instructions into superinstructions, for pairs that
+    // a loaded ZAM profile marks as hot.  True if something got fused.
+    bool FuseHotInsts();
+
     // For the current state of insts1, compute lifetimes of frame
     // denizens (variable(s) using a given frame slot) in terms of
     // first-instruction-to-last-instruction during which they're
@@ -601,4 +605,8 @@ private:
 class FuncInfo;
 extern void finalize_functions(const std::vector<FuncInfo>& funcs);
 
+// Interpreter frame sizes of functions whose variables compiling to ZAM
+// has remapped into ZAM frames.
+extern std::unordered_map<const Func*, int> remapped_intrp_frame_sizes;
+
 } // namespace zeek::detail
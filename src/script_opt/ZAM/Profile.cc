@@ -2,12 +2,16 @@
 
 #include "zeek/script_opt/ZAM/Profile.h"
 
+#include <fstream>
+#include <set>
+#include <sstream>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "zeek/Obj.h"
 #include "zeek/script_opt/ProfileFunc.h"
 #include "zeek/script_opt/ZAM/ZBody.h"
+#include "zeek/script_opt/ZAM/ZInst.h"
 
 namespace zeek::detail {
 
@@ -52,4 +56,54 @@ std::string ZAMLocInfo::Describe(bool include_lines) const {
     return desc;
 }
 
+// A pair needs to account for at least this fraction of all sampled pairs
+// to be worth fusing.
+static constexpr double HOT_ZOP_PAIR_FRACTION = 0.001;
+
+static std::set<std::pair<ZOp, ZOp>> hot_ZOP_pairs;
+
+bool load_ZOP_pair_profile(const char* filename) {
+    std::ifstream in(filename);
+    if ( ! in )
+        return false;
+
+    std::unordered_map<std::string, ZOp> ops_by_name;
+    for ( int i = 1; i <= OP_NOP; ++i )
+        ops_by_name[ZOP_name(ZOp(i))] = ZOp(i);
+
+    std::vector<std::pair<std::pair<ZOp, ZOp>, int>> pairs;
+    int64_t total = 0;
+    std::string line;
+
+    while ( std::getline(in, line) ) {
+        std::istringstream fields(line);
+        std::string tag, name1, name2;
+        int count;
+
+        if ( ! std::getline(fields, tag, '\t') || tag != "pair" )
+            continue;
+
+        if ( ! std::getline(fields, name1, '\t') || ! std::getline(fields, name2, '\t') || ! (fields >> count) )
+            continue;
+
+        auto op1 = ops_by_name.find(name1);
+        auto op2 = ops_by_name.find(name2);
+
+        // Profiles from a different build can refer to ops we don't have.
+        if ( op1 == ops_by_name.end() || op2 == ops_by_name.end() )
+            continue;
+
+        pairs.push_back({{op1->second, op2->second}, count});
+        total += count;
+    }
+
+    for ( auto& [ops, count] : pairs )
+        if ( count >= total * HOT_ZOP_PAIR_FRACTION )
+            hot_ZOP_pairs.insert(ops);
+
+    return true;
+}
+
+bool is_hot_ZOP_pair(ZOp op1, ZOp op2) { return hot_ZOP_pairs.count({op1, op2}) > 0; }
+
 } // namespace zeek::detail
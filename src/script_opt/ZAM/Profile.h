@@ -5,6 +5,7 @@
 #pragma once
 
 #include "zeek/script_opt/ProfileFunc.h"
+#include "zeek/script_opt/ZAM/ZOp.h"
 #include "zeek/util.h"
 
 namespace zeek::detail {
@@ -42,4 +43,13 @@ extern void estimate_ZAM_profiling_overhead();
 // that executed.
 extern void report_ZOP_profile();
 
+// Loads the instruction pairs recorded in a profile written by
+// report_ZOP_profile(), for guiding which of them to fuse into
+// superinstructions. Returns false if the file can't be read.
+extern bool load_ZOP_pair_profile(const char* filename);
+
+// True if a ZOP pair profile is loaded and the given pair of ZOPs, in
+// that order, accounted for a significant share of it.
+extern bool is_hot_ZOP_pair(ZOp op1, ZOp op2);
+
 } // namespace zeek::detail
@@ -2,6 +2,8 @@
 
 #include "zeek/script_opt/ZAM/ZBody.h"
 
+#include <map>
+
 #include "zeek/Desc.h"
 #include "zeek/EventHandler.h"
 #include "zeek/Frame.h"
@@ -11,6 +13,7 @@
 #include "zeek/Traverse.h"
 #include "zeek/Trigger.h"
 #include "zeek/script_opt/ScriptOpt.h"
+#include "zeek/script_opt/ZAM/Cache.h"
 #include "zeek/script_opt/ZAM/Compile.h"
 
 // Needed for managing the corresponding values.
@@ -126,11 +129,31 @@ class ZAMDelayedCallException : public InterpreterException {};
 
 static bool did_init = false;
 
+// It's a little weird doing this when constructing a ZBody, but unless
+// we add a general "initialize for ZAM" function, that's as good a place
+// as any.
+static void init_ZAM_globals() {
+    if ( ! did_init ) {
+        auto log_ID_type = lookup_ID("ID", "Log");
+        ASSERT(log_ID_type);
+        ZAM::log_ID_enum_type = log_ID_type->GetType<EnumType>();
+        ZAM::any_base_type = base_type(TYPE_ANY);
+        ZVal::SetZValNilStatusAddr(&ZAM_error);
+        did_init = false;
+    }
+}
+
 // Count of how often each type of ZOP executed, and how much CPU it
 // cumulatively took.
 int ZOP_count[OP_NOP + 1];
 double ZOP_CPU[OP_NOP + 1];
 
+// Count of how often each type of ZOP was sampled together with the type
+// of the instruction following it in the code (which, for branches, isn't
+// necessarily the one executed next). These pairs are the candidates for
+// fusing into superinstructions.
+static std::map<std::pair<ZOp, ZOp>, int> ZOP_pair_count;
+
 void report_ZOP_profile() {
     static bool did_overhead_report = false;
 
@@ -148,6 +171,11 @@ void report_ZOP_profile() {
             auto CPU = std::max(ZOP_CPU[i] - ZOP_count[i] * CPU_prof_overhead, 0.0);
             fprintf(analysis_options.profile_file, "%s\t%d\t%.06f\n", ZOP_name(ZOp(i)), ZOP_count[i], CPU);
         }
+
+    // These are what a later run can use, via ZEEK_ZAM_PROF_GUIDE, to decide
+    // which instruction sequences to fuse.
+    for ( auto& [ops, count] : ZOP_pair_count )
+        fprintf(analysis_options.profile_file, "pair\t%s\t%s\t%d\n", ZOP_name(ops.first), ZOP_name(ops.second), count);
 }
 
 // Sets the given element to a copy of an existing (not newly constructed)
@@ -255,17 +283,12 @@ ZBody::ZBody(std::string _func_name, const ZAMCompiler* zc) : Stmt(STMT_ZAM) {
     table_iters = zc->GetTableIters();
     num_step_iters = zc->NumStepIters();
 
-    // It's a little weird doing this in the constructor, but unless
-    // we add a general "initialize for ZAM" function, this is as good
-    // a place as any.
-    if ( ! did_init ) {
-        auto log_ID_type = lookup_ID("ID", "Log");
-        ASSERT(log_ID_type);
-        ZAM::log_ID_enum_type = log_ID_type->GetType<EnumType>();
-        ZAM::any_base_type = base_type(TYPE_ANY);
-        ZVal::SetZValNilStatusAddr(&ZAM_error);
-        did_init = false;
-    }
+    init_ZAM_globals();
+}
+
+ZBody::ZBody(std::string _func_name) : Stmt(STMT_ZAM) {
+    func_name = std::move(_func_name);
+    init_ZAM_globals();
 }
 
 ZBody::~ZBody() {
@@ -299,6 +322,125 @@ void ZBody::SetInsts(vector<ZInstI*>& instsI) {
     InitProfile();
 }
 
+bool ZBody::Save(ZAMSaver& s) const {
+    s.Str(func_name);
+
+    s.UInt(frame_denizens.size());
+    for ( auto& fd : frame_denizens ) {
+        s.UInt(fd.names.size());
+        for ( auto n : fd.names )
+            s.Str(n);
+
+        s.UInt(fd.id_start.size());
+        for ( auto is : fd.id_start )
+            s.UInt(is);
+
+        s.Int(fd.scope_end);
+        s.Int(fd.is_managed);
+    }
+
+    s.UInt(managed_slots.size());
+    for ( auto ms : managed_slots )
+        s.Int(ms);
+
+    s.UInt(globals.size());
+    for ( auto& g : globals ) {
+        s.Global(g.id.get());
+        s.Int(g.slot);
+    }
+
+    s.Cases(int_cases);
+    s.Cases(uint_cases);
+    s.Cases(double_cases);
+    s.Cases(str_cases);
+
+    s.Int(fixed_frame != nullptr);
+    s.UInt(table_iters.size());
+    s.Int(num_step_iters);
+
+    s.UInt(end_pc);
+    for ( auto i = 0U; i < end_pc && s.OK(); ++i )
+        s.Inst(insts[i]);
+
+    return s.OK();
+}
+
+IntrusivePtr<ZBody> ZBody::Load(ZAMLoader& l) {
+    auto name = l.Str();
+    IntrusivePtr<ZBody> zb{AdoptRef{}, new ZBody(std::move(name))};
+
+    auto nfd = l.UInt();
+    for ( auto i = 0U; l.OK() && i < nfd; ++i ) {
+        FrameSharingInfo fd;
+
+        auto nn = l.UInt();
+        for ( auto j = 0U; l.OK() && j < nn; ++j )
+            fd.names.push_back(ZAMLoader::Intern(l.Str()));
+
+        auto nis = l.UInt();
+        for ( auto j = 0U; l.OK() && j < nis; ++j )
+            fd.id_start.push_back(l.UInt());
+
+        fd.scope_end = l.Int();
+        fd.is_managed = l.Int();
+
+        zb->frame_denizens.emplace_back(std::move(fd));
+    }
+
+    zb->frame_size = zb->frame_denizens.size();
+
+    auto nms = l.UInt();
+    for ( auto i = 0U; l.OK() && i < nms; ++i ) {
+        auto ms = l.Int();
+        if ( ms < 0 || ms >= zb->frame_size )
+            l.Fail();
+        else
+            zb->managed_slots.push_back(ms);
+    }
+
+    auto ng = l.UInt();
+    for ( auto i = 0U; l.OK() && i < ng; ++i ) {
+        auto id = l.Global();
+        zb->globals.push_back({std::move(id), static_cast<int>(l.Int())});
+    }
+
+    zb->num_globals = zb->globals.size();
+
+    zb->int_cases = l.Cases<zeek_int_t>();
+    zb->uint_cases = l.Cases<zeek_uint_t>();
+    zb->double_cases = l.Cases<double>();
+    zb->str_cases = l.Cases<std::string>();
+
+    bool non_recursive = l.Int();
+    auto ntable_iters = l.UInt();
+    zb->num_step_iters = l.Int();
+
+    if ( ! l.OK() )
+        return nullptr;
+
+    if ( non_recursive ) {
+        zb->fixed_frame = new ZVal[zb->frame_size];
+
+        for ( auto& ms : zb->managed_slots )
+            zb->fixed_frame[ms].ClearManagedVal();
+    }
+
+    zb->table_iters.resize(ntable_iters);
+
+    std::vector<ZInst*> insts;
+    auto ninst = l.UInt();
+    for ( auto i = 0U; l.OK() && i < ninst; ++i )
+        insts.push_back(l.Inst());
+
+    if ( l.OK() )
+        zb->SetInsts(insts);
+
+    for ( auto z : insts )
+        delete z;
+
+    return l.OK() ? zb : nullptr;
+}
+
 void ZBody::InitProfile() {
     if ( analysis_options.profile_ZAM ) {
         default_prof_vec = BuildProfVec();
@@ -389,6 +531,9 @@ ValPtr ZBody::Exec(Frame* f, StmtFlowType& flow) {
                 ++ZOP_count[z.op];
                 ++ninst;
 
+                if ( pc + 1 < end_pc )
+                    ++ZOP_pair_count[{z.op, insts[pc + 1].op}];
+
                 profile_pc = pc;
                 profile_CPU = util::curr_CPU_time();
             }
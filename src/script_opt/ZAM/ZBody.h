@@ -36,6 +36,9 @@ using ProfVec = std::vector<ProfVal>;
 using ProfMap = std::unordered_map<std::string, ProfVal>;
 using CallStack = std::vector<const ZAMLocInfo*>;
 
+class ZAMSaver;
+class ZAMLoader;
+
 class ZBody : public Stmt {
 public:
     ZBody(std::string _func_name, const ZAMCompiler* zc);
@@ -43,18 +46,18 @@ public:
     ~ZBody() override;
 
     // These are split out from the constructor to allow construction
-    // of a ZBody from either save-file full instructions (first method,
-    // not currently supported) or intermediary instructions (second method).
+    // of a ZBody from either full instructions (first method, used when
+    // loading a cached body) or intermediary instructions (second method).
     void SetInsts(std::vector<ZInst*>& insts);
     void SetInsts(std::vector<ZInstI*>& instsI);
 
     ValPtr Exec(Frame* f, StmtFlowType& flow) override;
 
-    // Older code exists for save files, but let's see if we can
-    // avoid having to support them, as they're a fairly elaborate
-    // production.
-    //
-    // void SaveTo(FILE* f, int interp_frame_size) const;
+    // Support for the on-disk cache of compiled bodies (see Cache.h).
+    // Save() returns false if the body can't be saved, and Load() nil
+    // if what it's loading from is unusable.
+    bool Save(ZAMSaver& s) const;
+    static IntrusivePtr<ZBody> Load(ZAMLoader& l);
 
     void Dump() const;
 
@@ -63,6 +66,9 @@ public:
     const std::string& FuncName() const { return func_name; }
 
 private:
+    // Used by Load(), which fills in the rest.
+    explicit ZBody(std::string _func_name);
+
     // Initializes profiling information, if needed.
     void InitProfile();
     std::shared_ptr<ProfVec> BuildProfVec() const;
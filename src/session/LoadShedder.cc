@@ -0,0 +1,92 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/session/LoadShedder.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::session::detail {
+
+LoadShedder::LoadShedder(double arg_lag_threshold, double arg_max_ratio)
+    : lag_threshold(arg_lag_threshold), max_ratio(std::clamp(arg_max_ratio, 0.0, 1.0)) {}
+
+void LoadShedder::Update(double lag) {
+    if ( ! Enabled() )
+        return;
+
+    // Back off slower than we ramp up, and only once the lag has come down
+    // clearly, to avoid oscillating around the threshold.
+    if ( lag > lag_threshold )
+        ratio = std::min(max_ratio, ratio + RATIO_INCREASE);
+    else if ( lag < lag_threshold / 2 )
+        ratio = std::max(0.0, ratio - RATIO_DECREASE);
+
+    threshold = static_cast<uint64_t>(std::ldexp(ratio, 32));
+}
+
+} // namespace zeek::session::detail
+
+using zeek::session::detail::LoadShedder;
+
+TEST_CASE("load shedder") {
+    LoadShedder ls(1.0, 0.5);
+
+    CHECK(ls.Enabled());
+    CHECK_FALSE(ls.Active());
+    CHECK_FALSE(ls.Shed(0));
+
+    SUBCASE("disabled") {
+        LoadShedder off(0.0, 0.5);
+        off.Update(100.0);
+        CHECK_FALSE(off.Enabled());
+        CHECK_FALSE(off.Active());
+        CHECK_EQ(off.Ratio(), 0.0);
+    }
+
+    SUBCASE("ramp up and down") {
+        ls.Update(0.1);
+        CHECK_EQ(ls.Ratio(), 0.0);
+
+        ls.Update(2.0);
+        CHECK_EQ(ls.Ratio(), LoadShedder::RATIO_INCREASE);
+        CHECK(ls.Active());
+
+        for ( int i = 0; i < 100; ++i )
+            ls.Update(2.0);
+
+        CHECK_EQ(ls.Ratio(), 0.5);
+
+        // Between half the threshold and the threshold, the ratio holds.
+        ls.Update(0.75);
+        CHECK_EQ(ls.Ratio(), 0.5);
+
+        ls.Update(0.1);
+        CHECK_EQ(ls.Ratio(), 0.5 - LoadShedder::RATIO_DECREASE);
+
+        for ( int i = 0; i < 100; ++i )
+            ls.Update(0.1);
+
+        CHECK_EQ(ls.Ratio(), 0.0);
+        CHECK_FALSE(ls.Active());
+    }
+
+    SUBCASE("hash fraction") {
+        for ( int i = 0; i < 4; ++i )
+            ls.Update(2.0);
+
+        CHECK_EQ(ls.Ratio(), 0.25);
+
+        // Flows are shed by the top bits of their hash.
+        CHECK(ls.Shed(0));
+        CHECK(ls.Shed(0x3fffffffffffffff));
+        CHECK_FALSE(ls.Shed(0x4000000000000000));
+        CHECK_FALSE(ls.Shed(0xffffffffffffffff));
+
+        // Raising the ratio keeps shedding the same flows.
+        ls.Update(2.0);
+        CHECK(ls.Shed(0x3fffffffffffffff));
+        CHECK(ls.Shed(0x4000000000000000));
+    }
+}
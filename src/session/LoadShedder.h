@@ -0,0 +1,74 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+
+namespace zeek::session::detail {
+
+/**
+ * Decides which new flows to drop when Zeek can't keep up with live traffic.
+ *
+ * The shedder tracks a ratio of flows to shed, which it raises while the
+ * observed processing lag stays above a threshold and lowers again, more
+ * slowly, once the lag has dropped well below it. A flow is shed if its hash
+ * falls into the lowest fraction of the hash space given by the ratio. That
+ * makes the selection deterministic: a flow's packets are either all shed or
+ * not at all, and raising the ratio only ever adds flows to the shed set.
+ */
+class LoadShedder {
+public:
+    // How much the ratio changes per update in either direction.
+    static constexpr double RATIO_INCREASE = 1.0 / 16;
+    static constexpr double RATIO_DECREASE = 1.0 / 64;
+
+    /**
+     * Constructor.
+     *
+     * @param lag_threshold The lag, in seconds, above which to shed. Zero
+     * disables shedding.
+     * @param max_ratio The largest fraction of flows to shed, in [0, 1].
+     */
+    LoadShedder(double lag_threshold, double max_ratio);
+
+    /**
+     * Returns true if shedding is configured at all.
+     */
+    bool Enabled() const { return lag_threshold > 0.0 && max_ratio > 0.0; }
+
+    /**
+     * Returns true if flows are currently being shed.
+     */
+    bool Active() const { return threshold != 0; }
+
+    /**
+     * Adjusts the shed ratio according to a new lag observation.
+     *
+     * @param lag The current processing lag in seconds, i.e., how far the
+     * time of the packet being processed trails the wall clock.
+     */
+    void Update(double lag);
+
+    /**
+     * Returns the current fraction of flows being shed.
+     */
+    double Ratio() const { return ratio; }
+
+    /**
+     * Returns true if the flow with a given hash is currently shed.
+     *
+     * @param flow_hash A hash of the flow's key, uniformly distributed over
+     * the 64-bit range.
+     */
+    bool Shed(uint64_t flow_hash) const { return (flow_hash >> 32) < threshold; }
+
+private:
+    double lag_threshold;
+    double max_ratio;
+    double ratio = 0.0;
+
+    // The ratio scaled to the upper 32 bits of a flow hash.
+    uint64_t threshold = 0;
+};
+
+} // namespace zeek::session::detail
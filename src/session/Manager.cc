@@ -75,7 +75,20 @@ private:
 
 } // namespace detail
 
-Manager::Manager() { stats = new detail::ProtocolStats(); }
+Manager::Manager()
+    : load_shedder(BifConst::load_shedding_lag_threshold, BifConst::load_shedding_max_ratio) {
+    stats = new detail::ProtocolStats();
+
+    flow_shard_count = BifConst::flow_shard_count;
+    flow_shard_index = BifConst::flow_shard_index;
+
+    if ( flow_shard_count == 0 )
+        reporter->FatalError("flow_shard_count must be at least 1");
+
+    if ( flow_shard_index >= flow_shard_count )
+        reporter->FatalError("flow_shard_index (%" PRIu64 ") must be less than flow_shard_count (%" PRIu64 ")",
+                             flow_shard_index, flow_shard_count);
+}
 
 Manager::~Manager() {
     Clear();
@@ -96,11 +109,50 @@ Connection* Manager::FindConnection(Val* v) {
 Connection* Manager::FindConnection(const zeek::detail::ConnKey& conn_key) {
     detail::Key key(&conn_key, sizeof(conn_key), detail::Key::CONNECTION_KEY_TYPE, false);
 
-    auto it = session_map.find(key);
-    if ( it != session_map.end() )
-        return static_cast<Connection*>(it->second);
+    return static_cast<Connection*>(session_map.Lookup(key));
+}
+
+void Manager::PrefetchConnection(const zeek::detail::ConnKey& conn_key) {
+    detail::Key key(&conn_key, sizeof(conn_key), detail::Key::CONNECTION_KEY_TYPE, false);
+    session_map.Prefetch(key);
+}
+
+uint64_t Manager::FlowHash(const zeek::detail::ConnKey& conn_key) const {
+    return zeek::detail::KeyedHash::StaticHash64(&conn_key, sizeof(conn_key));
+}
+
+bool Manager::IsLocalTunnel(const EncapsulationStack& encap) const {
+    return flow_shard_count <= 1 || FlowShard(encap.Outermost().FlowKey()) == flow_shard_index;
+}
 
-    return nullptr;
+uint64_t Manager::FlowShard(const zeek::detail::ConnKey& conn_key) const {
+    return FlowHash(conn_key) % flow_shard_count;
+}
+
+void Manager::UpdateLoad(double pkt_time) {
+    packets_since_load_check = 0;
+
+    // Lag only means something when we're supposed to keep up with a clock.
+    // In pseudo-realtime mode, current_time() follows the trace's time.
+    if ( ! run_state::reading_live )
+        return;
+
+    double now = util::current_time();
+    if ( now - last_load_update < LOAD_UPDATE_INTERVAL )
+        return;
+
+    last_load_update = now;
+
+    bool was_active = load_shedder.Active();
+    load_shedder.Update(now - pkt_time);
+
+    static auto shed_ratio = telemetry_mgr->GaugeInstance<double>("zeek", "flow-shed-ratio", {},
+                                                                   "Fraction of new flows shed due to overload");
+    shed_ratio.Inc(load_shedder.Ratio() - shed_ratio.Value());
+
+    if ( load_shedder.Active() != was_active )
+        reporter->Info("%s shedding new flows, processing lags %.3fs behind", was_active ? "stopped" : "started",
+                       now - pkt_time);
 }
 
 void Manager::Remove(Session* s) {
@@ -111,7 +163,7 @@ void Manager::Remove(Session* s) {
 
         detail::Key key = s->SessionKey(false);
 
-        if ( session_map.erase(key) == 0 )
+        if ( ! session_map.Remove(key) )
             reporter->InternalWarning("connection missing");
         else {
             Connection* c = static_cast<Connection*>(s);
@@ -132,13 +184,8 @@ void Manager::Insert(Session* s, bool remove_existing) {
     Session* old = nullptr;
     detail::Key key = s->SessionKey(true);
 
-    if ( remove_existing ) {
-        auto it = session_map.find(key);
-        if ( it != session_map.end() )
-            old = it->second;
-
-        session_map.erase(key);
-    }
+    if ( remove_existing )
+        old = session_map.Remove(key);
 
     InsertSession(std::move(key), s);
 
@@ -157,21 +204,21 @@ void Manager::Drain() {
     // every run.
     if ( zeek::util::detail::have_random_seed() ) {
         std::vector<const detail::Key*> keys;
-        keys.reserve(session_map.size());
+        keys.reserve(session_map.Size());
 
-        for ( auto& entry : session_map )
-            keys.push_back(&(entry.first));
+        for ( const auto& entry : session_map )
+            keys.push_back(&(entry.key));
         std::sort(keys.begin(), keys.end(), [](const detail::Key* a, const detail::Key* b) { return *a < *b; });
 
         for ( const auto* k : keys ) {
-            Session* tc = session_map.at(*k);
+            Session* tc = session_map.Lookup(*k);
             tc->Done();
             tc->RemovalEvent();
         }
     }
     else {
         for ( const auto& entry : session_map ) {
-            Session* tc = entry.second;
+            Session* tc = entry.session;
             tc->Done();
             tc->RemovalEvent();
         }
@@ -180,9 +227,9 @@ void Manager::Drain() {
 
 void Manager::Clear() {
     for ( const auto& entry : session_map )
-        Unref(entry.second);
+        Unref(entry.session);
 
-    session_map.clear();
+    session_map.Clear();
 
     zeek::detail::fragment_mgr->Clear();
 }
@@ -233,7 +280,7 @@ void Manager::Weird(const char* name, const IP_Hdr* ip, const char* addl) {
 void Manager::InsertSession(detail::Key key, Session* session) {
     session->SetInSessionTable(true);
     key.CopyData();
-    session_map.insert_or_assign(std::move(key), session);
+    session_map.Insert(std::move(key), session);
 
     std::string protocol = session->TransportIdentifier();
 
@@ -3,13 +3,14 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
-#include <unordered_map>
 #include <utility>
 
 #include "zeek/Frag.h"
 #include "zeek/Hash.h"
 #include "zeek/NetVar.h"
+#include "zeek/session/LoadShedder.h"
 #include "zeek/session/Session.h"
+#include "zeek/session/SessionTable.h"
 
 namespace zeek {
 
@@ -67,6 +68,77 @@ public:
      */
     Connection* FindConnection(const zeek::detail::ConnKey& conn_key);
 
+    /**
+     * Prefetches the part of the session table that a lookup of the given
+     * key will access. Callers that know the key of an upcoming lookup,
+     * e.g. for the next packet of a batch, can use this to overlap the
+     * table's memory access with other work.
+     *
+     * @param conn_key The key of the connection that will be looked up.
+     */
+    void PrefetchConnection(const zeek::detail::ConnKey& conn_key);
+
+    /**
+     * Returns whether this process analyzes the flow with the given key. When
+     * :zeek:see:`flow_shard_count` is larger than one, flows are partitioned
+     * across processes by a hash of their key that is stable across processes
+     * sharing the same :zeek:see:`digest_salt`.
+     *
+     * @param conn_key The key of the flow to check.
+     * @return true if the flow falls into this process's shard.
+     */
+    bool IsLocalFlow(const zeek::detail::ConnKey& conn_key) const {
+        return flow_shard_count <= 1 || FlowShard(conn_key) == flow_shard_index;
+    }
+
+    /**
+     * Returns whether this process analyzes the flows inside a tunnel. All
+     * of them go with the shard of the outermost flow carrying the tunnel,
+     * even if that flow isn't itself a connection, as with IP-in-IP and GRE.
+     *
+     * @param encap The tunnels the flows are inside of, at least one.
+     * @return true if the tunnel falls into this process's shard.
+     */
+    bool IsLocalTunnel(const EncapsulationStack& encap) const;
+
+    /**
+     * Returns the shard a flow belongs to, in the range [0, flow_shard_count).
+     *
+     * @param conn_key The key of the flow.
+     */
+    uint64_t FlowShard(const zeek::detail::ConnKey& conn_key) const;
+
+    /**
+     * Returns whether load shedding currently drops the flow with the given
+     * key. This should only be consulted for flows that don't have a session
+     * yet, so that flows already under analysis always run to completion.
+     *
+     * @param conn_key The key of the new flow.
+     * @return true if the flow's packets should be ignored.
+     */
+    bool ShedFlow(const zeek::detail::ConnKey& conn_key) const {
+        return load_shedder.Active() && load_shedder.Shed(FlowHash(conn_key));
+    }
+
+    /**
+     * Returns true if Zeek currently sheds flows because it can't keep up
+     * with its input.
+     */
+    bool IsShedding() const { return load_shedder.Active(); }
+
+    /**
+     * Tracks how far packet processing lags behind the wall clock, adjusting
+     * the fraction of new flows to shed. See
+     * :zeek:see:`load_shedding_lag_threshold`. The packet analysis manager
+     * calls this for every packet.
+     *
+     * @param pkt_time The timestamp of the packet being processed.
+     */
+    void CheckLoad(double pkt_time) {
+        if ( load_shedder.Enabled() && ++packets_since_load_check >= LOAD_CHECK_PACKETS )
+            UpdateLoad(pkt_time);
+    }
+
     void Remove(Session* s);
     void Insert(Session* c, bool remove_existing = true);
 
@@ -82,11 +154,9 @@ public:
     void Weird(const char* name, const Packet* pkt, const char* addl = "", const char* source = "");
     void Weird(const char* name, const IP_Hdr* ip, const char* addl = "");
 
-    unsigned int CurrentSessions() { return session_map.size(); }
+    unsigned int CurrentSessions() { return session_map.Size(); }
 
 private:
-    using SessionMap = std::unordered_map<detail::Key, Session*, detail::KeyHash>;
-
     // Inserts a new connection into the sessions map. If a connection with
     // the same key already exists in the map, it will be overwritten by
     // the new one.  Connection count stats get updated either way (so most
@@ -94,8 +164,23 @@ private:
     // avoid unnecessary incrementing of connecting counts).
     void InsertSession(detail::Key key, Session* session);
 
-    SessionMap session_map;
+    uint64_t FlowHash(const zeek::detail::ConnKey& conn_key) const;
+    void UpdateLoad(double pkt_time);
+
+    // Looking at the clock for every packet would be wasteful, and the load
+    // shedder only reacts to sustained lag anyway.
+    static constexpr uint32_t LOAD_CHECK_PACKETS = 1024;
+    static constexpr double LOAD_UPDATE_INTERVAL = 0.1;
+
+    detail::SessionTable session_map;
     detail::ProtocolStats* stats;
+
+    uint64_t flow_shard_count = 1;
+    uint64_t flow_shard_index = 0;
+
+    detail::LoadShedder load_shedder;
+    uint32_t packets_since_load_check = 0;
+    double last_load_update = 0.0;
 };
 
 } // namespace session
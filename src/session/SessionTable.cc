@@ -0,0 +1,303 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/session/SessionTable.h"
+
+#include <unordered_map>
+#include <utility>
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/IPAddr.h"
+#include "zeek/util.h"
+
+namespace zeek::session::detail {
+
+static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+Session* SessionTable::Lookup(const Key& key) const {
+    if ( num_entries == 0 )
+        return nullptr;
+
+    auto idx = Find(key, key.Hash());
+    return idx == NOT_FOUND ? nullptr : slots[idx].session;
+}
+
+Session* SessionTable::Insert(Key key, Session* session) {
+    auto hash = key.Hash();
+
+    if ( num_entries > 0 ) {
+        if ( auto idx = Find(key, hash); idx != NOT_FOUND ) {
+            auto* old = slots[idx].session;
+            slots[idx].session = session;
+            return old;
+        }
+    }
+
+    // Keep the load factor at or below 7/8.
+    if ( (num_entries + 1) * 8 > meta.size() * 7 )
+        Grow();
+
+    InsertNew({hash, std::move(key), session});
+    ++num_entries;
+
+    return nullptr;
+}
+
+Session* SessionTable::Remove(const Key& key) {
+    if ( num_entries == 0 )
+        return nullptr;
+
+    auto idx = Find(key, key.Hash());
+    if ( idx == NOT_FOUND )
+        return nullptr;
+
+    auto* rval = slots[idx].session;
+
+    // Shift the following entries of the probe sequence back by one slot,
+    // until reaching one that's empty or already at its home slot.
+    for ( ;; ) {
+        auto next = (idx + 1) & mask;
+        auto m = meta[next];
+
+        if ( m == 0 || Distance(m) == 0 )
+            break;
+
+        slots[idx] = std::move(slots[next]);
+        meta[idx] = m - 1;
+        idx = next;
+    }
+
+    meta[idx] = 0;
+    slots[idx] = Entry{};
+    --num_entries;
+
+    return rval;
+}
+
+void SessionTable::Prefetch(const Key& key) const {
+    if ( meta.empty() )
+        return;
+
+#ifndef _MSC_VER
+    auto idx = key.Hash() & mask;
+    __builtin_prefetch(&meta[idx]);
+    __builtin_prefetch(&slots[idx]);
+#endif
+}
+
+void SessionTable::Clear() {
+    meta = std::vector<uint32_t>();
+    slots = std::vector<Entry>();
+    num_entries = 0;
+    mask = 0;
+}
+
+size_t SessionTable::Find(const Key& key, uint64_t hash) const {
+    auto idx = hash & mask;
+
+    for ( uint32_t dist = 0; dist <= MAX_DISTANCE; ++dist ) {
+        auto m = meta[idx];
+
+        // With Robin Hood hashing, the key can't be further along once we
+        // reach an entry that's closer to its home slot than we are.
+        if ( m == 0 || Distance(m) < dist )
+            break;
+
+        if ( m == MakeMeta(hash, dist) && slots[idx].hash == hash && slots[idx].key == key )
+            return idx;
+
+        idx = (idx + 1) & mask;
+    }
+
+    return NOT_FOUND;
+}
+
+void SessionTable::InsertNew(Entry e) {
+    for ( ;; ) {
+        auto idx = e.hash & mask;
+        uint32_t dist = 0;
+
+        while ( dist <= MAX_DISTANCE ) {
+            auto m = meta[idx];
+
+            if ( m == 0 ) {
+                meta[idx] = MakeMeta(e.hash, dist);
+                slots[idx] = std::move(e);
+                return;
+            }
+
+            // Take the slot from an entry that's closer to its home slot,
+            // and continue placing that one instead.
+            if ( Distance(m) < dist ) {
+                std::swap(e, slots[idx]);
+                meta[idx] = MakeMeta(slots[idx].hash, dist);
+                dist = Distance(m);
+            }
+
+            ++dist;
+            idx = (idx + 1) & mask;
+        }
+
+        // A probe sequence got too long for the metadata to express. That's
+        // extremely unlikely with a decent hash function, but if it happens
+        // we grow the table and place whichever entry we're holding anew.
+        Grow();
+    }
+}
+
+void SessionTable::Grow() {
+    auto capacity = meta.empty() ? MIN_CAPACITY : meta.size() * 2;
+
+    auto old_meta = std::move(meta);
+    auto old_slots = std::move(slots);
+
+    meta.assign(capacity, 0);
+    slots = std::vector<Entry>(capacity);
+    mask = capacity - 1;
+
+    for ( size_t i = 0; i < old_meta.size(); ++i )
+        if ( old_meta[i] != 0 )
+            InsertNew(std::move(old_slots[i]));
+}
+
+} // namespace zeek::session::detail
+
+using zeek::session::Session;
+using zeek::session::detail::Key;
+using zeek::session::detail::SessionTable;
+
+namespace {
+
+std::vector<zeek::detail::ConnKey> make_conn_keys(size_t n) {
+    std::vector<zeek::detail::ConnKey> keys;
+    keys.reserve(n);
+
+    for ( size_t i = 0; i < n; ++i ) {
+        auto orig = static_cast<uint32_t>(0x0a000000 + (i >> 16));
+        auto resp = static_cast<uint32_t>(0xc0a80000 + (i & 0xffff));
+        keys.emplace_back(zeek::IPAddr(in_addr{htonl(orig)}), zeek::IPAddr(in_addr{htonl(resp)}),
+                          htons(static_cast<uint16_t>(1024 + i % 50000)), htons(443), TRANSPORT_TCP, false);
+    }
+
+    return keys;
+}
+
+Key make_key(const zeek::detail::ConnKey& k, bool copy = false) {
+    return {&k, sizeof(k), Key::CONNECTION_KEY_TYPE, copy};
+}
+
+Session* fake_session(size_t i) { return reinterpret_cast<Session*>((i + 1) * 16); }
+
+} // namespace
+
+TEST_CASE("session table") {
+    auto keys = make_conn_keys(10000);
+    SessionTable t;
+
+    CHECK_EQ(t.Lookup(make_key(keys[0])), nullptr);
+    CHECK_EQ(t.Remove(make_key(keys[0])), nullptr);
+
+    for ( size_t i = 0; i < keys.size(); ++i )
+        CHECK_EQ(t.Insert(make_key(keys[i], true), fake_session(i)), nullptr);
+
+    CHECK_EQ(t.Size(), keys.size());
+
+    SUBCASE("lookup") {
+        for ( size_t i = 0; i < keys.size(); ++i )
+            CHECK_EQ(t.Lookup(make_key(keys[i])), fake_session(i));
+
+        size_t n = 0;
+        for ( const auto& e : t ) {
+            CHECK_NE(e.session, nullptr);
+            ++n;
+        }
+
+        CHECK_EQ(n, keys.size());
+    }
+
+    SUBCASE("replace") {
+        CHECK_EQ(t.Insert(make_key(keys[42], true), fake_session(0)), fake_session(42));
+        CHECK_EQ(t.Lookup(make_key(keys[42])), fake_session(0));
+        CHECK_EQ(t.Size(), keys.size());
+    }
+
+    SUBCASE("remove") {
+        for ( size_t i = 0; i < keys.size(); i += 2 )
+            CHECK_EQ(t.Remove(make_key(keys[i])), fake_session(i));
+
+        CHECK_EQ(t.Size(), keys.size() / 2);
+
+        for ( size_t i = 0; i < keys.size(); ++i )
+            CHECK_EQ(t.Lookup(make_key(keys[i])), i % 2 ? fake_session(i) : nullptr);
+
+        CHECK_EQ(t.Remove(make_key(keys[0])), nullptr);
+    }
+
+    SUBCASE("clear") {
+        t.Clear();
+        CHECK_EQ(t.Size(), 0);
+        CHECK(t.begin() == t.end());
+        CHECK_EQ(t.Lookup(make_key(keys[1])), nullptr);
+    }
+}
+
+// Compares the session table with the std::unordered_map it replaced. This
+// needs tens of GB of memory at the largest size, so it's skipped by default.
+// Run it with:
+//
+//     zeek --test --test-case="session table benchmark" --no-skip
+TEST_CASE("session table benchmark" * doctest::skip(true)) {
+    for ( size_t n : {1000000, 10000000, 50000000} ) {
+        auto keys = make_conn_keys(n);
+
+        // Replay the flows' packets in an order unrelated to their insertion.
+        std::vector<size_t> order(n);
+        for ( size_t i = 0; i < n; ++i )
+            order[i] = (i * 2654435761u) % n;
+
+        double t0, t1, t2, t3;
+        size_t found = 0;
+
+        {
+            std::unordered_map<Key, Session*, zeek::session::detail::KeyHash> m;
+
+            t0 = zeek::util::current_time(true);
+            for ( size_t i = 0; i < n; ++i )
+                m.insert_or_assign(make_key(keys[i], true), fake_session(i));
+
+            t1 = zeek::util::current_time(true);
+            for ( auto i : order )
+                found += m.count(make_key(keys[i]));
+
+            t2 = zeek::util::current_time(true);
+        }
+
+        fprintf(stderr, "%9zu flows  unordered_map  insert %.3fs  lookup %.3fs\n", n, t1 - t0, t2 - t1);
+
+        SessionTable t;
+
+        t0 = zeek::util::current_time(true);
+        for ( size_t i = 0; i < n; ++i )
+            t.Insert(make_key(keys[i], true), fake_session(i));
+
+        t1 = zeek::util::current_time(true);
+        for ( auto i : order )
+            found += t.Lookup(make_key(keys[i])) != nullptr;
+
+        // Look up in batches, prefetching the next packet's slot while
+        // handling the current one.
+        t2 = zeek::util::current_time(true);
+        for ( size_t j = 0; j < n; ++j ) {
+            if ( j + 1 < n )
+                t.Prefetch(make_key(keys[order[j + 1]]));
+
+            found += t.Lookup(make_key(keys[order[j]])) != nullptr;
+        }
+
+        t3 = zeek::util::current_time(true);
+
+        fprintf(stderr, "%9zu flows  session table  insert %.3fs  lookup %.3fs  prefetched lookup %.3fs\n", n, t1 - t0,
+                t2 - t1, t3 - t2);
+
+        CHECK_EQ(found, 3 * n);
+    }
+}
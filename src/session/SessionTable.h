@@ -0,0 +1,158 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "zeek/session/Key.h"
+
+namespace zeek::session {
+
+class Session;
+
+namespace detail {
+
+/**
+ * A flat, open-addressing hash table mapping session keys to sessions. It
+ * uses Robin Hood hashing with backward-shift deletion, so that probe
+ * sequences stay short even at high load.
+ *
+ * Each slot has a 32-bit metadata word, kept in a separate array, that holds
+ * the slot's probe distance and a few bits of its key's hash. Lookups scan
+ * the dense metadata array and only touch a slot's key once both the hash tag
+ * and the full hash match. Unlike a node-based map, the table doesn't allocate
+ * anything per entry except for the key's data.
+ */
+class SessionTable final {
+public:
+    struct Entry {
+        uint64_t hash = 0;
+        Key key{nullptr, 0, Key::CONNECTION_KEY_TYPE};
+        Session* session = nullptr;
+    };
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Entry*;
+        using reference = const Entry&;
+
+        const_iterator() = default;
+
+        reference operator*() const { return t->slots[idx]; }
+        pointer operator->() const { return &t->slots[idx]; }
+
+        const_iterator& operator++() {
+            ++idx;
+            SkipEmpty();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const const_iterator& rhs) const { return idx == rhs.idx; }
+        bool operator!=(const const_iterator& rhs) const { return idx != rhs.idx; }
+
+    private:
+        friend class SessionTable;
+
+        const_iterator(const SessionTable* t, size_t idx) : t(t), idx(idx) { SkipEmpty(); }
+
+        void SkipEmpty() {
+            while ( idx < t->meta.size() && t->meta[idx] == 0 )
+                ++idx;
+        }
+
+        const SessionTable* t = nullptr;
+        size_t idx = 0;
+    };
+
+    SessionTable() = default;
+
+    SessionTable(const SessionTable&) = delete;
+    SessionTable& operator=(const SessionTable&) = delete;
+
+    /**
+     * Looks up the session stored for a key.
+     *
+     * @param key The key to search for.
+     * @return The session, or nullptr if there's none.
+     */
+    Session* Lookup(const Key& key) const;
+
+    /**
+     * Stores a session for a key, replacing any session already stored for
+     * an equal key. The key's data must remain valid for as long as it's in
+     * the table, which normally means it has been copied.
+     *
+     * @param key The key to store the session under.
+     * @param session The session to store.
+     * @return The session previously stored for the key, or nullptr.
+     */
+    Session* Insert(Key key, Session* session);
+
+    /**
+     * Removes the entry for a key.
+     *
+     * @param key The key to remove.
+     * @return The session that was stored for the key, or nullptr if there
+     * was none.
+     */
+    Session* Remove(const Key& key);
+
+    /**
+     * Prefetches the part of the table a lookup of the given key will start
+     * at. Issuing this for the next packet's key while the current one is
+     * still being processed hides most of the memory latency of the eventual
+     * lookup when the table is much larger than the CPU caches.
+     *
+     * @param key The key that will be looked up soon.
+     */
+    void Prefetch(const Key& key) const;
+
+    /**
+     * Removes all entries, releasing the table's memory.
+     */
+    void Clear();
+
+    size_t Size() const { return num_entries; }
+    size_t Capacity() const { return meta.size(); }
+
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, meta.size()}; }
+
+private:
+    static constexpr size_t MIN_CAPACITY = 64;
+
+    // The low byte of a metadata word holds the probe distance plus one,
+    // such that zero marks an empty slot. The remaining bits hold the top
+    // of the hash.
+    static constexpr uint32_t MAX_DISTANCE = 0xfe;
+
+    static uint32_t MakeMeta(uint64_t hash, uint32_t dist) {
+        return static_cast<uint32_t>(hash >> 40) << 8 | (dist + 1);
+    }
+
+    static uint32_t Distance(uint32_t m) { return (m & 0xff) - 1; }
+
+    size_t Find(const Key& key, uint64_t hash) const;
+    void InsertNew(Entry e);
+    void Grow();
+
+    std::vector<uint32_t> meta;
+    std::vector<Entry> slots;
+    size_t num_entries = 0;
+    size_t mask = 0;
+};
+
+} // namespace detail
+} // namespace zeek::session
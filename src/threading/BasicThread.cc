@@ -3,8 +3,10 @@
 #include "zeek/zeek-config.h"
 
 #include <pthread.h>
+#include <cassert>
 #include <csignal>
 
+#include "zeek/Reporter.h"
 #include "zeek/threading/Manager.h"
 #include "zeek/util.h"
 
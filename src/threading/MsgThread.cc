@@ -2,11 +2,20 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/DebugLogger.h"
 #include "zeek/Desc.h"
 #include "zeek/Obj.h"
+#include "zeek/Reporter.h"
 #include "zeek/RunState.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/threading/Manager.h"
@@ -433,4 +442,134 @@ void MsgThread::Process() {
     }
 }
 
+TEST_CASE("threading queue") {
+    Queue<int*> q(nullptr, nullptr);
+    std::vector<int> items(3000);
+
+    CHECK(! q.Ready());
+    CHECK(! q.MaybeReady());
+
+    // Overflow the first ring twice before reading anything.
+    for ( auto& i : items )
+        q.Put(&i);
+
+    CHECK(q.Ready());
+    CHECK(q.Size() == items.size());
+
+    for ( auto& i : items )
+        CHECK(q.Get() == &i);
+
+    CHECK(! q.Ready());
+    CHECK(q.Size() == 0);
+
+    // Wrap around a ring a few times with the reader lagging behind.
+    size_t next = 0;
+
+    for ( size_t n = 0; n < 10 * items.size(); ++n ) {
+        q.Put(&items[n % items.size()]);
+
+        if ( n >= 500 ) {
+            CHECK(q.Get() == &items[next % items.size()]);
+            ++next;
+        }
+    }
+
+    CHECK(q.Size() == 500);
+
+    Queue<int*>::Stats stats;
+    q.GetStats(&stats);
+    CHECK(stats.num_writes == 11 * items.size());
+    CHECK(stats.num_reads == stats.num_writes - 500);
+    CHECK(stats.num_full == 2);
+    CHECK(stats.max_size == items.size());
+}
+
+TEST_CASE("threading queue across threads") {
+    Queue<int*> q(nullptr, nullptr);
+    std::vector<int> items(100'000);
+
+    std::thread writer([&]() {
+        for ( auto& i : items )
+            q.Put(&i);
+    });
+
+    size_t next = 0;
+    size_t wrong = 0;
+
+    while ( next < items.size() ) {
+        if ( auto i = q.Get() ) {
+            if ( i != &items[next] )
+                ++wrong;
+
+            ++next;
+        }
+    }
+
+    writer.join();
+
+    CHECK(wrong == 0);
+    CHECK(! q.Ready());
+}
+
+TEST_CASE("threading queue benchmark" * doctest::skip(true)) {
+    // Run it with: zeek --test --test-case="threading queue benchmark" --no-skip
+    //
+    // Passes messages from the main thread to a writer thread, in bursts
+    // such as the log writes of a packet, and compares against a queue
+    // guarded by a mutex and condition variable.
+    constexpr size_t num_msgs = 10'000'000;
+    std::vector<int> items(1024);
+
+    auto run = [&](auto put, auto get) {
+        auto begin = std::chrono::steady_clock::now();
+
+        std::thread writer([&]() {
+            for ( size_t n = 0; n < num_msgs; )
+                if ( get() )
+                    ++n;
+        });
+
+        for ( size_t n = 0; n < num_msgs; ++n )
+            put(&items[n % items.size()]);
+
+        writer.join();
+
+        auto end = std::chrono::steady_clock::now();
+        auto secs = std::chrono::duration<double>(end - begin).count();
+        return num_msgs / secs;
+    };
+
+    Queue<int*> q(nullptr, nullptr);
+    auto lock_free = run([&](int* i) { q.Put(i); }, [&]() { return q.Get(); });
+
+    Queue<int*>::Stats stats;
+    q.GetStats(&stats);
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::queue<int*> locked_q;
+
+    auto locked = run(
+        [&](int* i) {
+            std::unique_lock<std::mutex> lock(m);
+            bool need_signal = locked_q.empty();
+            locked_q.push(i);
+            lock.unlock();
+
+            if ( need_signal )
+                cv.notify_one();
+        },
+        [&]() -> int* {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [&]() { return ! locked_q.empty(); });
+            auto i = locked_q.front();
+            locked_q.pop();
+            return i;
+        });
+
+    MESSAGE("lock-free: " << static_cast<uint64_t>(lock_free) << " msgs/sec (ring full " << stats.num_full
+                          << " times, max size " << stats.max_size << ")");
+    MESSAGE("mutex: " << static_cast<uint64_t>(locked) << " msgs/sec");
+}
+
 } // namespace zeek::threading
@@ -7,6 +7,7 @@
 #include "zeek/iosource/IOSource.h"
 #include "zeek/threading/BasicThread.h"
 #include "zeek/threading/Queue.h"
+#include "zeek/util.h"
 
 namespace zeek::detail {
 class Location;
@@ -1,13 +1,16 @@
 #pragma once
 
-#include <sys/time.h>
-#include <condition_variable>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
-#include <deque>
-#include <mutex>
-#include <queue>
 
-#include "zeek/Reporter.h"
+#ifndef _MSC_VER
+#include <poll.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include "zeek/Flare.h"
 #include "zeek/threading/BasicThread.h"
 
 #undef Queue // Defined elsewhere unfortunately.
@@ -17,13 +20,19 @@ namespace zeek::threading {
 /**
  * A thread-safe single-reader single-writer queue.
  *
- * The implementation uses multiple queues and reads/writes in rotary fashion
- * in an attempt to limit contention.
+ * The implementation is a lock-free ring buffer. Put() and Get() each
+ * touch only their own end of the ring, plus one atomic index of the
+ * other end. When the ring is full, the writer links in a new ring
+ * rather than waiting for the reader, and the reader moves over to it
+ * once it has drained the old one. A reader finding the queue empty
+ * sleeps on a flare that the writer fires only when it knows the reader
+ * is waiting.
  *
- * All Queue instances must be instantiated by Zeek's main thread.
+ * Each queue must have exactly one thread calling Put() and one calling
+ * Get(), Ready() and MaybeReady(). The remaining methods may be called
+ * from any thread.
  *
- * TODO: Unclear how critical performance is for this queue. We could likely
- * optimize it further if helpful.
+ * All Queue instances must be instantiated by Zeek's main thread.
  */
 template<typename T>
 class Queue {
@@ -42,6 +51,9 @@ public:
      */
     ~Queue();
 
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
     /**
      * Retrieves one element. This may block for a little while of no
      * input is available and eventually return with a null element if
@@ -50,7 +62,8 @@ public:
     T Get();
 
     /**
-     * Queues one element.
+     * Queues one element. This never blocks: if the reader falls behind,
+     * the queue grows by another ring.
      */
     void Put(T data);
 
@@ -65,10 +78,11 @@ public:
      * state, but won't do so very often. Note that this means that it can
      * consistently return false even if there is something in the Queue.
      * You have to check real queue status from time to time to be sure that
-     * it is empty. In other words, this method helps to avoid locking the queue
-     * frequently, but doesn't allow you to forgo it completely.
+     * it is empty.
      */
-    bool MaybeReady() { return (num_reads != num_writes); }
+    bool MaybeReady() {
+        return num_reads.load(std::memory_order_relaxed) != num_writes.load(std::memory_order_relaxed);
+    }
 
     /**
      * Wake up the reader if it's currently blocked for input. This is
@@ -87,6 +101,8 @@ public:
     struct Stats {
         uint64_t num_reads;  //! Number of messages read from the queue.
         uint64_t num_writes; //! Number of messages written to the queue.
+        uint64_t num_full;   //! Number of times the writer found the ring full and had to extend it.
+        uint64_t max_size;   //! Largest number of messages the writer saw queued.
     };
 
     /**
@@ -98,145 +114,211 @@ public:
     void GetStats(Stats* stats);
 
 private:
-    static const int NUM_QUEUES = 8;
+    // The number of elements each ring holds. The queues of an idle thread
+    // hold one ring each.
+    static constexpr size_t RING_SIZE = 1024;
+
+    // Keeps the reader's and the writer's data on separate cache lines.
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    struct Ring {
+        // Indices only grow; the slot is the index modulo RING_SIZE.
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head{0}; // Next to read, advanced by the reader.
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail{0}; // Next to write, advanced by the writer.
+
+        // The ring the writer continued with once this one was full.
+        std::atomic<Ring*> next{nullptr};
+
+        T slots[RING_SIZE];
+    };
+
+    // Returns the next element without blocking, or null if there is none.
+    T TryGet();
 
-    std::vector<std::unique_lock<std::mutex>> LocksForAllQueues();
+    // Blocks until the writer signals new data or a timeout passes.
+    void Wait();
 
-    std::mutex mutex[NUM_QUEUES];                 // Mutex protected shared accesses.
-    std::condition_variable has_data[NUM_QUEUES]; // Signals when data becomes available
-    std::queue<T> messages[NUM_QUEUES];           // Actually holds the queued messages
+    // The reader's state.
+    alignas(CACHE_LINE_SIZE) Ring* read_ring;
+    uint64_t read_tail_cache = 0; // Last seen tail of read_ring.
+    std::atomic<bool> reader_waiting{false};
 
-    int read_ptr;  // Where the next operation will read from
-    int write_ptr; // Where the next operation will write to
+    // The writer's state.
+    alignas(CACHE_LINE_SIZE) Ring* write_ring;
+    uint64_t write_head_cache = 0; // Last seen head of write_ring.
+
+    zeek::detail::Flare flare; // Fired to wake up a waiting reader.
 
     BasicThread* reader;
     BasicThread* writer;
 
-    // Statistics.
-    uint64_t num_reads;
-    uint64_t num_writes;
+    // Statistics. Each is updated by only one of the two threads.
+    std::atomic<uint64_t> num_reads{0};
+    std::atomic<uint64_t> num_writes{0};
+    std::atomic<uint64_t> num_full{0};
+    std::atomic<uint64_t> max_size{0};
 };
 
-inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m) {
-    try {
-        return std::unique_lock<std::mutex>(m);
-    } catch ( const std::system_error& e ) {
-        reporter->FatalErrorWithCore("cannot lock mutex: %s", e.what());
-        // Never gets here.
-        throw std::exception();
-    }
-}
-
 template<typename T>
 inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer) {
-    read_ptr = 0;
-    write_ptr = 0;
-    num_reads = num_writes = 0;
+    read_ring = write_ring = new Ring;
     reader = arg_reader;
     writer = arg_writer;
 }
 
 template<typename T>
-inline Queue<T>::~Queue() {}
+inline Queue<T>::~Queue() {
+    while ( read_ring ) {
+        auto next = read_ring->next.load();
+        delete read_ring;
+        read_ring = next;
+    }
+}
 
 template<typename T>
-inline T Queue<T>::Get() {
-    auto lock = acquire_lock(mutex[read_ptr]);
+inline T Queue<T>::TryGet() {
+    for ( ;; ) {
+        auto head = read_ring->head.load(std::memory_order_relaxed);
 
-    int old_read_ptr = read_ptr;
+        if ( head == read_tail_cache ) {
+            read_tail_cache = read_ring->tail.load(std::memory_order_acquire);
 
-    if ( messages[read_ptr].empty() && ! ((reader && reader->Killed()) || (writer && writer->Killed())) ) {
-        if ( has_data[read_ptr].wait_for(lock, std::chrono::seconds(5)) == std::cv_status::timeout )
-            return nullptr;
-    }
+            if ( head == read_tail_cache ) {
+                auto next = read_ring->next.load(std::memory_order_acquire);
 
-    if ( messages[read_ptr].empty() )
-        return nullptr;
+                if ( ! next )
+                    return nullptr;
+
+                // The writer links the next ring only after its last
+                // write to this one, so look once more before leaving.
+                read_tail_cache = read_ring->tail.load(std::memory_order_acquire);
 
-    T data = messages[read_ptr].front();
-    messages[read_ptr].pop();
+                if ( head == read_tail_cache ) {
+                    delete read_ring;
+                    read_ring = next;
+                    read_tail_cache = 0;
+                    continue;
+                }
+            }
+        }
 
-    read_ptr = (read_ptr + 1) % NUM_QUEUES;
-    ++num_reads;
+        T data = read_ring->slots[head % RING_SIZE];
+        read_ring->head.store(head + 1, std::memory_order_release);
+        num_reads.store(num_reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 
-    return data;
+        return data;
+    }
 }
 
 template<typename T>
-inline void Queue<T>::Put(T data) {
-    auto lock = acquire_lock(mutex[write_ptr]);
+inline void Queue<T>::Wait() {
+    reader_waiting.store(true, std::memory_order_relaxed);
+
+    // Pairs with the fence in Put(): either the writer sees us waiting,
+    // or we see its data here.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if ( ! Ready() ) {
+#ifndef _MSC_VER
+        pollfd pfd = {flare.FD(), POLLIN, 0};
+        poll(&pfd, 1, 5000);
+#else
+        WSAPOLLFD pfd = {static_cast<SOCKET>(flare.FD()), POLLIN, 0};
+        WSAPoll(&pfd, 1, 5000);
+#endif
+    }
 
-    int old_write_ptr = write_ptr;
+    reader_waiting.store(false, std::memory_order_relaxed);
+    flare.Extinguish();
+}
 
-    bool need_signal = messages[write_ptr].empty();
+template<typename T>
+inline T Queue<T>::Get() {
+    if ( T data = TryGet() )
+        return data;
 
-    messages[write_ptr].push(data);
+    if ( (reader && reader->Killed()) || (writer && writer->Killed()) )
+        return nullptr;
 
-    write_ptr = (write_ptr + 1) % NUM_QUEUES;
-    ++num_writes;
+    Wait();
 
-    if ( need_signal ) {
-        lock.unlock();
-        has_data[old_write_ptr].notify_one();
-    }
+    return TryGet();
 }
 
 template<typename T>
-inline bool Queue<T>::Ready() {
-    auto lock = acquire_lock(mutex[read_ptr]);
+inline void Queue<T>::Put(T data) {
+    auto tail = write_ring->tail.load(std::memory_order_relaxed);
+
+    if ( tail - write_head_cache == RING_SIZE ) {
+        write_head_cache = write_ring->head.load(std::memory_order_acquire);
+
+        if ( tail - write_head_cache == RING_SIZE ) {
+            // The reader is a full ring behind. Rather than waiting for
+            // it, continue with a new ring that it moves on to once it
+            // has drained this one.
+            auto ring = new Ring;
+            write_ring->next.store(ring, std::memory_order_release);
+            write_ring = ring;
+            write_head_cache = 0;
+            tail = 0;
+
+            num_full.store(num_full.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
 
-    bool ret = (messages[read_ptr].size());
+    write_ring->slots[tail % RING_SIZE] = data;
+    write_ring->tail.store(tail + 1, std::memory_order_release);
 
-    return ret;
+    auto writes = num_writes.load(std::memory_order_relaxed) + 1;
+    num_writes.store(writes, std::memory_order_relaxed);
+
+    auto size = writes - num_reads.load(std::memory_order_relaxed);
+
+    if ( size > max_size.load(std::memory_order_relaxed) )
+        max_size.store(size, std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if ( reader_waiting.load(std::memory_order_relaxed) && reader_waiting.exchange(false) )
+        flare.Fire();
 }
 
 template<typename T>
-inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues() {
-    std::vector<std::unique_lock<std::mutex>> locks;
+inline bool Queue<T>::Ready() {
+    auto ring = read_ring;
 
-    try {
-        for ( int i = 0; i < NUM_QUEUES; i++ )
-            locks.emplace_back(std::unique_lock<std::mutex>(mutex[i]));
-    }
+    // Only the reader ever leaves a ring, so the ones it is about to move
+    // on to remain valid here.
+    while ( ring ) {
+        if ( ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_acquire) )
+            return true;
 
-    catch ( const std::system_error& e ) {
-        reporter->FatalErrorWithCore("cannot lock all mutexes: %s", e.what());
-        // Never gets here.
-        throw std::exception();
+        ring = ring->next.load(std::memory_order_acquire);
     }
 
-    return locks;
+    return false;
 }
 
 template<typename T>
 inline uint64_t Queue<T>::Size() {
-    // Need to lock all queues.
-    auto locks = LocksForAllQueues();
-
-    uint64_t size = 0;
-
-    for ( int i = 0; i < NUM_QUEUES; i++ )
-        size += messages[i].size();
+    auto reads = num_reads.load(std::memory_order_relaxed);
+    auto writes = num_writes.load(std::memory_order_relaxed);
 
-    return size;
+    // The two counters are read at slightly different times.
+    return writes > reads ? writes - reads : 0;
 }
 
 template<typename T>
 inline void Queue<T>::GetStats(Stats* stats) {
-    // To be safe, we look all queues. That's probably unnecessary, but
-    // doesn't really hurt.
-    auto locks = LocksForAllQueues();
-
-    stats->num_reads = num_reads;
-    stats->num_writes = num_writes;
+    stats->num_reads = num_reads.load(std::memory_order_relaxed);
+    stats->num_writes = num_writes.load(std::memory_order_relaxed);
+    stats->num_full = num_full.load(std::memory_order_relaxed);
+    stats->max_size = max_size.load(std::memory_order_relaxed);
 }
 
 template<typename T>
 inline void Queue<T>::WakeUp() {
-    for ( int i = 0; i < NUM_QUEUES; i++ ) {
-        auto lock = acquire_lock(mutex[i]);
-        has_data[i].notify_all();
-    }
+    flare.Fire();
 }
 
 } // namespace zeek::threading
@@ -8,18 +8,196 @@
 #define __STDC_LIMIT_MACROS
 #endif
 
+#include <rapidjson/internal/dtoa.h>
 #include <rapidjson/internal/ieee754.h>
 #include <cerrno>
+#include <charconv>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
-#include <sstream>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ZEEK_JSON_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ZEEK_JSON_NEON
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Desc.h"
+#include "zeek/Reporter.h"
 #include "zeek/threading/MsgThread.h"
 #include "zeek/threading/formatters/detail/json.h"
 
 namespace zeek::threading::formatter {
 
+namespace {
+
+#if defined(ZEEK_JSON_SSE2) || defined(ZEEK_JSON_NEON)
+inline int lowest_bit(uint64_t mask) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return static_cast<int>(idx);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+#endif
+
+// Returns the number of bytes at the start of p that can go into a JSON
+// string as they are: printable ASCII other than quotes and backslashes.
+size_t plain_prefix(const char* p, size_t n) {
+    size_t i = 0;
+
+#if defined(ZEEK_JSON_SSE2)
+    const auto space = _mm_set1_epi8(' ');
+    const auto del = _mm_set1_epi8(0x7f);
+    const auto quote = _mm_set1_epi8('"');
+    const auto backslash = _mm_set1_epi8('\\');
+
+    for ( ; i + 16 <= n; i += 16 ) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        // The comparison is signed, so bytes >= 0x80 count as below space.
+        auto special = _mm_or_si128(_mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+
+        if ( auto mask = static_cast<uint32_t>(_mm_movemask_epi8(special)) )
+            return i + lowest_bit(mask);
+    }
+#elif defined(ZEEK_JSON_NEON)
+    for ( ; i + 16 <= n; i += 16 ) {
+        auto v = vld1q_u8(reinterpret_cast<const uint8_t*>(p + i));
+        auto special = vorrq_u8(vorrq_u8(vcltq_u8(v, vdupq_n_u8(' ')), vcgeq_u8(v, vdupq_n_u8(0x7f))),
+                                vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\'))));
+        // There's no movemask on NEON, so we narrow each byte to a nibble.
+        auto nibbles = vshrn_n_u16(vreinterpretq_u16_u8(special), 4);
+
+        if ( auto mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) )
+            return i + lowest_bit(mask) / 4;
+    }
+#endif
+
+    for ( ; i < n; ++i ) {
+        auto c = static_cast<unsigned char>(p[i]);
+
+        if ( c < ' ' || c >= 0x7f || c == '"' || c == '\\' )
+            break;
+    }
+
+    return i;
+}
+
+// Appends bytes to a JSON string, escaping them the way rapidjson's Writer
+// does: quotes, backslashes and control characters. Other bytes, including
+// non-ASCII ones, are copied.
+void append_escaped(std::string& out, const char* p, size_t n) {
+    static constexpr char hex_digits[] = "0123456789ABCDEF";
+
+    for ( size_t i = 0; i < n; ++i ) {
+        auto k = plain_prefix(p + i, n - i);
+        out.append(p + i, k);
+        i += k;
+
+        if ( i == n )
+            break;
+
+        auto c = static_cast<unsigned char>(p[i]);
+
+        if ( c >= 0x7f ) {
+            out.push_back(static_cast<char>(c));
+            continue;
+        }
+
+        out.push_back('\\');
+
+        switch ( c ) {
+            case '"':
+            case '\\': out.push_back(static_cast<char>(c)); break;
+            case '\b': out.push_back('b'); break;
+            case '\f': out.push_back('f'); break;
+            case '\n': out.push_back('n'); break;
+            case '\r': out.push_back('r'); break;
+            case '\t': out.push_back('t'); break;
+            default:
+                out.append("u00");
+                out.push_back(hex_digits[c >> 4]);
+                out.push_back(hex_digits[c & 0xf]);
+                break;
+        }
+    }
+}
+
+// Appends a string value as a JSON string. Printable ASCII, by far the most
+// common, only needs quotes and backslashes escaped. Anything else first
+// goes through util::json_escape_utf8(), as it did with rapidjson.
+void append_string(std::string& out, const char* p, size_t n) {
+    out.push_back('"');
+    auto start = out.size();
+
+    for ( size_t i = 0; i < n; ++i ) {
+        auto k = plain_prefix(p + i, n - i);
+        out.append(p + i, k);
+        i += k;
+
+        if ( i == n )
+            break;
+
+        if ( p[i] != '"' && p[i] != '\\' ) {
+            out.resize(start);
+            auto escaped = util::json_escape_utf8(p, n);
+            append_escaped(out, escaped.data(), escaped.size());
+            break;
+        }
+
+        out.push_back('\\');
+        out.push_back(p[i]);
+    }
+
+    out.push_back('"');
+}
+
+// Appends a string that is known not to need escaping.
+void append_plain_string(std::string& out, const char* p, size_t n) {
+    out.push_back('"');
+    out.append(p, n);
+    out.push_back('"');
+}
+
+template<typename T>
+void append_integer(std::string& out, T i) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), i);
+    out.append(buf, res.ptr);
+}
+
+// Writes null for inf and nan, like json::detail::NullDoubleWriter.
+void append_double(std::string& out, double d) {
+    if ( rapidjson::internal::Double(d).IsNanOrInf() ) {
+        out.append("null");
+        return;
+    }
+
+    // The same conversion that rapidjson's Writer uses.
+    char buf[32];
+    auto end = rapidjson::internal::dtoa(d, buf);
+    out.append(buf, end);
+}
+
+std::string make_key(const char* name) {
+    std::string key = ",\"";
+    append_escaped(key, name, strlen(name));
+    key.append("\":");
+    return key;
+}
+
+} // namespace
+
 // For deprecated NullDoubleWriter
 JSON::NullDoubleWriter::NullDoubleWriter(rapidjson::StringBuffer& stream)
     : writer(std::make_unique<zeek::json::detail::NullDoubleWriter>(stream)) {}
@@ -29,19 +207,38 @@ bool JSON::NullDoubleWriter::Double(double d) { return writer->Double(d); }
 JSON::JSON(MsgThread* t, TimeFormat tf, bool arg_include_unset_fields)
     : Formatter(t), timestamps(tf), include_unset_fields(arg_include_unset_fields) {}
 
+void JSON::InitFields(int num_fields, const Field* const* fields) {
+    key_fields = fields;
+    keys.clear();
+    keys.reserve(num_fields);
+
+    for ( int i = 0; i < num_fields; i++ )
+        keys.emplace_back(make_key(fields[i]->name));
+}
+
 bool JSON::Describe(ODesc* desc, int num_fields, const Field* const* fields, Value** vals) const {
-    rapidjson::StringBuffer buffer;
-    zeek::json::detail::NullDoubleWriter writer(buffer);
+    bool have_keys = (fields == key_fields && keys.size() == static_cast<size_t>(num_fields));
+    bool first = true;
 
-    writer.StartObject();
+    output.clear();
+    output.push_back('{');
 
     for ( int i = 0; i < num_fields; i++ ) {
-        if ( vals[i]->present || include_unset_fields )
-            BuildJSON(writer, vals[i], fields[i]->name);
+        if ( ! vals[i]->present && ! include_unset_fields )
+            continue;
+
+        // Keys start with the comma separating them from the previous one.
+        if ( have_keys )
+            output.append(keys[i], first ? 1 : 0);
+        else
+            output.append(make_key(fields[i]->name), first ? 1 : 0);
+
+        first = false;
+        BuildJSON(output, vals[i]);
     }
 
-    writer.EndObject();
-    desc->Add(buffer.GetString());
+    output.push_back('}');
+    desc->Add(output.c_str());
 
     return true;
 }
@@ -55,15 +252,14 @@ bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const {
     if ( (! val->present && ! include_unset_fields) || name.empty() )
         return true;
 
-    rapidjson::Document doc;
-    rapidjson::StringBuffer buffer;
-    zeek::json::detail::NullDoubleWriter writer(buffer);
+    output.clear();
+    output.append("{\"");
+    append_escaped(output, name.data(), name.size());
+    output.append("\":");
+    BuildJSON(output, val);
+    output.push_back('}');
 
-    writer.StartObject();
-    BuildJSON(writer, val, name);
-    writer.EndObject();
-
-    desc->Add(buffer.GetString());
+    desc->Add(output.c_str());
     return true;
 }
 
@@ -72,30 +268,35 @@ Value* JSON::ParseValue(const std::string& s, const std::string& name, TypeTag t
     return nullptr;
 }
 
-void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, const std::string& name) const {
-    if ( ! name.empty() )
-        writer.Key(name);
-
+void JSON::BuildJSON(std::string& out, Value* val) const {
     if ( ! val->present ) {
-        writer.Null();
+        out.append("null");
         return;
     }
 
     switch ( val->type ) {
-        case TYPE_BOOL: writer.Bool(val->val.int_val != 0); break;
+        case TYPE_BOOL: out.append(val->val.int_val != 0 ? "true" : "false"); break;
 
-        case TYPE_INT: writer.Int64(val->val.int_val); break;
+        case TYPE_INT: append_integer(out, static_cast<int64_t>(val->val.int_val)); break;
 
-        case TYPE_COUNT: writer.Uint64(val->val.uint_val); break;
+        case TYPE_COUNT: append_integer(out, static_cast<uint64_t>(val->val.uint_val)); break;
 
-        case TYPE_PORT: writer.Uint64(val->val.port_val.port); break;
+        case TYPE_PORT: append_integer(out, static_cast<uint64_t>(val->val.port_val.port)); break;
 
-        case TYPE_SUBNET: writer.String(Formatter::Render(val->val.subnet_val)); break;
+        case TYPE_SUBNET: {
+            auto s = Formatter::Render(val->val.subnet_val);
+            append_plain_string(out, s.data(), s.size());
+            break;
+        }
 
-        case TYPE_ADDR: writer.String(Formatter::Render(val->val.addr_val)); break;
+        case TYPE_ADDR: {
+            auto s = Formatter::Render(val->val.addr_val);
+            append_plain_string(out, s.data(), s.size());
+            break;
+        }
 
         case TYPE_DOUBLE:
-        case TYPE_INTERVAL: writer.Double(val->val.double_val); break;
+        case TYPE_INTERVAL: append_double(out, val->val.double_val); break;
 
         case TYPE_TIME: {
             if ( timestamps == TS_ISO8601 ) {
@@ -109,7 +310,7 @@ void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, c
                         GetThread()->Fmt("json formatter: failure getting time: (%lf)", val->val.double_val));
                     // This was a failure, doesn't really matter what gets put here
                     // but it should probably stand out...
-                    writer.String("2000-01-01T00:00:00.000000");
+                    out.append("\"2000-01-01T00:00:00.000000\"");
                 }
                 else {
                     double integ;
@@ -119,16 +320,16 @@ void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, c
                         frac += 1;
 
                     snprintf(buffer2, sizeof(buffer2), "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
-                    writer.String(buffer2, strlen(buffer2));
+                    append_plain_string(out, buffer2, strlen(buffer2));
                 }
             }
 
             else if ( timestamps == TS_EPOCH )
-                writer.Double(val->val.double_val);
+                append_double(out, val->val.double_val);
 
             else if ( timestamps == TS_MILLIS ) {
                 // ElasticSearch uses milliseconds for timestamps
-                writer.Uint64((uint64_t)(val->val.double_val * 1000));
+                append_integer(out, (uint64_t)(val->val.double_val * 1000));
             }
 
             break;
@@ -138,32 +339,354 @@ void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, c
         case TYPE_STRING:
         case TYPE_FILE:
         case TYPE_FUNC: {
-            writer.String(util::json_escape_utf8(std::string(val->val.string_val.data, val->val.string_val.length)));
+            append_string(out, val->val.string_val.data, val->val.string_val.length);
             break;
         }
 
         case TYPE_TABLE: {
-            writer.StartArray();
+            out.push_back('[');
 
-            for ( zeek_int_t idx = 0; idx < val->val.set_val.size; idx++ )
-                BuildJSON(writer, val->val.set_val.vals[idx]);
+            for ( zeek_int_t idx = 0; idx < val->val.set_val.size; idx++ ) {
+                if ( idx > 0 )
+                    out.push_back(',');
 
-            writer.EndArray();
+                BuildJSON(out, val->val.set_val.vals[idx]);
+            }
+
+            out.push_back(']');
             break;
         }
 
         case TYPE_VECTOR: {
-            writer.StartArray();
+            out.push_back('[');
 
-            for ( zeek_int_t idx = 0; idx < val->val.vector_val.size; idx++ )
-                BuildJSON(writer, val->val.vector_val.vals[idx]);
+            for ( zeek_int_t idx = 0; idx < val->val.vector_val.size; idx++ ) {
+                if ( idx > 0 )
+                    out.push_back(',');
+
+                BuildJSON(out, val->val.vector_val.vals[idx]);
+            }
+
+            out.push_back(']');
+            break;
+        }
 
+        default:
+            reporter->Warning("Unhandled type in JSON::BuildJSON");
+            out.append("null");
+            break;
+    }
+}
+
+namespace {
+
+// Formats values through rapidjson the way the formatter used to, to
+// check that the output hasn't changed.
+void rapidjson_build(json::detail::NullDoubleWriter& writer, Value* val) {
+    if ( ! val->present ) {
+        writer.Null();
+        return;
+    }
+
+    switch ( val->type ) {
+        case TYPE_BOOL: writer.Bool(val->val.int_val != 0); break;
+        case TYPE_INT: writer.Int64(val->val.int_val); break;
+        case TYPE_COUNT: writer.Uint64(val->val.uint_val); break;
+        case TYPE_PORT: writer.Uint64(val->val.port_val.port); break;
+        case TYPE_ADDR: writer.String(Formatter::Render(val->val.addr_val)); break;
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: writer.Double(val->val.double_val); break;
+
+        case TYPE_ENUM:
+        case TYPE_STRING:
+            writer.String(util::json_escape_utf8(std::string(val->val.string_val.data, val->val.string_val.length)));
+            break;
+
+        case TYPE_TABLE:
+            writer.StartArray();
+            for ( zeek_int_t idx = 0; idx < val->val.set_val.size; idx++ )
+                rapidjson_build(writer, val->val.set_val.vals[idx]);
             writer.EndArray();
             break;
+
+        default: FAIL("unexpected type"); break;
+    }
+}
+
+std::string rapidjson_describe(int num_fields, const Field* const* fields, Value** vals) {
+    rapidjson::StringBuffer buffer;
+    json::detail::NullDoubleWriter writer(buffer);
+
+    writer.StartObject();
+
+    for ( int i = 0; i < num_fields; i++ ) {
+        writer.Key(fields[i]->name);
+        rapidjson_build(writer, vals[i]);
+    }
+
+    writer.EndObject();
+    return buffer.GetString();
+}
+
+std::string describe(const JSON& json, int num_fields, const Field* const* fields, Value** vals) {
+    ODesc desc;
+    json.Describe(&desc, num_fields, fields, vals);
+    return {reinterpret_cast<const char*>(desc.Bytes()), static_cast<size_t>(desc.Len())};
+}
+
+Value* make_string(TypeTag type, const std::string& s) {
+    auto val = new Value(type);
+    val->val.string_val.data = new char[s.size()];
+    val->val.string_val.length = static_cast<int>(s.size());
+    memcpy(val->val.string_val.data, s.data(), s.size());
+    return val;
+}
+
+Value* make_double(double d) {
+    auto val = new Value(TYPE_DOUBLE);
+    val->val.double_val = d;
+    return val;
+}
+
+// Checks that a single value comes out as rapidjson formatted it.
+void check_value(Value* val) {
+    Field field("v", nullptr, val->type, TYPE_VOID, false);
+    const Field* fields[] = {&field};
+    JSON json(nullptr, JSON::TS_EPOCH);
+
+    CHECK(describe(json, 1, fields, &val) == rapidjson_describe(1, fields, &val));
+    delete val;
+}
+
+} // namespace
+
+TEST_CASE("json formatter strings") {
+    std::vector<std::string> strings = {"",
+                                        "plain",
+                                        "quote\" backslash\\ slash/",
+                                        std::string("nul\x00", 4),
+                                        "control \x01 \x1f \x7f",
+                                        "printable controls \b\f\n\r\t",
+                                        "valid utf-8 \xc3\xb1 \xe2\x82\xa1 \xf0\x90\x8c\xbc",
+                                        "invalid utf-8 \xc3\x28 \x82",
+                                        "private use \xee\x8b\xa0"};
+
+    // Put each kind of special byte at every position of a string longer
+    // than two vector widths.
+    for ( std::string special : {"\"", "\\", "\x01", "\x7f", "\xc3\xb1", "\x82"} ) {
+        for ( size_t pos = 0; pos < 48; ++pos ) {
+            std::string s(48, 'a');
+            s.insert(pos, special);
+            strings.push_back(s);
+        }
+    }
+
+    for ( const auto& s : strings ) {
+        CAPTURE(s);
+        check_value(make_string(TYPE_STRING, s));
+    }
+
+    Field field("v", nullptr, TYPE_STRING, TYPE_VOID, false);
+    const Field* fields[] = {&field};
+    JSON json(nullptr, JSON::TS_EPOCH);
+
+    Value* val = make_string(TYPE_STRING, "a\"b\\c");
+    CHECK(describe(json, 1, fields, &val) == R"({"v":"a\"b\\c"})");
+    delete val;
+
+    val = make_string(TYPE_STRING, "\x82\t");
+    CHECK(describe(json, 1, fields, &val) == R"({"v":"\\x82\t"})");
+    delete val;
+}
+
+TEST_CASE("json formatter numbers") {
+    std::vector<double> doubles = {0.0,
+                                   -0.0,
+                                   1.0,
+                                   -1.5,
+                                   0.1,
+                                   1.0 / 3,
+                                   1e-7,
+                                   1.5e-300,
+                                   1e21,
+                                   123456.789,
+                                   1700000000.123456,
+                                   std::numeric_limits<double>::min(),
+                                   std::numeric_limits<double>::max(),
+                                   std::numeric_limits<double>::denorm_min(),
+                                   std::numeric_limits<double>::infinity(),
+                                   -std::numeric_limits<double>::infinity(),
+                                   std::numeric_limits<double>::quiet_NaN()};
+
+    // Arbitrary bit patterns cover all the exponents.
+    uint64_t bits = 0x9e3779b97f4a7c15;
+
+    for ( int i = 0; i < 10000; ++i ) {
+        bits ^= bits << 13;
+        bits ^= bits >> 7;
+        bits ^= bits << 17;
+
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        doubles.push_back(d);
+    }
+
+    for ( auto d : doubles ) {
+        CAPTURE(d);
+        check_value(make_double(d));
+    }
+
+    for ( int64_t i : {std::numeric_limits<int64_t>::min(), int64_t(-1), int64_t(0), int64_t(42),
+                       std::numeric_limits<int64_t>::max()} ) {
+        auto val = new Value(TYPE_INT);
+        val->val.int_val = i;
+        check_value(val);
+    }
+
+    for ( uint64_t u : {uint64_t(0), uint64_t(9), uint64_t(10), std::numeric_limits<uint64_t>::max()} ) {
+        auto val = new Value(TYPE_COUNT);
+        val->val.uint_val = u;
+        check_value(val);
+    }
+}
+
+TEST_CASE("json formatter records") {
+    Field f_b("b", nullptr, TYPE_BOOL, TYPE_VOID, false);
+    Field f_i("i", nullptr, TYPE_INT, TYPE_VOID, true);
+    Field f_p("p\"q", nullptr, TYPE_PORT, TYPE_VOID, false);
+    Field f_s("s", nullptr, TYPE_TABLE, TYPE_STRING, false);
+    Field f_d("d", nullptr, TYPE_DOUBLE, TYPE_VOID, true);
+    const Field* fields[] = {&f_b, &f_i, &f_p, &f_s, &f_d};
+
+    Value b(TYPE_BOOL);
+    b.val.int_val = 1;
+
+    Value i(TYPE_INT, false);
+
+    Value p(TYPE_PORT);
+    p.val.port_val.port = 443;
+    p.val.port_val.proto = TRANSPORT_TCP;
+
+    Value s(TYPE_TABLE, TYPE_STRING);
+    s.val.set_val.size = 2;
+    s.val.set_val.vals = new Value*[2];
+    s.val.set_val.vals[0] = make_string(TYPE_STRING, "x");
+    s.val.set_val.vals[1] = make_string(TYPE_STRING, "y");
+
+    Value d(TYPE_DOUBLE);
+    d.val.double_val = 2.5;
+
+    Value* vals[] = {&b, &i, &p, &s, &d};
+
+    JSON json(nullptr, JSON::TS_EPOCH);
+    CHECK(describe(json, 5, fields, vals) == R"({"b":true,"p\"q":443,"s":["x","y"],"d":2.5})");
+
+    // The same with the keys prepared, and with the first field unset.
+    json.InitFields(5, fields);
+    CHECK(describe(json, 5, fields, vals) == R"({"b":true,"p\"q":443,"s":["x","y"],"d":2.5})");
+
+    b.present = false;
+    CHECK(describe(json, 5, fields, vals) == R"({"p\"q":443,"s":["x","y"],"d":2.5})");
+
+    JSON json_unset(nullptr, JSON::TS_EPOCH, true);
+    json_unset.InitFields(5, fields);
+    CHECK(describe(json_unset, 5, fields, vals) == R"({"b":null,"i":null,"p\"q":443,"s":["x","y"],"d":2.5})");
+    CHECK(describe(json_unset, 5, fields, vals) == rapidjson_describe(5, fields, vals));
+
+    b.present = true;
+    s.val.set_val.size = 0;
+    CHECK(describe(json, 5, fields, vals) == R"({"b":true,"p\"q":443,"s":[],"d":2.5})");
+    s.val.set_val.size = 2;
+}
+
+TEST_CASE("json formatter benchmark" * doctest::skip(true)) {
+    // Run it with: zeek --test --test-case="json formatter benchmark" --no-skip
+    //
+    // Formats records shaped like those of conn.log, and compares against
+    // formatting them through rapidjson as the formatter used to.
+    constexpr int num_records = 1'000'000;
+
+    std::vector<std::pair<const char*, TypeTag>> columns = {
+        {"ts", TYPE_TIME},          {"uid", TYPE_STRING},          {"id.orig_h", TYPE_ADDR},
+        {"id.orig_p", TYPE_PORT},   {"id.resp_h", TYPE_ADDR},      {"id.resp_p", TYPE_PORT},
+        {"proto", TYPE_ENUM},       {"service", TYPE_STRING},      {"duration", TYPE_INTERVAL},
+        {"orig_bytes", TYPE_COUNT}, {"resp_bytes", TYPE_COUNT},    {"conn_state", TYPE_STRING},
+        {"local_orig", TYPE_BOOL},  {"local_resp", TYPE_BOOL},     {"missed_bytes", TYPE_COUNT},
+        {"history", TYPE_STRING},   {"orig_pkts", TYPE_COUNT},     {"orig_ip_bytes", TYPE_COUNT},
+        {"resp_pkts", TYPE_COUNT},  {"resp_ip_bytes", TYPE_COUNT}, {"tunnel_parents", TYPE_TABLE}};
+
+    std::vector<std::unique_ptr<Field>> field_storage;
+    std::vector<const Field*> fields;
+    std::vector<std::unique_ptr<Value>> value_storage;
+    std::vector<Value*> vals;
+
+    for ( const auto& [name, type] : columns ) {
+        field_storage.emplace_back(new Field(name, nullptr, type, TYPE_STRING, false));
+        fields.push_back(field_storage.back().get());
+
+        Value* val = nullptr;
+
+        switch ( type ) {
+            case TYPE_STRING: val = make_string(type, std::string("C") + name + "Yx2cHn4VxnsCT3bs"); break;
+            case TYPE_ENUM: val = make_string(type, "tcp"); break;
+            case TYPE_TIME: val = make_double(1700000000.123456); break;
+            case TYPE_INTERVAL: val = make_double(0.000123); break;
+            case TYPE_ADDR:
+                val = new Value(type);
+                val->val.addr_val.family = IPv4;
+                val->val.addr_val.in.in4.s_addr = htonl(0xc0a80101);
+                break;
+            case TYPE_TABLE: val = new Value(type, TYPE_STRING); break;
+            case TYPE_PORT:
+                val = new Value(type);
+                val->val.port_val.port = 443;
+                val->val.port_val.proto = TRANSPORT_TCP;
+                break;
+            default:
+                val = new Value(type);
+                val->val.uint_val = 123456;
+                break;
         }
 
-        default: reporter->Warning("Unhandled type in JSON::BuildJSON"); break;
+        value_storage.emplace_back(val);
+        vals.push_back(val);
     }
+
+    int num_fields = static_cast<int>(fields.size());
+    JSON json(nullptr, JSON::TS_EPOCH);
+    json.InitFields(num_fields, fields.data());
+
+    REQUIRE(describe(json, num_fields, fields.data(), vals.data()) ==
+            rapidjson_describe(num_fields, fields.data(), vals.data()));
+
+    auto run = [&](auto format) {
+        auto begin = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+
+        for ( int n = 0; n < num_records; ++n )
+            bytes += format();
+
+        auto end = std::chrono::steady_clock::now();
+        auto secs = std::chrono::duration<double>(end - begin).count();
+        return std::make_pair(num_records / secs, bytes);
+    };
+
+    ODesc desc;
+    auto direct = run([&]() {
+        desc.Clear();
+        json.Describe(&desc, num_fields, fields.data(), vals.data());
+        return desc.Len();
+    });
+
+    auto through_rapidjson = run([&]() {
+        desc.Clear();
+        desc.Add(rapidjson_describe(num_fields, fields.data(), vals.data()).c_str());
+        return desc.Len();
+    });
+
+    MESSAGE("direct: " << static_cast<uint64_t>(direct.first) << " records/sec");
+    MESSAGE("rapidjson: " << static_cast<uint64_t>(through_rapidjson.first) << " records/sec");
 }
 
 } // namespace zeek::threading::formatter
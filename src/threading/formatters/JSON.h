@@ -3,6 +3,8 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #define RAPIDJSON_HAS_STDSTRING 1
 // Remove in v7.1 when removing NullDoubleWriter below and also remove
@@ -21,6 +23,10 @@ namespace zeek::threading::formatter {
 /**
  * A thread-safe class for converting values into a JSON representation
  * and vice versa.
+ *
+ * Values are written out directly rather than through rapidjson's Writer,
+ * producing the same output. An instance reuses an internal buffer, so it
+ * must only be used by one thread at a time.
  */
 class JSON : public Formatter {
 public:
@@ -34,6 +40,17 @@ public:
     JSON(MsgThread* t, TimeFormat tf, bool include_unset_fields = false);
     ~JSON() override = default;
 
+    /**
+     * Prepares the keys of a set of fields once, so that describing records
+     * with them doesn't have to escape the field names every time. Describe()
+     * works without this, or with other fields.
+     *
+     * @param num_fields The number of fields.
+     *
+     * @param fields The fields, which must remain valid while in use.
+     */
+    void InitFields(int num_fields, const Field* const* fields);
+
     bool Describe(ODesc* desc, Value* val, const std::string& name = "") const override;
     bool Describe(ODesc* desc, int num_fields, const Field* const* fields, Value** vals) const override;
     Value* ParseValue(const std::string& s, const std::string& name, TypeTag type,
@@ -50,10 +67,18 @@ public:
     };
 
 private:
-    void BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, const std::string& name = "") const;
+    void BuildJSON(std::string& out, Value* val) const;
 
     TimeFormat timestamps;
     bool include_unset_fields;
+
+    // The fields passed to InitFields(), with each one's key as
+    // ',"name":'.
+    const Field* const* key_fields = nullptr;
+    std::vector<std::string> keys;
+
+    // Output buffer, reused across calls.
+    mutable std::string output;
 };
 
 } // namespace zeek::threading::formatter
@@ -535,8 +535,10 @@ SetupResult setup(int argc, char** argv, Options* zopts) {
         fprintf(stderr, "Zeek script debugging ON.\n");
     }
 
-    if ( options.script_code_to_exec )
+    if ( options.script_code_to_exec ) {
         command_line_policy = options.script_code_to_exec->data();
+        analysis_options.command_line_code = *options.script_code_to_exec;
+    }
 
     if ( options.debug_script_tracing_file ) {
         g_trace_state.SetTraceFile(options.debug_script_tracing_file->data());
@@ -645,6 +647,9 @@ SetupResult setup(int argc, char** argv, Options* zopts) {
     for ( const auto& script_option : options.script_options_to_set )
         params.push_back(script_option);
 
+    // The scanner consumes params, so keep a copy for the ZAM cache.
+    analysis_options.command_line_options = options.script_options_to_set;
+
     for ( const auto& plugin : options.plugins_to_load )
         requested_plugins.insert(plugin);
 